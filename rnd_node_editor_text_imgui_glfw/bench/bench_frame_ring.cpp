@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "hrs_bench.h"
+#include "ipc/hrs_frame_publisher.h"
+
+// The frame ring the editor publishes, exercised in one process: a thread publishes numbered
+// frames as fast as it can while a reader takes the latest one, the way an external consumer
+// does. Every pixel of a frame holds its number, a frame whose pixels disagree while its slot
+// still claims it is torn and fails the suite, so do a second publisher on a live ring and a
+// reader that still sees frames once the ring is closed.
+int run_frame_ring_benchmarks(BenchReport& report)
+{
+	const int width = 1280;
+	const int height = 720;
+	const size_t frame_bytes = static_cast<size_t>(width) * height * 4 * sizeof(float);
+	const int frame_count = 500;
+	const std::string name = "/hrs_frames_bench";
+
+	int status = 0;
+
+	FramePublisher publisher;
+
+	if (!publisher.open(name, frame_bytes))
+	{
+		printf("  frames : cannot open the ring\n");
+		return 1;
+	}
+
+	FramePublisher intruder;
+
+	if (intruder.open(name, frame_bytes))
+	{
+		printf("  frames : a second publisher took over a live ring\n");
+		status = 1;
+	}
+
+	FrameSubscriber subscriber;
+
+	if (!subscriber.open(name))
+	{
+		printf("  frames : cannot subscribe to the ring\n");
+		return 1;
+	}
+
+	std::atomic<bool> is_done = false;
+	double publish_ms = 0.0;
+
+	std::thread writer([&]()
+		{
+			const auto start = std::chrono::steady_clock::now();
+
+			for (int frame = 1; frame <= frame_count; ++frame)
+			{
+				const int64_t render_ns = get_shared_frame_clock_ns();
+				float* pixels = static_cast<float*>(publisher.begin_frame(width, height, frame_bytes));
+
+				if (pixels)
+				{
+					std::fill(pixels, pixels + frame_bytes / sizeof(float), static_cast<float>(frame));
+					publisher.end_frame(frame, render_ns);
+				}
+			}
+
+			publish_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			is_done = true;
+		});
+
+	int read = 0;
+	int dropped = 0;
+	int torn = 0;
+	double latency_ns = 0.0;
+
+	while (true)
+	{
+		const bool was_done = is_done;
+		const SharedFrameSlot* slot = subscriber.acquire();
+
+		if (!slot)
+		{
+			if (was_done)
+			{
+				break;
+			}
+
+			std::this_thread::yield();
+			continue;
+		}
+
+		latency_ns += static_cast<double>(get_shared_frame_clock_ns() - slot->render_ns);
+
+		const float* pixels = static_cast<const float*>(subscriber.get_pixels(slot));
+		const size_t count = slot->bytes / sizeof(float);
+		const float expected = static_cast<float>(slot->sample_count);
+		const bool is_intact = pixels[0] == expected && pixels[count / 2] == expected && pixels[count - 1] == expected;
+
+		if (!subscriber.is_valid(slot))
+		{
+			dropped++;
+		}
+		else if (!is_intact)
+		{
+			torn++;
+		}
+		else
+		{
+			read++;
+		}
+	}
+
+	writer.join();
+
+	report.add("frames", "publish/" + std::to_string(width) + "x" + std::to_string(height), publish_ms * 1e6 / frame_count, frame_count, static_cast<double>(frame_bytes));
+
+	if (read > 0)
+	{
+		report.add("frames", "read_latency", latency_ns / (read + dropped + torn), read + dropped + torn);
+	}
+
+	printf("  frames : %d read, %d dropped while read, %llu never seen, %d torn\n", read, dropped, static_cast<unsigned long long>(subscriber.get_missed()), torn);
+
+	if (read == 0 || torn > 0)
+	{
+		printf("  frames : the reader did not get the frames intact\n");
+		status = 1;
+	}
+
+	publisher.close();
+
+	if (subscriber.acquire())
+	{
+		printf("  frames : a closed ring still hands out frames\n");
+		status = 1;
+	}
+
+	return status;
+}
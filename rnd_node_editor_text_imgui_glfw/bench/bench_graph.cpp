@@ -0,0 +1,215 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hrs_bench.h"
+#include "hrs_graph_generators.h"
+
+struct GraphShape
+{
+	const char* name;
+	void (*build)(Graph& graph, int node_count);
+};
+
+// First or last node with parameters: an edit near the sources reaches most of the graph, one
+// near the sinks only a few nodes
+static int find_editable(const Graph& graph, bool is_last)
+{
+	const int count = graph.get_node_capacity();
+
+	for (int i = 0; i < count; ++i)
+	{
+		const int id = is_last ? count - 1 - i : i;
+
+		if (graph.get_node(id) && graph.get_node(id)->get_param_count() > 0)
+		{
+			return id;
+		}
+	}
+
+	return -1;
+}
+
+// Outputs after incremental passes against a full one, false on the first difference
+static bool is_same_as_full(Graph& graph)
+{
+	std::vector<Color> outputs(graph.get_node_capacity());
+
+	for (int id = 0; id < graph.get_node_capacity(); ++id)
+	{
+		outputs[id] = graph.get_output(id);
+	}
+
+	graph.invalidate();
+	graph.evaluate();
+
+	for (int id = 0; id < graph.get_node_capacity(); ++id)
+	{
+		const Color color = graph.get_output(id);
+
+		// Bitwise, deep graphs overflow to NaN and those must match too
+		if (graph.get_node(id) && memcmp(&color, &outputs[id], sizeof(Color)) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// A link from the middle of the graph, removed and added back by the relink case
+static int find_middle_link(const Graph& graph)
+{
+	for (int id = graph.get_link_capacity() / 2; id < graph.get_link_capacity(); ++id)
+	{
+		if (graph.get_link(id))
+		{
+			return id;
+		}
+	}
+
+	return -1;
+}
+
+// Scaling of the graph core on synthetic DAGs: insertion, relinking, ordering, evaluation,
+// serialization and deletion. Cases that change the graph run once, the others take the best
+// of a few runs. Bytes on the insert case are the graph containers, node objects excluded.
+int run_graph_benchmarks(BenchReport& report, int max_nodes)
+{
+	const GraphShape shapes[] = {
+		{ "chain", build_chain_graph },
+		{ "fan", build_fan_graph },
+		{ "layered", build_layered_graph },
+		{ "diamond", build_diamond_graph },
+	};
+
+	int status = 0;
+
+	for (const GraphShape& shape : shapes)
+	{
+		for (int node_count : { 1000, 10000, 100000, 1000000 })
+		{
+			if (node_count > max_nodes)
+			{
+				continue;
+			}
+
+			const std::string suffix = "/" + std::to_string(node_count);
+			const std::string prefix = shape.name;
+
+			Graph graph;
+			graph.set_cache_enabled(false);
+
+			double insert_ms = bench_time_ms([&]() { shape.build(graph, node_count); }, 1);
+			const double nodes = static_cast<double>(graph.get_node_count());
+			const double elements = nodes + graph.get_link_count();
+			report.add("graph", prefix + "/insert" + suffix, insert_ms * 1e6 / elements, elements, static_cast<double>(graph.get_memory_bytes()));
+
+			std::vector<int> order;
+			double full_order_ms = bench_time_ms([&]() { graph.compute_full_order(order); });
+			report.add("graph", prefix + "/order_full" + suffix, full_order_ms * 1e6 / nodes, nodes);
+
+			// Removing a link and adding it back, then reading the order the way evaluate does
+			int link_id = find_middle_link(graph);
+			const Link link = *graph.get_link(link_id);
+			const int relinks = 100;
+
+			double relink_ms = bench_time_ms([&]()
+				{
+					for (int i = 0; i < relinks; ++i)
+					{
+						graph.remove_link(link_id);
+						link_id = graph.add_link(link.start_pin, link.end_pin);
+						graph.get_execution_order();
+					}
+				});
+			report.add("graph", prefix + "/relink" + suffix, relink_ms * 1e6 / relinks, relinks);
+
+			double evaluate_ms = bench_time_ms([&]()
+				{
+					graph.invalidate();
+					graph.evaluate();
+				});
+			report.add("graph", prefix + "/evaluate_full" + suffix, evaluate_ms * 1e6 / nodes, nodes);
+
+			// One parameter edited then evaluated, only its downstream cone runs. Per edit, the
+			// cone size is printed below. The value flips between two states, so with the cache
+			// every pass after the first two is a reverted edit the cache has seen.
+			int cone_sizes[2] = {};
+
+			for (bool is_cached : { false, true })
+			{
+				graph.set_cache_enabled(is_cached);
+				graph.evaluate();
+
+				for (bool is_last : { false, true })
+				{
+					const int edited = find_editable(graph, is_last);
+					float* param = graph.get_node(edited)->get_params();
+					const int edits = 16;
+
+					double edit_ms = bench_time_ms([&]()
+						{
+							for (int i = 0; i < edits; ++i)
+							{
+								*param = *param < 0.5f ? *param + 0.25f : *param - 0.25f;
+								graph.mark_edited(edited);
+								graph.evaluate();
+							}
+						});
+
+					const std::string name = std::string("/evaluate_edit_") + (is_last ? "sink" : "source") + (is_cached ? "_cached" : "");
+					report.add("graph", prefix + name + suffix, edit_ms * 1e6 / edits, edits);
+					cone_sizes[is_last] = graph.get_last_evaluated();
+				}
+
+				if (!is_same_as_full(graph))
+				{
+					printf("  %s %d : incremental evaluation%s differs from a full pass\n", shape.name, node_count, is_cached ? " with the cache" : "");
+					status = 1;
+				}
+			}
+
+			graph.set_cache_enabled(false);
+			printf("  %s %d : an edit reevaluates %d nodes from the first editable node, %d from the last\n", shape.name, node_count, cone_sizes[0], cone_sizes[1]);
+
+			std::vector<uint8_t> data;
+			double write_ms = bench_time_ms([&]() { write_graph(graph, data); });
+			report.add("graph", prefix + "/serialize" + suffix, write_ms * 1e6 / nodes, nodes, static_cast<double>(data.size()));
+
+			Graph loaded;
+			bool is_loaded = false;
+			double read_ms = bench_time_ms([&]() { is_loaded = read_graph(loaded, data.data(), data.size()); });
+			report.add("graph", prefix + "/deserialize" + suffix, read_ms * 1e6 / nodes, nodes);
+
+			if (!is_loaded || loaded.get_node_count() != graph.get_node_count() || loaded.get_link_count() != graph.get_link_count())
+			{
+				printf("  %s %d : graph does not survive serialization\n", shape.name, node_count);
+				status = 1;
+			}
+
+			printf("  %s %d : %d links, %.1f MB graph, %.1f MB node pool, %.1f MB serialized\n", shape.name, node_count, graph.get_link_count(),
+				graph.get_memory_bytes() / (1024.0 * 1024.0), get_node_pool().get_reserved_bytes() / (1024.0 * 1024.0), data.size() / (1024.0 * 1024.0));
+
+			loaded.clear();
+
+			// Newest first, the order an undo or a selection delete takes
+			double remove_ms = bench_time_ms([&]()
+				{
+					for (int id = graph.get_node_capacity() - 1; id >= 0; --id)
+					{
+						graph.remove_node(id);
+					}
+				}, 1);
+			report.add("graph", prefix + "/remove" + suffix, remove_ms * 1e6 / elements, elements);
+
+			if (graph.get_node_count() != 0 || graph.get_link_count() != 0)
+			{
+				printf("  %s %d : graph not empty after removing every node\n", shape.name, node_count);
+				status = 1;
+			}
+		}
+	}
+
+	return status;
+}
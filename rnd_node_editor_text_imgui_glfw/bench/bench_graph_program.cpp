@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "hrs_bench.h"
+#include "hrs_graph_generators.h"
+
+// Graph::evaluate walking the node objects against the compiled program, on the same graph
+int run_graph_program_benchmarks(BenchReport& report)
+{
+	int status = 0;
+
+	for (int node_count : { 1000, 10000, 100000 })
+	{
+		Graph graph;
+		build_layered_graph(graph, node_count);
+		graph.set_cache_enabled(false);
+
+		const std::string size = std::to_string(node_count);
+		const double nodes = static_cast<double>(node_count);
+
+		// Every pass evaluates all nodes, the way the program always runs
+		double interpreted_ms = bench_time_ms([&]()
+			{
+				graph.invalidate();
+				graph.evaluate();
+			});
+		report.add("program", "interpreted/" + size, interpreted_ms * 1e6 / nodes, nodes);
+
+		// Profiler overhead, every pass timed and the default of one in eight
+		GraphProfiler profiler;
+		graph.set_profiler(&profiler);
+
+		profiler.set_sample_interval(1);
+		double profiled_ms = bench_time_ms([&]()
+			{
+				graph.invalidate();
+				graph.evaluate();
+			});
+		report.add("program", "interpreted_profiled/" + size, profiled_ms * 1e6 / nodes, nodes);
+
+		profiler.set_sample_interval(8);
+		double sampled_ms = bench_time_ms([&]()
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					graph.invalidate();
+					graph.evaluate();
+				}
+			}) / 8.0;
+		report.add("program", "interpreted_sampled/" + size, sampled_ms * 1e6 / nodes, nodes);
+
+		graph.set_profiler(nullptr);
+
+		GraphProgram program;
+
+		double compile_ms = bench_time_ms([&]() { program.compile(graph, true); });
+		report.add("program", "compile/" + size, compile_ms * 1e6 / nodes, nodes);
+
+		double run_ms = bench_time_ms([&]() { program.run(); });
+		report.add("program", "run/" + size, run_ms * 1e6 / nodes, nodes);
+
+		// Scrubbing one parameter: patch every constant register then run
+		ColorNode* scrubbed = graph.get_node(node_count / 2);
+
+		double patch_ms = bench_time_ms([&]()
+			{
+				if (scrubbed->get_param_count() > 0)
+				{
+					scrubbed->get_params()[0] += 1e-3f;
+				}
+
+				program.patch_constants(graph);
+				program.run();
+			});
+		report.add("program", "patch_run/" + size, patch_ms * 1e6 / nodes, nodes);
+
+		GraphProgram sinks_only;
+		sinks_only.compile(graph, false);
+
+		double sinks_ms = bench_time_ms([&]() { sinks_only.run(); });
+		report.add("program", "run_sinks/" + size, sinks_ms * 1e6 / nodes, nodes);
+
+		const ProgramStats& stats = program.get_stats();
+		printf("  %d nodes : %d instructions, %d folded, %.1fx faster than interpreted\n",
+			node_count, stats.instructions, stats.folded, interpreted_ms / run_ms);
+
+		// Same outputs as the node objects, folding may only change the last bits
+		program.compile(graph, true);
+		graph.invalidate();
+		graph.evaluate();
+		program.run();
+
+		auto differs = [](float a, float b) { return std::abs(a - b) > 1e-4f * std::max(1.0f, std::abs(a)); };
+
+		for (int id = 0; id < graph.get_node_capacity(); ++id)
+		{
+			Color a = graph.get_output(id);
+			Color b = program.get_output(id);
+
+			if (differs(a.r, b.r) || differs(a.g, b.g) || differs(a.b, b.b))
+			{
+				printf("  mismatch on node %d\n", id);
+				status = 1;
+				break;
+			}
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,161 @@
+#include <cmath>
+#include <string>
+
+#include "hrs_bench.h"
+#include "../core/kernels/hrs_image_kernels.h"
+
+static KernelParams make_params(KernelOp op)
+{
+	KernelParams params;
+
+	switch (op)
+	{
+	case KernelOp::Gradient:
+	{
+		const float values[8] = { 0.1f, 0.2f, 0.8f, 0.9f, 0.6f, 0.1f, 1.0f, 0.5f };
+		std::copy(values, values + 8, params.values);
+		break;
+	}
+	case KernelOp::Noise:
+	{
+		const float values[8] = { 32.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f };
+		std::copy(values, values + 8, params.values);
+		params.seed = 7;
+		break;
+	}
+	case KernelOp::Blend:
+		params.values[0] = 0.5f;
+		params.mode = BlendMode::Screen;
+		break;
+	case KernelOp::HsvAdjust:
+		params.values[0] = 0.1f;
+		params.values[1] = 1.2f;
+		params.values[2] = 0.9f;
+		break;
+	case KernelOp::Levels:
+	{
+		const float values[8] = { 0.05f, 0.95f, 1.4f, 0.0f, 1.0f };
+		std::copy(values, values + 8, params.values);
+		break;
+	}
+	default:
+		break;
+	}
+
+	return params;
+}
+
+static float max_difference(const PlanarImage& a, const PlanarImage& b)
+{
+	float difference = 0.0f;
+
+	for (int c = 0; c < 3; ++c)
+	{
+		for (size_t i = 0; i < a.planes[c].size(); ++i)
+		{
+			difference = std::max(difference, std::abs(a.planes[c][i] - b.planes[c][i]));
+		}
+	}
+
+	return difference;
+}
+
+// Every kernel on a 2K frame for each ISA the CPU supports, then a fused chain against
+// the same stages run one full-image pass at a time.
+int run_kernel_benchmarks(BenchReport& report)
+{
+	const int width = 2048;
+	const int height = 1080;
+	const double pixels = static_cast<double>(width) * height;
+
+	const char* op_names[] = { "gradient", "noise", "blend", "hsv_adjust", "levels" };
+
+	PlanarImage source;
+	source.resize(width, height);
+	run_kernel(KernelOp::Noise, make_params(KernelOp::Noise), source);
+
+	PlanarImage other;
+	other.resize(width, height);
+	run_kernel(KernelOp::Gradient, make_params(KernelOp::Gradient), other);
+
+	const KernelIsa best_isa = detect_kernel_isa();
+	int status = 0;
+
+	PlanarImage reference[static_cast<int>(KernelOp::Count)];
+
+	for (int isa = 0; isa <= static_cast<int>(best_isa); ++isa)
+	{
+		set_kernel_isa(static_cast<KernelIsa>(isa));
+		std::string isa_name = get_kernel_isa_name(static_cast<KernelIsa>(isa));
+
+		for (int op = 0; op < static_cast<int>(KernelOp::Count); ++op)
+		{
+			KernelOp kernel_op = static_cast<KernelOp>(op);
+			KernelParams params = make_params(kernel_op);
+
+			PlanarImage image = source;
+			run_kernel(kernel_op, params, image, &other);
+
+			// Point kernels keep values in range, so repeating them in place is a fair timing
+			PlanarImage scratch = source;
+
+			double ms = bench_time_ms([&]()
+				{
+					run_kernel(kernel_op, params, scratch, &other);
+				});
+
+			report.add("kernels", std::string(op_names[op]) + "/" + isa_name, ms * 1e6 / pixels, pixels);
+
+			// SIMD paths must match the scalar reference, pow is approximated so allow a little slack
+			if (isa == 0)
+			{
+				reference[op] = image;
+			}
+			else if (max_difference(reference[op], image) > 2e-3f)
+			{
+				printf("  mismatch against scalar : %g\n", max_difference(reference[op], image));
+				status = 1;
+			}
+		}
+	}
+
+	set_kernel_isa(best_isa);
+
+	KernelChain chain;
+	chain.add(KernelOp::Gradient, make_params(KernelOp::Gradient));
+	chain.add(KernelOp::Blend, make_params(KernelOp::Blend), &source);
+	chain.add(KernelOp::HsvAdjust, make_params(KernelOp::HsvAdjust));
+	chain.add(KernelOp::Levels, make_params(KernelOp::Levels));
+
+	PlanarImage image;
+	image.resize(width, height);
+
+	double unfused_ms = bench_time_ms([&]()
+		{
+			run_kernel(KernelOp::Gradient, make_params(KernelOp::Gradient), image);
+			run_kernel(KernelOp::Blend, make_params(KernelOp::Blend), image, &source);
+			run_kernel(KernelOp::HsvAdjust, make_params(KernelOp::HsvAdjust), image);
+			run_kernel(KernelOp::Levels, make_params(KernelOp::Levels), image);
+		});
+	report.add("kernels", "chain4/unfused/1t", unfused_ms * 1e6 / pixels, pixels);
+
+	// The chain starts with a generator, every run gives the same image
+	const PlanarImage unfused = image;
+
+	double fused_ms = bench_time_ms([&]() { chain.run(image, 1); });
+	report.add("kernels", "chain4/fused/1t", fused_ms * 1e6 / pixels, pixels);
+
+	if (max_difference(unfused, image) > 1e-5f)
+	{
+		printf("  fused chain differs from the stages run one by one : %g\n", max_difference(unfused, image));
+		status = 1;
+	}
+
+	double threaded_ms = bench_time_ms([&]() { chain.run(image); });
+	report.add("kernels", "chain4/fused/mt", threaded_ms * 1e6 / pixels, pixels);
+
+	printf("  2K chain of 4 : %.2f ms unfused, %.2f ms fused, %.2f ms fused + threads (%s)\n",
+		unfused_ms, fused_ms, threaded_ms, get_kernel_isa_name(best_isa));
+
+	return status;
+}
@@ -0,0 +1,66 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "hrs_bench.h"
+
+// rnd_node_editor_bench [suite] [--json file] [--max-nodes count]
+int main(int argc, char** argv)
+{
+	std::string suite = "all";
+	std::string json_path;
+	int max_nodes = 1000000;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+		{
+			json_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc)
+		{
+			max_nodes = atoi(argv[++i]);
+		}
+		else
+		{
+			suite = argv[i];
+		}
+	}
+
+	BenchReport report;
+	int status = 0;
+
+	if (suite == "all" || suite == "kernels")
+	{
+		status |= run_kernel_benchmarks(report);
+	}
+
+	if (suite == "all" || suite == "program")
+	{
+		status |= run_graph_program_benchmarks(report);
+	}
+
+	if (suite == "all" || suite == "topo")
+	{
+		status |= run_topo_order_benchmarks(report);
+	}
+
+	if (suite == "all" || suite == "graph")
+	{
+		status |= run_graph_benchmarks(report, max_nodes);
+	}
+
+	if (suite == "all" || suite == "frames")
+	{
+		status |= run_frame_ring_benchmarks(report);
+	}
+
+	if (!json_path.empty() && !report.write_json(json_path))
+	{
+		std::cout << "Error: cannot write " << json_path << std::endl;
+		return -1;
+	}
+
+	return status;
+}
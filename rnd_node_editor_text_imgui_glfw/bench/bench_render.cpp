@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "hrs_render_bench.h"
+#include "render/hrs_cpu_backend.h"
+
+#ifndef HRS_RENDER_BENCH_CPU_ONLY
+#include "render/hrs_rpr_backend.h"
+#endif
+
+using clock_type = std::chrono::steady_clock;
+
+// DemoSceneSettings::env_intensity, RenderCamera defaults to the demo camera
+const float kEnvIntensity = 0.8f;
+
+// Every scene instances this mesh, both backends load it from here
+const char* kTeapotMesh = "Resources/Meshes/teapot.obj";
+
+static double elapsed_ms(clock_type::time_point start, clock_type::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Current, not the process peak: that one cannot be reset and would keep the reference render
+static double get_rss_mb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.WorkingSetSize / (1024.0 * 1024.0);
+#else
+	long pages = 0;
+	long resident = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+
+	if (file)
+	{
+		if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+		{
+			resident = 0;
+		}
+
+		fclose(file);
+	}
+
+	return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#endif
+}
+
+const std::vector<std::string>& get_render_bench_scenes()
+{
+	static const std::vector<std::string> scenes = { "teapot", "instances", "textures" };
+	return scenes;
+}
+
+const std::vector<std::string>& get_render_bench_backends()
+{
+#ifdef HRS_RENDER_BENCH_CPU_ONLY
+	static const std::vector<std::string> backends = { "cpu" };
+#else
+	static const std::vector<std::string> backends = { "rpr", "cpu" };
+#endif
+	return backends;
+}
+
+// The RPR backend is left out of builds without the RPR runtime, the CPU one is always there
+static std::unique_ptr<RenderBackend> create_bench_backend(const RenderBenchSettings& settings)
+{
+#ifndef HRS_RENDER_BENCH_CPU_ONLY
+	if (settings.backend == "rpr")
+	{
+		return std::make_unique<RprRenderBackend>();
+	}
+#endif
+
+	if (settings.backend == "cpu")
+	{
+		return std::make_unique<CpuRenderBackend>(settings.threads);
+	}
+
+	std::cout << "Error: unknown render backend " << settings.backend << std::endl;
+	return nullptr;
+}
+
+bool is_render_bench_scene_supported(const std::string& scene, const RenderBenchSettings& settings)
+{
+	std::unique_ptr<RenderBackend> backend = create_bench_backend(settings);
+	return backend && backend->supports_scene(scene);
+}
+
+// FNV-1a over the file bytes, 0 when it cannot be read
+static uint64_t hash_file(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file)
+	{
+		return 0;
+	}
+
+	uint64_t hash = 14695981039346656037ull;
+	char buffer[64 * 1024];
+
+	while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+	{
+		for (std::streamsize i = 0; i < file.gcount(); ++i)
+		{
+			hash = (hash ^ static_cast<uint8_t>(buffer[i])) * 1099511628211ull;
+		}
+	}
+
+	return hash;
+}
+
+// Same rule as CpuRenderBackend, and the CPU context of RPR takes every hardware thread
+void resolve_render_bench_settings(RenderBenchSettings& settings)
+{
+	settings.resolved_threads = settings.threads > 0 ? settings.threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	settings.mesh_hash = hash_file(kTeapotMesh);
+}
+
+// Sized, with the scene and the seed, ready for its first sample
+static std::unique_ptr<RenderBackend> create_bench_scene(const std::string& scene, const RenderBenchSettings& settings, uint32_t seed)
+{
+	std::unique_ptr<RenderBackend> backend = create_bench_backend(settings);
+
+	if (!backend || !backend->resize(settings.width, settings.height) || !backend->load_scene(scene, RenderCamera(), kEnvIntensity))
+	{
+		return nullptr;
+	}
+
+	backend->set_seed(seed);
+
+	return backend;
+}
+
+static void read_framebuffer(RenderBackend& backend, std::vector<float>& pixels)
+{
+	backend.resolve();
+	backend.read_pixels(pixels.data(), pixels.size() * sizeof(float));
+}
+
+// On the displayed values, clamped so a few fireflies do not decide the result
+static double compute_rmse(const std::vector<float>& image, const std::vector<float>& reference)
+{
+	double sum = 0.0;
+
+	for (size_t i = 0; i < image.size(); i += 4)
+	{
+		for (size_t c = 0; c < 3; ++c)
+		{
+			double d = std::clamp(image[i + c], 0.0f, 1.0f) - std::clamp(reference[i + c], 0.0f, 1.0f);
+			sum += d * d;
+		}
+	}
+
+	return std::sqrt(sum / (image.size() / 4 * 3));
+}
+
+// Rendered in a context of its own so the measured run starts cold, then kept on disk
+static bool load_reference(const std::string& scene, const RenderBenchSettings& settings, std::vector<float>& reference)
+{
+	namespace fs = std::filesystem;
+
+	// Each backend converges to its own image, references are not shared
+	char name[128];
+	snprintf(name, sizeof(name), "%s_%s_%dx%d_%d_%u.bin", settings.backend.c_str(), scene.c_str(), settings.width, settings.height, settings.reference_samples, settings.seed);
+	fs::path path = fs::path(settings.reference_dir) / name;
+
+	std::ifstream input(path, std::ios::binary);
+
+	if (input.read(reinterpret_cast<char*>(reference.data()), reference.size() * sizeof(float)))
+	{
+		return true;
+	}
+
+	std::cout << "Rendering the " << scene << " reference, " << settings.reference_samples << " samples" << std::endl;
+
+	// Another seed so the reference noise is independent of the measured run
+	std::unique_ptr<RenderBackend> backend = create_bench_scene(scene, settings, settings.seed + 1);
+
+	if (!backend)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < settings.reference_samples; ++i)
+	{
+		backend->render(1);
+	}
+
+	read_framebuffer(*backend, reference);
+	backend = nullptr;
+
+	std::error_code error;
+	fs::create_directories(path.parent_path(), error);
+	std::ofstream output(path, std::ios::binary);
+
+	if (!output.write(reinterpret_cast<const char*>(reference.data()), reference.size() * sizeof(float)))
+	{
+		std::cout << "Warning: cannot write " << path.string() << std::endl;
+	}
+
+	return true;
+}
+
+bool run_render_scene(const std::string& scene, const RenderBenchSettings& settings, RenderBenchMetrics& metrics)
+{
+	const auto& scenes = get_render_bench_scenes();
+
+	if (std::find(scenes.begin(), scenes.end(), scene) == scenes.end())
+	{
+		std::cout << "Error: unknown scene " << scene << std::endl;
+		return false;
+	}
+
+#ifdef __GLIBC__
+	// A fixed threshold turns off glibc's adaptive one, which the freed reference render would
+	// raise so the measured run kept its own freed temporaries resident
+	mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+#endif
+
+	metrics = RenderBenchMetrics();
+	metrics.backend = settings.backend;
+	metrics.scene = scene;
+
+	std::vector<float> pixels(static_cast<size_t>(settings.width) * settings.height * 4);
+	std::vector<float> reference(pixels.size());
+
+	if (!load_reference(scene, settings, reference))
+	{
+		return false;
+	}
+
+	const auto init_start = clock_type::now();
+
+	std::unique_ptr<RenderBackend> backend = create_bench_scene(scene, settings, settings.seed);
+
+	if (!backend)
+	{
+		return false;
+	}
+
+	metrics.init_ms = elapsed_ms(init_start, clock_type::now());
+	metrics.peak_rss_mb = get_rss_mb();
+
+	// Compared against the reference on a geometric schedule, outside the measured time
+	int next_check = 1;
+	double render_ms = 0.0;
+
+	for (int sample = 1; sample <= settings.max_samples; ++sample)
+	{
+		const auto start = clock_type::now();
+		backend->render(1);
+
+		// The first sample counts until it can be displayed, so with the resolve
+		if (sample == 1)
+		{
+			read_framebuffer(*backend, pixels);
+			metrics.first_sample_ms = elapsed_ms(start, clock_type::now());
+			render_ms += metrics.first_sample_ms;
+		}
+		else
+		{
+			render_ms += elapsed_ms(start, clock_type::now());
+		}
+
+		if (sample == next_check || sample == settings.max_samples)
+		{
+			read_framebuffer(*backend, pixels);
+			metrics.final_rmse = compute_rmse(pixels, reference);
+			metrics.peak_rss_mb = std::max(metrics.peak_rss_mb, get_rss_mb());
+
+			if (metrics.time_to_rmse_ms < 0.0 && metrics.final_rmse <= settings.target_rmse)
+			{
+				metrics.time_to_rmse_ms = render_ms;
+			}
+
+			next_check = std::max(next_check + 1, static_cast<int>(next_check * 1.25f));
+		}
+
+		metrics.samples = sample;
+	}
+
+	if (metrics.samples > 1)
+	{
+		metrics.samples_per_sec = (metrics.samples - 1) * 1000.0 / (render_ms - metrics.first_sample_ms);
+	}
+
+	return true;
+}
@@ -0,0 +1,260 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "hrs_render_bench.h"
+
+namespace
+{
+	// Lower is better for everything but samples_per_sec
+	struct MetricInfo
+	{
+		const char* name;
+		double RenderBenchMetrics::* value;
+		bool higher_is_better;
+	};
+
+	const MetricInfo kMetrics[] = {
+		{ "init_ms", &RenderBenchMetrics::init_ms, false },
+		{ "first_sample_ms", &RenderBenchMetrics::first_sample_ms, false },
+		{ "samples_per_sec", &RenderBenchMetrics::samples_per_sec, true },
+		{ "time_to_rmse_ms", &RenderBenchMetrics::time_to_rmse_ms, false },
+		{ "final_rmse", &RenderBenchMetrics::final_rmse, false },
+		{ "peak_rss_mb", &RenderBenchMetrics::peak_rss_mb, false },
+	};
+
+	// Value following "key": on the line, written by write_render_json so no general parser
+	bool find_value(const std::string& line, const char* key, std::string& value)
+	{
+		std::string pattern = std::string("\"") + key + "\":";
+		size_t start = line.find(pattern);
+
+		if (start == std::string::npos)
+		{
+			return false;
+		}
+
+		start = line.find_first_not_of(" \"", start + pattern.size());
+		size_t end = line.find_first_of(",\"}", start);
+		value = line.substr(start, end - start);
+
+		return true;
+	}
+}
+
+// One object per scene and line, keys in a fixed order so files diff cleanly between builds
+bool write_render_json(const std::string& path, const RenderBenchSettings& settings, const std::vector<RenderBenchMetrics>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\n  \"settings\": { \"width\": %d, \"height\": %d, \"max_samples\": %d, \"reference_samples\": %d, \"target_rmse\": %.4f, \"seed\": %u, \"threads\": %d, \"resolved_threads\": %d, \"mesh_hash\": \"%016llx\" },\n",
+		settings.width, settings.height, settings.max_samples, settings.reference_samples, settings.target_rmse, settings.seed, settings.threads,
+		settings.resolved_threads, static_cast<unsigned long long>(settings.mesh_hash));
+	fprintf(file, "  \"scenes\": [\n");
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const RenderBenchMetrics& r = results[i];
+		fprintf(file, "    { \"backend\": \"%s\", \"scene\": \"%s\", \"samples\": %d", r.backend.c_str(), r.scene.c_str(), r.samples);
+
+		for (const MetricInfo& metric : kMetrics)
+		{
+			fprintf(file, ", \"%s\": %.4f", metric.name, r.*metric.value);
+		}
+
+		fprintf(file, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+
+	return true;
+}
+
+bool read_render_json(const std::string& path, RenderBenchSettings& settings, std::vector<RenderBenchMetrics>& results)
+{
+	std::ifstream file(path);
+
+	if (!file)
+	{
+		return false;
+	}
+
+	// A key the file does not have never matches, files written before the resolved threads and
+	// the mesh hash were kept included
+	settings.width = -1;
+	settings.height = -1;
+	settings.max_samples = -1;
+	settings.reference_samples = -1;
+	settings.target_rmse = -1.0f;
+	settings.threads = -1;
+	settings.resolved_threads = -1;
+	settings.mesh_hash = 0;
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		RenderBenchMetrics metrics;
+		std::string value;
+
+		if (line.find("\"settings\":") != std::string::npos)
+		{
+			const std::pair<const char*, int*> fields[] = {
+				{ "width", &settings.width },
+				{ "height", &settings.height },
+				{ "max_samples", &settings.max_samples },
+				{ "reference_samples", &settings.reference_samples },
+				{ "threads", &settings.threads },
+				{ "resolved_threads", &settings.resolved_threads },
+			};
+
+			for (const auto& field : fields)
+			{
+				if (find_value(line, field.first, value))
+				{
+					*field.second = atoi(value.c_str());
+				}
+			}
+
+			if (find_value(line, "target_rmse", value))
+			{
+				settings.target_rmse = static_cast<float>(atof(value.c_str()));
+			}
+
+			if (find_value(line, "seed", value))
+			{
+				settings.seed = static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 10));
+			}
+
+			if (find_value(line, "mesh_hash", value))
+			{
+				settings.mesh_hash = strtoull(value.c_str(), nullptr, 16);
+			}
+
+			continue;
+		}
+
+		if (!find_value(line, "scene", metrics.scene))
+		{
+			continue;
+		}
+
+		// Written before the backend field, those results are RPR
+		if (!find_value(line, "backend", metrics.backend))
+		{
+			metrics.backend = "rpr";
+		}
+
+		if (find_value(line, "samples", value))
+		{
+			metrics.samples = atoi(value.c_str());
+		}
+
+		for (const MetricInfo& metric : kMetrics)
+		{
+			if (find_value(line, metric.name, value))
+			{
+				metrics.*metric.value = atof(value.c_str());
+			}
+		}
+
+		results.push_back(metrics);
+	}
+
+	return true;
+}
+
+bool is_same_render_settings(const RenderBenchSettings& settings, const RenderBenchSettings& baseline)
+{
+	bool is_same = true;
+
+	const auto check = [&](const char* name, double current, double reference)
+		{
+			if (current != reference)
+			{
+				printf("%-16s %12g baseline %g\n", name, current, reference);
+				is_same = false;
+			}
+		};
+
+	check("width", settings.width, baseline.width);
+	check("height", settings.height, baseline.height);
+	check("max_samples", settings.max_samples, baseline.max_samples);
+	check("reference_samples", settings.reference_samples, baseline.reference_samples);
+	check("seed", settings.seed, baseline.seed);
+	check("resolved_threads", settings.resolved_threads, baseline.resolved_threads);
+
+	// Written with 4 decimals
+	check("target_rmse", std::round(settings.target_rmse * 1e4f), std::round(baseline.target_rmse * 1e4f));
+
+	// 64 bits do not survive the double of check
+	if (settings.mesh_hash != baseline.mesh_hash)
+	{
+		printf("%-16s %016llx baseline %016llx\n", "mesh_hash", static_cast<unsigned long long>(settings.mesh_hash),
+			static_cast<unsigned long long>(baseline.mesh_hash));
+		is_same = false;
+	}
+
+	return is_same;
+}
+
+int compare_render_baseline(const std::vector<RenderBenchMetrics>& results, const std::vector<RenderBenchMetrics>& baseline, double threshold)
+{
+	int regressions = 0;
+
+	for (const RenderBenchMetrics& result : results)
+	{
+		const std::string label = result.backend + "/" + result.scene;
+		const RenderBenchMetrics* base = nullptr;
+
+		for (const RenderBenchMetrics& candidate : baseline)
+		{
+			if (candidate.backend == result.backend && candidate.scene == result.scene)
+			{
+				base = &candidate;
+			}
+		}
+
+		if (!base)
+		{
+			printf("%-16s no baseline\n", label.c_str());
+			continue;
+		}
+
+		for (const MetricInfo& metric : kMetrics)
+		{
+			double current = result.*metric.value;
+			double reference = base->*metric.value;
+			bool is_regression;
+			double change = 0.0;
+
+			// Not reaching the target at all is a regression, reaching it when the baseline did not is not
+			if (current < 0.0 || reference < 0.0)
+			{
+				is_regression = current < 0.0 && reference >= 0.0;
+			}
+			else
+			{
+				change = reference != 0.0 ? (current - reference) / reference : 0.0;
+				is_regression = metric.higher_is_better ? change < -threshold : change > threshold;
+			}
+
+			printf("%-16s %-16s %12.3f %12.3f %+8.1f%%%s\n", label.c_str(), metric.name, reference, current, change * 100.0,
+				is_regression ? "  REGRESSION" : "");
+
+			regressions += is_regression ? 1 : 0;
+		}
+	}
+
+	return regressions;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+#include "hrs_bench.h"
+#include "../core/node_editor.hpp"
+
+// Nodes created first and wired afterwards in random order, the way a graph gets edited. Each
+// node has a hidden rank and only takes inputs from the ranks just below it, so the result is a
+// DAG whose edges mostly disagree with creation order and force the order to move.
+static std::vector<std::pair<int, int>> build_unlinked_graph(Graph& graph, int node_count)
+{
+	srand(11);
+
+	std::vector<int> rank_to_id(node_count);
+
+	for (int i = 0; i < node_count; ++i)
+	{
+		ColorNodeType type = i < 64 || rand() % 8 == 0 ? ColorNodeType::Constant : static_cast<ColorNodeType>(2 + rand() % 3);
+		rank_to_id[i] = graph.add_node(create_color_node(type));
+	}
+
+	for (int i = node_count - 1; i > 0; --i)
+	{
+		std::swap(rank_to_id[i], rank_to_id[rand() % (i + 1)]);
+	}
+
+	std::vector<std::pair<int, int>> pins;
+
+	for (int rank = 64; rank < node_count; ++rank)
+	{
+		int id = rank_to_id[rank];
+
+		for (int i = 0; i < graph.get_node(id)->get_input_count(); ++i)
+		{
+			int source = rank_to_id[rank - 1 - rand() % 64];
+			pins.push_back({ make_output_pin_id(source), make_input_pin_id(id, i) });
+		}
+	}
+
+	for (int i = static_cast<int>(pins.size()) - 1; i > 0; --i)
+	{
+		std::swap(pins[i], pins[rand() % (i + 1)]);
+	}
+
+	return pins;
+}
+
+static bool is_topological(const Graph& graph, const std::vector<int>& order)
+{
+	std::vector<int> position(graph.get_node_capacity(), -1);
+
+	for (int i = 0; i < static_cast<int>(order.size()); ++i)
+	{
+		position[order[i]] = i;
+	}
+
+	for (int id = 0; id < graph.get_link_capacity(); ++id)
+	{
+		const Link* link = graph.get_link(id);
+
+		if (link && position[get_pin_node_id(link->start_pin)] >= position[get_pin_node_id(link->end_pin)])
+		{
+			return false;
+		}
+	}
+
+	return static_cast<int>(order.size()) == graph.get_node_count();
+}
+
+// Keeping the order link by link against the DFS from scratch that every link used to cost
+int run_topo_order_benchmarks(BenchReport& report)
+{
+	int status = 0;
+
+	for (int node_count : { 10000, 100000 })
+	{
+		Graph graph;
+		std::vector<std::pair<int, int>> pins = build_unlinked_graph(graph, node_count);
+
+		const std::string size = std::to_string(node_count);
+		const double links = static_cast<double>(pins.size());
+
+		// The graph only grows once, a single run
+		double incremental_ms = bench_time_ms([&]()
+			{
+				for (const auto& [start_pin, end_pin] : pins)
+				{
+					graph.add_link(start_pin, end_pin);
+				}
+			}, 1);
+		report.add("topo", "add_link_incremental/" + size, incremental_ms * 1e6 / links, links);
+
+		std::vector<int> order;
+		double full_ms = bench_time_ms([&]() { graph.compute_full_order(order); });
+		report.add("topo", "full_order/" + size, full_ms * 1e6, 1.0);
+
+		// Every existing link reversed closes a cycle, the test a drag runs on each hovered pin
+		std::vector<std::pair<int, int>> reversed;
+
+		for (int id = 0; id < graph.get_link_capacity() && reversed.size() < 10000; id += 7)
+		{
+			if (const Link* link = graph.get_link(id))
+			{
+				int from = get_pin_node_id(link->start_pin);
+				int to = get_pin_node_id(link->end_pin);
+
+				if (graph.get_node(from)->get_input_count() > 0)
+				{
+					reversed.push_back({ make_output_pin_id(to), make_input_pin_id(from, 0) });
+				}
+			}
+		}
+
+		int rejected = 0;
+		double query_ms = bench_time_ms([&]()
+			{
+				rejected = 0;
+
+				for (const auto& [start_pin, end_pin] : reversed)
+				{
+					rejected += graph.would_create_cycle(start_pin, end_pin) ? 1 : 0;
+				}
+			});
+		report.add("topo", "cycle_query/" + size, query_ms * 1e6 / std::max<size_t>(reversed.size(), 1), static_cast<double>(reversed.size()));
+
+		const TopologicalOrder& topo = graph.get_topological_order();
+		const double reorders = static_cast<double>(topo.get_reorder_count());
+		const double average_affected = reorders > 0.0 ? static_cast<double>(topo.get_affected_total()) / reorders : 0.0;
+
+		printf("  %d nodes, %d links : %.0f reorders, %.1f nodes moved per reorder, %.0fx cheaper than a full order per link\n",
+			node_count, graph.get_link_count(), reorders, average_affected, full_ms / (incremental_ms / links));
+
+		if (rejected != static_cast<int>(reversed.size()))
+		{
+			printf("  %d of %d cycles not detected\n", static_cast<int>(reversed.size()) - rejected, static_cast<int>(reversed.size()));
+			status = 1;
+		}
+
+		if (!is_topological(graph, graph.get_execution_order()) || !is_topological(graph, order))
+		{
+			printf("  execution order is not topological\n");
+			status = 1;
+		}
+	}
+
+	return status;
+}
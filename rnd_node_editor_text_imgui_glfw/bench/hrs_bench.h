@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct BenchResult
+{
+	std::string suite;
+	std::string name;
+	double ns_per_op = 0.0;
+	double ops = 0.0;
+	double bytes = 0.0;
+};
+
+class BenchReport
+{
+public:
+
+	void add(const std::string& suite, const std::string& name, double ns_per_op, double ops, double bytes = 0.0)
+	{
+		results_.push_back({ suite, name, ns_per_op, ops, bytes });
+		printf("%-10s %-44s %14.2f ns/op %12.0f ops", suite.c_str(), name.c_str(), ns_per_op, ops);
+
+		if (bytes > 0.0)
+		{
+			printf(" %10.2f MB", bytes / (1024.0 * 1024.0));
+		}
+
+		printf("\n");
+	}
+
+	// One object per result, keys and order never change so files diff cleanly between commits
+	bool write_json(const std::string& path) const
+	{
+		FILE* file = fopen(path.c_str(), "w");
+
+		if (!file)
+		{
+			return false;
+		}
+
+		fprintf(file, "{\n  \"results\": [\n");
+
+		for (size_t i = 0; i < results_.size(); ++i)
+		{
+			const BenchResult& r = results_[i];
+			fprintf(file, "    { \"suite\": \"%s\", \"name\": \"%s\", \"ns_per_op\": %.3f, \"ops\": %.0f, \"bytes\": %.0f }%s\n",
+				r.suite.c_str(), r.name.c_str(), r.ns_per_op, r.ops, r.bytes, i + 1 < results_.size() ? "," : "");
+		}
+
+		fprintf(file, "  ]\n}\n");
+		fclose(file);
+
+		return true;
+	}
+
+private:
+
+	std::vector<BenchResult> results_;
+};
+
+// Best of a few runs, in milliseconds
+template <typename Function>
+double bench_time_ms(Function&& function, int runs = 5)
+{
+	double best = 1e300;
+
+	for (int i = 0; i < runs; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		auto end = std::chrono::steady_clock::now();
+
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+
+	return best;
+}
+
+int run_kernel_benchmarks(BenchReport& report);
+int run_graph_program_benchmarks(BenchReport& report);
+int run_topo_order_benchmarks(BenchReport& report);
+int run_graph_benchmarks(BenchReport& report, int max_nodes);
+int run_frame_ring_benchmarks(BenchReport& report);
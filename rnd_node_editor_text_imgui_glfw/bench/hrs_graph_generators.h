@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdlib>
+#include <vector>
+
+#include "../core/node_editor.hpp"
+
+// Synthetic DAGs for the graph benchmarks, every generator is deterministic for a given size
+
+// Constant followed by Invert nodes, each fed by the one before
+inline void build_chain_graph(Graph& graph, int node_count)
+{
+	int previous = graph.add_node(std::make_unique<ConstantColorNode>(Color{ 0.2f, 0.4f, 0.6f }));
+
+	for (int i = 1; i < node_count; ++i)
+	{
+		int id = graph.add_node(create_color_node(ColorNodeType::Invert));
+		graph.add_link(make_output_pin_id(previous), make_input_pin_id(id, 0));
+		previous = id;
+	}
+}
+
+// One constant read by every other node
+inline void build_fan_graph(Graph& graph, int node_count)
+{
+	int source = graph.add_node(std::make_unique<ConstantColorNode>(Color{ 0.2f, 0.4f, 0.6f }));
+
+	for (int i = 1; i < node_count; ++i)
+	{
+		int id = graph.add_node(create_color_node(ColorNodeType::Invert));
+		graph.add_link(make_output_pin_id(source), make_input_pin_id(id, 0));
+	}
+}
+
+// Columns of 100 nodes fed by the previous column, a mix of every operator with a few
+// inputs left unlinked so the folding rules get exercised. Add is rare so values stay finite.
+inline void build_layered_graph(Graph& graph, int node_count)
+{
+	const int rows = 100;
+	std::vector<int> previous;
+	std::vector<int> column;
+
+	srand(7);
+
+	for (int c = 0; c * rows < node_count; ++c)
+	{
+		column.clear();
+
+		for (int r = 0; r < rows && c * rows + r < node_count; ++r)
+		{
+			if (c == 0)
+			{
+				Color color = { rand() / float(RAND_MAX), rand() / float(RAND_MAX), rand() / float(RAND_MAX) };
+				column.push_back(graph.add_node(std::make_unique<ConstantColorNode>(color)));
+				continue;
+			}
+
+			ColorNodeType type = rand() % 16 == 0 ? ColorNodeType::Add : static_cast<ColorNodeType>(2 + rand() % 3);
+			int id = graph.add_node(create_color_node(type));
+			ColorNode* node = graph.get_node(id);
+
+			for (int i = 0; i < node->get_input_count(); ++i)
+			{
+				if (rand() % 16 != 0)
+				{
+					int source = previous[(r + i) % previous.size()];
+					graph.add_link(make_output_pin_id(source), make_input_pin_id(id, i));
+				}
+			}
+
+			column.push_back(id);
+		}
+
+		previous.swap(column);
+	}
+}
+
+// Diamonds in series: a node split into two Invert branches joined by a Mix, whose output
+// starts the next diamond. Every join reads the same value twice, the worst case for caching.
+inline void build_diamond_graph(Graph& graph, int node_count)
+{
+	int top = graph.add_node(std::make_unique<ConstantColorNode>(Color{ 0.2f, 0.4f, 0.6f }));
+
+	for (int count = 1; count + 3 <= node_count; count += 3)
+	{
+		int left = graph.add_node(create_color_node(ColorNodeType::Invert));
+		int right = graph.add_node(create_color_node(ColorNodeType::Invert));
+		int join = graph.add_node(create_color_node(ColorNodeType::Mix));
+
+		graph.add_link(make_output_pin_id(top), make_input_pin_id(left, 0));
+		graph.add_link(make_output_pin_id(top), make_input_pin_id(right, 0));
+		graph.add_link(make_output_pin_id(left), make_input_pin_id(join, 0));
+		graph.add_link(make_output_pin_id(right), make_input_pin_id(join, 1));
+
+		top = join;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fixed so two runs of the same build render the same images
+struct RenderBenchSettings
+{
+	int width = 640;
+	int height = 360;
+	int max_samples = 256;
+	int reference_samples = 2048;
+	float target_rmse = 0.02f;
+	uint32_t seed = 1234;
+
+	// rpr or cpu, see get_render_bench_backends. threads is for the cpu backend, 0 takes all.
+	std::string backend = "rpr";
+	int threads = 0;
+
+	// Reference images are rendered once per scene and resolution then read back from here
+	std::string reference_dir = "bench/reference";
+
+	// Filled by resolve_render_bench_settings: the threads a run actually gets and a hash of the
+	// teapot mesh, so a baseline from another machine or another mesh is not compared to
+	int resolved_threads = 0;
+	uint64_t mesh_hash = 0;
+};
+
+struct RenderBenchMetrics
+{
+	std::string backend;
+	std::string scene;
+	double init_ms = 0.0;
+	double first_sample_ms = 0.0;
+	double samples_per_sec = 0.0;
+
+	// -1 when max_samples was not enough to reach target_rmse
+	double time_to_rmse_ms = -1.0;
+	double final_rmse = 0.0;
+
+	// Highest resident size sampled from the scene creation to the last sample, the reference
+	// render happens before and is not in it
+	double peak_rss_mb = 0.0;
+	int samples = 0;
+};
+
+// teapot, instances, textures
+const std::vector<std::string>& get_render_bench_scenes();
+
+// rpr and cpu, cpu only when built with HRS_RENDER_BENCH_CPU_ONLY (no RPR runtime)
+const std::vector<std::string>& get_render_bench_backends();
+bool is_render_bench_scene_supported(const std::string& scene, const RenderBenchSettings& settings);
+
+// Thread count the backends resolve threads to and the mesh hash, 0 when the mesh is missing
+void resolve_render_bench_settings(RenderBenchSettings& settings);
+
+// Creates the settings backend (RPR runs on a CPU only context), builds the scene, renders
+// max_samples and tears everything down
+bool run_render_scene(const std::string& scene, const RenderBenchSettings& settings, RenderBenchMetrics& metrics);
+
+bool write_render_json(const std::string& path, const RenderBenchSettings& settings, const std::vector<RenderBenchMetrics>& results);
+bool read_render_json(const std::string& path, RenderBenchSettings& settings, std::vector<RenderBenchMetrics>& results);
+
+// Results only compare to a baseline rendered at the same size, sample counts, seed, resolved
+// thread count and mesh. Prints what differs.
+bool is_same_render_settings(const RenderBenchSettings& settings, const RenderBenchSettings& baseline);
+
+// Results are matched to the baseline by backend and scene. Prints every metric next to its baseline and returns how many moved the wrong way by more
+// than threshold (0.1 is 10%)
+int compare_render_baseline(const std::vector<RenderBenchMetrics>& results, const std::vector<RenderBenchMetrics>& baseline, double threshold);
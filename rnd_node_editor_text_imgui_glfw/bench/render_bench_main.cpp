@@ -0,0 +1,156 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "hrs_render_bench.h"
+
+static void print_render_metrics(const RenderBenchMetrics& metrics)
+{
+	printf("%-4s %-10s init %.1f ms, first sample %.1f ms, %.2f samples/s, rmse %.4f after %d samples", metrics.backend.c_str(),
+		metrics.scene.c_str(), metrics.init_ms, metrics.first_sample_ms, metrics.samples_per_sec, metrics.final_rmse, metrics.samples);
+
+	if (metrics.time_to_rmse_ms >= 0.0)
+	{
+		printf(", target reached in %.1f ms", metrics.time_to_rmse_ms);
+	}
+
+	printf(", peak %.1f MB\n", metrics.peak_rss_mb);
+}
+
+// rnd_render_bench [scene|all] [--json file] [--baseline file] [--threshold 0.1] [--update-baseline]
+//                  [--size width height] [--samples count] [--backend rpr|cpu|all] [--threads count]
+// Run from the project directory so Resources and bench resolve. With every backend the same
+// scenes run on each in turn, scenes a backend does not have are skipped when all are asked.
+int main(int argc, char** argv)
+{
+	RenderBenchSettings settings;
+	std::string scene = "all";
+	std::string backend = settings.backend;
+	std::string json_path;
+	std::string baseline_path = "bench/render_baseline.json";
+	double threshold = 0.1;
+	bool update_baseline = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+		{
+			json_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+		{
+			baseline_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+		{
+			threshold = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--update-baseline") == 0)
+		{
+			update_baseline = true;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+		{
+			settings.width = atoi(argv[++i]);
+			settings.height = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+		{
+			settings.max_samples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+		{
+			backend = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			settings.threads = atoi(argv[++i]);
+		}
+		else
+		{
+			scene = argv[i];
+		}
+	}
+
+	resolve_render_bench_settings(settings);
+
+	std::vector<std::string> backends = backend == "all" ? get_render_bench_backends() : std::vector<std::string>{ backend };
+	std::vector<std::string> scenes = scene == "all" ? get_render_bench_scenes() : std::vector<std::string>{ scene };
+	std::vector<RenderBenchMetrics> results;
+	int status = 0;
+
+	for (const std::string& backend_name : backends)
+	{
+		settings.backend = backend_name;
+
+		for (const std::string& name : scenes)
+		{
+			if (scene == "all" && !is_render_bench_scene_supported(name, settings))
+			{
+				continue;
+			}
+
+			RenderBenchMetrics metrics;
+
+			if (!run_render_scene(name, settings, metrics))
+			{
+				status = -1;
+				continue;
+			}
+
+			print_render_metrics(metrics);
+			results.push_back(metrics);
+		}
+	}
+
+	if (!json_path.empty() && !write_render_json(json_path, settings, results))
+	{
+		std::cout << "Error: cannot write " << json_path << std::endl;
+		return -1;
+	}
+
+	if (update_baseline)
+	{
+		if (!write_render_json(baseline_path, settings, results))
+		{
+			std::cout << "Error: cannot write " << baseline_path << std::endl;
+			return -1;
+		}
+
+		return status;
+	}
+
+	RenderBenchSettings baseline_settings;
+	std::vector<RenderBenchMetrics> baseline;
+
+	if (!read_render_json(baseline_path, baseline_settings, baseline))
+	{
+		std::cout << "No baseline at " << baseline_path << ", run with --update-baseline on the reference machine" << std::endl;
+		return status;
+	}
+
+	// A placeholder until a baseline is recorded on the reference machine
+	if (baseline.empty())
+	{
+		std::cout << baseline_path << " has no results yet, run with --update-baseline on the reference machine" << std::endl;
+		return status;
+	}
+
+	// Other settings give other numbers, comparing them would report noise as regressions
+	if (!is_same_render_settings(settings, baseline_settings))
+	{
+		std::cout << "Error: " << baseline_path << " was recorded with other settings, run with its settings or --update-baseline" << std::endl;
+		return -1;
+	}
+
+	int regressions = compare_render_baseline(results, baseline, threshold);
+
+	if (regressions > 0)
+	{
+		std::cout << regressions << " metric(s) regressed by more than " << threshold * 100.0 << "%" << std::endl;
+		status = 1;
+	}
+
+	return status;
+}
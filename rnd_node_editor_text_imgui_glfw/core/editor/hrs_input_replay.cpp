@@ -0,0 +1,504 @@
+#include "hrs_input_replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <GLFW/glfw3.h>
+
+#include "imgui.h"
+#include "imgui_impl_glfw.h"
+
+namespace
+{
+	const char* kPhaseKeys[] = { "other", "render", "viewer", "node_editor", "panels" };
+
+	// Below this a p95 change is timer noise, whatever the ratio
+	constexpr float kMinRegressionMs = 0.25f;
+
+	// Value following "key": on the line, written by write_report so no general parser
+	bool find_value(const std::string& line, const char* key, std::string& value)
+	{
+		std::string pattern = std::string("\"") + key + "\":";
+		size_t start = line.find(pattern);
+
+		if (start == std::string::npos)
+		{
+			return false;
+		}
+
+		start = line.find_first_not_of(" \"", start + pattern.size());
+		size_t end = line.find_first_of(",\"}", start);
+		value = line.substr(start, end - start);
+
+		return true;
+	}
+
+	uint32_t get_mouse_down(const ImGuiIO& io)
+	{
+		uint32_t mouse_down = 0;
+
+		for (int i = 0; i < IM_ARRAYSIZE(io.MouseDown); ++i)
+		{
+			mouse_down |= io.MouseDown[i] ? 1u << i : 0u;
+		}
+
+		return mouse_down;
+	}
+}
+
+void FrameTimer::begin_frame()
+{
+	frame_start_ = clock_type::now();
+	last_mark_ = frame_start_;
+	current_ = FrameTiming();
+}
+
+void FrameTimer::mark(FramePhase phase)
+{
+	const clock_type::time_point now = clock_type::now();
+
+	current_.phase_ms[static_cast<int>(phase)] += std::chrono::duration<float, std::milli>(now - last_mark_).count();
+	last_mark_ = now;
+}
+
+void FrameTimer::end_frame()
+{
+	mark(FramePhase::Other);
+	current_.frame_ms = std::chrono::duration<float, std::milli>(last_mark_ - frame_start_).count();
+	frame_ = current_;
+}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+bool InputRecorder::open(const std::string& path)
+{
+	close();
+
+	file_ = fopen(path.c_str(), "wb");
+
+	if (!file_)
+	{
+		std::cout << "Error: cannot write the input recording " << path << std::endl;
+		return false;
+	}
+
+	const InputFileHeader header = { kInputFileMagic, kInputFileVersion };
+	fwrite(&header, sizeof(header), 1, file_);
+
+	return true;
+}
+
+void InputRecorder::install(GLFWwindow* window)
+{
+	window_ = window;
+
+	glfwSetWindowUserPointer(window, this);
+	glfwSetCursorPosCallback(window, cursor_pos_callback);
+	glfwSetCursorEnterCallback(window, cursor_enter_callback);
+	glfwSetWindowFocusCallback(window, focus_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetKeyCallback(window, key_callback);
+	glfwSetCharCallback(window, char_callback);
+}
+
+void InputRecorder::start()
+{
+	if (!file_ || !window_ || is_started_)
+	{
+		return;
+	}
+
+	is_started_ = true;
+
+	double x = 0.0;
+	double y = 0.0;
+	glfwGetCursorPos(window_, &x, &y);
+
+	push(InputEventType::Focus, 0, 0, glfwGetWindowAttrib(window_, GLFW_FOCUSED), 0, 0.0, 0.0);
+	push(InputEventType::CursorEnter, 0, 0, glfwGetWindowAttrib(window_, GLFW_HOVERED), 0, 0.0, 0.0);
+	push(InputEventType::CursorPos, 0, 0, 0, 0, x, y);
+}
+
+void InputRecorder::end_frame()
+{
+	if (!file_ || !is_started_)
+	{
+		return;
+	}
+
+	const ImGuiIO& io = ImGui::GetIO();
+
+	InputFrameRecord record = {};
+	record.event_count = static_cast<uint32_t>(events_.size());
+	record.delta_time = io.DeltaTime;
+	record.display_width = static_cast<uint16_t>(io.DisplaySize.x);
+	record.display_height = static_cast<uint16_t>(io.DisplaySize.y);
+	record.mouse_x = io.MousePos.x;
+	record.mouse_y = io.MousePos.y;
+	record.mouse_down = get_mouse_down(io);
+	record.key_mods = static_cast<uint32_t>(io.KeyMods);
+
+	fwrite(&record, sizeof(record), 1, file_);
+	fwrite(events_.data(), sizeof(InputEvent), events_.size(), file_);
+
+	events_.clear();
+	++frame_count_;
+}
+
+void InputRecorder::close()
+{
+	if (!file_)
+	{
+		return;
+	}
+
+	fclose(file_);
+	file_ = nullptr;
+
+	if (is_started_)
+	{
+		std::cout << "Recorded " << frame_count_ << " frames of input" << std::endl;
+	}
+}
+
+void InputRecorder::push(InputEventType type, int action, int mods, int code, int scancode, double x, double y)
+{
+	if (!is_started_)
+	{
+		return;
+	}
+
+	events_.push_back({ type, static_cast<uint8_t>(action), static_cast<uint16_t>(mods), code, scancode, static_cast<float>(x), static_cast<float>(y) });
+}
+
+void InputRecorder::cursor_pos_callback(GLFWwindow* window, double x, double y)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::CursorPos, 0, 0, 0, 0, x, y);
+}
+
+void InputRecorder::cursor_enter_callback(GLFWwindow* window, int entered)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::CursorEnter, 0, 0, entered, 0, 0.0, 0.0);
+}
+
+void InputRecorder::focus_callback(GLFWwindow* window, int focused)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::Focus, 0, 0, focused, 0, 0.0, 0.0);
+}
+
+void InputRecorder::mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::MouseButton, action, mods, button, 0, 0.0, 0.0);
+}
+
+void InputRecorder::scroll_callback(GLFWwindow* window, double x, double y)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::Scroll, 0, 0, 0, 0, x, y);
+}
+
+void InputRecorder::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::Key, action, mods, key, scancode, 0.0, 0.0);
+}
+
+void InputRecorder::char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+	static_cast<InputRecorder*>(glfwGetWindowUserPointer(window))->push(InputEventType::Char, 0, 0, static_cast<int>(codepoint), 0, 0.0, 0.0);
+}
+
+bool InputReplay::open(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+
+	if (!file)
+	{
+		std::cout << "Error: cannot read the input recording " << path << std::endl;
+		return false;
+	}
+
+	InputFileHeader header = {};
+	const bool is_valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == kInputFileMagic && header.version == kInputFileVersion;
+
+	frames_.clear();
+	events_.clear();
+
+	ReplayFrame frame;
+
+	// A frame cut short by the end of the file is dropped with everything after it
+	while (is_valid && fread(&frame.record, sizeof(frame.record), 1, file) == 1)
+	{
+		frame.first_event = events_.size();
+		events_.resize(frame.first_event + frame.record.event_count);
+
+		if (fread(events_.data() + frame.first_event, sizeof(InputEvent), frame.record.event_count, file) != frame.record.event_count)
+		{
+			events_.resize(frame.first_event);
+			break;
+		}
+
+		frames_.push_back(frame);
+	}
+
+	fclose(file);
+
+	if (!is_valid || frames_.empty())
+	{
+		std::cout << "Error: " << path << " is not an input recording or has no frames" << std::endl;
+		frames_.clear();
+		return false;
+	}
+
+	path_ = path;
+	next_frame_ = 0;
+	timings_.reserve(frames_.size());
+	event_counts_.reserve(frames_.size());
+	allocations_.reserve(frames_.size());
+
+	return true;
+}
+
+bool InputReplay::apply_frame(GLFWwindow* window)
+{
+	if (next_frame_ >= frames_.size())
+	{
+		return false;
+	}
+
+	const ReplayFrame& frame = frames_[next_frame_++];
+	ImGuiIO& io = ImGui::GetIO();
+
+	io.DeltaTime = step_ > 0.0f ? step_ : frame.record.delta_time;
+
+	// The backend read the window size before this, the new one shows from the next frame on
+	int width = 0;
+	int height = 0;
+	glfwGetWindowSize(window, &width, &height);
+
+	if (width != frame.record.display_width || height != frame.record.display_height)
+	{
+		glfwSetWindowSize(window, frame.record.display_width, frame.record.display_height);
+		io.DisplaySize = ImVec2(frame.record.display_width, frame.record.display_height);
+	}
+
+	for (uint32_t i = 0; i < frame.record.event_count; ++i)
+	{
+		const InputEvent& event = events_[frame.first_event + i];
+
+		switch (event.type)
+		{
+		case InputEventType::CursorPos:
+			ImGui_ImplGlfw_CursorPosCallback(window, event.x, event.y);
+			break;
+		case InputEventType::CursorEnter:
+			ImGui_ImplGlfw_CursorEnterCallback(window, event.code);
+			break;
+		case InputEventType::Focus:
+			ImGui_ImplGlfw_WindowFocusCallback(window, event.code);
+			break;
+		case InputEventType::MouseButton:
+			ImGui_ImplGlfw_MouseButtonCallback(window, event.code, event.action, event.mods);
+			update_modifiers();
+			break;
+		case InputEventType::Scroll:
+			ImGui_ImplGlfw_ScrollCallback(window, event.x, event.y);
+			break;
+		case InputEventType::Key:
+			if (event.code >= GLFW_KEY_LEFT_SHIFT && event.code <= GLFW_KEY_RIGHT_SUPER)
+			{
+				modifiers_down_[event.code - GLFW_KEY_LEFT_SHIFT] = event.action != GLFW_RELEASE;
+			}
+
+			ImGui_ImplGlfw_KeyCallback(window, event.code, event.scancode, event.action, event.mods);
+			update_modifiers();
+			break;
+		case InputEventType::Char:
+			ImGui_ImplGlfw_CharCallback(window, static_cast<unsigned int>(event.code));
+			break;
+		}
+	}
+
+	return true;
+}
+
+// After the backend's own modifier events, which come from the real keyboard
+void InputReplay::update_modifiers()
+{
+	ImGuiIO& io = ImGui::GetIO();
+
+	io.AddKeyEvent(ImGuiMod_Shift, modifiers_down_[0] || modifiers_down_[4]);
+	io.AddKeyEvent(ImGuiMod_Ctrl, modifiers_down_[1] || modifiers_down_[5]);
+	io.AddKeyEvent(ImGuiMod_Alt, modifiers_down_[2] || modifiers_down_[6]);
+	io.AddKeyEvent(ImGuiMod_Super, modifiers_down_[3] || modifiers_down_[7]);
+}
+
+void InputReplay::check_frame()
+{
+	if (next_frame_ == 0 || next_frame_ > frames_.size())
+	{
+		return;
+	}
+
+	const InputFrameRecord& record = frames_[next_frame_ - 1].record;
+	const ImGuiIO& io = ImGui::GetIO();
+
+	const bool is_same = io.MousePos.x == record.mouse_x && io.MousePos.y == record.mouse_y && get_mouse_down(io) == record.mouse_down
+		&& static_cast<uint32_t>(io.KeyMods) == record.key_mods;
+
+	if (!is_same && diverged_frames_++ == 0)
+	{
+		std::cout << "Replay diverged from the recording at frame " << next_frame_ - 1 << std::endl;
+	}
+}
+
+void InputReplay::end_frame(const FrameTiming& timing, uint64_t allocations)
+{
+	if (timings_.size() >= next_frame_)
+	{
+		return;
+	}
+
+	timings_.push_back(timing);
+	event_counts_.push_back(frames_[timings_.size() - 1].record.event_count);
+	allocations_.push_back(allocations);
+}
+
+InputReplay::PhaseSummary InputReplay::summarize(int phase) const
+{
+	PhaseSummary summary;
+
+	if (timings_.empty())
+	{
+		return summary;
+	}
+
+	std::vector<float> values(timings_.size());
+	double sum = 0.0;
+
+	for (size_t i = 0; i < timings_.size(); ++i)
+	{
+		values[i] = phase < 0 ? timings_[i].frame_ms : timings_[i].phase_ms[phase];
+		sum += values[i];
+	}
+
+	std::sort(values.begin(), values.end());
+
+	auto percentile = [&values](float p)
+	{
+		return values[std::min(values.size() - 1, static_cast<size_t>(std::ceil(p * values.size())) - 1)];
+	};
+
+	summary.mean_ms = static_cast<float>(sum / values.size());
+	summary.p50_ms = percentile(0.5f);
+	summary.p95_ms = percentile(0.95f);
+	summary.p99_ms = percentile(0.99f);
+	summary.max_ms = values.back();
+
+	return summary;
+}
+
+void InputReplay::log() const
+{
+	printf("Replayed %zu frames of %s, %d diverged\n", timings_.size(), path_.c_str(), diverged_frames_);
+	printf("%-12s %9s %9s %9s %9s %9s\n", "phase (ms)", "mean", "p50", "p95", "p99", "max");
+
+	for (int phase = -1; phase < static_cast<int>(FramePhase::Count); ++phase)
+	{
+		const PhaseSummary s = summarize(phase);
+		printf("%-12s %9.3f %9.3f %9.3f %9.3f %9.3f\n", phase < 0 ? "frame" : kPhaseKeys[phase], s.mean_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms);
+	}
+}
+
+bool InputReplay::write_report(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\n  \"settings\": { \"recording\": \"%s\", \"frames\": %zu, \"step_ms\": %.3f, \"diverged_frames\": %d },\n",
+		path_.c_str(), timings_.size(), step_ * 1000.0f, diverged_frames_);
+	fprintf(file, "  \"summary\": [\n");
+
+	for (int phase = -1; phase < static_cast<int>(FramePhase::Count); ++phase)
+	{
+		const PhaseSummary s = summarize(phase);
+		fprintf(file, "    { \"phase\": \"%s\", \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }%s\n",
+			phase < 0 ? "frame" : kPhaseKeys[phase], s.mean_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms, phase + 1 < static_cast<int>(FramePhase::Count) ? "," : "");
+	}
+
+	fprintf(file, "  ],\n  \"frames\": [\n");
+
+	for (size_t i = 0; i < timings_.size(); ++i)
+	{
+		const FrameTiming& t = timings_[i];
+		fprintf(file, "    { \"frame\": %zu, \"events\": %u, \"allocations\": %llu, \"frame_ms\": %.4f", i, event_counts_[i], static_cast<unsigned long long>(allocations_[i]), t.frame_ms);
+
+		for (int phase = 0; phase < static_cast<int>(FramePhase::Count); ++phase)
+		{
+			fprintf(file, ", \"%s_ms\": %.4f", kPhaseKeys[phase], t.phase_ms[phase]);
+		}
+
+		fprintf(file, " }%s\n", i + 1 < timings_.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+
+	return true;
+}
+
+int InputReplay::compare_baseline(const std::string& path, float threshold) const
+{
+	std::ifstream file(path);
+
+	if (!file)
+	{
+		std::cout << "Error: cannot read the replay baseline " << path << std::endl;
+		return 0;
+	}
+
+	int regressions = 0;
+	std::string line;
+	std::string phase_key;
+	std::string value;
+
+	while (std::getline(file, line))
+	{
+		if (!find_value(line, "phase", phase_key) || !find_value(line, "p95_ms", value))
+		{
+			continue;
+		}
+
+		int phase = -2;
+
+		for (int i = -1; i < static_cast<int>(FramePhase::Count); ++i)
+		{
+			phase = phase_key == (i < 0 ? "frame" : kPhaseKeys[i]) ? i : phase;
+		}
+
+		if (phase == -2)
+		{
+			continue;
+		}
+
+		const float baseline_ms = static_cast<float>(atof(value.c_str()));
+		const float p95_ms = summarize(phase).p95_ms;
+
+		if (p95_ms > baseline_ms * (1.0f + threshold) && p95_ms - baseline_ms > kMinRegressionMs)
+		{
+			printf("Regression: %s p95 %.3f ms -> %.3f ms\n", phase_key.c_str(), baseline_ms, p95_ms);
+			++regressions;
+		}
+	}
+
+	return regressions;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../memory/hrs_allocation_tracker.h"
+
+struct GLFWwindow;
+
+// Input files: an InputFileHeader, then every frame as an InputFrameRecord followed by its
+// events. Frames are appended as they end, so a session cut short still replays up to its
+// last complete frame. Events are the GLFW callbacks of the main window as they came, a
+// replay goes through the same ImGui backend code as the live input did.
+constexpr uint32_t kInputFileMagic = 0x49535248; // "HRSI"
+constexpr uint32_t kInputFileVersion = 1;
+
+struct InputFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+};
+
+enum class InputEventType : uint8_t
+{
+	CursorPos,
+	CursorEnter,
+	Focus,
+	MouseButton,
+	Scroll,
+	Key,
+	Char
+};
+
+// code is the button, key, codepoint or the entered / focused flag, scancode only for keys,
+// x and y the cursor position or the scroll offsets
+struct InputEvent
+{
+	InputEventType type;
+	uint8_t action;
+	uint16_t mods;
+	int32_t code;
+	int32_t scancode;
+	float x;
+	float y;
+};
+
+// ImGui IO as NewFrame left it, a replay compares its own to find where it diverged
+struct InputFrameRecord
+{
+	uint32_t event_count;
+	float delta_time;
+	uint16_t display_width;
+	uint16_t display_height;
+	float mouse_x;
+	float mouse_y;
+	uint32_t mouse_down;
+	uint32_t key_mods;
+};
+
+// Wall time of the main loop phases, the same phases allocations are charged to
+struct FrameTiming
+{
+	float phase_ms[static_cast<int>(FramePhase::Count)] = {};
+	float frame_ms = 0.0f;
+};
+
+class FrameTimer
+{
+public:
+
+	void begin_frame();
+
+	// Charges the time since the previous mark to phase
+	void mark(FramePhase phase);
+
+	// What is left goes to Other: ImGui draw data, swap and event polling
+	void end_frame();
+
+	const FrameTiming& get_frame() const { return frame_; }
+
+private:
+
+	using clock_type = std::chrono::steady_clock;
+
+	clock_type::time_point frame_start_;
+	clock_type::time_point last_mark_;
+	FrameTiming current_;
+	FrameTiming frame_;
+};
+
+// Records the main window input from its GLFW callbacks. install goes before the ImGui
+// backend installs its own, which chain to these. Nothing is kept before start, which writes
+// the cursor and focus state first so the replay does not depend on where the cursor was.
+class InputRecorder
+{
+public:
+
+	InputRecorder() = default;
+	~InputRecorder();
+
+	InputRecorder(const InputRecorder&) = delete;
+	InputRecorder& operator=(const InputRecorder&) = delete;
+
+	bool open(const std::string& path);
+	void install(GLFWwindow* window);
+	void start();
+
+	// After ImGui::NewFrame, appends the events it consumed and the IO state they led to
+	void end_frame();
+
+	void close();
+
+	bool is_open() const { return file_ != nullptr; }
+	bool is_started() const { return is_started_; }
+	uint64_t get_frame_count() const { return frame_count_; }
+
+private:
+
+	static void cursor_pos_callback(GLFWwindow* window, double x, double y);
+	static void cursor_enter_callback(GLFWwindow* window, int entered);
+	static void focus_callback(GLFWwindow* window, int focused);
+	static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+	static void scroll_callback(GLFWwindow* window, double x, double y);
+	static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void char_callback(GLFWwindow* window, unsigned int codepoint);
+
+	void push(InputEventType type, int action, int mods, int code, int scancode, double x, double y);
+
+	FILE* file_ = nullptr;
+	GLFWwindow* window_ = nullptr;
+	std::vector<InputEvent> events_;
+	bool is_started_ = false;
+	uint64_t frame_count_ = 0;
+};
+
+// Feeds a recording back one recorded frame per frame through the ImGui GLFW backend
+// callbacks. The backend is initialised without callbacks of its own, the real window input
+// never reaches ImGui. Every frame advances by the same step, 0 takes the recorded ones, so
+// what the UI does does not depend on how fast the machine runs, and the frame times are
+// collected for a report.
+class InputReplay
+{
+public:
+
+	bool open(const std::string& path);
+
+	void set_step(float seconds) { step_ = seconds; }
+
+	// Between ImGui_ImplGlfw_NewFrame and ImGui::NewFrame, false once every frame was fed
+	bool apply_frame(GLFWwindow* window);
+
+	// After ImGui::NewFrame, counts the frames whose IO differs from the recording
+	void check_frame();
+
+	// timing of the frame apply_frame fed
+	void end_frame(const FrameTiming& timing, uint64_t allocations);
+
+	bool is_open() const { return !frames_.empty(); }
+	bool is_finished() const { return is_open() && next_frame_ >= frames_.size(); }
+	size_t get_frame_count() const { return frames_.size(); }
+	int get_diverged_frames() const { return diverged_frames_; }
+
+	// Mean and percentiles per phase to stdout
+	void log() const;
+
+	// Summary per phase then one line per frame, keys in a fixed order so files diff cleanly
+	bool write_report(const std::string& path) const;
+
+	// Phases whose p95 grew by more than threshold and a millisecond fraction over a report
+	// written by write_report, printed and counted
+	int compare_baseline(const std::string& path, float threshold) const;
+
+private:
+
+	struct ReplayFrame
+	{
+		InputFrameRecord record;
+		size_t first_event = 0;
+	};
+
+	struct PhaseSummary
+	{
+		float mean_ms = 0.0f;
+		float p50_ms = 0.0f;
+		float p95_ms = 0.0f;
+		float p99_ms = 0.0f;
+		float max_ms = 0.0f;
+	};
+
+	// Phase index or -1 for the whole frame
+	PhaseSummary summarize(int phase) const;
+	void update_modifiers();
+
+	std::string path_;
+	std::vector<ReplayFrame> frames_;
+	std::vector<InputEvent> events_;
+	size_t next_frame_ = 0;
+	float step_ = 1.0f / 60.0f;
+
+	// Modifier keys held in the replayed events, the backend polls the real keyboard for them
+	bool modifiers_down_[8] = {};
+
+	int diverged_frames_ = 0;
+	std::vector<FrameTiming> timings_;
+	std::vector<uint32_t> event_counts_;
+	std::vector<uint64_t> allocations_;
+};
@@ -0,0 +1,551 @@
+#include "hrs_preview_service.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "../memory/hrs_memory_ledger.h"
+
+static uint64_t hash_color(uint64_t hash, Color color)
+{
+	uint32_t bits[3];
+	std::memcpy(&bits[0], &color.r, 4);
+	std::memcpy(&bits[1], &color.g, 4);
+	std::memcpy(&bits[2], &color.b, 4);
+
+	for (uint32_t value : bits)
+	{
+		hash = hash_mix(hash, value);
+	}
+
+	return hash;
+}
+
+// Output of the node feeding a link, black when unlinked like Graph::gather_inputs
+static int get_link_source(const Graph& graph, int link_id)
+{
+	const Link* link = link_id != -1 ? graph.get_link(link_id) : nullptr;
+	return link ? get_pin_node_id(link->start_pin) : -1;
+}
+
+static bool make_preview_stage(ColorNode* node, PreviewStage& stage)
+{
+	stage.params = KernelParams();
+
+	switch (node->get_type())
+	{
+	case ColorNodeType::Invert:
+		// Levels mapping [0, 1] onto [1, 0], out of range inputs clamp to what the display shows
+		stage.op = KernelOp::Levels;
+		stage.params.values[1] = 1.0f;
+		stage.params.values[2] = 1.0f;
+		stage.params.values[3] = 1.0f;
+		stage.params.values[4] = 0.0f;
+		return true;
+	case ColorNodeType::Mix:
+		stage.op = KernelOp::Blend;
+		stage.params.values[0] = node->get_params()[0];
+		stage.params.mode = BlendMode::Mix;
+		return true;
+	case ColorNodeType::Multiply:
+		stage.op = KernelOp::Blend;
+		stage.params.values[0] = 1.0f;
+		stage.params.mode = BlendMode::Multiply;
+		return true;
+	case ColorNodeType::Add:
+		stage.op = KernelOp::Blend;
+		stage.params.values[0] = 1.0f;
+		stage.params.mode = BlendMode::Add;
+		return true;
+	default:
+		return false;
+	}
+}
+
+PreviewChain build_preview_chain(const Graph& graph, int node_id)
+{
+	PreviewChain chain;
+	int id = node_id;
+
+	// Walked upstream from the previewed node, reversed below into graph order
+	while (id != -1 && chain.stage_count < PreviewChain::kMaxStages)
+	{
+		PreviewStage stage;
+
+		if (!make_preview_stage(graph.get_node(id), stage))
+		{
+			break;
+		}
+
+		PinLinks inputs = graph.get_input_links(id);
+		int other = inputs.size() > 1 ? get_link_source(graph, inputs[1]) : -1;
+		stage.other = other != -1 ? graph.get_output(other) : Color{};
+
+		chain.stages[chain.stage_count++] = stage;
+		id = get_link_source(graph, inputs[0]);
+	}
+
+	std::reverse(chain.stages, chain.stages + chain.stage_count);
+	chain.base = id != -1 ? graph.get_output(id) : Color{};
+
+	uint64_t hash = hash_color(0, chain.base);
+
+	for (int i = 0; i < chain.stage_count; ++i)
+	{
+		const PreviewStage& stage = chain.stages[i];
+		hash = hash_mix(hash, static_cast<uint64_t>(stage.op) << 8 | static_cast<uint64_t>(stage.params.mode));
+		hash = hash_color(hash, { stage.params.values[0], stage.params.values[3], stage.params.values[4] });
+		hash = hash_color(hash, stage.other);
+	}
+
+	chain.hash = hash;
+	return chain;
+}
+
+PreviewService::PreviewService(int swatch_size, int atlas_columns)
+	: swatch_size_(swatch_size), atlas_columns_(atlas_columns), slots_(atlas_columns * atlas_columns)
+{
+}
+
+PreviewService::~PreviewService()
+{
+	if (running_)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_ = false;
+		}
+
+		wake_.notify_all();
+		worker_.join();
+	}
+}
+
+void PreviewService::init()
+{
+	int atlas_size = swatch_size_ * atlas_columns_;
+
+	glGenTextures(1, &atlas_texture_);
+	glBindTexture(GL_TEXTURE_2D, atlas_texture_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_size, atlas_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	MemoryLedger::get().record(MemoryCategory::GLTexture, &atlas_texture_, static_cast<size_t>(atlas_size) * atlas_size * 4, "Preview atlas");
+
+	running_ = true;
+	worker_ = std::thread(&PreviewService::worker_loop, this);
+}
+
+void PreviewService::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_ = false;
+	}
+
+	wake_.notify_all();
+
+	if (worker_.joinable())
+	{
+		worker_.join();
+	}
+
+	glDeleteTextures(1, &atlas_texture_);
+	atlas_texture_ = 0;
+	MemoryLedger::get().release(&atlas_texture_);
+}
+
+void PreviewService::begin_frame()
+{
+	frame_++;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	shared_frame_ = frame_;
+
+	// Nodes that were not drawn last frame scrolled away, their work is dropped
+	auto stale = std::remove_if(pending_.begin(), pending_.end(), [&](const Job& job)
+		{
+			if (job.frame + 1 >= frame_)
+			{
+				return false;
+			}
+
+			latest_hash_.erase(job.node_id);
+			stats_.cancelled++;
+			return true;
+		});
+
+	pending_.erase(stale, pending_.end());
+	stats_.pending = static_cast<int>(pending_.size());
+
+	wake_.notify_one();
+}
+
+void PreviewService::request(int node_id, const PreviewChain& chain, bool recently_edited)
+{
+	const uint64_t content_hash = chain.hash;
+
+	auto slot = node_slots_.find(node_id);
+
+	if (slot != node_slots_.end() && slots_[slot->second].hash == content_hash)
+	{
+		return;
+	}
+
+	int priority = recently_edited ? 2 : 1;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto latest = latest_hash_.find(node_id);
+
+	if (latest != latest_hash_.end() && latest->second == content_hash)
+	{
+		// Already queued, in flight or waiting for upload, keep it alive
+		for (Job& job : pending_)
+		{
+			if (job.node_id == node_id)
+			{
+				job.frame = frame_;
+				job.priority = std::max(job.priority, priority);
+				break;
+			}
+		}
+		return;
+	}
+
+	latest_hash_[node_id] = content_hash;
+
+	for (Job& job : pending_)
+	{
+		if (job.node_id == node_id)
+		{
+			job = { node_id, content_hash, chain, priority, frame_ };
+			stats_.cancelled++;
+			return;
+		}
+	}
+
+	pending_.push_back({ node_id, content_hash, chain, priority, frame_ });
+	stats_.pending = static_cast<int>(pending_.size());
+
+	wake_.notify_one();
+}
+
+int PreviewService::upload_results(int max_uploads)
+{
+	// Reused between frames so an idle frame never allocates
+	std::vector<Result>& results = uploads_;
+	results.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto count = std::min(done_.size(), static_cast<size_t>(max_uploads));
+		results.assign(std::make_move_iterator(done_.begin()), std::make_move_iterator(done_.begin() + count));
+		done_.erase(done_.begin(), done_.begin() + count);
+
+		// The node may have changed again since the worker picked the job
+		results.erase(std::remove_if(results.begin(), results.end(), [&](const Result& result)
+			{
+				auto latest = latest_hash_.find(result.node_id);
+				return latest == latest_hash_.end() || latest->second != result.hash;
+			}), results.end());
+	}
+
+	if (results.empty())
+	{
+		return 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, atlas_texture_);
+
+	for (const Result& result : results)
+	{
+		int slot_index = acquire_slot(result.node_id);
+		Slot& slot = slots_[slot_index];
+		slot.hash = result.hash;
+		slot.last_used = frame_;
+
+		int x = (slot_index % atlas_columns_) * swatch_size_;
+		int y = (slot_index / atlas_columns_) * swatch_size_;
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, swatch_size_, swatch_size_, GL_RGBA, GL_UNSIGNED_BYTE, result.pixels.data());
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	stats_.uploaded += static_cast<int>(results.size());
+
+	return static_cast<int>(results.size());
+}
+
+bool PreviewService::get_preview(int node_id, float uv[4])
+{
+	auto iter = node_slots_.find(node_id);
+
+	if (iter == node_slots_.end())
+	{
+		return false;
+	}
+
+	int slot_index = iter->second;
+	slots_[slot_index].last_used = frame_;
+
+	float step = 1.0f / atlas_columns_;
+	uv[0] = (slot_index % atlas_columns_) * step;
+	uv[1] = (slot_index / atlas_columns_) * step;
+	uv[2] = uv[0] + step;
+	uv[3] = uv[1] + step;
+
+	return true;
+}
+
+void PreviewService::clear()
+{
+	std::fill(slots_.begin(), slots_.end(), Slot());
+	node_slots_.clear();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	pending_.clear();
+	done_.clear();
+	latest_hash_.clear();
+}
+
+PreviewStats PreviewService::get_stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+int PreviewService::acquire_slot(int node_id)
+{
+	auto iter = node_slots_.find(node_id);
+
+	if (iter != node_slots_.end())
+	{
+		return iter->second;
+	}
+
+	// Free slot first, otherwise the least recently drawn swatch goes
+	int best = 0;
+
+	for (int i = 0; i < static_cast<int>(slots_.size()); ++i)
+	{
+		if (slots_[i].node_id == -1)
+		{
+			best = i;
+			break;
+		}
+
+		if (slots_[i].last_used < slots_[best].last_used)
+		{
+			best = i;
+		}
+	}
+
+	Slot& slot = slots_[best];
+
+	if (slot.node_id != -1)
+	{
+		node_slots_.erase(slot.node_id);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		latest_hash_.erase(slot.node_id);
+		stats_.evicted++;
+	}
+
+	slot.node_id = node_id;
+	slot.hash = 0;
+	node_slots_[node_id] = best;
+
+	return best;
+}
+
+bool PreviewService::is_stale(const Job& job) const
+{
+	auto latest = latest_hash_.find(job.node_id);
+	return latest == latest_hash_.end() || latest->second != job.hash;
+}
+
+void PreviewService::worker_loop()
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<uint8_t> pixels(swatch_size_ * swatch_size_ * 4);
+
+	// Sized once, a job only refills them
+	PlanarImage image;
+	image.resize(swatch_size_, swatch_size_);
+
+	// The stages run on the albedo alone, one pixel, so the lighting and the checker never go
+	// through Levels or Blend
+	PlanarImage albedo;
+	albedo.resize(1, 1);
+
+	std::vector<PlanarImage> others(PreviewChain::kMaxStages);
+
+	for (PlanarImage& other : others)
+	{
+		other.resize(1, 1);
+	}
+
+	KernelChain kernels;
+	uint64_t budget_frame = 0;
+	float spent_ms = 0.0f;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true)
+	{
+		// Spend at most the budget per UI frame, then wait for the next one
+		wake_.wait(lock, [&]()
+			{
+				if (!running_)
+				{
+					return true;
+				}
+
+				if (shared_frame_ != budget_frame)
+				{
+					budget_frame = shared_frame_;
+					spent_ms = 0.0f;
+				}
+
+				return !pending_.empty() && spent_ms < budget_ms_;
+			});
+
+		if (!running_)
+		{
+			break;
+		}
+
+		auto best = std::max_element(pending_.begin(), pending_.end(), [](const Job& a, const Job& b)
+			{
+				return a.priority != b.priority ? a.priority < b.priority : a.frame < b.frame;
+			});
+
+		Job job = *best;
+		pending_.erase(best);
+		stats_.pending = static_cast<int>(pending_.size());
+
+		lock.unlock();
+
+		auto start = clock::now();
+
+		albedo.planes[0][0] = job.chain.base.r;
+		albedo.planes[1][0] = job.chain.base.g;
+		albedo.planes[2][0] = job.chain.base.b;
+
+		kernels.clear();
+
+		for (int i = 0; i < job.chain.stage_count; ++i)
+		{
+			const PreviewStage& stage = job.chain.stages[i];
+			others[i].planes[0][0] = stage.other.r;
+			others[i].planes[1][0] = stage.other.g;
+			others[i].planes[2][0] = stage.other.b;
+
+			kernels.add(stage.op, stage.params, &others[i]);
+		}
+
+		kernels.run(albedo, 1);
+
+		render_swatch({ albedo.planes[0][0], albedo.planes[1][0], albedo.planes[2][0] }, image);
+		encode_swatch(image, pixels.data());
+		float elapsed_ms = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+
+		lock.lock();
+
+		spent_ms += elapsed_ms;
+		stats_.worker_ms = elapsed_ms;
+
+		if (is_stale(job))
+		{
+			stats_.cancelled++;
+			continue;
+		}
+
+		done_.push_back({ job.node_id, job.hash, pixels });
+		stats_.rendered++;
+	}
+}
+
+// Lit sphere over a checker, enough to read hue, value and saturation at a glance
+void PreviewService::render_swatch(Color color, PlanarImage& image)
+{
+	const int size = image.width;
+	const float light[3] = { -0.45f, 0.55f, 0.70f };
+	const float radius = 0.82f;
+
+	// Blinn half vector between the light and a viewer looking down -z
+	float half[3] = { light[0], light[1], light[2] + 1.0f };
+	float half_length = std::sqrt(half[0] * half[0] + half[1] * half[1] + half[2] * half[2]);
+	half[0] /= half_length;
+	half[1] /= half_length;
+	half[2] /= half_length;
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			float u = (x + 0.5f) / size * 2.0f - 1.0f;
+			float v = 1.0f - (y + 0.5f) / size * 2.0f;
+			float d2 = (u * u + v * v) / (radius * radius);
+
+			float r, g, b;
+
+			if (d2 < 1.0f)
+			{
+				float nx = u / radius;
+				float ny = v / radius;
+				float nz = std::sqrt(1.0f - d2);
+
+				float diffuse = std::max(0.0f, nx * light[0] + ny * light[1] + nz * light[2]);
+				float specular = std::pow(std::max(0.0f, nx * half[0] + ny * half[1] + nz * half[2]), 48.0f) * 0.4f;
+				float shade = 0.12f + 0.88f * diffuse;
+
+				r = color.r * shade + specular;
+				g = color.g * shade + specular;
+				b = color.b * shade + specular;
+			}
+			else
+			{
+				float checker = ((x / 8 + y / 8) & 1) ? 0.18f : 0.08f;
+				r = g = b = checker;
+			}
+
+			size_t index = static_cast<size_t>(y) * size + x;
+			image.planes[0][index] = r;
+			image.planes[1][index] = g;
+			image.planes[2][index] = b;
+		}
+	}
+}
+
+void PreviewService::encode_swatch(const PlanarImage& image, uint8_t* rgba)
+{
+	auto encode = [](float linear)
+		{
+			float srgb = std::pow(std::clamp(linear, 0.0f, 1.0f), 1.0f / 2.2f);
+			return static_cast<uint8_t>(srgb * 255.0f + 0.5f);
+		};
+
+	size_t count = static_cast<size_t>(image.width) * image.height;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint8_t* pixel = rgba + i * 4;
+		pixel[0] = encode(image.planes[0][i]);
+		pixel[1] = encode(image.planes[1][i]);
+		pixel[2] = encode(image.planes[2][i]);
+		pixel[3] = 255;
+	}
+}
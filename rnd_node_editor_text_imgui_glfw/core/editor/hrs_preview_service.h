@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../kernels/hrs_image_kernels.h"
+#include "../node_editor.hpp"
+
+struct PreviewStats
+{
+	int pending = 0;
+	int rendered = 0;
+	int cancelled = 0;
+	int uploaded = 0;
+	int evicted = 0;
+	float worker_ms = 0.0f;
+};
+
+// A node op applied to the swatch albedo, other is the color of its second input
+struct PreviewStage
+{
+	KernelOp op;
+	KernelParams params;
+	Color other;
+};
+
+// What a swatch shows: the output of the first node upstream that is not a color op goes through
+// the run of Invert, Mix, Multiply and Add nodes down to the previewed one, along their first
+// input, as one fused KernelChain. The sphere is then shaded with the result over the checker.
+struct PreviewChain
+{
+	static constexpr int kMaxStages = 8;
+
+	Color base;
+	PreviewStage stages[kMaxStages];
+	int stage_count = 0;
+	uint64_t hash = 0;
+};
+
+PreviewChain build_preview_chain(const Graph& graph, int node_id);
+
+// Per-node swatches rendered on a background thread and packed into one LRU atlas texture.
+// The UI thread only queues requests and uploads finished swatches, it never waits on the worker.
+class PreviewService
+{
+public:
+
+	PreviewService(int swatch_size = 64, int atlas_columns = 16);
+	~PreviewService();
+
+	void init();
+	void cleanup();
+
+	// Once per frame before any request
+	void begin_frame();
+
+	// Nodes ask every frame they are drawn, a changed chain hash supersedes older work for the node
+	void request(int node_id, const PreviewChain& chain, bool recently_edited);
+
+	// Upload finished swatches, bounded so a burst of results cannot stall one frame.
+	// Returns the number of swatches uploaded.
+	int upload_results(int max_uploads = 16);
+
+	// UV rectangle of the node swatch in the atlas, false while it is not ready
+	bool get_preview(int node_id, float uv[4]);
+
+	void clear();
+
+	GLuint get_atlas_texture() const { return atlas_texture_; }
+	int get_swatch_size() const { return swatch_size_; }
+
+	void set_budget_ms(float budget_ms) { budget_ms_ = budget_ms; }
+	float get_budget_ms() const { return budget_ms_; }
+
+	PreviewStats get_stats();
+
+private:
+
+	struct Job
+	{
+		int node_id;
+		uint64_t hash;
+		PreviewChain chain;
+		int priority;
+		uint64_t frame;
+	};
+
+	struct Result
+	{
+		int node_id;
+		uint64_t hash;
+		std::vector<uint8_t> pixels;
+	};
+
+	struct Slot
+	{
+		int node_id = -1;
+		uint64_t hash = 0;
+		uint64_t last_used = 0;
+	};
+
+	void worker_loop();
+	bool is_stale(const Job& job) const;
+	int acquire_slot(int node_id);
+	static void render_swatch(Color color, PlanarImage& image);
+	static void encode_swatch(const PlanarImage& image, uint8_t* rgba);
+
+	int swatch_size_;
+	int atlas_columns_;
+	GLuint atlas_texture_ = 0;
+
+	// Atlas, UI thread only
+	std::vector<Slot> slots_;
+	std::unordered_map<int, int> node_slots_;
+	std::vector<Result> uploads_;
+	uint64_t frame_ = 0;
+
+	// Shared with the worker
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::vector<Job> pending_;
+	std::vector<Result> done_;
+	std::unordered_map<int, uint64_t> latest_hash_;
+	uint64_t shared_frame_ = 0;
+	float budget_ms_ = 4.0f;
+	bool running_ = false;
+	PreviewStats stats_;
+
+	std::thread worker_;
+};
@@ -0,0 +1,152 @@
+#include "hrs_startup_loader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+StartupLoader::StartupLoader() : origin_(clock_type::now())
+{
+}
+
+StartupLoader::~StartupLoader()
+{
+	join();
+}
+
+void StartupLoader::add_stage(const char* name, Stage stage)
+{
+	stages_.push_back({ name, std::move(stage) });
+}
+
+void StartupLoader::add_task(const char* name, Stage task)
+{
+	tasks_.push_back({ name, std::move(task) });
+}
+
+void StartupLoader::start()
+{
+	tasker_ = std::thread(&StartupLoader::run_tasks, this);
+	loader_ = std::thread(&StartupLoader::run, this);
+}
+
+void StartupLoader::join()
+{
+	if (loader_.joinable())
+	{
+		loader_.join();
+	}
+
+	if (tasker_.joinable())
+	{
+		tasker_.join();
+	}
+}
+
+bool StartupLoader::wait_tasks()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	tasks_done_.wait(lock, [&]() { return are_tasks_done_; });
+	return !has_task_failed_;
+}
+
+std::string StartupLoader::get_current_stage() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return current_stage_;
+}
+
+float StartupLoader::get_progress() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stages_.empty() ? 1.0f : static_cast<float>(stages_done_) / stages_.size();
+}
+
+double StartupLoader::get_elapsed_ms() const
+{
+	return std::chrono::duration<double, std::milli>(clock_type::now() - origin_).count();
+}
+
+void StartupLoader::record(const char* name, double start_ms)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	timings_.push_back({ name, start_ms, get_elapsed_ms() - start_ms, false });
+}
+
+std::vector<StartupStageTiming> StartupLoader::get_timings() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return timings_;
+}
+
+void StartupLoader::log() const
+{
+	std::vector<StartupStageTiming> timings = get_timings();
+	std::sort(timings.begin(), timings.end(), [](const auto& a, const auto& b) { return a.start_ms < b.start_ms; });
+
+	double end_ms = 0.0;
+
+	for (const StartupStageTiming& timing : timings)
+	{
+		printf("Startup %-18s %8.1f ms  (at %8.1f ms%s)\n", timing.name.c_str(), timing.duration_ms, timing.start_ms, timing.on_loader ? ", loader" : "");
+		end_ms = std::max(end_ms, timing.start_ms + timing.duration_ms);
+	}
+
+	printf("Startup %-18s %8.1f ms\n", "total", end_ms);
+	fflush(stdout);
+}
+
+void StartupLoader::run()
+{
+	for (StageEntry& entry : stages_)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			current_stage_ = entry.name;
+		}
+
+		const double start_ms = get_elapsed_ms();
+		const bool succeeded = entry.stage();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		timings_.push_back({ entry.name, start_ms, get_elapsed_ms() - start_ms, true });
+
+		if (!succeeded)
+		{
+			std::cout << "Error: startup stage " << entry.name << " failed" << std::endl;
+			has_failed_.store(true, std::memory_order_release);
+			break;
+		}
+
+		stages_done_++;
+	}
+
+	is_finished_.store(true, std::memory_order_release);
+}
+
+void StartupLoader::run_tasks()
+{
+	bool has_failed = false;
+
+	for (StageEntry& entry : tasks_)
+	{
+		const double start_ms = get_elapsed_ms();
+		has_failed = !entry.stage();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		timings_.push_back({ entry.name, start_ms, get_elapsed_ms() - start_ms, true });
+
+		if (has_failed)
+		{
+			std::cout << "Error: startup task " << entry.name << " failed" << std::endl;
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		are_tasks_done_ = true;
+		has_task_failed_ = has_failed;
+	}
+
+	tasks_done_.notify_all();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StartupStageTiming
+{
+	std::string name;
+	double start_ms = 0.0;
+	double duration_ms = 0.0;
+	bool on_loader = false;
+};
+
+// Brings the renderer up on a background thread while the window and the UI are already
+// running. Stages run in order on the loader thread, tasks run in order beside them on a
+// thread of their own so file parsing overlaps context creation, a stage that needs their
+// results calls wait_tasks. Every stage and task is timed from the loader's construction,
+// main thread milestones are added with record().
+class StartupLoader
+{
+public:
+
+	using Stage = std::function<bool()>;
+
+	StartupLoader();
+	~StartupLoader();
+
+	StartupLoader(const StartupLoader&) = delete;
+	StartupLoader& operator=(const StartupLoader&) = delete;
+
+	void add_stage(const char* name, Stage stage);
+	void add_task(const char* name, Stage task);
+
+	void start();
+
+	// Waits for the loader, called before tearing down what its stages create
+	void join();
+
+	// From a stage, blocks until every task ran. False when one failed, the rest are skipped.
+	bool wait_tasks();
+
+	// Every stage succeeded, or one failed and the rest were skipped
+	bool is_finished() const { return is_finished_.load(std::memory_order_acquire); }
+	bool has_failed() const { return has_failed_.load(std::memory_order_acquire); }
+
+	// Name of the stage running or the one that failed
+	std::string get_current_stage() const;
+	float get_progress() const;
+
+	// Milliseconds since construction
+	double get_elapsed_ms() const;
+
+	void record(const char* name, double start_ms);
+	std::vector<StartupStageTiming> get_timings() const;
+
+	// One line per stage and the overall time, to stdout
+	void log() const;
+
+private:
+
+	using clock_type = std::chrono::steady_clock;
+
+	struct StageEntry
+	{
+		std::string name;
+		Stage stage;
+	};
+
+	void run();
+	void run_tasks();
+
+	clock_type::time_point origin_;
+
+	std::vector<StageEntry> stages_;
+	std::vector<StageEntry> tasks_;
+
+	std::thread loader_;
+	std::thread tasker_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable tasks_done_;
+	bool are_tasks_done_ = false;
+	bool has_task_failed_ = false;
+	std::vector<StartupStageTiming> timings_;
+	std::string current_stage_;
+	int stages_done_ = 0;
+
+	std::atomic<bool> is_finished_ = false;
+	std::atomic<bool> has_failed_ = false;
+};
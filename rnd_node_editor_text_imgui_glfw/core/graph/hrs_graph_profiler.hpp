@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Rolling statistics of one node, times in nanoseconds
+struct NodeProfile
+{
+	uint64_t calls = 0;
+	uint64_t cache_hits = 0;
+	uint64_t samples = 0;
+	uint64_t bytes = 0;
+
+	double last_ns = 0.0;
+	double mean_ns = 0.0;
+
+	// Highest recent sample, decays so a single spike fades out
+	double peak_ns = 0.0;
+
+	// Calls times the mean, what the node costs over everything it ran
+	double get_total_ms() const { return mean_ns * static_cast<double>(calls - cache_hits) / 1e6; }
+};
+
+enum class ProfileSort
+{
+	Mean,
+	Peak,
+	Total,
+	Calls
+};
+
+// Per-node timings for Graph::evaluate. Every execution is counted, only one pass in
+// sample_interval is timed so the clock stays out of most passes. The compiled path runs
+// fused instructions, only its whole pass time is kept. Work done for a node outside the
+// graph (instancers) is added with add_sample.
+class GraphProfiler
+{
+public:
+
+	static int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void set_sample_interval(int passes) { sample_interval_ = std::max(passes, 1); }
+	int get_sample_interval() const { return sample_interval_; }
+
+	// Returns true when the nodes of this pass are timed
+	bool begin_pass()
+	{
+		return passes_++ % sample_interval_ == 0;
+	}
+
+	void end_pass(int64_t ns, bool compiled)
+	{
+		double& mean = compiled ? program_ns_ : pass_ns_;
+		mean = mean == 0.0 ? static_cast<double>(ns) : mean + (static_cast<double>(ns) - mean) * kAlpha;
+	}
+
+	// Untimed execution
+	void count(int id, bool cache_hit, size_t bytes)
+	{
+		NodeProfile& profile = get_profile(id);
+		profile.calls++;
+		profile.cache_hits += cache_hit ? 1 : 0;
+		profile.bytes += bytes;
+	}
+
+	void add_sample(int id, int64_t ns, size_t bytes)
+	{
+		NodeProfile& profile = get_profile(id);
+		const double sample = static_cast<double>(ns);
+
+		profile.calls++;
+		profile.samples++;
+		profile.bytes += bytes;
+		profile.last_ns = sample;
+		profile.mean_ns = profile.samples == 1 ? sample : profile.mean_ns + (sample - profile.mean_ns) * kAlpha;
+		profile.peak_ns = std::max(profile.peak_ns * 0.99, sample);
+	}
+
+	const NodeProfile* find(int id) const
+	{
+		return id >= 0 && id < static_cast<int>(profiles_.size()) && profiles_[id].calls > 0 ? &profiles_[id] : nullptr;
+	}
+
+	// Highest mean among the nodes, what the heat map is normalized by
+	double get_max_mean_ns() const
+	{
+		double max_ns = 0.0;
+
+		for (const NodeProfile& profile : profiles_)
+		{
+			max_ns = std::max(max_ns, profile.mean_ns);
+		}
+
+		return max_ns;
+	}
+
+	// Mean of the interpreted and compiled passes, zero until one ran
+	double get_pass_ns() const { return pass_ns_; }
+	double get_program_ns() const { return program_ns_; }
+	uint64_t get_pass_count() const { return passes_; }
+
+	// Up to count profiled ids, most expensive first
+	void get_top(int count, ProfileSort sort, std::vector<int>& ids) const
+	{
+		ids.clear();
+
+		for (int id = 0; id < static_cast<int>(profiles_.size()); ++id)
+		{
+			if (profiles_[id].calls > 0)
+			{
+				ids.push_back(id);
+			}
+		}
+
+		auto key = [&](int id)
+		{
+			const NodeProfile& profile = profiles_[id];
+
+			switch (sort)
+			{
+			case ProfileSort::Mean: return profile.mean_ns;
+			case ProfileSort::Peak: return profile.peak_ns;
+			case ProfileSort::Total: return profile.get_total_ms();
+			case ProfileSort::Calls: return static_cast<double>(profile.calls);
+			}
+
+			return 0.0;
+		};
+
+		const size_t kept = std::min(ids.size(), static_cast<size_t>(std::max(count, 0)));
+		std::partial_sort(ids.begin(), ids.begin() + kept, ids.end(), [&](int a, int b) { return key(a) > key(b); });
+		ids.resize(kept);
+	}
+
+	// Removed nodes keep their slot, a new node on the same id starts from zero
+	void remove(int id)
+	{
+		if (id >= 0 && id < static_cast<int>(profiles_.size()))
+		{
+			profiles_[id] = NodeProfile();
+		}
+	}
+
+	void reset()
+	{
+		profiles_.clear();
+		passes_ = 0;
+		pass_ns_ = 0.0;
+		program_ns_ = 0.0;
+	}
+
+	// One line per profiled node so two graph versions can be diffed or loaded in a sheet.
+	// The graph only provides the node names and types.
+	template <typename GraphType>
+	bool write_csv(const std::string& path, const GraphType& graph) const
+	{
+		FILE* file = fopen(path.c_str(), "w");
+
+		if (!file)
+		{
+			return false;
+		}
+
+		fprintf(file, "# nodes %d, links %d, topology %llu, passes %llu, pass_ns %.0f, program_ns %.0f, sample_interval %d\n",
+			graph.get_node_count(), graph.get_link_count(), static_cast<unsigned long long>(graph.get_topology_revision()),
+			static_cast<unsigned long long>(passes_), pass_ns_, program_ns_, sample_interval_);
+		fprintf(file, "id,name,type,calls,cache_hits,samples,mean_ns,peak_ns,last_ns,total_ms,bytes\n");
+
+		for (int id = 0; id < static_cast<int>(profiles_.size()); ++id)
+		{
+			const NodeProfile& profile = profiles_[id];
+			const auto* node = graph.get_node(id);
+
+			if (profile.calls == 0 || !node)
+			{
+				continue;
+			}
+
+			fprintf(file, "%d,%s,%d,%llu,%llu,%llu,%.1f,%.1f,%.1f,%.4f,%llu\n", id, node->get_name(), static_cast<int>(node->get_type()),
+				static_cast<unsigned long long>(profile.calls), static_cast<unsigned long long>(profile.cache_hits),
+				static_cast<unsigned long long>(profile.samples), profile.mean_ns, profile.peak_ns, profile.last_ns,
+				profile.get_total_ms(), static_cast<unsigned long long>(profile.bytes));
+		}
+
+		fclose(file);
+		return true;
+	}
+
+private:
+
+	static constexpr double kAlpha = 1.0 / 16.0;
+
+	NodeProfile& get_profile(int id)
+	{
+		if (id >= static_cast<int>(profiles_.size()))
+		{
+			profiles_.resize(id + 1);
+		}
+
+		return profiles_[id];
+	}
+
+	std::vector<NodeProfile> profiles_;
+	int sample_interval_ = 8;
+	uint64_t passes_ = 0;
+	double pass_ns_ = 0.0;
+	double program_ns_ = 0.0;
+};
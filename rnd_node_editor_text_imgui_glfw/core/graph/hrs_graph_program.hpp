@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "hrs_graph_types.hpp"
+
+enum class OpCode : uint8_t
+{
+	Add,
+	Multiply,
+	Mix,
+	Invert
+};
+
+// dst = op(a, b), Mix reads its factor from register c
+struct Instruction
+{
+	OpCode op;
+	int dst;
+	int a;
+	int b;
+	int c;
+};
+
+struct ProgramStats
+{
+	int instructions = 0;
+	int registers = 0;
+	int constants = 0;
+	int folded = 0;
+	int eliminated = 0;
+};
+
+// A graph lowered to straight-line register code. Register 0 holds black and 1 white, then
+// the node parameters, then one register per instruction. Parameters stay live registers
+// so scrubbing a value only patches them, compile() is needed again only when the topology
+// changes. Folding therefore works on structure: unlinked inputs, identities and aliases.
+class GraphProgram
+{
+public:
+
+	static constexpr int kBlack = 0;
+	static constexpr int kWhite = 1;
+
+	// With keep_all_nodes every node output stays readable (editor), otherwise only the sinks
+	// are kept and everything that does not reach them is dropped
+	template <typename GraphType>
+	void compile(GraphType& graph, bool keep_all_nodes)
+	{
+		const int capacity = graph.get_node_capacity();
+		const std::vector<int>& order = graph.get_execution_order();
+
+		code_.clear();
+		slots_.clear();
+		registers_.assign(2, Color{});
+		registers_[kWhite] = { 1.0f, 1.0f, 1.0f };
+		node_registers_.assign(capacity, -1);
+		inverted_.assign(2, -1);
+		inverted_[kBlack] = kWhite;
+		inverted_[kWhite] = kBlack;
+		stats_ = ProgramStats();
+
+		// Nodes that reach a root, walked backwards over the execution order
+		std::vector<uint8_t> is_live(capacity, 0);
+
+		for (int id : order)
+		{
+			is_live[id] = keep_all_nodes || graph.get_output_links(id).empty();
+		}
+
+		for (auto iter = order.rbegin(); iter != order.rend(); ++iter)
+		{
+			if (!is_live[*iter])
+			{
+				stats_.eliminated++;
+				continue;
+			}
+
+			for (int link_id : graph.get_input_links(*iter))
+			{
+				if (link_id != -1)
+				{
+					is_live[get_pin_node_id(graph.get_link(link_id)->start_pin)] = 1;
+				}
+			}
+		}
+
+		for (int id : order)
+		{
+			if (is_live[id])
+			{
+				node_registers_[id] = lower(graph, id);
+			}
+		}
+
+		// Aliasing can leave instructions nobody reads, sweep them from the end
+		std::vector<uint8_t> is_read(registers_.size(), 0);
+
+		for (int id : order)
+		{
+			if (node_registers_[id] != -1 && (keep_all_nodes || graph.get_output_links(id).empty()))
+			{
+				is_read[node_registers_[id]] = 1;
+			}
+		}
+
+		std::vector<Instruction> kept;
+		kept.reserve(code_.size());
+
+		for (auto iter = code_.rbegin(); iter != code_.rend(); ++iter)
+		{
+			if (!is_read[iter->dst])
+			{
+				stats_.eliminated++;
+				continue;
+			}
+
+			is_read[iter->a] = is_read[iter->b] = is_read[iter->c] = 1;
+			kept.push_back(*iter);
+		}
+
+		code_.assign(kept.rbegin(), kept.rend());
+
+		topology_revision_ = graph.get_topology_revision();
+		stats_.instructions = static_cast<int>(code_.size());
+		stats_.registers = static_cast<int>(registers_.size());
+		stats_.constants = static_cast<int>(slots_.size());
+	}
+
+	// Refresh parameter registers from the nodes, the code is untouched
+	template <typename GraphType>
+	void patch_constants(GraphType& graph)
+	{
+		for (const ConstantSlot& slot : slots_)
+		{
+			const float* params = graph.get_node(slot.node_id)->get_params();
+			registers_[slot.reg] = slot.is_splat ? Color{ params[0], params[0], params[0] } : Color{ params[0], params[1], params[2] };
+		}
+	}
+
+	template <typename GraphType>
+	bool is_current(const GraphType& graph) const
+	{
+		return topology_revision_ == graph.get_topology_revision();
+	}
+
+	void run()
+	{
+		Color* r = registers_.data();
+
+		for (const Instruction& instruction : code_)
+		{
+			const Color a = r[instruction.a];
+			const Color b = r[instruction.b];
+
+			switch (instruction.op)
+			{
+			case OpCode::Add:
+				r[instruction.dst] = { a.r + b.r, a.g + b.g, a.b + b.b };
+				break;
+			case OpCode::Multiply:
+				r[instruction.dst] = { a.r * b.r, a.g * b.g, a.b * b.b };
+				break;
+			case OpCode::Mix:
+			{
+				const float factor = r[instruction.c].r;
+				r[instruction.dst] = { a.r + (b.r - a.r) * factor, a.g + (b.g - a.g) * factor, a.b + (b.b - a.b) * factor };
+				break;
+			}
+			case OpCode::Invert:
+				r[instruction.dst] = { 1.0f - a.r, 1.0f - a.g, 1.0f - a.b };
+				break;
+			}
+		}
+	}
+
+	// -1 when the node was eliminated
+	int get_register(int node_id) const { return node_registers_[node_id]; }
+
+	// Black for an eliminated node, only a program compiled with keep_all_nodes has them all
+	Color get_output(int node_id) const
+	{
+		const int reg = node_registers_[node_id];
+		return registers_[reg != -1 ? reg : kBlack];
+	}
+
+	const std::vector<Instruction>& get_code() const { return code_; }
+	const ProgramStats& get_stats() const { return stats_; }
+
+private:
+
+	struct ConstantSlot
+	{
+		int node_id;
+		int reg;
+		bool is_splat;
+	};
+
+	int add_register(const Color& value = {})
+	{
+		registers_.push_back(value);
+		inverted_.push_back(-1);
+		return static_cast<int>(registers_.size()) - 1;
+	}
+
+	int add_constant(int node_id, bool is_splat)
+	{
+		int reg = add_register();
+		slots_.push_back({ node_id, reg, is_splat });
+		return reg;
+	}
+
+	int emit(OpCode op, int a, int b, int c = kBlack)
+	{
+		int dst = add_register();
+		code_.push_back({ op, dst, a, b, c });
+		return dst;
+	}
+
+	// Returns the register holding the node output, folded nodes return an existing one
+	template <typename GraphType>
+	int lower(GraphType& graph, int id)
+	{
+		auto* node = graph.get_node(id);
+		int inputs[2] = { kBlack, kBlack };
+		int input_count = 0;
+
+		// No op reads more than two inputs, nodes may have up to kMaxNodeInputs pins
+		for (int link_id : graph.get_input_links(id))
+		{
+			if (input_count == 2)
+			{
+				break;
+			}
+
+			inputs[input_count++] = link_id != -1 ? node_registers_[get_pin_node_id(graph.get_link(link_id)->start_pin)] : kBlack;
+		}
+
+		int a = inputs[0];
+		int b = inputs[1];
+
+		switch (node->get_type())
+		{
+		case ColorNodeType::Constant:
+		{
+			int reg = add_constant(id, false);
+			const float* params = node->get_params();
+			registers_[reg] = { params[0], params[1], params[2] };
+			return reg;
+		}
+		case ColorNodeType::Add:
+			if (a == kBlack || b == kBlack)
+			{
+				stats_.folded++;
+				return a == kBlack ? b : a;
+			}
+			return emit(OpCode::Add, a, b);
+		case ColorNodeType::Multiply:
+			if (a == kBlack || b == kBlack || a == kWhite || b == kWhite)
+			{
+				stats_.folded++;
+				return a == kBlack || b == kBlack ? kBlack : (a == kWhite ? b : a);
+			}
+			return emit(OpCode::Multiply, a, b);
+		case ColorNodeType::Mix:
+		{
+			if (a == b)
+			{
+				stats_.folded++;
+				return a;
+			}
+
+			int factor = add_constant(id, true);
+			registers_[factor].r = registers_[factor].g = registers_[factor].b = node->get_params()[0];
+			return emit(OpCode::Mix, a, b, factor);
+		}
+		case ColorNodeType::Invert:
+			if (inverted_[a] != -1)
+			{
+				stats_.folded++;
+				return inverted_[a];
+			}
+			{
+				int reg = emit(OpCode::Invert, a, kBlack);
+				inverted_[reg] = a;
+				inverted_[a] = reg;
+				return reg;
+			}
+		case ColorNodeType::Instancer:
+			// The scatter is scene side, the color is a pass-through
+			stats_.folded++;
+			return a;
+		}
+
+		return kBlack;
+	}
+
+	std::vector<Instruction> code_;
+	std::vector<Color> registers_;
+	std::vector<ConstantSlot> slots_;
+	std::vector<int> node_registers_;
+
+	// Register holding the inverse of each register when known, for Invert(Invert(x)) and Invert(black)
+	std::vector<int> inverted_;
+
+	uint64_t topology_revision_ = ~0ull;
+	ProgramStats stats_;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+// Pins are packed into the node id so ImNodes attribute ids need no lookup table
+constexpr int kMaxNodeInputs = 15;
+
+inline int make_input_pin_id(int node_id, int index) { return (node_id << 4) | index; }
+inline int make_output_pin_id(int node_id) { return (node_id << 4) | kMaxNodeInputs; }
+inline int get_pin_node_id(int pin_id) { return pin_id >> 4; }
+inline int get_pin_index(int pin_id) { return pin_id & kMaxNodeInputs; }
+inline bool is_output_pin(int pin_id) { return (pin_id & kMaxNodeInputs) == kMaxNodeInputs; }
+
+struct Color
+{
+	float r = 0.0f;
+	float g = 0.0f;
+	float b = 0.0f;
+};
+
+enum class ColorNodeType
+{
+	Constant,
+	Add,
+	Multiply,
+	Mix,
+	Invert,
+	Instancer
+};
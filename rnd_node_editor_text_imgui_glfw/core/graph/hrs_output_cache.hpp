@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Content hashing, a node output is addressed by what produced it and not by its id
+inline uint64_t hash_mix(uint64_t seed, uint64_t value)
+{
+	// splitmix64 finalizer over the combined value
+	uint64_t x = seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+inline uint64_t hash_float(uint64_t seed, float value)
+{
+	// -0.0 and 0.0 produce the same output, keep them on the same key
+	if (value == 0.0f)
+	{
+		value = 0.0f;
+	}
+
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return hash_mix(seed, bits);
+}
+
+struct CacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	size_t bytes = 0;
+	size_t entries = 0;
+
+	float get_hit_rate() const
+	{
+		uint64_t lookups = hits + misses;
+		return lookups == 0 ? 0.0f : static_cast<float>(hits) / static_cast<float>(lookups);
+	}
+};
+
+// Bounded LRU keyed by content hash. Thread safe so previews and evaluation can share it.
+template <typename Value>
+class LruCache
+{
+public:
+
+	explicit LruCache(size_t capacity_bytes) : capacity_bytes_(capacity_bytes) {}
+
+	bool find(uint64_t key, Value& value)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto iter = entries_.find(key);
+
+		if (iter == entries_.end())
+		{
+			stats_.misses++;
+			return false;
+		}
+
+		lru_.splice(lru_.begin(), lru_, iter->second);
+		value = iter->second->value;
+		stats_.hits++;
+
+		return true;
+	}
+
+	void insert(uint64_t key, const Value& value, size_t value_bytes = sizeof(Value))
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const size_t bytes = value_bytes + kEntryOverhead;
+		auto iter = entries_.find(key);
+
+		if (iter != entries_.end())
+		{
+			stats_.bytes -= iter->second->bytes;
+			iter->second->value = value;
+			iter->second->bytes = bytes;
+			stats_.bytes += bytes;
+			lru_.splice(lru_.begin(), lru_, iter->second);
+		}
+		else
+		{
+			lru_.push_front({ key, value, bytes });
+			entries_[key] = lru_.begin();
+			stats_.bytes += bytes;
+		}
+
+		evict_to(capacity_bytes_);
+		stats_.entries = entries_.size();
+	}
+
+	void set_capacity(size_t capacity_bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		capacity_bytes_ = capacity_bytes;
+		evict_to(capacity_bytes_);
+		stats_.entries = entries_.size();
+	}
+
+	size_t get_capacity() const { return capacity_bytes_; }
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		lru_.clear();
+		entries_.clear();
+		stats_.bytes = 0;
+		stats_.entries = 0;
+	}
+
+	void reset_stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		stats_.hits = stats_.misses = stats_.evictions = 0;
+	}
+
+	CacheStats get_stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+private:
+
+	// List node plus hash map slot, close enough for the budget
+	static constexpr size_t kEntryOverhead = 64;
+
+	struct Entry
+	{
+		uint64_t key;
+		Value value;
+		size_t bytes;
+	};
+
+	void evict_to(size_t capacity_bytes)
+	{
+		while (stats_.bytes > capacity_bytes && !lru_.empty())
+		{
+			const Entry& last = lru_.back();
+			stats_.bytes -= last.bytes;
+			entries_.erase(last.key);
+			lru_.pop_back();
+			stats_.evictions++;
+		}
+	}
+
+	std::mutex mutex_;
+	size_t capacity_bytes_;
+	std::list<Entry> lru_;
+	std::unordered_map<uint64_t, typename std::list<Entry>::iterator> entries_;
+	CacheStats stats_;
+};
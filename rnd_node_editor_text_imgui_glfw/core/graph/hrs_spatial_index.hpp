@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct SpatialRect
+{
+	float min_x = 0.0f;
+	float min_y = 0.0f;
+	float max_x = 0.0f;
+	float max_y = 0.0f;
+
+	bool overlaps(const SpatialRect& other) const
+	{
+		return min_x <= other.max_x && max_x >= other.min_x && min_y <= other.max_y && max_y >= other.min_y;
+	}
+
+	bool contains(float x, float y) const
+	{
+		return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+	}
+
+	SpatialRect expanded(float margin) const
+	{
+		return { min_x - margin, min_y - margin, max_x + margin, max_y + margin };
+	}
+};
+
+// Uniform grid over the node canvas (grid space). Nodes are stored by bounds, links by
+// segment, and every entry remembers the cells it covers so a move only touches the
+// cells that actually change.
+class SpatialGrid
+{
+public:
+
+	explicit SpatialGrid(float cell_size = 256.0f) : cell_size_(cell_size), inv_cell_size_(1.0f / cell_size) {}
+
+	void clear()
+	{
+		cells_.clear();
+		nodes_.clear();
+		links_.clear();
+	}
+
+	void insert_node(int id, const SpatialRect& bounds)
+	{
+		Entry& entry = nodes_[id];
+		entry.bounds = bounds;
+		entry.cells.clear();
+		collect_rect_cells(bounds, entry.cells);
+
+		for (int64_t key : entry.cells)
+		{
+			cells_[key].nodes.push_back(id);
+		}
+	}
+
+	void update_node(int id, const SpatialRect& bounds)
+	{
+		auto iter = nodes_.find(id);
+
+		if (iter == nodes_.end())
+		{
+			insert_node(id, bounds);
+			return;
+		}
+
+		Entry& entry = iter->second;
+		entry.bounds = bounds;
+
+		scratch_cells_.clear();
+		collect_rect_cells(bounds, scratch_cells_);
+
+		if (scratch_cells_ == entry.cells)
+		{
+			return;
+		}
+
+		move_entry(id, entry, scratch_cells_, &Cell::nodes);
+	}
+
+	void remove_node(int id)
+	{
+		auto iter = nodes_.find(id);
+
+		if (iter == nodes_.end())
+		{
+			return;
+		}
+
+		for (int64_t key : iter->second.cells)
+		{
+			erase_from_cell(key, id, &Cell::nodes);
+		}
+
+		nodes_.erase(iter);
+	}
+
+	void insert_link(int id, float x0, float y0, float x1, float y1)
+	{
+		Entry& entry = links_[id];
+		entry.bounds = { x0, y0, x1, y1 };
+		entry.cells.clear();
+		collect_segment_cells(x0, y0, x1, y1, entry.cells);
+
+		for (int64_t key : entry.cells)
+		{
+			cells_[key].links.push_back(id);
+		}
+	}
+
+	void update_link(int id, float x0, float y0, float x1, float y1)
+	{
+		auto iter = links_.find(id);
+
+		if (iter == links_.end())
+		{
+			insert_link(id, x0, y0, x1, y1);
+			return;
+		}
+
+		Entry& entry = iter->second;
+		entry.bounds = { x0, y0, x1, y1 };
+
+		scratch_cells_.clear();
+		collect_segment_cells(x0, y0, x1, y1, scratch_cells_);
+
+		if (scratch_cells_ == entry.cells)
+		{
+			return;
+		}
+
+		move_entry(id, entry, scratch_cells_, &Cell::links);
+	}
+
+	void remove_link(int id)
+	{
+		auto iter = links_.find(id);
+
+		if (iter == links_.end())
+		{
+			return;
+		}
+
+		for (int64_t key : iter->second.cells)
+		{
+			erase_from_cell(key, id, &Cell::links);
+		}
+
+		links_.erase(iter);
+	}
+
+	// Node ids whose bounds overlap the rect, sorted and unique
+	void query_nodes(const SpatialRect& rect, std::vector<int>& out) const
+	{
+		out.clear();
+		visit_cells(rect, [&](const Cell& cell)
+			{
+				for (int id : cell.nodes)
+				{
+					if (nodes_.at(id).bounds.overlaps(rect))
+					{
+						out.push_back(id);
+					}
+				}
+			});
+
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	// Link ids whose segment crosses the rect, sorted and unique
+	void query_links(const SpatialRect& rect, std::vector<int>& out) const
+	{
+		out.clear();
+		visit_cells(rect, [&](const Cell& cell)
+			{
+				for (int id : cell.links)
+				{
+					const SpatialRect& s = links_.at(id).bounds;
+
+					if (segment_intersects(s.min_x, s.min_y, s.max_x, s.max_y, rect))
+					{
+						out.push_back(id);
+					}
+				}
+			});
+
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	// Topmost hit is the highest id, matching the submission order of the editor
+	int hit_test_node(float x, float y) const
+	{
+		auto cell = cells_.find(make_key(to_cell(x), to_cell(y)));
+
+		if (cell == cells_.end())
+		{
+			return -1;
+		}
+
+		int hit = -1;
+
+		for (int id : cell->second.nodes)
+		{
+			if (id > hit && nodes_.at(id).bounds.contains(x, y))
+			{
+				hit = id;
+			}
+		}
+
+		return hit;
+	}
+
+	size_t get_node_count() const { return nodes_.size(); }
+	size_t get_link_count() const { return links_.size(); }
+	size_t get_cell_count() const { return cells_.size(); }
+
+private:
+
+	struct Cell
+	{
+		std::vector<int> nodes;
+		std::vector<int> links;
+	};
+
+	struct Entry
+	{
+		SpatialRect bounds;
+		std::vector<int64_t> cells;
+	};
+
+	int to_cell(float v) const
+	{
+		return static_cast<int>(std::floor(v * inv_cell_size_));
+	}
+
+	// Shifted as unsigned, a negative cell would make the signed shift undefined before C++20
+	static int64_t make_key(int cx, int cy)
+	{
+		return static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy));
+	}
+
+	void collect_rect_cells(const SpatialRect& rect, std::vector<int64_t>& out) const
+	{
+		int cx0 = to_cell(rect.min_x);
+		int cy0 = to_cell(rect.min_y);
+		int cx1 = to_cell(rect.max_x);
+		int cy1 = to_cell(rect.max_y);
+
+		for (int cy = cy0; cy <= cy1; ++cy)
+		{
+			for (int cx = cx0; cx <= cx1; ++cx)
+			{
+				out.push_back(make_key(cx, cy));
+			}
+		}
+
+		std::sort(out.begin(), out.end());
+	}
+
+	// Grid traversal (Amanatides & Woo) so long links only occupy the cells they pass through
+	void collect_segment_cells(float x0, float y0, float x1, float y1, std::vector<int64_t>& out) const
+	{
+		int cx = to_cell(x0);
+		int cy = to_cell(y0);
+		const int end_cx = to_cell(x1);
+		const int end_cy = to_cell(y1);
+
+		const float dx = x1 - x0;
+		const float dy = y1 - y0;
+		const int step_x = dx > 0.0f ? 1 : -1;
+		const int step_y = dy > 0.0f ? 1 : -1;
+
+		const float t_delta_x = dx != 0.0f ? std::abs(cell_size_ / dx) : INFINITY;
+		const float t_delta_y = dy != 0.0f ? std::abs(cell_size_ / dy) : INFINITY;
+
+		float next_x = (step_x > 0 ? (cx + 1) * cell_size_ : cx * cell_size_);
+		float next_y = (step_y > 0 ? (cy + 1) * cell_size_ : cy * cell_size_);
+		float t_max_x = dx != 0.0f ? (next_x - x0) / dx : INFINITY;
+		float t_max_y = dy != 0.0f ? (next_y - y0) / dy : INFINITY;
+
+		out.push_back(make_key(cx, cy));
+
+		const int max_steps = std::abs(end_cx - cx) + std::abs(end_cy - cy);
+
+		for (int i = 0; i < max_steps; ++i)
+		{
+			if (t_max_x < t_max_y)
+			{
+				cx += step_x;
+				t_max_x += t_delta_x;
+			}
+			else
+			{
+				cy += step_y;
+				t_max_y += t_delta_y;
+			}
+
+			out.push_back(make_key(cx, cy));
+		}
+
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	static bool segment_intersects(float x0, float y0, float x1, float y1, const SpatialRect& rect)
+	{
+		// Liang-Barsky clip
+		float t0 = 0.0f;
+		float t1 = 1.0f;
+		const float dx = x1 - x0;
+		const float dy = y1 - y0;
+
+		const float p[4] = { -dx, dx, -dy, dy };
+		const float q[4] = { x0 - rect.min_x, rect.max_x - x0, y0 - rect.min_y, rect.max_y - y0 };
+
+		for (int i = 0; i < 4; ++i)
+		{
+			if (p[i] == 0.0f)
+			{
+				if (q[i] < 0.0f)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float t = q[i] / p[i];
+
+			if (p[i] < 0.0f)
+			{
+				t0 = std::max(t0, t);
+			}
+			else
+			{
+				t1 = std::min(t1, t);
+			}
+
+			if (t0 > t1)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template <typename Visitor>
+	void visit_cells(const SpatialRect& rect, Visitor&& visitor) const
+	{
+		int cx0 = to_cell(rect.min_x);
+		int cy0 = to_cell(rect.min_y);
+		int cx1 = to_cell(rect.max_x);
+		int cy1 = to_cell(rect.max_y);
+
+		// Huge zoomed-out views cover more cells than exist, walk the occupied ones instead
+		const int64_t span = (static_cast<int64_t>(cx1) - cx0 + 1) * (static_cast<int64_t>(cy1) - cy0 + 1);
+
+		if (span > static_cast<int64_t>(cells_.size()))
+		{
+			for (const auto& [key, cell] : cells_)
+			{
+				int cx = static_cast<int>(key >> 32);
+				int cy = static_cast<int>(static_cast<uint32_t>(key & 0xffffffff));
+
+				if (cx >= cx0 && cx <= cx1 && cy >= cy0 && cy <= cy1)
+				{
+					visitor(cell);
+				}
+			}
+			return;
+		}
+
+		for (int cy = cy0; cy <= cy1; ++cy)
+		{
+			for (int cx = cx0; cx <= cx1; ++cx)
+			{
+				auto cell = cells_.find(make_key(cx, cy));
+
+				if (cell != cells_.end())
+				{
+					visitor(cell->second);
+				}
+			}
+		}
+	}
+
+	void erase_from_cell(int64_t key, int id, std::vector<int> Cell::* list)
+	{
+		auto cell = cells_.find(key);
+
+		if (cell == cells_.end())
+		{
+			return;
+		}
+
+		std::vector<int>& ids = cell->second.*list;
+		auto iter = std::find(ids.begin(), ids.end(), id);
+
+		if (iter != ids.end())
+		{
+			*iter = ids.back();
+			ids.pop_back();
+		}
+
+		if (cell->second.nodes.empty() && cell->second.links.empty())
+		{
+			cells_.erase(cell);
+		}
+	}
+
+	void move_entry(int id, Entry& entry, const std::vector<int64_t>& new_cells, std::vector<int> Cell::* list)
+	{
+		// Both cell lists are sorted, only the symmetric difference is touched
+		auto old_iter = entry.cells.begin();
+		auto new_iter = new_cells.begin();
+
+		while (old_iter != entry.cells.end() || new_iter != new_cells.end())
+		{
+			if (new_iter == new_cells.end() || (old_iter != entry.cells.end() && *old_iter < *new_iter))
+			{
+				erase_from_cell(*old_iter, id, list);
+				++old_iter;
+			}
+			else if (old_iter == entry.cells.end() || *new_iter < *old_iter)
+			{
+				(cells_[*new_iter].*list).push_back(id);
+				++new_iter;
+			}
+			else
+			{
+				++old_iter;
+				++new_iter;
+			}
+		}
+
+		entry.cells = new_cells;
+	}
+
+	float cell_size_;
+	float inv_cell_size_;
+
+	std::unordered_map<int64_t, Cell> cells_;
+	std::unordered_map<int, Entry> nodes_;
+	std::unordered_map<int, Entry> links_;
+	std::vector<int64_t> scratch_cells_;
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Dynamic topological order (Pearce and Kelly). Every node holds a position, an edge source to
+// target is kept with the source first. An edge that already agrees with the order costs
+// nothing, otherwise only the nodes between the two positions that are reachable from the
+// target or reach the source are visited and swapped among their own positions. Reaching the
+// source from the target means the edge closes a cycle, it is refused before anything moves.
+//
+// The graph is not stored here, the edge functions take visitors over the successors and the
+// predecessors of a node: successors(id, [&](int next) { ... }).
+class TopologicalOrder
+{
+public:
+
+	// Ids are dense and new nodes go last, which keeps the order valid without a visit
+	void add_node(int id)
+	{
+		if (id >= static_cast<int>(position_.size()))
+		{
+			position_.resize(id + 1, -1);
+			marks_.resize(id + 1, 0);
+		}
+
+		position_[id] = static_cast<int>(node_at_.size());
+		node_at_.push_back(id);
+	}
+
+	// The node must have no edges left, its position stays as a hole until the next compaction
+	void remove_node(int id)
+	{
+		node_at_[position_[id]] = -1;
+		position_[id] = -1;
+		holes_++;
+
+		if (holes_ > 1024 && holes_ * 2 > static_cast<int>(node_at_.size()))
+		{
+			compact();
+		}
+	}
+
+	void clear()
+	{
+		position_.clear();
+		node_at_.clear();
+		marks_.clear();
+		holes_ = 0;
+		last_affected_ = 0;
+	}
+
+	int get_position(int id) const { return position_[id]; }
+
+	// Returns false and leaves the order alone when the edge would close a cycle
+	template <typename Successors, typename Predecessors>
+	bool add_edge(int source, int target, Successors&& successors, Predecessors&& predecessors)
+	{
+		last_affected_ = 0;
+
+		if (source == target)
+		{
+			return false;
+		}
+
+		const int lower = position_[target];
+		const int upper = position_[source];
+
+		if (upper < lower)
+		{
+			return true;
+		}
+
+		if (!visit_forward(target, upper, successors, forward_))
+		{
+			return false;
+		}
+
+		visit_backward(source, lower, predecessors, backward_);
+		reorder();
+
+		last_affected_ = static_cast<int>(forward_.size() + backward_.size());
+		affected_total_ += static_cast<uint64_t>(last_affected_);
+		reorders_++;
+
+		return true;
+	}
+
+	// Same test as add_edge without touching the order, for feedback while a link is dragged
+	template <typename Successors>
+	bool would_create_cycle(int source, int target, Successors&& successors)
+	{
+		if (source == target)
+		{
+			return true;
+		}
+
+		if (position_[source] < position_[target])
+		{
+			return false;
+		}
+
+		bool closes = !visit_forward(target, position_[source], successors, forward_);
+
+		if (!closes)
+		{
+			unmark(forward_);
+		}
+
+		return closes;
+	}
+
+	// Nodes visited by the last add_edge, zero when the edge already agreed with the order
+	int get_last_affected() const { return last_affected_; }
+
+	// Edges that had to move nodes and the nodes they moved, since construction
+	uint64_t get_reorder_count() const { return reorders_; }
+	uint64_t get_affected_total() const { return affected_total_; }
+
+	size_t get_memory_bytes() const
+	{
+		return (position_.capacity() + node_at_.capacity() + forward_.capacity() + backward_.capacity() + stack_.capacity() + slots_.capacity()) * sizeof(int) + marks_.capacity();
+	}
+
+	void get_order(std::vector<int>& order) const
+	{
+		order.clear();
+		order.reserve(node_at_.size() - holes_);
+
+		for (int id : node_at_)
+		{
+			if (id != -1)
+			{
+				order.push_back(id);
+			}
+		}
+	}
+
+private:
+
+	// Marks every node reachable from start with a position up to bound into visited. Stops and
+	// clears the marks when the node at bound is reached.
+	template <typename Successors>
+	bool visit_forward(int start, int bound, Successors& successors, std::vector<int>& visited)
+	{
+		visited.clear();
+		stack_.clear();
+
+		stack_.push_back(start);
+		marks_[start] = 1;
+		visited.push_back(start);
+
+		bool found = false;
+
+		while (!stack_.empty() && !found)
+		{
+			int id = stack_.back();
+			stack_.pop_back();
+
+			successors(id, [&](int next)
+			{
+				if (found || marks_[next] || position_[next] > bound)
+				{
+					return;
+				}
+
+				if (position_[next] == bound)
+				{
+					found = true;
+					return;
+				}
+
+				marks_[next] = 1;
+				visited.push_back(next);
+				stack_.push_back(next);
+			});
+		}
+
+		if (found)
+		{
+			unmark(visited);
+			return false;
+		}
+
+		return true;
+	}
+
+	template <typename Predecessors>
+	void visit_backward(int start, int bound, Predecessors& predecessors, std::vector<int>& visited)
+	{
+		visited.clear();
+		stack_.clear();
+
+		stack_.push_back(start);
+		marks_[start] = 1;
+		visited.push_back(start);
+
+		while (!stack_.empty())
+		{
+			int id = stack_.back();
+			stack_.pop_back();
+
+			predecessors(id, [&](int previous)
+			{
+				if (marks_[previous] || position_[previous] < bound)
+				{
+					return;
+				}
+
+				marks_[previous] = 1;
+				visited.push_back(previous);
+				stack_.push_back(previous);
+			});
+		}
+	}
+
+	// The two sets keep their inner order, the backward one takes the lowest of their
+	// pooled positions so everything reaching the source lands before the target
+	void reorder()
+	{
+		auto by_position = [this](int a, int b) { return position_[a] < position_[b]; };
+		std::sort(forward_.begin(), forward_.end(), by_position);
+		std::sort(backward_.begin(), backward_.end(), by_position);
+
+		slots_.clear();
+
+		for (int id : backward_)
+		{
+			slots_.push_back(position_[id]);
+		}
+
+		for (int id : forward_)
+		{
+			slots_.push_back(position_[id]);
+		}
+
+		std::sort(slots_.begin(), slots_.end());
+
+		size_t slot = 0;
+
+		for (int id : backward_)
+		{
+			place(id, slots_[slot++]);
+		}
+
+		for (int id : forward_)
+		{
+			place(id, slots_[slot++]);
+		}
+
+		unmark(forward_);
+		unmark(backward_);
+	}
+
+	void place(int id, int position)
+	{
+		position_[id] = position;
+		node_at_[position] = id;
+	}
+
+	void unmark(const std::vector<int>& ids)
+	{
+		for (int id : ids)
+		{
+			marks_[id] = 0;
+		}
+	}
+
+	void compact()
+	{
+		int next = 0;
+
+		for (int id : node_at_)
+		{
+			if (id != -1)
+			{
+				place(id, next++);
+			}
+		}
+
+		node_at_.resize(next);
+		holes_ = 0;
+	}
+
+	std::vector<int> position_;
+	std::vector<int> node_at_;
+	std::vector<uint8_t> marks_;
+	int holes_ = 0;
+
+	// Scratch kept between edges so a drag does not allocate
+	std::vector<int> forward_;
+	std::vector<int> backward_;
+	std::vector<int> stack_;
+	std::vector<int> slots_;
+
+	int last_affected_ = 0;
+	uint64_t reorders_ = 0;
+	uint64_t affected_total_ = 0;
+};
@@ -0,0 +1,404 @@
+#include "hrs_frame_publisher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t align_up(size_t value)
+{
+	return (value + kSharedFrameAlignment - 1) & ~(kSharedFrameAlignment - 1);
+}
+
+int64_t get_shared_frame_clock_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+static std::string get_mapping_name(const std::string& name)
+{
+	return "Local\\" + (name.empty() || name[0] != '/' ? name : name.substr(1));
+}
+#else
+// A ring whose editor closed it or is no longer running. Memory that is not a ring, or a ring
+// of another version still open, is never taken for stale.
+static bool is_stale_ring(const std::string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info = {};
+	bool is_stale = false;
+
+	if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(SharedFrameHeader)))
+	{
+		void* memory = mmap(nullptr, sizeof(SharedFrameHeader), PROT_READ, MAP_SHARED, fd, 0);
+
+		if (memory != MAP_FAILED)
+		{
+			const SharedFrameHeader* header = static_cast<const SharedFrameHeader*>(memory);
+
+			if (header->magic == kSharedFrameMagic)
+			{
+				if (!header->is_open.load(std::memory_order_acquire))
+				{
+					is_stale = true;
+				}
+				else if (header->version == kSharedFrameVersion)
+				{
+					is_stale = kill(static_cast<pid_t>(header->owner_pid), 0) != 0 && errno == ESRCH;
+				}
+			}
+
+			munmap(memory, sizeof(SharedFrameHeader));
+		}
+	}
+
+	::close(fd);
+
+	return is_stale;
+}
+#endif
+
+FramePublisher::~FramePublisher()
+{
+	close();
+}
+
+bool FramePublisher::open(const std::string& name, size_t max_frame_bytes, int slot_count)
+{
+	close();
+
+	slot_count = std::max(slot_count, 2);
+
+	const size_t pixel_offset = align_up(sizeof(SharedFrameSlot));
+	const size_t slot_stride = pixel_offset + align_up(max_frame_bytes);
+	const size_t mapped_bytes = align_up(sizeof(SharedFrameHeader)) + slot_stride * slot_count;
+
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(static_cast<uint64_t>(mapped_bytes) >> 32), static_cast<DWORD>(mapped_bytes), get_mapping_name(name).c_str());
+
+	if (!mapping)
+	{
+		std::cout << "Error: cannot create frame mapping " << name << " (" << GetLastError() << ")" << std::endl;
+		return false;
+	}
+
+	// Windows drops a mapping with its last handle, so an existing one is held by a running
+	// process: another editor, or readers of a crashed one that have to let go first
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		std::cout << "Error: frame mapping " << name << " is in use by another process" << std::endl;
+		CloseHandle(mapping);
+		return false;
+	}
+
+	void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mapped_bytes);
+
+	if (!memory)
+	{
+		std::cout << "Error: cannot map frame mapping " << name << " (" << GetLastError() << ")" << std::endl;
+		CloseHandle(mapping);
+		return false;
+	}
+
+	mapping_ = mapping;
+#else
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+	// A previous run that crashed leaves its ring behind, only that one is removed
+	if (fd < 0 && errno == EEXIST && is_stale_ring(name))
+	{
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+
+	if (fd < 0)
+	{
+		std::cout << "Error: cannot create shared memory " << name << (errno == EEXIST ? ", another editor publishes under it" : "") << std::endl;
+		return false;
+	}
+
+	// Pages are only committed once written, a generous max_frame_bytes costs little
+	if (ftruncate(fd, static_cast<off_t>(mapped_bytes)) != 0)
+	{
+		std::cout << "Error: cannot size shared memory " << name << std::endl;
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (memory == MAP_FAILED)
+	{
+		std::cout << "Error: cannot map shared memory " << name << std::endl;
+		shm_unlink(name.c_str());
+		return false;
+	}
+#endif
+
+	name_ = name;
+	mapped_bytes_ = mapped_bytes;
+	slot_count_ = slot_count;
+	frame_ = 0;
+
+	header_ = new (memory) SharedFrameHeader();
+	header_->magic = kSharedFrameMagic;
+	header_->version = kSharedFrameVersion;
+	header_->slot_count = static_cast<uint32_t>(slot_count);
+	header_->pixel_offset = static_cast<uint32_t>(pixel_offset);
+	header_->slot_stride = slot_stride;
+	header_->max_frame_bytes = slot_stride - pixel_offset;
+	header_->latest.store(0, std::memory_order_relaxed);
+#ifdef _WIN32
+	header_->owner_pid = static_cast<uint32_t>(GetCurrentProcessId());
+#else
+	header_->owner_pid = static_cast<uint32_t>(getpid());
+#endif
+
+	for (int i = 0; i < slot_count; ++i)
+	{
+		new (get_slot(i)) SharedFrameSlot();
+		get_slot(i)->sequence.store(0, std::memory_order_relaxed);
+	}
+
+	header_->is_open.store(1, std::memory_order_release);
+
+	stats_ = {};
+	stats_.mapped_bytes = mapped_bytes;
+
+	return true;
+}
+
+void FramePublisher::close()
+{
+	if (!header_)
+	{
+		return;
+	}
+
+	header_->is_open.store(0, std::memory_order_release);
+
+#ifdef _WIN32
+	UnmapViewOfFile(header_);
+	CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+	munmap(header_, mapped_bytes_);
+	shm_unlink(name_.c_str());
+#endif
+
+	header_ = nullptr;
+	mapping_ = nullptr;
+	writing_ = nullptr;
+	mapped_bytes_ = 0;
+}
+
+SharedFrameSlot* FramePublisher::get_slot(uint64_t frame) const
+{
+	char* slots = reinterpret_cast<char*>(header_) + align_up(sizeof(SharedFrameHeader));
+	return reinterpret_cast<SharedFrameSlot*>(slots + (frame % slot_count_) * header_->slot_stride);
+}
+
+void* FramePublisher::begin_frame(int width, int height, size_t bytes)
+{
+	if (!header_)
+	{
+		return nullptr;
+	}
+
+	if (bytes > header_->max_frame_bytes)
+	{
+		stats_.skipped++;
+		return nullptr;
+	}
+
+	frame_++;
+	writing_ = get_slot(frame_);
+
+	// Odd until end_frame, a reader still on the slot sees it move and drops its frame
+	writing_->sequence.store(frame_ * 2 - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	writing_->width = static_cast<uint32_t>(width);
+	writing_->height = static_cast<uint32_t>(height);
+	writing_->format = SharedFrameFormat::RGBA32F;
+	writing_->bytes = bytes;
+
+	return reinterpret_cast<char*>(writing_) + header_->pixel_offset;
+}
+
+void FramePublisher::end_frame(int sample_count, int64_t render_ns)
+{
+	if (!writing_)
+	{
+		return;
+	}
+
+	const int64_t end_ns = get_shared_frame_clock_ns();
+
+	writing_->sample_count = static_cast<uint32_t>(std::max(sample_count, 0));
+	writing_->render_ns = render_ns;
+	writing_->publish_ns = end_ns;
+	writing_->sequence.store(frame_ * 2, std::memory_order_release);
+	header_->latest.store(frame_, std::memory_order_release);
+
+	writing_ = nullptr;
+
+	const float ms = static_cast<float>((end_ns - render_ns) / 1e6);
+	stats_.frames++;
+	stats_.last_ms = ms;
+	stats_.max_ms = std::max(stats_.max_ms, ms);
+	stats_.average_ms += (ms - stats_.average_ms) / static_cast<float>(std::min<uint64_t>(stats_.frames, 100));
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+	close();
+}
+
+bool FrameSubscriber::open(const std::string& name)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, get_mapping_name(name).c_str());
+
+	if (!mapping)
+	{
+		return false;
+	}
+
+	void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!memory)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info = {};
+	VirtualQuery(memory, &info, sizeof(info));
+
+	mapping_ = mapping;
+	mapped_bytes_ = info.RegionSize;
+#else
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info = {};
+
+	if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SharedFrameHeader)))
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* memory = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (memory == MAP_FAILED)
+	{
+		return false;
+	}
+
+	mapped_bytes_ = static_cast<size_t>(info.st_size);
+#endif
+
+	header_ = static_cast<const SharedFrameHeader*>(memory);
+
+	if (header_->magic != kSharedFrameMagic || header_->version != kSharedFrameVersion)
+	{
+		std::cout << "Error: " << name << " is not a frame ring of version " << kSharedFrameVersion << std::endl;
+		close();
+		return false;
+	}
+
+	last_ = 0;
+	acquired_ = 0;
+	missed_ = 0;
+
+	return true;
+}
+
+void FrameSubscriber::close()
+{
+	if (!header_)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(header_);
+	CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+	munmap(const_cast<SharedFrameHeader*>(header_), mapped_bytes_);
+#endif
+
+	header_ = nullptr;
+	mapping_ = nullptr;
+	mapped_bytes_ = 0;
+}
+
+const SharedFrameSlot* FrameSubscriber::acquire()
+{
+	if (!header_ || !header_->is_open.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+
+	const uint64_t latest = header_->latest.load(std::memory_order_acquire);
+
+	if (latest == last_)
+	{
+		return nullptr;
+	}
+
+	const char* slots = reinterpret_cast<const char*>(header_) + align_up(sizeof(SharedFrameHeader));
+	const SharedFrameSlot* slot = reinterpret_cast<const SharedFrameSlot*>(slots + (latest % header_->slot_count) * header_->slot_stride);
+
+	// Already reused by a newer frame, that one is picked up next call
+	if (slot->sequence.load(std::memory_order_acquire) != latest * 2)
+	{
+		return nullptr;
+	}
+
+	// A converged render publishes nothing more, so the first call takes whatever is there
+	if (last_ != 0)
+	{
+		missed_ += latest - last_ - 1;
+	}
+
+	last_ = latest;
+	acquired_ = latest * 2;
+
+	return slot;
+}
+
+bool FrameSubscriber::is_valid(const SharedFrameSlot* slot) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->sequence.load(std::memory_order_relaxed) == acquired_;
+}
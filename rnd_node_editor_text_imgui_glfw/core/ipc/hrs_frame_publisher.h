@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Layout of the shared frame ring, kept plain so external tools can include this header alone.
+// One SharedFrameHeader padded to kSharedFrameAlignment, then slot_count slots of slot_stride
+// bytes, each a SharedFrameSlot with the pixels at pixel_offset.
+// A slot's sequence is odd while the editor writes it and twice the frame number once complete,
+// readers check it before and after using the pixels and drop the frame when it moved.
+constexpr uint32_t kSharedFrameMagic = 0x46535248; // "HRSF"
+constexpr uint32_t kSharedFrameVersion = 2;
+
+enum class SharedFrameFormat : uint32_t
+{
+	// Linear radiance, the display transform is left to the reader
+	RGBA32F = 1
+};
+
+struct SharedFrameHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t pixel_offset;
+	uint64_t slot_stride;
+	uint64_t max_frame_bytes;
+
+	// Number of the last complete frame, zero before the first
+	std::atomic<uint64_t> latest;
+
+	// Cleared when the editor closes or grows the ring, readers map it again
+	std::atomic<uint32_t> is_open;
+
+	// Process of the editor that created the ring, one left by an editor that is gone is stale
+	uint32_t owner_pid;
+};
+
+struct SharedFrameSlot
+{
+	std::atomic<uint64_t> sequence;
+	uint32_t width;
+	uint32_t height;
+	SharedFrameFormat format;
+	uint32_t sample_count;
+	uint64_t bytes;
+
+	// steady_clock nanoseconds, the clock is system wide so readers can measure latency.
+	// render_ns is when the samples of the frame were done, publish_ns when it became readable.
+	int64_t render_ns;
+	int64_t publish_ns;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared frame ring needs address free atomics");
+
+constexpr size_t kSharedFrameAlignment = 64;
+
+struct FramePublisherStats
+{
+	uint64_t frames = 0;
+	uint64_t skipped = 0;
+	size_t mapped_bytes = 0;
+
+	// From the end of the render pass to the frame being readable: resolve, readback and copy
+	float last_ms = 0.0f;
+	float average_ms = 0.0f;
+	float max_ms = 0.0f;
+};
+
+// Writes the viewer frames into the ring. Never waits on readers: slots are reused round robin
+// and a reader too slow for slot_count frames only sees its frame dropped.
+// RPR reads the frame buffer straight into the slot between begin_frame and end_frame, the
+// viewer texture is then uploaded from the same memory.
+class FramePublisher
+{
+public:
+
+	FramePublisher() = default;
+	~FramePublisher();
+
+	FramePublisher(const FramePublisher&) = delete;
+	FramePublisher& operator=(const FramePublisher&) = delete;
+
+	// name is "/hrs_frames" style, mapped as Local\hrs_frames on Windows. Fails when another
+	// editor publishes under the name, a ring left behind by one that crashed is replaced.
+	bool open(const std::string& name, size_t max_frame_bytes, int slot_count = 3);
+	void close();
+
+	bool is_open() const { return header_ != nullptr; }
+	const std::string& get_name() const { return name_; }
+	size_t get_max_frame_bytes() const { return header_ ? static_cast<size_t>(header_->max_frame_bytes) : 0; }
+
+	// Pixel memory of the next slot, nullptr when closed or the frame does not fit. render_ns is
+	// get_shared_frame_clock_ns() when the pass that rendered the frame ended.
+	void* begin_frame(int width, int height, size_t bytes);
+	void end_frame(int sample_count, int64_t render_ns);
+
+	// Number of the last frame begun, and the frame its slot held before, zero when the slot
+	// was never written. Pixels written since that frame are still in the slot.
+	uint64_t get_frame() const { return frame_; }
+	uint64_t get_overwritten_frame() const { return frame_ > static_cast<uint64_t>(slot_count_) ? frame_ - slot_count_ : 0; }
+
+	const FramePublisherStats& get_stats() const { return stats_; }
+
+private:
+
+	SharedFrameSlot* get_slot(uint64_t frame) const;
+
+	std::string name_;
+	SharedFrameHeader* header_ = nullptr;
+	size_t mapped_bytes_ = 0;
+	int slot_count_ = 0;
+	void* mapping_ = nullptr;
+
+	uint64_t frame_ = 0;
+	SharedFrameSlot* writing_ = nullptr;
+
+	FramePublisherStats stats_;
+};
+
+// Read-only view of a ring for consumers, no copy is made: the pixels stay valid until
+// is_valid() says the editor has reused the slot
+class FrameSubscriber
+{
+public:
+
+	FrameSubscriber() = default;
+	~FrameSubscriber();
+
+	FrameSubscriber(const FrameSubscriber&) = delete;
+	FrameSubscriber& operator=(const FrameSubscriber&) = delete;
+
+	bool open(const std::string& name);
+	void close();
+
+	// Latest complete frame newer than the last one returned, nullptr otherwise or when the
+	// editor closed the ring
+	const SharedFrameSlot* acquire();
+	const void* get_pixels(const SharedFrameSlot* slot) const { return reinterpret_cast<const char*>(slot) + header_->pixel_offset; }
+	bool is_valid(const SharedFrameSlot* slot) const;
+
+	// Frames the editor published that this reader never saw
+	uint64_t get_missed() const { return missed_; }
+
+private:
+
+	const SharedFrameHeader* header_ = nullptr;
+	size_t mapped_bytes_ = 0;
+	void* mapping_ = nullptr;
+
+	uint64_t last_ = 0;
+	uint64_t acquired_ = 0;
+	uint64_t missed_ = 0;
+};
+
+int64_t get_shared_frame_clock_ns();
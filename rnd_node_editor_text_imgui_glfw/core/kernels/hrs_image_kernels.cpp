@@ -0,0 +1,186 @@
+#include "hrs_image_kernels.h"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "hrs_image_kernels_impl.inl"
+
+KernelTable make_kernel_table_sse41();
+KernelTable make_kernel_table_avx2();
+
+static KernelIsa kernel_isa = detect_kernel_isa();
+
+KernelIsa detect_kernel_isa()
+{
+#if defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool has_sse41 = (info[2] & (1 << 19)) != 0;
+	bool has_fma = (info[2] & (1 << 12)) != 0;
+	bool has_avx = (info[2] & (1 << 28)) != 0;
+	bool has_osxsave = (info[2] & (1 << 27)) != 0;
+
+	// The OS must save the YMM registers too
+	bool has_avx2 = false;
+
+	if (max_leaf >= 7 && has_avx && has_fma && has_osxsave && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		has_avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool has_sse41 = __builtin_cpu_supports("sse4.1");
+	bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+
+	if (has_avx2)
+	{
+		return KernelIsa::Avx2;
+	}
+
+	return has_sse41 ? KernelIsa::Sse41 : KernelIsa::Scalar;
+}
+
+KernelIsa get_kernel_isa()
+{
+	return kernel_isa;
+}
+
+void set_kernel_isa(KernelIsa isa)
+{
+	// Never pick a path the CPU cannot run
+	kernel_isa = std::min(isa, detect_kernel_isa());
+}
+
+const char* get_kernel_isa_name(KernelIsa isa)
+{
+	switch (isa)
+	{
+	case KernelIsa::Sse41: return "SSE4.1";
+	case KernelIsa::Avx2: return "AVX2";
+	default: return "Scalar";
+	}
+}
+
+const KernelTable& get_kernel_table(KernelIsa isa)
+{
+	static const KernelTable scalar_table = make_table<VecScalar>();
+	static const KernelTable sse41_table = make_kernel_table_sse41();
+	static const KernelTable avx2_table = make_kernel_table_avx2();
+
+	switch (isa)
+	{
+	case KernelIsa::Sse41: return sse41_table;
+	case KernelIsa::Avx2: return avx2_table;
+	default: return scalar_table;
+	}
+}
+
+static KernelSpan make_span(PlanarImage& image, const PlanarImage* other, int x, int y, int count)
+{
+	size_t offset = static_cast<size_t>(y) * image.width + x;
+
+	KernelSpan span;
+	span.r = image.get_plane(0) + offset;
+	span.g = image.get_plane(1) + offset;
+	span.b = image.get_plane(2) + offset;
+	span.other_r = other ? other->get_plane(0) + offset : nullptr;
+	span.other_g = other ? other->get_plane(1) + offset : nullptr;
+	span.other_b = other ? other->get_plane(2) + offset : nullptr;
+	span.x = x;
+	span.y = y;
+	span.count = count;
+	span.width = image.width;
+	span.height = image.height;
+
+	return span;
+}
+
+void run_kernel(KernelOp op, const KernelParams& params, PlanarImage& image, const PlanarImage* other)
+{
+	KernelChain chain;
+	chain.add(op, params, other);
+	chain.run(image, 1);
+}
+
+void KernelChain::run_tiles(PlanarImage& image, const KernelTable& table, std::atomic<int>& next_tile) const
+{
+	const int tiles_per_row = (image.width + kTilePixels - 1) / kTilePixels;
+	const int tile_count = tiles_per_row * image.height;
+	const int stage_count = static_cast<int>(stages_.size());
+
+	std::vector<KernelStage> stages(stage_count);
+
+	for (int k = 0; k < stage_count; ++k)
+	{
+		stages[k].op = stages_[k].op;
+		stages[k].params = &stages_[k].params;
+	}
+
+	// A few tiles per grab keeps the counter off the hot path
+	const int batch = 8;
+
+	for (int first = next_tile.fetch_add(batch); first < tile_count; first = next_tile.fetch_add(batch))
+	{
+		for (int tile = first; tile < std::min(first + batch, tile_count); ++tile)
+		{
+			const int y = tile / tiles_per_row;
+			const int x = (tile % tiles_per_row) * kTilePixels;
+			const int count = std::min(kTilePixels, image.width - x);
+
+			for (int k = 0; k < stage_count; ++k)
+			{
+				stages[k].span = make_span(image, stages_[k].other, x, y, count);
+			}
+
+			table.chain(stages.data(), stage_count);
+		}
+	}
+}
+
+void KernelChain::run(PlanarImage& image, int thread_count) const
+{
+	if (stages_.empty() || image.width <= 0 || image.height <= 0)
+	{
+		return;
+	}
+
+	const KernelTable& table = get_kernel_table(get_kernel_isa());
+
+	if (thread_count <= 0)
+	{
+		thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+
+	// Below a few rows per thread the spawn costs more than it saves
+	thread_count = std::min(thread_count, std::max(1, image.height / 16));
+
+	std::atomic<int> next_tile = 0;
+
+	std::vector<std::thread> workers;
+	workers.reserve(thread_count - 1);
+
+	for (int t = 1; t < thread_count; ++t)
+	{
+		workers.emplace_back([this, &image, &table, &next_tile]()
+			{
+				run_tiles(image, table, next_tile);
+			});
+	}
+
+	run_tiles(image, table, next_tile);
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
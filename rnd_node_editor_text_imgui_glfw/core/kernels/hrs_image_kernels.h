@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Planar RGB float image, one contiguous plane per channel
+struct PlanarImage
+{
+	int width = 0;
+	int height = 0;
+	std::vector<float> planes[3];
+
+	void resize(int new_width, int new_height)
+	{
+		width = new_width;
+		height = new_height;
+
+		for (auto& plane : planes)
+		{
+			plane.resize(static_cast<size_t>(width) * height);
+		}
+	}
+
+	float* get_plane(int channel) { return planes[channel].data(); }
+	const float* get_plane(int channel) const { return planes[channel].data(); }
+};
+
+enum class KernelIsa
+{
+	Scalar,
+	Sse41,
+	Avx2
+};
+
+enum class KernelOp
+{
+	// Generators, overwrite the span
+	Gradient,
+	Noise,
+
+	// Point operations, transform the span in place
+	Blend,
+	HsvAdjust,
+	Levels,
+
+	Count
+};
+
+enum class BlendMode
+{
+	Mix,
+	Multiply,
+	Screen,
+	Add
+};
+
+// Gradient  : r0 g0 b0 r1 g1 b1 dir_x dir_y
+// Noise     : frequency r0 g0 b0 r1 g1 b1, seed
+// Blend     : factor, mode, second image in KernelSpan::other
+// HsvAdjust : hue_shift (turns) saturation value
+// Levels    : in_black in_white gamma out_black out_white
+struct KernelParams
+{
+	float values[8] = {};
+	uint32_t seed = 0;
+	BlendMode mode = BlendMode::Mix;
+};
+
+// A run of pixels on one row, the unit every kernel works on
+struct KernelSpan
+{
+	float* r;
+	float* g;
+	float* b;
+	const float* other_r;
+	const float* other_g;
+	const float* other_b;
+	int x;
+	int y;
+	int count;
+	int width;
+	int height;
+};
+
+using KernelFunction = void (*)(const KernelSpan& span, const KernelParams& params);
+
+// One stage of a fused run, every stage covers the same pixels and only other differs
+struct KernelStage
+{
+	KernelOp op;
+	const KernelParams* params;
+	KernelSpan span;
+};
+
+// Runs the stages on the span of the first one, each block of pixels is loaded once, goes
+// through every stage while it sits in L1 and is stored once
+using KernelChainFunction = void (*)(const KernelStage* stages, int stage_count);
+
+struct KernelTable
+{
+	KernelFunction functions[static_cast<int>(KernelOp::Count)];
+	KernelChainFunction chain;
+};
+
+KernelIsa detect_kernel_isa();
+KernelIsa get_kernel_isa();
+void set_kernel_isa(KernelIsa isa);
+const char* get_kernel_isa_name(KernelIsa isa);
+const KernelTable& get_kernel_table(KernelIsa isa);
+
+// Single kernel over a whole image, other is only read by Blend
+void run_kernel(KernelOp op, const KernelParams& params, PlanarImage& image, const PlanarImage* other = nullptr);
+
+// Adjacent nodes fused into one pass: a pixel is read from the image once, goes through every
+// stage in a block that stays in L1 and is written once. Threads take tiles from a shared counter.
+class KernelChain
+{
+public:
+
+	void clear() { stages_.clear(); }
+
+	void add(KernelOp op, const KernelParams& params, const PlanarImage* other = nullptr)
+	{
+		stages_.push_back({ op, params, other });
+	}
+
+	size_t get_stage_count() const { return stages_.size(); }
+
+	void run(PlanarImage& image, int thread_count = 0) const;
+
+	// Pixels per tile, the unit a thread takes
+	static constexpr int kTilePixels = 1024;
+
+private:
+
+	struct Stage
+	{
+		KernelOp op;
+		KernelParams params;
+		const PlanarImage* other;
+	};
+
+	void run_tiles(PlanarImage& image, const KernelTable& table, std::atomic<int>& next_tile) const;
+
+	std::vector<Stage> stages_;
+};
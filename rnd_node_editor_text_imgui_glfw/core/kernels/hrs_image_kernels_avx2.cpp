@@ -0,0 +1,90 @@
+#include "hrs_image_kernels.h"
+
+#include <immintrin.h>
+
+#include "hrs_image_kernels_impl.inl"
+
+namespace
+{
+
+struct VecAvx
+{
+	static constexpr int kWidth = 8;
+
+	using Mask = __m256;
+
+	__m256 v;
+
+	static VecAvx load(const float* p) { return { _mm256_loadu_ps(p) }; }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+	static VecAvx set1(float x) { return { _mm256_set1_ps(x) }; }
+	static VecAvx iota(float start) { return { _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)) }; }
+
+	friend VecAvx operator+(VecAvx a, VecAvx b) { return { _mm256_add_ps(a.v, b.v) }; }
+	friend VecAvx operator-(VecAvx a, VecAvx b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	friend VecAvx operator*(VecAvx a, VecAvx b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	friend VecAvx operator/(VecAvx a, VecAvx b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+	static VecAvx min(VecAvx a, VecAvx b) { return { _mm256_min_ps(a.v, b.v) }; }
+	static VecAvx max(VecAvx a, VecAvx b) { return { _mm256_max_ps(a.v, b.v) }; }
+	static VecAvx floor(VecAvx a) { return { _mm256_floor_ps(a.v) }; }
+	static Mask lt(VecAvx a, VecAvx b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	static Mask eq(VecAvx a, VecAvx b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	static VecAvx select(Mask m, VecAvx a, VecAvx b) { return { _mm256_blendv_ps(b.v, a.v, m) }; }
+
+	// Same approximation as the SSE path, fused multiply-adds for the polynomials
+	static VecAvx pow(VecAvx a, float e)
+	{
+		__m256i bits = _mm256_castps_si256(a.v);
+		__m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+		__m256 m = _mm256_or_ps(_mm256_castsi256_ps(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff))), _mm256_set1_ps(1.0f));
+
+		__m256 p = _mm256_set1_ps(-3.4436006e-2f);
+		p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(3.1821337e-1f));
+		p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(-1.2315303f));
+		p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(2.5988452f));
+		p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(-3.3241990f));
+		p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(3.1157899f));
+		__m256 log2_x = _mm256_add_ps(_mm256_mul_ps(p, _mm256_sub_ps(m, _mm256_set1_ps(1.0f))), exponent);
+
+		__m256 y = _mm256_mul_ps(log2_x, _mm256_set1_ps(e));
+		y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+
+		__m256 yi = _mm256_floor_ps(y);
+		__m256 f = _mm256_sub_ps(y, yi);
+
+		__m256 q = _mm256_set1_ps(1.8775767e-3f);
+		q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(8.9893397e-3f));
+		q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(5.5826318e-2f));
+		q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(2.4015361e-1f));
+		q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(6.9315308e-1f));
+		q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(9.9999994e-1f));
+
+		__m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(yi), _mm256_set1_epi32(127)), 23));
+		__m256 result = _mm256_mul_ps(q, scale);
+
+		// log2(0) is not -inf with the bit trick, pin zero explicitly
+		return { _mm256_and_ps(result, _mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ)) };
+	}
+
+	static VecAvx hash01(VecAvx x, VecAvx y, uint32_t seed)
+	{
+		__m256i h = _mm256_xor_si256(
+			_mm256_mullo_epi32(_mm256_cvttps_epi32(x.v), _mm256_set1_epi32(static_cast<int>(0x8da6b343u))),
+			_mm256_mullo_epi32(_mm256_cvttps_epi32(y.v), _mm256_set1_epi32(static_cast<int>(0xd8163841u))));
+		h = _mm256_xor_si256(h, _mm256_set1_epi32(static_cast<int>(seed * 0xcb1ab31fu)));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+		h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x5bd1e995));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+
+		__m256 n = _mm256_cvtepi32_ps(_mm256_and_si256(h, _mm256_set1_epi32(0xffffff)));
+		return { _mm256_mul_ps(n, _mm256_set1_ps(1.0f / 16777216.0f)) };
+	}
+};
+
+}
+
+KernelTable make_kernel_table_avx2()
+{
+	return make_table<VecAvx>();
+}
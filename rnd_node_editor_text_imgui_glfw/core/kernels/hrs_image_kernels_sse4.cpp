@@ -0,0 +1,90 @@
+#include "hrs_image_kernels.h"
+
+#include <smmintrin.h>
+
+#include "hrs_image_kernels_impl.inl"
+
+namespace
+{
+
+struct VecSse
+{
+	static constexpr int kWidth = 4;
+
+	using Mask = __m128;
+
+	__m128 v;
+
+	static VecSse load(const float* p) { return { _mm_loadu_ps(p) }; }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+	static VecSse set1(float x) { return { _mm_set1_ps(x) }; }
+	static VecSse iota(float start) { return { _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)) }; }
+
+	friend VecSse operator+(VecSse a, VecSse b) { return { _mm_add_ps(a.v, b.v) }; }
+	friend VecSse operator-(VecSse a, VecSse b) { return { _mm_sub_ps(a.v, b.v) }; }
+	friend VecSse operator*(VecSse a, VecSse b) { return { _mm_mul_ps(a.v, b.v) }; }
+	friend VecSse operator/(VecSse a, VecSse b) { return { _mm_div_ps(a.v, b.v) }; }
+
+	static VecSse min(VecSse a, VecSse b) { return { _mm_min_ps(a.v, b.v) }; }
+	static VecSse max(VecSse a, VecSse b) { return { _mm_max_ps(a.v, b.v) }; }
+	static VecSse floor(VecSse a) { return { _mm_floor_ps(a.v) }; }
+	static Mask lt(VecSse a, VecSse b) { return _mm_cmplt_ps(a.v, b.v); }
+	static Mask eq(VecSse a, VecSse b) { return _mm_cmpeq_ps(a.v, b.v); }
+	static VecSse select(Mask m, VecSse a, VecSse b) { return { _mm_blendv_ps(b.v, a.v, m) }; }
+
+	// 2^(e * log2(x)) with 5th order polynomials, x >= 0
+	static VecSse pow(VecSse a, float e)
+	{
+		__m128i bits = _mm_castps_si128(a.v);
+		__m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+		__m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+
+		__m128 p = _mm_set1_ps(-3.4436006e-2f);
+		p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.1821337e-1f));
+		p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-1.2315303f));
+		p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.5988452f));
+		p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-3.3241990f));
+		p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.1157899f));
+		__m128 log2_x = _mm_add_ps(_mm_mul_ps(p, _mm_sub_ps(m, _mm_set1_ps(1.0f))), exponent);
+
+		__m128 y = _mm_mul_ps(log2_x, _mm_set1_ps(e));
+		y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+
+		__m128 yi = _mm_floor_ps(y);
+		__m128 f = _mm_sub_ps(y, yi);
+
+		__m128 q = _mm_set1_ps(1.8775767e-3f);
+		q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(8.9893397e-3f));
+		q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(5.5826318e-2f));
+		q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(2.4015361e-1f));
+		q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(6.9315308e-1f));
+		q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(9.9999994e-1f));
+
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(yi), _mm_set1_epi32(127)), 23));
+		__m128 result = _mm_mul_ps(q, scale);
+
+		// log2(0) is not -inf with the bit trick, pin zero explicitly
+		return { _mm_and_ps(result, _mm_cmpgt_ps(a.v, _mm_setzero_ps())) };
+	}
+
+	static VecSse hash01(VecSse x, VecSse y, uint32_t seed)
+	{
+		__m128i h = _mm_xor_si128(
+			_mm_mullo_epi32(_mm_cvttps_epi32(x.v), _mm_set1_epi32(static_cast<int>(0x8da6b343u))),
+			_mm_mullo_epi32(_mm_cvttps_epi32(y.v), _mm_set1_epi32(static_cast<int>(0xd8163841u))));
+		h = _mm_xor_si128(h, _mm_set1_epi32(static_cast<int>(seed * 0xcb1ab31fu)));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+		h = _mm_mullo_epi32(h, _mm_set1_epi32(0x5bd1e995));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+
+		__m128 n = _mm_cvtepi32_ps(_mm_and_si128(h, _mm_set1_epi32(0xffffff)));
+		return { _mm_mul_ps(n, _mm_set1_ps(1.0f / 16777216.0f)) };
+	}
+};
+
+}
+
+KernelTable make_kernel_table_sse41()
+{
+	return make_table<VecSse>();
+}
@@ -1,7 +1,10 @@
 
 #include <array>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
 
-#include "GLAD/glad.h"
+#include "glad/glad.h"
 
 #include <iostream>
 #include <mutex>
@@ -20,6 +23,21 @@
 #include "hrs_shader_manager.h"
 
 #include "node_editor.hpp"
+#include "editor/hrs_input_replay.h"
+#include "editor/hrs_preview_service.h"
+#include "editor/hrs_startup_loader.h"
+#include "ipc/hrs_frame_publisher.h"
+#include "memory/hrs_allocation_tracker.h"
+#include "memory/hrs_frame_arena.h"
+#include "memory/hrs_memory_ledger.h"
+#include "radeon/hrs_demo_scene.h"
+#include "radeon/hrs_image_cache.h"
+#include "radeon/hrs_instancer.h"
+#include "radeon/hrs_render_region.h"
+#include "radeon/hrs_scene_transaction.h"
+#include "render/hrs_cpu_backend.h"
+#include "render/hrs_render_checkpoint.h"
+#include "render/hrs_rpr_backend.h"
 
 using namespace std;
 
@@ -27,13 +45,28 @@ int m_window_width_ = 1280;
 int m_window_height_ = 800;
 
 GLFWwindow* window;
+const char* m_glsl_version_ = "#version 460";
+
+// HRS_RECORD_INPUT=file records the UI input. HRS_REPLAY_INPUT=file replays it, writes the
+// frame times to HRS_REPLAY_REPORT (file.json by default) and checks them against
+// HRS_REPLAY_BASELINE. Both start once the renderer is up so they see the same UI.
+InputRecorder m_input_recorder_;
+InputReplay m_input_replay_;
+FrameTimer m_frame_timer_;
+bool m_input_started_ = false;
+int m_replay_regressions_ = 0;
+bool m_replay_diverged_ = false;
 RPRGarbageCollector g_gc;
 rpr_context context = nullptr;
 rpr_material_system materialSystem = nullptr;
 
+// The viewer renders through m_backend_, RPR on the startup context owning the framebuffers,
+// or the CPU reference path tracer, created only while it is picked in the Scene panel
+std::unique_ptr<RprRenderBackend> m_rpr_backend_;
+std::unique_ptr<CpuRenderBackend> m_cpu_backend_;
+RenderBackend* m_backend_ = nullptr;
+
 // Radeon Buffers and Textures
-rpr_framebuffer m_frame_buffer_ = nullptr;
-rpr_framebuffer m_frame_buffer_2_ = nullptr;
 GLuint m_program_;
 GLuint m_texture_buffer_ = 0;
 GLuint m_vertex_buffer_id_ = 0;
@@ -41,18 +74,118 @@ GLuint m_index_buffer_id_ = 0;
 GLuint m_up_buffer_ = 0;
 ShaderManager m_shader_manager_;
 
+// The renderer accumulates linear radiance, the viewer shows m_display_texture_ drawn from it
+// by shader.frag. Display settings only redraw that texture, the render carries on.
+struct DisplaySettings
+{
+	float exposure = 0.0f;
+	int curve = 0;
+	int output = 0;
+	float gamma = 2.2f;
+	int view = 0;
+};
+
+DisplaySettings m_display_;
+GLuint m_display_texture_ = 0;
+GLuint m_display_fbo_ = 0;
+bool m_display_dirty_ = true;
+
 bool m_thread_running_ = false;
 bool m_is_dirty_;
-std::shared_ptr<float> m_fb_data_ = nullptr;
+// Grows only, going back to a smaller viewer reuses the allocation
+std::vector<float> m_fb_data_;
 
+// One render thread for the session, started with the first pass. radeon_render_engine hands
+// it a pass and waits for its end, a thread created per pass allocated on every frame.
 std::thread m_render_thread_;
+std::mutex m_render_pass_mutex_;
+std::condition_variable m_render_pass_wake_;
+bool m_render_pass_requested_ = false;
+bool m_render_pass_done_ = false;
+bool m_render_thread_exit_ = false;
 std::mutex renderMutex;
 
+// RPR memory statistics are due, asked for once the render lock is free
+bool m_ledger_query_pending_ = false;
+
+// Renderer startup on a background thread, the viewer shows its progress until ready
+StartupLoader m_startup_;
+bool m_scene_ready_ = false;
+double m_first_sample_start_ms_ = 0.0;
+bool m_has_resolved_ = false;
+std::vector<std::shared_future<rpr_image>> m_prefetched_images_;
+ObjMesh m_teapot_mesh_;
+
+// Resolved frames for external viewers, HRS_FRAME_SHM=/name turns it on at startup
+FramePublisher m_frame_publisher_;
+bool m_publish_frames_ = false;
+char m_publish_name_[64] = "/hrs_frames";
+
+// Name being typed in the panel, copied to m_publish_name_ on Enter
+char m_publish_name_edit_[64] = "/hrs_frames";
+
+// Scene edits are queued here and committed by the render thread between two passes
+SceneTransaction m_scene_edits_;
+
+float m_camera_eye_[3] = { 4.0f, 4.0f, 15.0f };
+float m_camera_target_[3] = { 1.5f, 0.0f, 0.0f };
+float m_camera_focal_length_ = 35.0f;
+float m_env_intensity_ = 0.8f;
+
+// Scene images go through the cache, released on cleanup
+std::unique_ptr<ImageCache> m_image_cache_;
+DemoScene m_scene_;
+
+// One per Instancer node, with the material its tint drives. The settings are kept so the
+// per frame refresh from the node parameters reuses the point file string.
+struct InstancerEntry
+{
+	std::unique_ptr<Instancer> instancer;
+	rpr_material_node material = nullptr;
+	Color tint = { -1.0f, -1.0f, -1.0f };
+	size_t recorded_bytes = 0;
+	ScatterSettings settings;
+
+	// Edited in the node, applied to settings on Enter
+	char point_file[260] = "Resources/Scatter/points.txt";
+};
+
+std::unordered_map<int, InstancerEntry> m_instancers_;
+
+// Ctrl+drag in the viewer sends every sample to a region. m_roi_data_ takes the region pixels
+// alone, they go to the texture and their rows to m_fb_data_.
+RegionRender m_region_render_;
+std::vector<float> m_roi_data_;
+float m_last_pass_ms_ = 0.0f;
+int m_last_pass_iterations_ = 1;
+
+// Last frame published before the region began, ring slots written after it already hold the
+// frozen rest of the frame and only take the region rows
+uint64_t m_region_publish_frame_ = 0;
+
 int m_min_samples_ = 4;
 int m_max_samples_ = 128;
 int m_sample_count_ = 0;
 int m_batch_size_ = 0;
 
+// The accumulation is checkpointed every m_checkpoint_interval_s_ to one file per viewer size.
+// A checkpoint whose hash matches the backend, camera, environment and node graph is resumed
+// at startup, after a resize and after a backend switch.
+CheckpointWriter m_checkpoint_writer_;
+RenderCheckpoint m_checkpoint_;
+bool m_checkpoints_enabled_ = true;
+float m_checkpoint_interval_s_ = 30.0f;
+std::chrono::steady_clock::time_point m_last_checkpoint_time_;
+int m_checkpoint_samples_ = 0;
+// Set between passes with the scene hash in m_checkpoint_, the next pass reads back after it
+bool m_checkpoint_requested_ = false;
+bool m_resume_pending_ = false;
+int m_resumed_samples_ = 0;
+const char* m_checkpoint_dir_ = "checkpoints";
+
+// Set by the node editor, the graph is declared after the renderer
+uint64_t m_graph_hash_ = 0;
+
 inline static float last_progress = -1.0f;
 inline static bool has_started = false;
 inline static bool is_options_changed = false;
@@ -77,7 +210,7 @@ public:
 
 	struct Update
 	{
-		Update() : m_hasUpdate(0), m_done(0), m_aborted(0), render_ready_(false), m_camUpdated(0), m_progress(0.0f) {}
+		Update() : m_hasUpdate(0), m_done(0), m_aborted(0), render_ready_(false), m_camUpdated(0), m_progress(0.0f), m_update_ns(0) {}
 
 		volatile int m_hasUpdate;
 		volatile int m_done;
@@ -86,6 +219,9 @@ public:
 		int m_camUpdated;
 		float m_progress;
 
+		// When RPR raised the update, published frames measure their latency from it
+		volatile int64_t m_update_ns;
+
 		void clear()
 		{
 			m_hasUpdate = m_done = m_aborted = m_camUpdated = 0;
@@ -95,6 +231,7 @@ public:
 	static void notifyUpdate(float x, void* userData)
 	{
 		auto update = static_cast<Update*>(userData);
+		update->m_update_ns = get_shared_frame_clock_ns();
 		update->m_hasUpdate = 1;
 		update->m_progress = x;
 	}
@@ -106,15 +243,157 @@ const auto invalid_time = std::chrono::time_point<std::chrono::high_resolution_c
 int benchmark_number_of_render_iteration = 0;
 auto benchmark_start = invalid_time;
 
-void render_job(rpr_context ctxt, Render_Progress_Callback::Update* update)
+RenderCamera get_viewer_camera()
+{
+	RenderCamera camera;
+	std::copy(m_camera_eye_, m_camera_eye_ + 3, camera.eye);
+	std::copy(m_camera_target_, m_camera_target_ + 3, camera.target);
+	camera.focal_length = m_camera_focal_length_;
+	return camera;
+}
+
+// Accumulation readback into m_checkpoint_, whose scene hash the caller has set. The writer
+// encodes and writes on its own thread.
+void submit_checkpoint()
+{
+	const int samples = m_backend_->get_sample_count();
+
+	m_checkpoint_.width = m_backend_->get_width();
+	m_checkpoint_.height = m_backend_->get_height();
+	m_checkpoint_.sample_count = samples;
+	m_checkpoint_.accumulation.resize(m_backend_->get_frame_bytes() / sizeof(float));
+
+	if (!m_backend_->read_accumulation(m_checkpoint_.accumulation.data(), m_backend_->get_frame_bytes()))
+	{
+		return;
+	}
+
+	m_checkpoint_writer_.submit(get_checkpoint_path(m_checkpoint_dir_, m_checkpoint_.width, m_checkpoint_.height), m_checkpoint_);
+	m_checkpoint_samples_ = samples;
+}
+
+void render_job(Render_Progress_Callback::Update* update)
 {
 	renderMutex.lock();
-	CHECK(rprContextRender(ctxt));
-	//rprContextRender(ctxt);
+
+	// Everything queued since the last pass lands here, with the single framebuffer clear.
+	// The CPU backend only follows the camera, it has a fixed scene of its own.
+	const bool is_committed = m_scene_edits_.commit(m_rpr_backend_->get_framebuffer());
+
+	if (is_committed)
+	{
+		m_sample_count_ = 1;
+		m_resumed_samples_ = 0;
+		m_region_render_.reset();
+		m_rpr_backend_->notify_cleared();
+
+		if (m_cpu_backend_)
+		{
+			m_cpu_backend_->set_camera(get_viewer_camera());
+		}
+	}
+
+	const auto pass_start = std::chrono::steady_clock::now();
+
+	if (m_region_render_.is_active())
+	{
+		const RenderRegion& region = m_region_render_.get_region();
+		m_backend_->render_tile(region.x0, region.x1, region.y0, region.y1);
+		m_last_pass_iterations_ = 1;
+	}
+	else
+	{
+		m_backend_->render(std::max(m_batch_size_, 1));
+		m_last_pass_iterations_ = std::max(m_batch_size_, 1);
+	}
+
+	m_last_pass_ms_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pass_start).count();
+
+	// Periodic checkpoints read back here so sampling never waits on the UI thread, a commit
+	// above cleared what the hash was taken for
+	if (m_checkpoint_requested_)
+	{
+		m_checkpoint_requested_ = false;
+
+		if (!is_committed)
+		{
+			submit_checkpoint();
+		}
+	}
+
+	// RPR reports through its progress callback, the CPU backend once the pass is done
+	if (m_backend_ != m_rpr_backend_.get())
+	{
+		update->m_hasUpdate = 1;
+	}
+
 	update->m_done = 1;
 	renderMutex.unlock();
 }
 
+void render_thread_loop()
+{
+	std::unique_lock<std::mutex> lock(m_render_pass_mutex_);
+
+	while (true)
+	{
+		m_render_pass_wake_.wait(lock, []() { return m_render_pass_requested_ || m_render_thread_exit_; });
+
+		if (m_render_thread_exit_)
+		{
+			break;
+		}
+
+		m_render_pass_requested_ = false;
+
+		lock.unlock();
+		render_job(&render_progress_callback);
+		lock.lock();
+
+		m_render_pass_done_ = true;
+		m_render_pass_wake_.notify_all();
+	}
+}
+
+void start_render_pass()
+{
+	if (!m_render_thread_.joinable())
+	{
+		m_render_thread_ = std::thread(render_thread_loop);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_render_pass_mutex_);
+		m_render_pass_done_ = false;
+		m_render_pass_requested_ = true;
+	}
+
+	m_render_pass_wake_.notify_all();
+}
+
+void wait_render_pass()
+{
+	std::unique_lock<std::mutex> lock(m_render_pass_mutex_);
+	m_render_pass_wake_.wait(lock, []() { return m_render_pass_done_; });
+}
+
+// Before the backends go, no pass is running since every started one was waited for
+void stop_render_thread()
+{
+	if (!m_render_thread_.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_render_pass_mutex_);
+		m_render_thread_exit_ = true;
+	}
+
+	m_render_pass_wake_.notify_all();
+	m_render_thread_.join();
+}
+
 // OpenGL	
 void opengl_init()
 {
@@ -136,6 +415,15 @@ void opengl_init()
 
 	window = glfwCreateWindow(m_window_width_, m_window_height_, "Node Editor", nullptr, nullptr);
 
+	// Software GL such as Mesa llvmpipe stops at 4.5, the replay test of CMakeLists.txt runs
+	// on it under Xvfb
+	if (!window)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		window = glfwCreateWindow(m_window_width_, m_window_height_, "Node Editor", nullptr, nullptr);
+		m_glsl_version_ = "#version 450";
+	}
+
 	if (!window)
 	{
 		cout << "Error: GLFW failed to create window" << endl;
@@ -144,7 +432,8 @@ void opengl_init()
 	}
 
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+	// A replay measures the frames, not the display rate
+	glfwSwapInterval(m_input_replay_.is_open() ? 0 : 1);
 
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
@@ -268,15 +557,40 @@ void imgui_init()
 		//style->WindowRounding = 0.0f;
 	}
 
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
-	ImGui_ImplOpenGL3_Init("#version 460");
+	// Panels undocked into windows of their own would take their input outside the recording
+	if (m_input_recorder_.is_open() || m_input_replay_.is_open())
+	{
+		io.ConfigFlags &= ~ImGuiConfigFlags_ViewportsEnable;
+	}
+
+	if (m_input_recorder_.is_open())
+	{
+		m_input_recorder_.install(window);
+	}
+
+	// Replayed, the window's own input never reaches ImGui
+	ImGui_ImplGlfw_InitForOpenGL(window, !m_input_replay_.is_open());
+	ImGui_ImplOpenGL3_Init(m_glsl_version_);
 }
 void imgui_init_render()
 {
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
+
+	// Over the time step and window size the backend just set
+	if (m_input_started_)
+	{
+		m_input_replay_.apply_frame(window);
+	}
+
 	ImGui::NewFrame();
 
+	if (m_input_started_)
+	{
+		m_input_replay_.check_frame();
+		m_input_recorder_.end_frame();
+	}
+
 	ImGuiWindowFlags window_flags =
 		ImGuiWindowFlags_NoBringToFrontOnFocus |
 		ImGuiWindowFlags_MenuBar |
@@ -333,8 +647,9 @@ std::tuple<GLuint, GLuint, GLuint> get_shader_variables(GLuint program, const ch
 }
 float get_render_progress()
 {
-	int maxSpp = m_max_samples_;
-	float progress = maxSpp <= 0 ? 0.0f : m_sample_count_ * 100.0f / maxSpp;
+	int maxSpp = m_region_render_.is_active() ? m_region_render_.get_budget() : m_max_samples_;
+	int samples = m_region_render_.is_active() ? m_region_render_.get_samples() : m_sample_count_;
+	float progress = maxSpp <= 0 ? 0.0f : samples * 100.0f / maxSpp;
 
 	if (progress >= 100.0f)
 	{
@@ -384,11 +699,11 @@ GLuint get_texture_buffer()
 }
 rpr_framebuffer get_frame_buffer()
 {
-	return m_frame_buffer_;
+	return m_rpr_backend_ ? m_rpr_backend_->get_framebuffer() : nullptr;
 }
 rpr_framebuffer get_frame_buffer_resolved()
 {
-	return m_frame_buffer_2_;
+	return m_rpr_backend_ ? m_rpr_backend_->get_resolved_framebuffer() : nullptr;
 }
 RadeonProRender::float2 set_window_size(int width, int height)
 {
@@ -398,172 +713,278 @@ RadeonProRender::float2 set_window_size(int width, int height)
 	return RadeonProRender::float2(static_cast<float>(m_window_width_), static_cast<float>(m_window_height_));
 }
 
-void reset_buffer()
+// Scene changes go through the returned transaction, the render loop wakes up and commits
+// them before its next pass
+SceneTransaction& edit_scene()
 {
 	options_changed = true;
 	set_is_dirty(true);
-	set_sample_count(1);
-	CHECK(rprFrameBufferClear(get_frame_buffer()));
+	return m_scene_edits_;
 }
 
-void radeon_init()
+// Deferred, the clear happens once with the next commit
+void reset_buffer()
+{
+	edit_scene().request_reset();
+}
+
+// Two RPR framebuffers, the host copy and the GL texture, all RGBA32F, and the RGBA8 display texture
+constexpr size_t kViewerBytesPerPixel = 4 * 4 * sizeof(float) + 4;
+int m_viewer_budget_frame_ = -1000;
+bool m_viewer_budget_refused_ = false;
+
+// Keyed on the globals, the handles change on every resize
+void record_viewer_memory()
 {
-	rpr_int status = RPR_SUCCESS;
+	MemoryLedger& ledger = MemoryLedger::get();
+	const size_t pixels = static_cast<size_t>(m_window_width_) * m_window_height_;
 
-	rpr_int pluginID = rprRegisterPlugin(RPR_PLUGIN_FILE_NAME);
-	CHECK_NE(pluginID, -1);
+	ledger.record(MemoryCategory::RprFramebuffer, &m_rpr_backend_, pixels * 2 * 4 * sizeof(float), "Viewer framebuffers");
+
+	if (m_cpu_backend_)
+	{
+		ledger.record(MemoryCategory::HostFramebuffer, &m_cpu_backend_, m_cpu_backend_->get_memory_bytes(), "CPU renderer");
+	}
+	else
+	{
+		ledger.release(&m_cpu_backend_);
+	}
 
-	rpr_int plugins[] = { pluginID };
-	size_t numPlugins = sizeof(plugins) / sizeof(plugins[0]);
+	ledger.record(MemoryCategory::HostFramebuffer, &m_fb_data_, m_fb_data_.capacity() * sizeof(float), "Viewer pixels");
+	ledger.record(MemoryCategory::GLTexture, &m_texture_buffer_, pixels * 4 * sizeof(float), "Viewer texture");
+	ledger.record(MemoryCategory::GLTexture, &m_display_texture_, pixels * 4, "Viewer display texture");
+}
 
-	status = rprCreateContext(RPR_API_VERSION, plugins, numPlugins,
-		RPR_CREATION_FLAGS_ENABLE_GL_INTEROP | RPR_CREATION_FLAGS_ENABLE_GPU0 |
-		RPR_CREATION_FLAGS_ENABLE_GPU1 | RPR_CREATION_FLAGS_ENABLE_CPU,
-		g_contextProperties, nullptr, &context);
+// Shrinks the requested viewer size, aspect kept, until the buffers fit the memory budget and
+// the GL texture limit. Returns false when even a tiny viewer would not fit.
+bool fit_viewer_size(int& width, int& height)
+{
+	MemoryLedger& ledger = MemoryLedger::get();
 
-	CHECK(status);
+	GLint max_texture_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
 
-	CHECK(rprContextSetActivePlugin(context, plugins[0]));
-	CHECK(rprContextCreateMaterialSystem(context, 0, &materialSystem));
+	double scale = 1.0;
 
-	// Scene
-	rpr_scene scene = nullptr;
-	CHECK(rprContextCreateScene(context, &scene));
-	CHECK(rprContextSetScene(context, scene));
+	if (max_texture_size > 0)
+	{
+		scale = std::min(scale, static_cast<double>(max_texture_size) / std::max(width, height));
+	}
 
-	// Camera
-	rpr_camera camera = nullptr;
-	CHECK(rprContextCreateCamera(context, &camera));
-	RadeonProRender::float3 eyePos(4, 4.0, 15);
-	CHECK(rprCameraLookAt(camera, eyePos.x, eyePos.y, eyePos.z, 1.5, 0, 0, 0, 1, 0));
-	CHECK(rprSceneSetCamera(scene, camera));
+	const size_t available = ledger.get_available({ &m_rpr_backend_, &m_cpu_backend_, &m_fb_data_, &m_texture_buffer_ });
+	const double requested = static_cast<double>(std::max(width, 1)) * std::max(height, 1) * kViewerBytesPerPixel;
 
-	// Create env light
-	CHECK(CreateNatureEnvLight(context, scene, g_gc, 0.8f));
+	if (requested * scale * scale > static_cast<double>(available))
+	{
+		scale = std::min(scale, std::sqrt(available / requested));
+	}
 
+	if (scale >= 1.0)
 	{
-		// Define the teapots list used in the scene
-		struct TEAPOT_DEF
-		{
-			TEAPOT_DEF(float x_, float z_, float rot_, float r_, float g_, float b_)
-			{
-				x = x_;
-				z = z_;
-				rot = rot_;
-				r = r_ / 255.0f;
-				g = g_ / 255.0f;
-				b = b_ / 255.0f;
-				shape = nullptr;
-				mat = nullptr;
-			}
+		return width > 0 && height > 0;
+	}
+
+	width = static_cast<int>(width * scale);
+	height = static_cast<int>(height * scale);
+
+	ledger.count_refusal();
+	m_viewer_budget_frame_ = ImGui::GetFrameCount();
+	m_viewer_budget_refused_ = width < 16 || height < 16;
+
+	return !m_viewer_budget_refused_;
+}
+
+// Sized for the current viewer and opened again when the viewer outgrows it
+void update_frame_publisher()
+{
+	MemoryLedger& ledger = MemoryLedger::get();
+	const size_t frame_bytes = static_cast<size_t>(m_window_width_) * m_window_height_ * 4 * sizeof(float);
+
+	if (!m_publish_frames_)
+	{
+		m_frame_publisher_.close();
+		ledger.release(&m_frame_publisher_);
+		return;
+	}
+
+	if (m_frame_publisher_.is_open() && m_frame_publisher_.get_name() == m_publish_name_ && frame_bytes <= m_frame_publisher_.get_max_frame_bytes())
+	{
+		return;
+	}
+
+	const int slot_count = 3;
+
+	if (!ledger.fits(frame_bytes * slot_count, { &m_frame_publisher_ }))
+	{
+		std::cout << "Frame publishing off, " << slot_count << " frames of " << frame_bytes / (1024 * 1024) << " MB exceed the memory budget" << std::endl;
+		ledger.count_refusal();
+		m_frame_publisher_.close();
+		ledger.release(&m_frame_publisher_);
+		m_publish_frames_ = false;
+		return;
+	}
+
+	if (!m_frame_publisher_.open(m_publish_name_, frame_bytes, slot_count))
+	{
+		ledger.release(&m_frame_publisher_);
+		m_publish_frames_ = false;
+		return;
+	}
 
-			float x;
-			float z;
-			float rot;
-			float r;
-			float g;
-			float b;
-			rpr_shape shape;
-			rpr_material_node mat;
-		};
-		std::vector<TEAPOT_DEF> posList;
-		posList.push_back(TEAPOT_DEF(5.0f, 2.0f, 1.6f, 122, 63, 0)); // brown
-		posList.push_back(TEAPOT_DEF(-5.0f, 3.0f, 5.6f, 122, 0, 14));
-		posList.push_back(TEAPOT_DEF(0.0f, -3.0f, 3.2f, 119, 0, 93));
-		posList.push_back(TEAPOT_DEF(1.0f, +3.0f, 1.2f, 7, 0, 119));
-		posList.push_back(TEAPOT_DEF(3.0f, +9.0f, -1.7f, 0, 59, 119));
-		posList.push_back(TEAPOT_DEF(-6.0f, +12.0f, 2.2f, 0, 119, 99));
-		posList.push_back(TEAPOT_DEF(9.0f, -6.0f, 4.8f, 0, 119, 1)); // green
-		posList.push_back(TEAPOT_DEF(9.0f, 7.0f, 2.5f, 219, 170, 0)); // yellow
-		posList.push_back(TEAPOT_DEF(-9.0f, -7.0f, 5.8f, 112, 216, 202));
+	ledger.record(MemoryCategory::HostFramebuffer, &m_frame_publisher_, m_frame_publisher_.get_stats().mapped_bytes, "Shared frame ring");
+
+	// The new ring starts empty, its slots take whole frames until each was written once
+	m_region_publish_frame_ = 0;
+}
+
+// Context and scene come up on the loader thread while the window already runs, the scene
+// images are read and decoded by the cache workers meanwhile and created once the context exists,
+// the teapot OBJ is parsed on the task thread beside context creation.
+// The GL interop flag is not asked for, frames reach GL through host memory and the context
+// is no longer created on the GL thread.
+void radeon_init()
+{
+	m_image_cache_ = std::make_unique<ImageCache>(nullptr, renderMutex);
+	m_prefetched_images_ = prefetch_demo_scene(*m_image_cache_);
 
+	m_startup_.add_task("Mesh", []()
+		{
+			return load_obj_mesh("Resources/Meshes/teapot.obj", m_teapot_mesh_);
+		});
 
-		// create teapots
-		int i = 0;
-		for (const auto iShape : posList)
+	m_startup_.add_stage("Context", []()
 		{
-			rpr_shape teapot01 = nullptr;
+			rpr_int pluginID = rprRegisterPlugin(RPR_PLUGIN_FILE_NAME);
 
-			if (i == 0)
+			if (pluginID == -1)
 			{
-				// create from OBJ for the first teapot
-				teapot01 = ImportOBJ("Resources/Meshes/teapot.obj", scene, context);
+				return false;
 			}
-			else
+
+			rpr_int plugins[] = { pluginID };
+			size_t numPlugins = sizeof(plugins) / sizeof(plugins[0]);
+
+			rpr_int status = rprCreateContext(RPR_API_VERSION, plugins, numPlugins,
+				RPR_CREATION_FLAGS_ENABLE_GPU0 | RPR_CREATION_FLAGS_ENABLE_GPU1 | RPR_CREATION_FLAGS_ENABLE_CPU,
+				g_contextProperties, nullptr, &context);
+
+			if (status != RPR_SUCCESS)
 			{
-				// other teapots will be instances of the first one.
-				CHECK(rprContextCreateInstance(context, posList[0].shape, &teapot01));
-				CHECK(rprSceneAttachShape(scene, teapot01));
+				return false;
 			}
 
-			// random transforms of teapot on the floor :
+			CHECK(rprContextSetActivePlugin(context, plugins[0]));
+			CHECK(rprContextCreateMaterialSystem(context, 0, &materialSystem));
+
+			m_image_cache_->set_context(context);
 
-			RadeonProRender::matrix m;
+			return true;
+		});
 
-			if (i % 4 == 0)
-				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
-				* RadeonProRender::rotation_x(MY_PI);
+	m_startup_.add_stage("Scene", []()
+		{
+			DemoSceneSettings scene_settings;
+			std::copy(m_camera_eye_, m_camera_eye_ + 3, scene_settings.camera_eye);
+			std::copy(m_camera_target_, m_camera_target_ + 3, scene_settings.camera_target);
+			scene_settings.camera_focal_length = m_camera_focal_length_;
+			scene_settings.env_intensity = m_env_intensity_;
+
+			// A mesh that failed to parse goes through ImportOBJ, which reports why
+			if (m_startup_.wait_tasks())
+			{
+				scene_settings.teapot_mesh = &m_teapot_mesh_;
+			}
 
-			if (i % 4 == 1)
-				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
-				* RadeonProRender::translation(RadeonProRender::float3(0, 2.65, 0))
-				* RadeonProRender::rotation_x(MY_PI + 1.9f)
-				* RadeonProRender::rotation_y(0.45);
+			rpr_status status = create_demo_scene(context, materialSystem, *m_image_cache_, g_gc, scene_settings, m_scene_);
 
+			// RPR copied the mesh
+			m_teapot_mesh_ = ObjMesh();
 
-			if (i % 4 == 2)
-				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
-				* RadeonProRender::translation(RadeonProRender::float3(0, 2.65, 0))
-				* RadeonProRender::rotation_x(MY_PI + 1.9f)
-				* RadeonProRender::rotation_y(-0.57);
+			for (const std::shared_future<rpr_image>& image : m_prefetched_images_)
+			{
+				m_image_cache_->release(image.get());
+			}
 
+			m_prefetched_images_.clear();
 
-			if (i % 4 == 3)
-				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
-				* RadeonProRender::translation(RadeonProRender::float3(0, 3.38, 0))
-				* RadeonProRender::rotation_x(+0.42f)
-				* RadeonProRender::rotation_z(-0.20f)
-				;
+			if (status != RPR_SUCCESS)
+			{
+				return false;
+			}
 
-			CHECK(rprShapeSetTransform(teapot01, RPR_TRUE, &m.m00));
+			// Linear radiance out of the resolve, the viewer shader does the display transform
+			CHECK(rprContextSetParameterByKey1f(context, RPR_CONTEXT_DISPLAY_GAMMA, 1.0f));
 
-			posList[i].shape = teapot01;
+			CHECK(rprContextSetParameterByKeyPtr(context, RPR_CONTEXT_RENDER_UPDATE_CALLBACK_FUNC, (void*)Render_Progress_Callback::notifyUpdate));
+			CHECK(rprContextSetParameterByKeyPtr(context, RPR_CONTEXT_RENDER_UPDATE_CALLBACK_DATA, &render_progress_callback));
 
-			i++;
-		}
+			// No warm-up render, the first viewer pass compiles the kernels
+			CHECK(rprContextSetParameterByKey1u(context, RPR_CONTEXT_ITERATIONS, m_batch_size_));
 
+			return true;
+		});
 
+	m_startup_.start();
+}
 
+// Main thread part once the loader is done, the framebuffers follow the viewer size
+void radeon_finish_init()
+{
+	const double start_ms = m_startup_.get_elapsed_ms();
 
-	}
+	m_rpr_backend_ = std::make_unique<RprRenderBackend>(context, m_scene_.camera);
+	m_rpr_backend_->resize(m_window_width_, m_window_height_);
+	m_backend_ = m_rpr_backend_.get();
 
-	// create the floor
-	CHECK(CreateAMDFloor(context, scene, materialSystem, g_gc, 1.0f, 1.0f));
+	m_fb_data_.resize(m_window_width_ * m_window_height_ * 4);
 
-	CHECK(rprContextSetParameterByKey1f(context, RPR_CONTEXT_DISPLAY_GAMMA, 2.2f));
+	record_viewer_memory();
 
-	rpr_framebuffer_desc desc = { static_cast<unsigned int>(m_window_width_), static_cast<unsigned int>(m_window_height_) };
-	rpr_framebuffer_format fmt = { 4, RPR_COMPONENT_TYPE_FLOAT32 };
+	const char* publish_name = getenv("HRS_FRAME_SHM");
 
-	CHECK(rprContextCreateFrameBuffer(context, fmt, &desc, &m_frame_buffer_));
-	CHECK(rprContextCreateFrameBuffer(context, fmt, &desc, &m_frame_buffer_2_));
+	if (publish_name && publish_name[0])
+	{
+		snprintf(m_publish_name_, sizeof(m_publish_name_), "%s", publish_name);
+		snprintf(m_publish_name_edit_, sizeof(m_publish_name_edit_), "%s", publish_name);
+		m_publish_frames_ = true;
+	}
 
-	CHECK(rprContextSetAOV(context, RPR_AOV_COLOR, m_frame_buffer_));
+	update_frame_publisher();
 
-	CHECK(rprContextSetParameterByKeyPtr(context, RPR_CONTEXT_RENDER_UPDATE_CALLBACK_FUNC, (void*)Render_Progress_Callback::notifyUpdate));
-	CHECK(rprContextSetParameterByKeyPtr(context, RPR_CONTEXT_RENDER_UPDATE_CALLBACK_DATA, &render_progress_callback));
+	m_startup_.record("Framebuffers", start_ms);
+	m_is_dirty_ = true;
+	m_scene_ready_ = true;
+	m_resume_pending_ = true;
+}
 
-	CHECK(rprContextSetParameterByKey1u(context, RPR_CONTEXT_ITERATIONS, 1));
+// Finishes the startup once the loader is done and logs the stages at the first sample
+// True on the frames that finish the startup, they allocate however idle the input is
+bool update_startup()
+{
+	static bool is_logged = false;
+	bool is_updated = false;
 
-	std::thread renderThread([&]() {
-		CHECK(rprContextRender(context));
-		});
-	renderThread.join();
+	if (!m_scene_ready_ && m_startup_.is_finished() && !m_startup_.has_failed())
+	{
+		m_startup_.join();
+		radeon_finish_init();
+		m_first_sample_start_ms_ = m_startup_.get_elapsed_ms();
+		is_updated = true;
+	}
 
-	CHECK(rprContextSetParameterByKey1u(context, RPR_CONTEXT_ITERATIONS, m_batch_size_));
+	if (!is_logged && (m_has_resolved_ || m_startup_.has_failed()))
+	{
+		if (m_has_resolved_)
+		{
+			m_startup_.record("First sample", m_first_sample_start_ms_);
+		}
 
-	m_fb_data_ = std::shared_ptr<float>(new float[m_window_width_ * m_window_height_ * 4], std::default_delete<float[]>());
+		m_startup_.log();
+		is_logged = true;
+		is_updated = true;
+	}
 
+	return is_updated;
 }
 bool radeon_init_pre_render(int width, int height)
 {
@@ -607,20 +1028,72 @@ bool radeon_init_pre_render(int width, int height)
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_window_width_, m_window_height_, 0, GL_RGBA, GL_FLOAT, nullptr);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
+	glDeleteFramebuffers(1, &m_display_fbo_);
+	glDeleteTextures(1, &m_display_texture_);
+
+	glGenTextures(1, &m_display_texture_);
+	glBindTexture(GL_TEXTURE_2D, m_display_texture_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_window_width_, m_window_height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &m_display_fbo_);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_display_fbo_);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_display_texture_, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Error: display framebuffer incomplete" << std::endl;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	m_display_dirty_ = true;
+
 	set_window_size(m_window_width_, m_window_height_);
 
 	return true;
 }
-void radeon_init_render()
+// One draw into the display texture when a frame arrived or a display setting changed
+void radeon_display_render()
 {
+	if (!m_display_dirty_)
+	{
+		return;
+	}
+
+	m_display_dirty_ = false;
+
+	// Put back as found, the caller's blend and depth test are its own
+	GLint viewport[4] = {};
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint framebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	const GLboolean was_blend = glIsEnabled(GL_BLEND);
+	const GLboolean was_depth_test = glIsEnabled(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_display_fbo_);
+	glViewport(0, 0, m_window_width_, m_window_height_);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+
 	glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer_id_);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_id_);
 
-	m_program_ = m_shader_manager_.get_program("core/shaders/shader");
+	// Kept, the name is past the small string buffer and would allocate every frame
+	static const std::string display_shader = "core/shaders/shader";
+	m_program_ = m_shader_manager_.get_program(display_shader);
 	auto [texture_location, position_location, texcoord_location] = get_shader_variables(m_program_, "g_Texture", "inPosition", "inTexcoord");
 
 	glUseProgram(m_program_);
 	glUniform1i(texture_location, 0);
+	m_shader_manager_.set_uniform(m_program_, "u_exposure", m_display_.exposure);
+	m_shader_manager_.set_uniform(m_program_, "u_curve", m_display_.curve);
+	m_shader_manager_.set_uniform(m_program_, "u_output", m_display_.output);
+	m_shader_manager_.set_uniform(m_program_, "u_gamma", std::max(m_display_.gamma, 0.1f));
+	m_shader_manager_.set_uniform(m_program_, "u_view", m_display_.view);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, m_texture_buffer_);
 
@@ -639,6 +1112,19 @@ void radeon_init_render()
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glUseProgram(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	if (was_blend)
+	{
+		glEnable(GL_BLEND);
+	}
+
+	if (was_depth_test)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
 }
 void radeon_post_render()
 {
@@ -647,13 +1133,56 @@ void radeon_post_render()
 void radeon_cleanup()
 {
 	glDeleteTextures(1, &m_texture_buffer_);
+	glDeleteFramebuffers(1, &m_display_fbo_);
+	glDeleteTextures(1, &m_display_texture_);
+
+	m_frame_publisher_.close();
+	MemoryLedger::get().release(&m_frame_publisher_);
+
+	// Closed while loading, the stages run to the end first
+	m_startup_.join();
+	stop_render_thread();
+
+	if (!context)
+	{
+		m_image_cache_ = nullptr;
+		return;
+	}
+
+	// The last samples are kept for the next run
+	if (m_backend_)
+	{
+		save_checkpoint();
+		m_checkpoint_writer_.flush();
+	}
+
+	if (materialSystem)
+	{
+		CHECK(rprObjectDelete(materialSystem)); materialSystem = nullptr;
+	}
+
+	m_backend_ = nullptr;
+	m_cpu_backend_ = nullptr;
+	m_rpr_backend_ = nullptr;
+	MemoryLedger::get().release(&m_cpu_backend_);
+
+	for (auto& [id, entry] : m_instancers_)
+	{
+		MemoryLedger::get().release(entry.instancer.get());
+		entry.instancer->clear(m_scene_edits_);
+		entry.instancer = nullptr;
+		m_scene_edits_.discard(entry.material);
+		CHECK(rprObjectDelete(entry.material));
+	}
 
-	CHECK(rprObjectDelete(materialSystem)); materialSystem = nullptr;
-	CHECK(rprObjectDelete(m_frame_buffer_)); m_frame_buffer_ = nullptr;
-	CHECK(rprObjectDelete(m_frame_buffer_2_)); m_frame_buffer_2_ = nullptr;
+	m_instancers_.clear();
 
 	g_gc.GCClean();
 
+	release_demo_scene(*m_image_cache_, m_scene_);
+	m_image_cache_->clear(true);
+	m_image_cache_ = nullptr;
+
 	rprContextClearMemory(context);
 	CheckNoLeak(context);
 	CHECK(rprObjectDelete(context)); context = nullptr;
@@ -665,73 +1194,217 @@ void radeon_create_framebuffer(int width, int height)
 
 	glDeleteTextures(1, &m_texture_buffer_);
 
-	CHECK(rprObjectDelete(m_frame_buffer_));
-	CHECK(rprObjectDelete(m_frame_buffer_2_));
+	// The RPR framebuffers follow the viewer even while the CPU backend renders
+	m_rpr_backend_->resize(m_window_width_, m_window_height_);
+
+	if (m_cpu_backend_)
+	{
+		m_cpu_backend_->resize(m_window_width_, m_window_height_);
+	}
+}
+// What the accumulation depends on besides its size
+uint64_t get_render_hash()
+{
+	const char* backend = m_backend_->get_name();
 
-	rpr_framebuffer_format fmt = { 4, RPR_COMPONENT_TYPE_FLOAT32 };
-	rpr_framebuffer_desc desc = { static_cast<unsigned int>(m_window_width_), static_cast<unsigned int>(m_window_height_) };
+	uint64_t hash = hash_checkpoint_bytes(backend, strlen(backend));
+	hash = hash_checkpoint_bytes(m_camera_eye_, sizeof(m_camera_eye_), hash);
+	hash = hash_checkpoint_bytes(m_camera_target_, sizeof(m_camera_target_), hash);
+	hash = hash_checkpoint_bytes(&m_camera_focal_length_, sizeof(m_camera_focal_length_), hash);
+	hash = hash_checkpoint_bytes(&m_env_intensity_, sizeof(m_env_intensity_), hash);
+	hash = hash_checkpoint_bytes(&m_graph_hash_, sizeof(m_graph_hash_), hash);
 
-	CHECK(rprContextCreateFrameBuffer(context, fmt, &desc, &m_frame_buffer_));
-	CHECK(rprContextCreateFrameBuffer(context, fmt, &desc, &m_frame_buffer_2_));
+	return hash;
 }
-void radeon_render_engine()
+
+// Never over queued scene edits, the camera globals already hold what the accumulation does
+// not show yet
+bool can_checkpoint()
 {
-	const auto timeUpdateStarts = std::chrono::high_resolution_clock::now();
+	const int samples = m_backend_->get_sample_count();
+	return m_checkpoints_enabled_ && samples > 0 && samples != m_checkpoint_samples_ && !m_region_render_.is_active() && !m_scene_edits_.has_pending();
+}
 
-	if (benchmark_start == invalid_time)
-		benchmark_start = timeUpdateStarts;
-	if (benchmark_number_of_render_iteration >= 100)
+// Right away on the UI thread, for a resize, a backend switch, shutdown or the panel button.
+// Nothing renders in between, the UI thread waits for every pass it starts.
+void save_checkpoint()
+{
+	m_checkpoint_requested_ = false;
+
+	if (!can_checkpoint())
 	{
-		double elapsed_time_ms = std::chrono::duration<double, std::milli>(timeUpdateStarts - benchmark_start).
-			count();
-		double renderPerSecond = static_cast<double>(benchmark_number_of_render_iteration) * 1000.0 /
-			elapsed_time_ms;
-		std::cout << renderPerSecond << " iterations per second." << std::endl;
-		benchmark_number_of_render_iteration = 0;
-		benchmark_start = timeUpdateStarts;
+		return;
 	}
 
-	render_progress_callback.clear();
+	m_checkpoint_.scene_hash = get_render_hash();
+	submit_checkpoint();
+	m_last_checkpoint_time_ = std::chrono::steady_clock::now();
+}
+
+void resume_checkpoint()
+{
+	m_resume_pending_ = false;
+	m_last_checkpoint_time_ = std::chrono::steady_clock::now();
+	m_checkpoint_writer_.flush();
+
+	RenderCheckpoint checkpoint;
 
-	if (m_is_dirty_)
+	if (!read_checkpoint(get_checkpoint_path(m_checkpoint_dir_, m_window_width_, m_window_height_), checkpoint))
 	{
-		m_render_thread_ = std::thread(render_job, context, &render_progress_callback);
+		return;
+	}
 
-		m_thread_running_ = true;
+	if (checkpoint.width != m_backend_->get_width() || checkpoint.height != m_backend_->get_height() || checkpoint.scene_hash != get_render_hash())
+	{
+		std::cout << "Checkpoint for another scene, starting over" << std::endl;
+		return;
 	}
 
-	while (!render_progress_callback.m_done)
+	m_backend_->clear();
+
+	if (!m_backend_->add_accumulation(checkpoint.accumulation.data(), m_backend_->get_frame_bytes(), checkpoint.sample_count))
+	{
+		return;
+	}
+
+	m_sample_count_ = checkpoint.sample_count;
+	m_resumed_samples_ = checkpoint.sample_count;
+	m_checkpoint_samples_ = checkpoint.sample_count;
+	m_is_dirty_ = true;
+
+	std::cout << "Resumed " << checkpoint.sample_count << " samples from the checkpoint" << std::endl;
+}
+
+// Between two passes, a resume waits for queued scene edits since their commit would clear it
+void update_checkpoint()
+{
+	if (!m_checkpoints_enabled_ || m_scene_edits_.has_pending())
+	{
+		return;
+	}
+
+	if (m_resume_pending_)
+	{
+		resume_checkpoint();
+		return;
+	}
+
+	const float elapsed_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_last_checkpoint_time_).count();
+
+	if (elapsed_s >= m_checkpoint_interval_s_ && can_checkpoint())
+	{
+		m_checkpoint_.scene_hash = get_render_hash();
+		m_checkpoint_requested_ = true;
+		m_last_checkpoint_time_ = std::chrono::steady_clock::now();
+	}
+}
+
+void radeon_render_engine()
+{
+	const auto timeUpdateStarts = std::chrono::high_resolution_clock::now();
+
+	if (benchmark_start == invalid_time)
+		benchmark_start = timeUpdateStarts;
+	if (benchmark_number_of_render_iteration >= 100)
+	{
+		double elapsed_time_ms = std::chrono::duration<double, std::milli>(timeUpdateStarts - benchmark_start).
+			count();
+		double renderPerSecond = static_cast<double>(benchmark_number_of_render_iteration) * 1000.0 /
+			elapsed_time_ms;
+		std::cout << renderPerSecond << " iterations per second." << std::endl;
+		benchmark_number_of_render_iteration = 0;
+		benchmark_start = timeUpdateStarts;
+	}
+
+	render_progress_callback.clear();
+	update_checkpoint();
+
+	if (m_is_dirty_ && !m_region_render_.is_converged())
+	{
+		start_render_pass();
+
+		m_thread_running_ = true;
+	}
+
+	// An update raised right before the pass ends is still read back
+	while (m_thread_running_ && (!render_progress_callback.m_done || render_progress_callback.m_hasUpdate))
 	{
 		if (!m_is_dirty_ && m_max_samples_ != -1 && m_sample_count_ >= m_max_samples_)
 		{
 			break;
 		}
 
+		// A region pass between two displayed ones skips the whole-frame resolve and readback
+		if (render_progress_callback.m_hasUpdate && m_region_render_.is_active() && !m_region_render_.is_display_due())
+		{
+			render_progress_callback.m_hasUpdate = false;
+			break;
+		}
+
 		if (render_progress_callback.m_hasUpdate)
 		{
 			renderMutex.lock();
 
-			m_sample_count_++;
-
-			rpr_int status = rprContextResolveFrameBuffer(context, m_frame_buffer_, m_frame_buffer_2_, false);
-			if (status != RPR_SUCCESS) {
-				std::cout << "RPR Error: " << status << std::endl;
+			if (!m_region_render_.is_active())
+			{
+				m_sample_count_++;
 			}
 
-			size_t framebuffer_size = 0;
-			CHECK(rprFrameBufferGetInfo(m_frame_buffer_2_, RPR_FRAMEBUFFER_DATA, 0, NULL, &framebuffer_size));
+			m_backend_->resolve();
+
+			const size_t framebuffer_size = m_backend_->get_frame_bytes();
 
 			if (framebuffer_size != m_window_width_ * m_window_height_ * 4 * sizeof(float))
 			{
 				CHECK(RPR_ERROR_INTERNAL_ERROR);
 			}
 
-			CHECK(rprFrameBufferGetInfo(m_frame_buffer_2_, RPR_FRAMEBUFFER_DATA, framebuffer_size, m_fb_data_.get(), NULL));
-
 			glBindTexture(GL_TEXTURE_2D, m_texture_buffer_);
 
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_window_width_, m_window_height_, GL_RGBA, GL_FLOAT,
-				static_cast<const GLvoid*>(m_fb_data_.get()));
+			if (m_region_render_.is_active())
+			{
+				// Outside the region RPR may hold a cleared buffer, the frozen frame is kept
+				const RenderRegion& region = m_region_render_.get_region();
+
+				m_backend_->read_region(m_roi_data_.data(), region.x0, region.x1, region.y0, region.y1);
+				paste_region_rows(m_roi_data_.data(), m_fb_data_.data(), m_window_width_, region);
+
+				glTexSubImage2D(GL_TEXTURE_2D, 0, region.x0, region.y0, region.get_width(), region.get_height(), GL_RGBA, GL_FLOAT,
+					static_cast<const GLvoid*>(m_roi_data_.data()));
+
+				if (void* slot = m_frame_publisher_.begin_frame(m_window_width_, m_window_height_, framebuffer_size))
+				{
+					if (m_frame_publisher_.get_overwritten_frame() > m_region_publish_frame_)
+					{
+						copy_region_rows(m_fb_data_.data(), static_cast<float*>(slot), m_window_width_, region);
+					}
+					else
+					{
+						memcpy(slot, m_fb_data_.data(), framebuffer_size);
+					}
+
+					m_frame_publisher_.end_frame(m_sample_count_ + m_region_render_.get_samples(), render_progress_callback.m_update_ns);
+				}
+			}
+			else
+			{
+				// Published frames are read straight into the shared slot and uploaded from there
+				float* pixels = static_cast<float*>(m_frame_publisher_.begin_frame(m_window_width_, m_window_height_, framebuffer_size));
+
+				if (!pixels)
+				{
+					pixels = m_fb_data_.data();
+				}
+
+				m_backend_->read_pixels(pixels, framebuffer_size);
+				m_frame_publisher_.end_frame(m_sample_count_, render_progress_callback.m_update_ns);
+
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_window_width_, m_window_height_, GL_RGBA, GL_FLOAT,
+					static_cast<const GLvoid*>(pixels));
+			}
+
+			m_has_resolved_ = true;
+			m_display_dirty_ = true;
 
 			glBindTexture(GL_TEXTURE_2D, 0);
 			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture_buffer_, 0);
@@ -747,8 +1420,9 @@ void radeon_render_engine()
 
 	if (m_thread_running_)
 	{
-		m_render_thread_.join();
+		wait_render_pass();
 		m_thread_running_ = false;
+		m_region_render_.add_pass(m_last_pass_ms_, m_last_pass_iterations_);
 	}
 
 	get_render_progress();
@@ -758,30 +1432,123 @@ void radeon_render_engine()
 }
 void radeon_resize_render(int width, int height)
 {
+	end_region_render();
+
 	m_window_width_ = width;
 	m_window_height_ = height;
 
 	glViewport(0, 0, m_window_width_, m_window_height_);
 
-	m_fb_data_ = nullptr;
-
+	// Saved at the old size, so going back to it resumes
+	save_checkpoint();
 	radeon_create_framebuffer(m_window_width_, m_window_height_);
 
-	CHECK(rprContextSetAOV(context, RPR_AOV_COLOR, m_frame_buffer_));
-
-	m_fb_data_ = std::shared_ptr<float>(new float[m_window_width_ * m_window_height_ * 4], std::default_delete<float[]>());
+	m_fb_data_.resize(m_window_width_ * m_window_height_ * 4);
 
 	radeon_init_pre_render(m_window_width_, m_window_height_);
+	record_viewer_memory();
+	update_frame_publisher();
 
-	CHECK(rprContextResolveFrameBuffer(context, m_frame_buffer_, m_frame_buffer_2_, false));
-	size_t fb_size = 0;
-	CHECK(rprFrameBufferGetInfo(m_frame_buffer_2_, RPR_FRAMEBUFFER_DATA, 0, nullptr, &fb_size));
+	m_backend_->resolve();
 
 	set_window_size(m_window_width_, m_window_height_);
 	m_sample_count_ = 1;
-	
+	m_checkpoint_samples_ = 0;
+	m_resume_pending_ = true;
+}
+
+// Region from the viewer drag, what the viewer shows becomes the frozen rest of the frame
+void begin_region_render(const RenderRegion& region)
+{
+	MemoryLedger& ledger = MemoryLedger::get();
+	const size_t floats = static_cast<size_t>(region.get_width()) * region.get_height() * 4;
+
+	if (!ledger.fits(floats * sizeof(float), { &m_roi_data_ }))
+	{
+		std::cout << "Region render refused, the readback buffer exceeds the memory budget" << std::endl;
+		ledger.count_refusal();
+		return;
+	}
+
+	m_roi_data_.resize(floats);
+	ledger.record(MemoryCategory::HostFramebuffer, &m_roi_data_, m_roi_data_.capacity() * sizeof(float), "Region readback");
+
+	glBindTexture(GL_TEXTURE_2D, m_texture_buffer_);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, m_fb_data_.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_region_render_.begin(region, m_window_width_, m_window_height_);
+	m_region_publish_frame_ = m_frame_publisher_.get_frame();
+	m_is_dirty_ = true;
+}
+
+// Back to full frame. The region keeps the samples it got on top of the rest, it stays that
+// many ahead until the next clear.
+void end_region_render()
+{
+	if (!m_region_render_.is_active())
+	{
+		return;
+	}
+
+	m_region_render_.end();
+
+	m_roi_data_.clear();
+	m_roi_data_.shrink_to_fit();
+	MemoryLedger::get().release(&m_roi_data_);
+
+	m_is_dirty_ = true;
 }
 
+// Ctrl+drag on the viewer image picks the render region, outlined while it renders
+void viewer_region_drag()
+{
+	static bool is_dragging = false;
+	static ImVec2 drag_start;
+
+	ImGuiIO& io = ImGui::GetIO();
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+
+	const ImVec2 image_min = ImGui::GetItemRectMin();
+	const ImVec2 image_max = ImGui::GetItemRectMax();
+	const ImVec2 image_size(std::max(image_max.x - image_min.x, 1.0f), std::max(image_max.y - image_min.y, 1.0f));
+
+	if (!is_dragging && io.KeyCtrl && ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+	{
+		is_dragging = true;
+		drag_start = io.MousePos;
+	}
+
+	if (is_dragging)
+	{
+		draw_list->AddRect(drag_start, io.MousePos, IM_COL32(255, 200, 0, 255));
+
+		if (ImGui::IsMouseReleased(ImGuiMouseButton_Left))
+		{
+			is_dragging = false;
+
+			RenderRegion region = make_render_region(
+				(drag_start.x - image_min.x) / image_size.x, (drag_start.y - image_min.y) / image_size.y,
+				(io.MousePos.x - image_min.x) / image_size.x, (io.MousePos.y - image_min.y) / image_size.y,
+				m_window_width_, m_window_height_);
+
+			if (!region.is_empty())
+			{
+				begin_region_render(region);
+			}
+		}
+	}
+
+	if (m_region_render_.is_active())
+	{
+		const RenderRegion& region = m_region_render_.get_region();
+		const float scale_x = image_size.x / m_window_width_;
+		const float scale_y = image_size.y / m_window_height_;
+
+		draw_list->AddRect(ImVec2(image_min.x + region.x0 * scale_x, image_min.y + region.y0 * scale_y),
+			ImVec2(image_min.x + region.x1 * scale_x, image_min.y + region.y1 * scale_y), IM_COL32(0, 200, 255, 255));
+	}
+}
 
 // UI
 void viewer()
@@ -803,7 +1570,7 @@ void viewer()
 
 	ImGuiWindowFlags window_flags = 0;
 
-	if (isLeftAltPressed) {
+	if (isLeftAltPressed || io.KeyCtrl) {
 		window_flags |= ImGuiWindowFlags_NoMove;
 	}
 
@@ -812,6 +1579,16 @@ void viewer()
 
 	if (ImGui::Begin("Viewer", nullptr, ImGuiWindowFlags_MenuBar | window_flags))
 	{
+		// Sizes picked meanwhile are applied once the renderer is up
+		if (!m_scene_ready_)
+		{
+			ImGui::Text(m_startup_.has_failed() ? "Renderer failed to start at : %s" : "Loading renderer : %s", m_startup_.get_current_stage().c_str());
+			ImGui::ProgressBar(m_startup_.get_progress(), ImVec2(250.0f, 0.0f));
+			ImGui::Text("%.1f s", m_startup_.get_elapsed_ms() / 1000.0);
+			ImGui::End();
+			return;
+		}
+
 		if (ImGui::BeginMenuBar())
 		{
 			ImGui::Text("Size : ");
@@ -840,16 +1617,35 @@ void viewer()
 
 			ImGui::SameLine();
 
+			if (m_region_render_.is_active())
+			{
+				int budget = m_region_render_.get_budget();
+				ImGui::SetNextItemWidth(80);
+				if (ImGui::DragInt("Region samples", &budget, 1.0f, 1, 65536))
+				{
+					m_region_render_.set_budget(budget);
+					m_is_dirty_ = true;
+				}
+
+				ImGui::SameLine();
+
+				if (ImGui::Button("Full frame"))
+				{
+					end_region_render();
+				}
+
+				ImGui::SameLine();
+			}
+
 			ImGui::SameLine();
 			// progress bar
 			float progress = get_render_progress();
-			int max_samples = get_max_samples();
+			int max_samples = m_region_render_.is_active() ? m_region_render_.get_budget() : get_max_samples();
 			int current_samples = static_cast<int>(progress / 100.0f * max_samples);
 			ImGui::SetNextItemWidth(100);
 			ImGui::Text("Progress : ");
 			ImGui::SetNextItemWidth(250);
-			char overlayText[32];
-			sprintf_s(overlayText, "%d sur %d", current_samples, max_samples);
+			const char* overlayText = get_frame_arena().format("%d sur %d", current_samples, max_samples);
 			ImGui::ProgressBar(progress / 100.0f, ImVec2(0.0f, 0.0f), overlayText);
 			bool isRenderComplete = (progress >= 100.0f);
 			ImGui::EndMenuBar();
@@ -884,8 +1680,7 @@ void viewer()
 
 			if (isRenderComplete)
 			{
-				char timeString[100];
-				snprintf(timeString, sizeof(timeString), "Rendering finish in : %lldh %lldm %llds %lldms", hours, minutes, seconds, milliseconds);
+				const char* timeString = get_frame_arena().format("Rendering finish in : %lldh %lldm %llds %lldms", hours, minutes, seconds, milliseconds);
 
 
 
@@ -915,12 +1710,27 @@ void viewer()
 
 		if (customX != lastCustomX || customY != lastCustomY)
 		{
-			radeon_resize_render(customX, customY);
+			if (fit_viewer_size(customX, customY))
+			{
+				radeon_resize_render(customX, customY);
+			}
+			else
+			{
+				customX = lastCustomX;
+				customY = lastCustomY;
+			}
+
 			lastCustomX = customX;
 			lastCustomY = customY;
 		}
 
-		GLuint TextureID = get_texture_buffer();
+		if (ImGui::GetFrameCount() - m_viewer_budget_frame_ < 180)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), m_viewer_budget_refused_ ?
+				"Viewer size refused, over the memory budget" : "Viewer size reduced to fit the memory budget");
+		}
+
+		GLuint TextureID = m_display_texture_;
 		ImVec2 m_viewer_size = ImGui::GetContentRegionAvail();
 
 
@@ -929,11 +1739,19 @@ void viewer()
 		{
 			if (m_viewer_size.x != lastSize.x || m_viewer_size.y != lastSize.y)
 			{
-				radeon_resize_render(static_cast<int>(m_viewer_size.x), static_cast<int>(m_viewer_size.y));
+				int width = static_cast<int>(m_viewer_size.x);
+				int height = static_cast<int>(m_viewer_size.y);
+
+				if (fit_viewer_size(width, height))
+				{
+					radeon_resize_render(width, height);
+				}
+
 				lastSize = m_viewer_size;
 			}
 
 			ImGui::Image((void*)(intptr_t)TextureID, ImVec2(m_viewer_size.x, m_viewer_size.y));
+			viewer_region_drag();
 		}
 		else
 		{
@@ -958,6 +1776,7 @@ void viewer()
 			ImGui::SetCursorPos(ImVec2(offsetX + 30, offsetY + 60));
 
 			ImGui::Image((void*)(intptr_t)TextureID, img_size);
+			viewer_region_drag();
 
 			float middleX = offsetX + 30 + img_size.x / 2.0f;
 			float middleY = offsetY + 60 + img_size.y / 2.0f;
@@ -972,39 +1791,1469 @@ void viewer()
 	ImGui::End();
 }
 
+// Node editor
+UINodeManager m_node_manager_;
+bool m_node_culling_ = true;
+std::vector<int> m_visible_nodes_;
+std::vector<int> m_visible_links_;
+std::vector<uint8_t> m_node_visible_;
+std::vector<uint8_t> m_node_selected_;
+std::vector<int> m_node_edit_frame_;
+float m_node_editor_time_ms_ = 0.0f;
+bool m_node_editor_changed_ = false;
+std::vector<uint8_t> m_graph_bytes_;
+
+// Pin a link is being dragged from, -1 when none. Pins the link cannot reach without closing
+// a cycle are drawn red until the mouse is released.
+int m_link_drag_pin_ = -1;
+std::vector<uint8_t> m_link_drag_cycle_nodes_;
+int m_link_reorder_size_ = 0;
+
+// Node timings, the graph only holds the profiler while profiling is on
+GraphProfiler m_graph_profiler_;
+bool m_profile_graph_ = false;
+bool m_show_heat_map_ = true;
+int m_profile_top_count_ = 20;
+double m_profile_max_ns_ = 0.0;
+std::vector<int> m_profile_top_;
+
+PreviewService m_preview_service_;
+bool m_show_previews_ = true;
+
+// UI frame time measured after a stress graph is generated
+const int stress_sizes[] = { 1000, 10000, 100000 };
+float stress_results_ms[3] = { 0.0f, 0.0f, 0.0f };
+int stress_current = -1;
+int stress_frames = 0;
+double stress_accumulated_ms = 0.0;
+
+void generate_stress_graph(int node_count)
+{
+	m_node_manager_.clear();
+	m_preview_service_.clear();
+
+	const int rows = 100;
+	const int columns = (node_count + rows - 1) / rows;
+	std::vector<int> previous_column;
+	std::vector<int> column;
 
-int main()
+	srand(42);
+
+	for (int c = 0; c < columns; ++c)
+	{
+		column.clear();
+
+		for (int r = 0; r < rows && c * rows + r < node_count; ++r)
+		{
+			float x = c * 220.0f;
+			float y = r * 140.0f;
+
+			if (c == 0)
+			{
+				Color color = { rand() / float(RAND_MAX), rand() / float(RAND_MAX), rand() / float(RAND_MAX) };
+				column.push_back(m_node_manager_.create_node(std::make_unique<ConstantColorNode>(color), x, y));
+			}
+			else
+			{
+				int id = m_node_manager_.create_node(std::make_unique<MixColorNode>(), x, y);
+
+				m_node_manager_.create_link(make_output_pin_id(previous_column[r % previous_column.size()]), make_input_pin_id(id, 0));
+				m_node_manager_.create_link(make_output_pin_id(previous_column[(r + 1) % previous_column.size()]), make_input_pin_id(id, 1));
+
+				column.push_back(id);
+			}
+		}
+
+		previous_column.swap(column);
+	}
+
+	ImNodes::EditorContextResetPanning(ImVec2(0.0f, 0.0f));
+}
+
+// A link from the dragged pin would close a cycle on pin, by the nodes taken at drag start
+bool is_link_drag_cycle(int pin)
 {
-	// Initialize the library
-	opengl_init();
-	imgui_init();
-	radeon_init();
-	radeon_init_pre_render(m_window_width_, m_window_height_);
+	if (m_link_drag_pin_ == -1 || is_output_pin(pin) == is_output_pin(m_link_drag_pin_))
+	{
+		return false;
+	}
 
-	// Main loop
-	while (!glfwWindowShouldClose(window))
+	const int id = get_pin_node_id(pin);
+
+	return id < static_cast<int>(m_link_drag_cycle_nodes_.size()) && m_link_drag_cycle_nodes_[id];
+}
+
+// Red while a dragged link could not end on the pin
+bool push_pin_cycle_color(int pin)
+{
+	if (!is_link_drag_cycle(pin))
 	{
-		// Pre rendering
-		opengl_render();
-		imgui_init_render();
-		radeon_init_render();
+		return false;
+	}
 
-		// Rendering
-		radeon_render_engine();
+	ImNodes::PushColorStyle(ImNodesCol_Pin, IM_COL32(220, 60, 60, 255));
+	ImNodes::PushColorStyle(ImNodesCol_PinHovered, IM_COL32(255, 80, 80, 255));
+	return true;
+}
 
-		// Show the viewer with the rendered image <- dynamic window and buffers
-		// You can modificate the scene in real time
-		viewer();
+void pop_pin_cycle_color(bool pushed)
+{
+	if (pushed)
+	{
+		ImNodes::PopColorStyle();
+		ImNodes::PopColorStyle();
+	}
+}
 
-		// Post rendering
-		imgui_post_render();
-		opengl_post_render();
+// Cold to hot, blue through green and yellow to red
+ImU32 get_heat_color(float t)
+{
+	t = std::clamp(t, 0.0f, 1.0f);
+
+	const float r = std::clamp(t * 2.0f - 0.5f, 0.0f, 1.0f);
+	const float g = t < 0.5f ? t * 2.0f : 2.0f - t * 2.0f;
+	const float b = std::clamp(1.0f - t * 3.0f, 0.0f, 1.0f);
+
+	return IM_COL32(static_cast<int>(40 + r * 200), static_cast<int>(40 + g * 160), static_cast<int>(40 + b * 160), 255);
+}
+
+void render_ui_node(int id)
+{
+	Graph& graph = m_node_manager_.get_graph();
+	ColorNode* node = graph.get_node(id);
+	const UINode& ui_node = m_node_manager_.get_ui_node(id);
+
+	ImNodes::SetNodeGridSpacePos(id, ImVec2(ui_node.x, ui_node.y));
+
+	// Title bars colored by the node's mean time against the slowest node
+	const NodeProfile* profile = m_profile_graph_ ? m_graph_profiler_.find(id) : nullptr;
+	const bool is_heat = profile && m_show_heat_map_ && m_profile_max_ns_ > 0.0;
+
+	if (is_heat)
+	{
+		ImU32 color = get_heat_color(static_cast<float>(profile->mean_ns / m_profile_max_ns_));
+		ImNodes::PushColorStyle(ImNodesCol_TitleBar, color);
+		ImNodes::PushColorStyle(ImNodesCol_TitleBarHovered, color);
+		ImNodes::PushColorStyle(ImNodesCol_TitleBarSelected, color);
+	}
+
+	ImNodes::BeginNode(id);
+
+	ImNodes::BeginNodeTitleBar();
+	ImGui::TextUnformatted(node->get_name());
+
+	if (profile)
+	{
+		ImGui::SameLine();
+		ImGui::TextDisabled("%.0f ns", profile->mean_ns);
+	}
+
+	ImNodes::EndNodeTitleBar();
+
+	ImGui::PushID(id);
+
+	for (int i = 0; i < node->get_input_count(); ++i)
+	{
+		bool is_cycle = push_pin_cycle_color(make_input_pin_id(id, i));
+		ImNodes::BeginInputAttribute(make_input_pin_id(id, i));
+		ImGui::Text("Input %d", i);
+		ImNodes::EndInputAttribute();
+		pop_pin_cycle_color(is_cycle);
+	}
+
+	bool is_edited = false;
+
+	if (node->get_type() == ColorNodeType::Constant)
+	{
+		is_edited = ImGui::ColorEdit3("##color", node->get_params(), ImGuiColorEditFlags_NoInputs);
+	}
+	else if (node->get_type() == ColorNodeType::Instancer)
+	{
+		float* params = node->get_params();
+		const char* modes[] = { "Grid", "Surface", "Point file" };
+		int mode = static_cast<int>(params[InstancerColorNode::Mode]);
+		int count = static_cast<int>(params[InstancerColorNode::Count]);
+		int seed = static_cast<int>(params[InstancerColorNode::Seed]);
+
+		ImGui::PushItemWidth(120);
+
+		if (ImGui::Combo("Mode", &mode, modes, IM_ARRAYSIZE(modes)))
+		{
+			params[InstancerColorNode::Mode] = static_cast<float>(mode);
+			is_edited = true;
+		}
+
+		if (ImGui::DragInt("Count", &count, 10.0f, 0, 1000000))
+		{
+			params[InstancerColorNode::Count] = static_cast<float>(count);
+			is_edited = true;
+		}
+
+		if (ImGui::DragInt("Seed", &seed, 1.0f, 0, 65535))
+		{
+			params[InstancerColorNode::Seed] = static_cast<float>(seed);
+			is_edited = true;
+		}
+
+		is_edited |= ImGui::DragFloat("Spacing", &params[InstancerColorNode::Spacing], 0.05f, 0.1f, 100.0f);
+		is_edited |= ImGui::DragFloatRange2("Scale", &params[InstancerColorNode::ScaleMin], &params[InstancerColorNode::ScaleMax], 0.01f, 0.01f, 10.0f);
+		is_edited |= ImGui::DragFloat("Jitter", &params[InstancerColorNode::Jitter], 0.01f, 0.0f, 1.0f);
+
+		ImGui::PopItemWidth();
+
+		auto iter = m_instancers_.find(id);
+
+		if (iter != m_instancers_.end())
+		{
+			InstancerEntry& entry = iter->second;
+
+			if (mode == static_cast<int>(ScatterMode::PointFile))
+			{
+				ImGui::SetNextItemWidth(160);
+
+				if (ImGui::InputText("File", entry.point_file, sizeof(entry.point_file), ImGuiInputTextFlags_EnterReturnsTrue))
+				{
+					entry.settings.point_file = entry.point_file;
+				}
+			}
+
+			const InstancerStats& stats = entry.instancer->get_stats();
+			ImGui::Text("%d instances", stats.instances);
+
+			if (stats.pending > 0)
+			{
+				ImGui::Text("%d pending", stats.pending);
+			}
+
+			if (stats.error)
+			{
+				ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.3f, 1.0f), "%s", stats.error);
+			}
+		}
+	}
+	else if (node->get_param_count() > 0)
+	{
+		ImGui::SetNextItemWidth(100);
+		is_edited = ImGui::DragFloat("##factor", node->get_params(), 0.01f, 0.0f, 1.0f);
+	}
+
+	if (is_edited)
+	{
+		m_node_manager_.mark_edited(id);
+		m_node_edit_frame_[id] = ImGui::GetFrameCount();
+	}
+
+	bool is_cycle = push_pin_cycle_color(make_output_pin_id(id));
+	ImNodes::BeginOutputAttribute(make_output_pin_id(id));
+	Color output = graph.get_output(id);
+	float uv[4];
+
+	if (m_show_previews_)
+	{
+		bool recently_edited = ImGui::GetFrameCount() - m_node_edit_frame_[id] < 120;
+		m_preview_service_.request(id, build_preview_chain(graph, id), recently_edited);
+	}
+
+	if (m_show_previews_ && m_preview_service_.get_preview(id, uv))
+	{
+		ImGui::Image((void*)(intptr_t)m_preview_service_.get_atlas_texture(), ImVec2(48, 48), ImVec2(uv[0], uv[1]), ImVec2(uv[2], uv[3]));
+	}
+	else
+	{
+		ImGui::ColorButton("##output", ImVec4(output.r, output.g, output.b, 1.0f), ImGuiColorEditFlags_NoTooltip, ImVec2(20, 20));
+	}
+	ImNodes::EndOutputAttribute();
+	pop_pin_cycle_color(is_cycle);
+
+	ImGui::PopID();
+
+	ImNodes::EndNode();
+
+	if (is_heat)
+	{
+		ImNodes::PopColorStyle();
+		ImNodes::PopColorStyle();
+		ImNodes::PopColorStyle();
+	}
+}
+
+void node_editor()
+{
+	const auto frame_start = std::chrono::high_resolution_clock::now();
+
+	Graph& graph = m_node_manager_.get_graph();
+	const SpatialGrid& index = m_node_manager_.get_index();
+
+	m_preview_service_.begin_frame();
+	m_node_editor_changed_ = false;
+
+	if (ImGui::Begin("Node Editor", nullptr, ImGuiWindowFlags_MenuBar))
+	{
+		ImVec2 panning = ImNodes::EditorContextGetPanning();
+
+		if (ImGui::BeginMenuBar())
+		{
+			if (ImGui::BeginMenu("Add"))
+			{
+				const char* names[] = { "Constant Color", "Add", "Multiply", "Mix", "Invert", "Instancer" };
+
+				for (int i = 0; i < IM_ARRAYSIZE(names); ++i)
+				{
+					if (ImGui::MenuItem(names[i]))
+					{
+						m_node_manager_.create_node(create_color_node(static_cast<ColorNodeType>(i)), -panning.x + 50.0f, -panning.y + 50.0f);
+					}
+				}
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Stress test"))
+			{
+				for (int i = 0; i < IM_ARRAYSIZE(stress_sizes); ++i)
+				{
+					char label[32];
+					snprintf(label, sizeof(label), "%d nodes", stress_sizes[i]);
+
+					if (ImGui::MenuItem(label))
+					{
+						generate_stress_graph(stress_sizes[i]);
+						stress_current = i;
+						stress_frames = 0;
+						stress_accumulated_ms = 0.0;
+					}
+				}
+
+				ImGui::Separator();
+
+				for (int i = 0; i < IM_ARRAYSIZE(stress_sizes); ++i)
+				{
+					ImGui::Text("%d nodes : %.3f ms", stress_sizes[i], stress_results_ms[i]);
+				}
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Cache"))
+			{
+				OutputCache& cache = get_output_cache();
+				CacheStats stats = cache.get_stats();
+
+				bool use_cache = graph.get_cache_enabled();
+				if (ImGui::Checkbox("Enabled", &use_cache))
+				{
+					graph.set_cache_enabled(use_cache);
+					m_node_manager_.mark_dirty();
+				}
+
+				int capacity_mb = static_cast<int>(cache.get_capacity() / (1024 * 1024));
+				ImGui::SetNextItemWidth(120);
+				if (ImGui::DragInt("Capacity (MB)", &capacity_mb, 1.0f, 1, 4096))
+				{
+					cache.set_capacity(static_cast<size_t>(capacity_mb) * 1024 * 1024);
+				}
+
+				ImGui::Separator();
+				ImGui::Text("Hit rate : %.1f %%", stats.get_hit_rate() * 100.0f);
+				ImGui::Text("Hits : %llu / Misses : %llu", static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses));
+				ImGui::Text("Entries : %zu (%.2f MB)", stats.entries, stats.bytes / (1024.0f * 1024.0f));
+				ImGui::Text("Evictions : %llu", static_cast<unsigned long long>(stats.evictions));
+
+				if (ImGui::MenuItem("Reset stats"))
+				{
+					cache.reset_stats();
+				}
+
+				if (ImGui::MenuItem("Clear"))
+				{
+					cache.clear();
+				}
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Program"))
+			{
+				bool use_program = graph.get_compiled();
+				if (ImGui::Checkbox("Compiled evaluation", &use_program))
+				{
+					graph.set_compiled(use_program);
+					m_node_manager_.mark_dirty();
+				}
+
+				const ProgramStats& stats = graph.get_program().get_stats();
+
+				ImGui::Separator();
+				ImGui::Text("Instructions : %d", stats.instructions);
+				ImGui::Text("Registers : %d (%d constants)", stats.registers, stats.constants);
+				ImGui::Text("Folded : %d / Eliminated : %d", stats.folded, stats.eliminated);
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Profiler"))
+			{
+				if (ImGui::Checkbox("Profile nodes", &m_profile_graph_))
+				{
+					graph.set_profiler(m_profile_graph_ ? &m_graph_profiler_ : nullptr);
+				}
+
+				int interval = m_graph_profiler_.get_sample_interval();
+				if (ImGui::SliderInt("Time one pass in", &interval, 1, 64))
+				{
+					m_graph_profiler_.set_sample_interval(interval);
+				}
+
+				ImGui::Checkbox("Heat map", &m_show_heat_map_);
+				ImGui::SliderInt("Top nodes", &m_profile_top_count_, 5, 100);
+
+				if (ImGui::MenuItem("Reset"))
+				{
+					m_graph_profiler_.reset();
+				}
+
+				if (ImGui::MenuItem("Export graph_profile.csv"))
+				{
+					if (!m_graph_profiler_.write_csv("graph_profile.csv", graph))
+					{
+						std::cout << "Error: cannot write graph_profile.csv" << std::endl;
+					}
+				}
+
+				ImGui::Separator();
+				ImGui::Text("Passes : %llu", static_cast<unsigned long long>(m_graph_profiler_.get_pass_count()));
+				ImGui::Text("Interpreted pass : %.3f ms", m_graph_profiler_.get_pass_ns() / 1e6);
+				ImGui::Text("Compiled pass : %.3f ms", m_graph_profiler_.get_program_ns() / 1e6);
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Previews"))
+			{
+				PreviewStats stats = m_preview_service_.get_stats();
+
+				ImGui::Checkbox("Show swatches", &m_show_previews_);
+
+				float budget_ms = m_preview_service_.get_budget_ms();
+				ImGui::SetNextItemWidth(120);
+				if (ImGui::DragFloat("Budget (ms / frame)", &budget_ms, 0.1f, 0.1f, 16.0f))
+				{
+					m_preview_service_.set_budget_ms(budget_ms);
+				}
+
+				ImGui::Separator();
+				ImGui::Text("Pending : %d", stats.pending);
+				ImGui::Text("Rendered : %d / Uploaded : %d", stats.rendered, stats.uploaded);
+				ImGui::Text("Cancelled : %d / Evicted : %d", stats.cancelled, stats.evicted);
+				ImGui::Text("Last swatch : %.3f ms", stats.worker_ms);
+
+				ImGui::EndMenu();
+			}
+
+			ImGui::Checkbox("Culling", &m_node_culling_);
+
+			ImGui::Text("| UI : %.3f ms | Visible : %d / %d nodes", m_node_editor_time_ms_, static_cast<int>(m_visible_nodes_.size()), graph.get_node_count());
+			ImGui::Text("| Last link reordered %d", m_link_reorder_size_);
+
+			ImGui::EndMenuBar();
+		}
+
+		m_node_editor_changed_ = m_node_manager_.evaluate_if_dirty();
+
+		// Every evaluated change, the checkpoints of another graph are not resumed
+		if (m_node_editor_changed_ || m_graph_hash_ == 0)
+		{
+			write_graph(graph, m_graph_bytes_);
+			m_graph_hash_ = hash_checkpoint_bytes(m_graph_bytes_.data(), m_graph_bytes_.size());
+		}
+		m_profile_max_ns_ = m_profile_graph_ ? m_graph_profiler_.get_max_mean_ns() : 0.0;
+
+		ImVec2 canvas_origin = ImGui::GetCursorScreenPos();
+		ImVec2 canvas_size = ImGui::GetContentRegionAvail();
+
+		// Visible region of the canvas in grid space, padded so nodes do not pop at the border
+		const SpatialRect view = SpatialRect{ -panning.x, -panning.y, -panning.x + canvas_size.x, -panning.y + canvas_size.y }.expanded(32.0f);
+
+		if (m_node_culling_)
+		{
+			index.query_nodes(view, m_visible_nodes_);
+			index.query_links(view, m_visible_links_);
+		}
+		else
+		{
+			m_visible_nodes_.clear();
+			m_visible_links_.clear();
+
+			for (int id = 0; id < graph.get_node_capacity(); ++id)
+			{
+				if (graph.get_node(id))
+				{
+					m_visible_nodes_.push_back(id);
+				}
+			}
+
+			for (int link_id = 0; link_id < graph.get_link_capacity(); ++link_id)
+			{
+				if (graph.get_link(link_id))
+				{
+					m_visible_links_.push_back(link_id);
+				}
+			}
+		}
+
+		m_node_visible_.resize(graph.get_node_capacity(), 0);
+		m_node_selected_.resize(graph.get_node_capacity(), 0);
+		m_node_edit_frame_.resize(graph.get_node_capacity(), -1000);
+
+		uint8_t* was_visible = get_frame_arena().allocate_array<uint8_t>(m_node_visible_.size());
+		std::copy(m_node_visible_.begin(), m_node_visible_.end(), was_visible);
+		std::fill(m_node_visible_.begin(), m_node_visible_.end(), 0);
+
+		for (int id : m_visible_nodes_)
+		{
+			m_node_visible_[id] = 1;
+		}
+
+		ImNodes::BeginNodeEditor();
+
+		// Links with a culled end are drawn as a plain segment instead of submitting the far node
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		ImVec2 offset = ImVec2(canvas_origin.x + panning.x, canvas_origin.y + panning.y);
+
+		for (int link_id : m_visible_links_)
+		{
+			const Link* link = graph.get_link(link_id);
+
+			if (!m_node_visible_[get_pin_node_id(link->start_pin)] || !m_node_visible_[get_pin_node_id(link->end_pin)])
+			{
+				float x0, y0, x1, y1;
+				m_node_manager_.get_link_segment(link_id, x0, y0, x1, y1);
+				draw_list->AddLine(ImVec2(x0 + offset.x, y0 + offset.y), ImVec2(x1 + offset.x, y1 + offset.y), IM_COL32(120, 120, 140, 160), 1.5f);
+			}
+		}
+
+		for (int id : m_visible_nodes_)
+		{
+			render_ui_node(id);
+		}
+
+		for (int link_id : m_visible_links_)
+		{
+			const Link* link = graph.get_link(link_id);
+
+			if (m_node_visible_[get_pin_node_id(link->start_pin)] && m_node_visible_[get_pin_node_id(link->end_pin)])
+			{
+				ImNodes::Link(link_id, link->start_pin, link->end_pin);
+			}
+		}
+
+		bool is_editor_hovered = ImNodes::IsEditorHovered();
+
+		ImNodes::EndNodeEditor();
+
+		int start_pin, end_pin;
+		if (ImNodes::IsLinkCreated(&start_pin, &end_pin))
+		{
+			if (m_node_manager_.create_link(start_pin, end_pin) != -1)
+			{
+				m_link_reorder_size_ = graph.get_last_reorder_size();
+			}
+		}
+
+		if (ImNodes::IsLinkStarted(&start_pin))
+		{
+			m_link_drag_pin_ = start_pin;
+			graph.get_cycle_nodes(start_pin, m_link_drag_cycle_nodes_);
+		}
+		else if (m_link_drag_pin_ != -1 && !ImGui::IsMouseDown(ImGuiMouseButton_Left))
+		{
+			m_link_drag_pin_ = -1;
+			m_link_drag_cycle_nodes_.clear();
+		}
+
+		int hovered_pin;
+		if (ImNodes::IsPinHovered(&hovered_pin) && is_link_drag_cycle(hovered_pin))
+		{
+			ImGui::SetTooltip("Would create a cycle");
+		}
+
+		if (m_preview_service_.upload_results() > 0)
+		{
+			m_node_editor_changed_ = true;
+		}
+
+		// ImNodes forgets nodes that are not submitted, so positions and selection live on our side
+		for (int id : m_visible_nodes_)
+		{
+			ImVec2 position = ImNodes::GetNodeGridSpacePos(id);
+			ImVec2 dimensions = ImNodes::GetNodeDimensions(id);
+
+			m_node_manager_.move_node(id, position.x, position.y);
+			m_node_manager_.resize_node(id, dimensions.x, dimensions.y);
+
+			if (!was_visible[id] && m_node_selected_[id])
+			{
+				ImNodes::SelectNode(id);
+			}
+			else
+			{
+				m_node_selected_[id] = ImNodes::IsNodeSelected(id);
+			}
+		}
+
+		if (is_editor_hovered)
+		{
+			ImVec2 mouse = ImGui::GetIO().MousePos;
+			int hovered = index.hit_test_node(mouse.x - offset.x, mouse.y - offset.y);
+
+			if (hovered != -1)
+			{
+				Color output = graph.get_output(hovered);
+				ImGui::SetTooltip("%s #%d\n%.3f %.3f %.3f", graph.get_node(hovered)->get_name(), hovered, output.r, output.g, output.b);
+			}
+
+			if (ImGui::IsKeyPressed(ImGuiKey_Delete))
+			{
+				int link_count = ImNodes::NumSelectedLinks();
+
+				if (link_count > 0)
+				{
+					int* selected_links = get_frame_arena().allocate_array<int>(link_count);
+					ImNodes::GetSelectedLinks(selected_links);
+
+					for (int i = 0; i < link_count; ++i)
+					{
+						m_node_manager_.remove_link(selected_links[i]);
+					}
+				}
+
+				for (int id = 0; id < static_cast<int>(m_node_selected_.size()); ++id)
+				{
+					if (m_node_selected_[id])
+					{
+						m_node_manager_.remove_node(id);
+						m_node_selected_[id] = 0;
+					}
+				}
+
+				ImNodes::ClearNodeSelection();
+				ImNodes::ClearLinkSelection();
+			}
+		}
+	}
+
+	ImGui::End();
+
+	const auto frame_end = std::chrono::high_resolution_clock::now();
+	m_node_editor_time_ms_ = std::chrono::duration<float, std::milli>(frame_end - frame_start).count();
+
+	if (stress_current != -1)
+	{
+		// Skip the first frames, ImNodes allocates its pools while the graph appears
+		if (++stress_frames > 10)
+		{
+			stress_accumulated_ms += m_node_editor_time_ms_;
+		}
+
+		if (stress_frames == 130)
+		{
+			stress_results_ms[stress_current] = static_cast<float>(stress_accumulated_ms / 120.0);
+			std::cout << "Node editor " << stress_sizes[stress_current] << " nodes : " << stress_results_ms[stress_current] << " ms per frame" << std::endl;
+			stress_current = -1;
+		}
+	}
+}
+
+// Slowest nodes first, sorted on the clicked column
+void node_profile_panel()
+{
+	if (!m_profile_graph_)
+	{
+		return;
+	}
+
+	if (ImGui::Begin("Node profile", &m_profile_graph_))
+	{
+		Graph& graph = m_node_manager_.get_graph();
+
+		static ProfileSort sort = ProfileSort::Mean;
+		const ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY;
+
+		if (ImGui::BeginTable("##profile", 6, flags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Node", ImGuiTableColumnFlags_NoSort);
+			ImGui::TableSetupColumn("Mean ns", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, static_cast<ImGuiID>(ProfileSort::Mean));
+			ImGui::TableSetupColumn("Peak ns", ImGuiTableColumnFlags_PreferSortDescending, 0.0f, static_cast<ImGuiID>(ProfileSort::Peak));
+			ImGui::TableSetupColumn("Total ms", ImGuiTableColumnFlags_PreferSortDescending, 0.0f, static_cast<ImGuiID>(ProfileSort::Total));
+			ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_PreferSortDescending, 0.0f, static_cast<ImGuiID>(ProfileSort::Calls));
+			ImGui::TableSetupColumn("Cache hits", ImGuiTableColumnFlags_NoSort);
+			ImGui::TableHeadersRow();
+
+			if (ImGuiTableSortSpecs* specs = ImGui::TableGetSortSpecs())
+			{
+				if (specs->SpecsCount > 0)
+				{
+					sort = static_cast<ProfileSort>(specs->Specs[0].ColumnUserID);
+				}
+
+				specs->SpecsDirty = false;
+			}
+
+			m_graph_profiler_.get_top(m_profile_top_count_, sort, m_profile_top_);
+
+			for (int id : m_profile_top_)
+			{
+				const NodeProfile* profile = m_graph_profiler_.find(id);
+				const ColorNode* node = graph.get_node(id);
+
+				if (!profile || !node)
+				{
+					continue;
+				}
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%s %d", node->get_name(), id);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", profile->mean_ns);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", profile->peak_ns);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", profile->get_total_ms());
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", static_cast<unsigned long long>(profile->calls));
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", static_cast<unsigned long long>(profile->cache_hits));
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	ImGui::End();
+
+	// Closed from its title bar
+	if (!m_profile_graph_)
+	{
+		m_node_manager_.get_graph().set_profiler(nullptr);
+	}
+}
+
+std::vector<int> m_instancer_nodes_;
+uint64_t m_instancer_revision_ = ~0ull;
+
+// Keeps one Instancer per Instancer node in sync with its parameters and tint. Creation is
+// spread over frames by the instancer, this only pushes what changed.
+void update_instancers()
+{
+	if (!m_scene_ready_)
+	{
+		return;
+	}
+
+	Graph& graph = m_node_manager_.get_graph();
+
+	// The node list is only rescanned when the topology changed
+	if (graph.get_topology_revision() != m_instancer_revision_)
+	{
+		m_instancer_revision_ = graph.get_topology_revision();
+		m_instancer_nodes_.clear();
+
+		for (int id = 0; id < graph.get_node_capacity(); ++id)
+		{
+			ColorNode* node = graph.get_node(id);
+
+			if (node && node->get_type() == ColorNodeType::Instancer)
+			{
+				m_instancer_nodes_.push_back(id);
+			}
+		}
+
+		for (auto iter = m_instancers_.begin(); iter != m_instancers_.end();)
+		{
+			if (std::find(m_instancer_nodes_.begin(), m_instancer_nodes_.end(), iter->first) != m_instancer_nodes_.end())
+			{
+				++iter;
+				continue;
+			}
+
+			// Queued edits on the instances and the material must not reach deleted handles
+			MemoryLedger::get().release(iter->second.instancer.get());
+			iter->second.instancer->clear(m_scene_edits_);
+			iter->second.instancer = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock(renderMutex);
+				m_scene_edits_.discard(iter->second.material);
+				CHECK(rprObjectDelete(iter->second.material));
+			}
+
+			iter = m_instancers_.erase(iter);
+			edit_scene().request_reset();
+		}
+	}
+
+	for (int id : m_instancer_nodes_)
+	{
+		InstancerEntry& entry = m_instancers_[id];
+
+		if (!entry.instancer)
+		{
+			entry.instancer = std::make_unique<Instancer>(context, m_scene_.scene, m_scene_.teapot, renderMutex);
+			entry.instancer->set_surface(m_scene_.floor_surface);
+
+			entry.settings.point_file = entry.point_file;
+
+			std::lock_guard<std::mutex> lock(renderMutex);
+			CHECK(rprMaterialSystemCreateNode(materialSystem, RPR_MATERIAL_NODE_UBERV2, &entry.material));
+			entry.instancer->set_material(entry.material);
+		}
+
+		const float* params = graph.get_node(id)->get_params();
+
+		ScatterSettings& settings = entry.settings;
+		settings.mode = static_cast<ScatterMode>(std::clamp(static_cast<int>(params[InstancerColorNode::Mode]), 0, 2));
+		settings.count = static_cast<int>(params[InstancerColorNode::Count]);
+		settings.spacing = params[InstancerColorNode::Spacing];
+		settings.seed = static_cast<uint32_t>(params[InstancerColorNode::Seed]);
+		settings.scale_min = params[InstancerColorNode::ScaleMin];
+		settings.scale_max = params[InstancerColorNode::ScaleMax];
+		settings.jitter = params[InstancerColorNode::Jitter];
+
+		// Counts the budget cannot hold are clamped, measured RPR cost per instance once known
+		const InstancerStats& stats = entry.instancer->get_stats();
+		size_t instance_bytes = 2 * sizeof(InstanceTransform) + sizeof(rpr_shape) + 512;
+
+		if (stats.instances > 0 && stats.rpr_bytes > 0)
+		{
+			instance_bytes = 2 * sizeof(InstanceTransform) + sizeof(rpr_shape) + static_cast<size_t>(stats.rpr_bytes) / stats.instances;
+		}
+
+		const int max_count = static_cast<int>(std::min<size_t>(MemoryLedger::get().get_available({ entry.instancer.get() }) / instance_bytes, 1000000));
+
+		if (settings.count > max_count)
+		{
+			settings.count = max_count;
+			graph.get_node(id)->get_params()[InstancerColorNode::Count] = static_cast<float>(max_count);
+			m_node_manager_.mark_edited(id);
+			MemoryLedger::get().count_refusal();
+		}
+
+		entry.instancer->set_settings(settings);
+
+		Color tint = graph.get_output(id);
+
+		if (tint.r != entry.tint.r || tint.g != entry.tint.g || tint.b != entry.tint.b)
+		{
+			entry.tint = tint;
+			edit_scene().set_material_value(entry.material, RPR_MATERIAL_INPUT_UBER_DIFFUSE_COLOR, tint.r, tint.g, tint.b, 1.0f);
+		}
+
+		// Instances attached directly need the accumulation restarted too
+		const int64_t start_ns = m_profile_graph_ ? GraphProfiler::now_ns() : 0;
+		const bool is_updated = entry.instancer->update(m_scene_edits_);
+
+		if (is_updated)
+		{
+			edit_scene().request_reset();
+		}
+
+		size_t bytes = stats.host_bytes + static_cast<size_t>(std::max(stats.rpr_bytes, 0ll));
+
+		// Only frames that changed instances count as an execution of the node
+		if (m_profile_graph_ && is_updated)
+		{
+			m_graph_profiler_.add_sample(id, GraphProfiler::now_ns() - start_ns, bytes > entry.recorded_bytes ? bytes - entry.recorded_bytes : 0);
+		}
+
+		if (bytes != entry.recorded_bytes)
+		{
+			MemoryLedger::get().record(MemoryCategory::Instances, entry.instancer.get(), bytes, "Instancer node");
+			entry.recorded_bytes = bytes;
+		}
+	}
+}
+
+// No pointer motion, button, wheel or key this frame
+bool is_input_idle()
+{
+	ImGuiIO& io = ImGui::GetIO();
+
+	if (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f || io.MouseWheel != 0.0f || io.MouseWheelH != 0.0f)
+	{
+		return false;
+	}
+
+	if (ImGui::IsAnyMouseDown() || !io.InputQueueCharacters.empty())
+	{
+		return false;
+	}
+
+	for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END; ++key)
+	{
+		if (ImGui::IsKeyDown(static_cast<ImGuiKey>(key)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Host side entries change every frame, RPR's own counters are asked for now and then. The
+// frame never waits on the render lock for them, a busy lock moves the query to a later frame.
+void update_memory_ledger()
+{
+	MemoryLedger& ledger = MemoryLedger::get();
+
+	ledger.record(MemoryCategory::HostHeap, &get_frame_arena(), get_frame_arena().get_capacity(), "Frame arena");
+	ledger.record(MemoryCategory::HostHeap, &get_node_pool(), get_node_pool().get_reserved_bytes(), "Node pool");
+
+	if (ImGui::GetFrameCount() % 60 == 0)
+	{
+		m_ledger_query_pending_ = true;
+	}
+
+	if (!m_scene_ready_ || !m_ledger_query_pending_)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(renderMutex, std::try_to_lock);
+
+	if (!lock.owns_lock())
+	{
+		return;
+	}
+
+	m_ledger_query_pending_ = false;
+
+	rpr_render_statistics stats = {};
+
+	if (rprContextGetInfo(context, RPR_CONTEXT_RENDER_STATISTICS, sizeof(stats), &stats, nullptr) == RPR_SUCCESS)
+	{
+		ledger.set_reported(stats.sysmem_usage, stats.gpumem_usage);
+	}
+}
+
+// The CPU backend loads the teapot and builds its BVH on the UI thread, every frame waits for
+// the end of its pass so nothing renders meanwhile
+void set_cpu_renderer(bool is_cpu)
+{
+	save_checkpoint();
+	m_cpu_backend_ = nullptr;
+
+	if (is_cpu)
+	{
+		m_cpu_backend_ = std::make_unique<CpuRenderBackend>();
+
+		if (!m_cpu_backend_->resize(m_window_width_, m_window_height_) || !m_cpu_backend_->load_scene("teapot", get_viewer_camera(), m_env_intensity_))
+		{
+			std::cout << "CPU renderer unavailable, staying on RPR" << std::endl;
+			m_cpu_backend_ = nullptr;
+		}
+	}
+
+	m_backend_ = m_cpu_backend_ ? static_cast<RenderBackend*>(m_cpu_backend_.get()) : m_rpr_backend_.get();
+
+	end_region_render();
+	record_viewer_memory();
+	reset_buffer();
+
+	// After the reset above is committed
+	m_checkpoint_samples_ = 0;
+	m_resume_pending_ = true;
+}
+
+// Scene side services, one header per subsystem
+void scene_panel()
+{
+	if (ImGui::Begin("Scene"))
+	{
+		if (ImGui::CollapsingHeader("Image cache", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			ImageCacheStats stats = m_image_cache_->get_stats();
+
+			int budget_mb = static_cast<int>(m_image_cache_->get_budget() / (1024 * 1024));
+			ImGui::SetNextItemWidth(120);
+			if (ImGui::DragInt("Budget (MB)", &budget_mb, 1.0f, 1, 65536))
+			{
+				m_image_cache_->set_budget(static_cast<size_t>(budget_mb) * 1024 * 1024);
+			}
+
+			ImGui::Text("Images : %d", stats.images);
+			ImGui::Text("Resident : %.2f MB (%.2f MB referenced)", stats.resident_bytes / (1024.0f * 1024.0f), stats.referenced_bytes / (1024.0f * 1024.0f));
+			ImGui::Text("Requests : %llu", static_cast<unsigned long long>(stats.requests));
+			ImGui::Text("Hits : %llu / Coalesced : %llu", static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.coalesced));
+			ImGui::Text("Loads : %llu (%.1f ms) / Failures : %llu", static_cast<unsigned long long>(stats.loads), stats.load_ms, static_cast<unsigned long long>(stats.failures));
+			ImGui::Text("Evictions : %llu", static_cast<unsigned long long>(stats.evictions));
+
+			if (ImGui::Button("Drop unused"))
+			{
+				m_image_cache_->clear();
+			}
+		}
+
+		if (m_scene_ready_ && ImGui::CollapsingHeader("Camera"))
+		{
+			bool is_camera_edited = false;
+
+			is_camera_edited |= ImGui::DragFloat3("Eye", m_camera_eye_, 0.05f);
+			is_camera_edited |= ImGui::DragFloat3("Target", m_camera_target_, 0.05f);
+
+			if (is_camera_edited)
+			{
+				const float up[3] = { 0.0f, 1.0f, 0.0f };
+				edit_scene().set_camera_look_at(m_scene_.camera, m_camera_eye_, m_camera_target_, up);
+			}
+
+			if (ImGui::DragFloat("Focal length (mm)", &m_camera_focal_length_, 0.1f, 5.0f, 300.0f))
+			{
+				edit_scene().set_camera_focal_length(m_scene_.camera, m_camera_focal_length_);
+			}
+
+			if (ImGui::DragFloat("Environment", &m_env_intensity_, 0.01f, 0.0f, 10.0f))
+			{
+				edit_scene().set_environment_intensity(m_scene_.env_light, m_env_intensity_);
+			}
+		}
+
+		if (m_scene_ready_ && ImGui::CollapsingHeader("Renderer"))
+		{
+			int renderer = m_cpu_backend_ ? 1 : 0;
+			const char* renderers[] = { "Radeon ProRender", "CPU reference" };
+
+			if (ImGui::Combo("Backend", &renderer, renderers, IM_ARRAYSIZE(renderers)))
+			{
+				set_cpu_renderer(renderer == 1);
+			}
+
+			if (m_cpu_backend_)
+			{
+				const Bvh& bvh = m_cpu_backend_->get_bvh();
+
+				ImGui::TextUnformatted("Teapots, floor and sky of its own, only the camera follows the scene");
+				ImGui::Text("Threads : %d", m_cpu_backend_->get_thread_count());
+				ImGui::Text("BVH : %d triangles, %d nodes, built in %.1f ms", bvh.get_triangle_count(), bvh.get_node_count(), bvh.get_build_ms());
+				ImGui::Text("Memory : %.1f MB", m_cpu_backend_->get_memory_bytes() / (1024.0f * 1024.0f));
+			}
+
+			ImGui::Text("Last pass : %.2f ms", m_last_pass_ms_);
+		}
+
+		if (m_scene_ready_ && ImGui::CollapsingHeader("Checkpoints"))
+		{
+			CheckpointStats stats = m_checkpoint_writer_.get_stats();
+
+			ImGui::Checkbox("Enabled", &m_checkpoints_enabled_);
+			ImGui::SetNextItemWidth(120);
+			ImGui::DragFloat("Interval (s)", &m_checkpoint_interval_s_, 0.5f, 1.0f, 3600.0f, "%.0f");
+
+			if (ImGui::Button("Save now"))
+			{
+				save_checkpoint();
+			}
+
+			ImGui::Text("Resumed : %d samples", m_resumed_samples_);
+			ImGui::Text("Written : %llu / Failed : %llu / Replaced : %llu", static_cast<unsigned long long>(stats.written),
+				static_cast<unsigned long long>(stats.failed), static_cast<unsigned long long>(stats.replaced));
+			ImGui::Text("Last : %.2f MB in %.1f ms (max %.1f ms)", stats.last_bytes / (1024.0f * 1024.0f), stats.last_write_ms, stats.max_write_ms);
+		}
+
+		if (ImGui::CollapsingHeader("Instancers"))
+		{
+			if (m_instancers_.empty())
+			{
+				ImGui::TextUnformatted("Add an Instancer node to scatter teapots");
+			}
+
+			for (const auto& [id, entry] : m_instancers_)
+			{
+				const InstancerStats& stats = entry.instancer->get_stats();
+
+				ImGui::Text("Node %d : %d instances (%d pending)", id, stats.instances, stats.pending);
+				ImGui::BulletText("Generate : %.2f ms / Create : %.1f ms", stats.generate_ms, stats.create_ms);
+				ImGui::BulletText("Updated transforms : %d", stats.updated);
+				ImGui::BulletText("Host : %.2f MB / RPR : %.2f MB", stats.host_bytes / (1024.0f * 1024.0f), stats.rpr_bytes / (1024.0f * 1024.0f));
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Frame publishing"))
+		{
+			// A new name takes effect on Enter, readers of the old one see the ring closed. Typing
+			// goes to its own buffer, the ring is never reopened under a half typed name.
+			ImGui::SetNextItemWidth(160);
+			bool changed = false;
+
+			if (ImGui::InputText("Name", m_publish_name_edit_, sizeof(m_publish_name_edit_), ImGuiInputTextFlags_EnterReturnsTrue))
+			{
+				snprintf(m_publish_name_, sizeof(m_publish_name_), "%s", m_publish_name_edit_);
+				changed = true;
+			}
+
+			changed |= ImGui::Checkbox("Publish frames", &m_publish_frames_);
+
+			if (changed)
+			{
+				update_frame_publisher();
+			}
+
+			if (m_frame_publisher_.is_open())
+			{
+				const FramePublisherStats& stats = m_frame_publisher_.get_stats();
+
+				ImGui::Text("Frames : %llu (%llu too large)", static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.skipped));
+				ImGui::Text("Latency : %.3f ms last, %.3f ms average, %.3f ms max", stats.last_ms, stats.average_ms, stats.max_ms);
+				ImGui::TextDisabled("From the end of the pass to the frame being readable");
+				ImGui::Text("Ring : %.1f MB", stats.mapped_bytes / (1024.0f * 1024.0f));
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Display", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			const char* curves[] = { "Clamp", "ACES filmic" };
+			const char* outputs[] = { "sRGB", "Gamma" };
+			const char* views[] = { "Image", "False color", "Clipping" };
+
+			bool changed = ImGui::SliderFloat("Exposure (stops)", &m_display_.exposure, -10.0f, 10.0f, "%.2f");
+			changed |= ImGui::Combo("Curve", &m_display_.curve, curves, IM_ARRAYSIZE(curves));
+			changed |= ImGui::Combo("Output", &m_display_.output, outputs, IM_ARRAYSIZE(outputs));
+
+			if (m_display_.output == 1)
+			{
+				changed |= ImGui::DragFloat("Gamma", &m_display_.gamma, 0.01f, 0.1f, 4.0f);
+			}
+
+			changed |= ImGui::Combo("View", &m_display_.view, views, IM_ARRAYSIZE(views));
+
+			if (m_display_.view == 1)
+			{
+				ImGui::TextUnformatted("Blue -6 stops, green middle grey, red +6 stops");
+			}
+			else if (m_display_.view == 2)
+			{
+				ImGui::TextUnformatted("Magenta over 1.0, blue under 1/1024");
+			}
+
+			if (ImGui::Button("Reset display"))
+			{
+				m_display_ = DisplaySettings();
+				changed = true;
+			}
+
+			if (changed)
+			{
+				m_display_dirty_ = true;
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Region render"))
+		{
+			if (m_region_render_.is_active())
+			{
+				const RenderRegion& region = m_region_render_.get_region();
+				const float full_ms = m_region_render_.get_full_ms_per_sample();
+				const float region_ms = m_region_render_.get_region_ms_per_sample();
+
+				ImGui::Text("Region : %dx%d at %d,%d (%.1f%% of the frame)", region.get_width(), region.get_height(), region.x0, region.y0, m_region_render_.get_area_fraction() * 100.0f);
+				ImGui::Text("Samples : %d / %d", m_region_render_.get_samples(), m_region_render_.get_budget());
+				ImGui::Text("Per sample : %.2f ms region, %.2f ms full frame", region_ms, full_ms);
+				ImGui::TextDisabled("Render passes only, the frame readback is not in either");
+
+				int display_interval = m_region_render_.get_display_interval();
+
+				if (ImGui::SliderInt("Display every##region", &display_interval, 1, 64, "%d samples"))
+				{
+					m_region_render_.set_display_interval(display_interval);
+				}
+
+				if (full_ms > 0.0f && region_ms > 0.0f)
+				{
+					ImGui::Text("Speedup : %.1fx for %.1fx fewer pixels", full_ms / region_ms, 1.0f / m_region_render_.get_area_fraction());
+				}
+
+				if (m_region_render_.get_converge_ms() >= 0.0)
+				{
+					ImGui::Text("Budget reached in %.1f ms", m_region_render_.get_converge_ms());
+				}
+
+				if (ImGui::Button("Full frame##region"))
+				{
+					end_region_render();
+				}
+			}
+			else
+			{
+				ImGui::TextUnformatted("Ctrl+drag in the viewer to render a region only");
+				ImGui::Text("Per sample : %.2f ms full frame", m_region_render_.get_full_ms_per_sample());
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Startup"))
+		{
+			for (const StartupStageTiming& timing : m_startup_.get_timings())
+			{
+				ImGui::BulletText("%s : %.1f ms (at %.1f ms)%s", timing.name.c_str(), timing.duration_ms, timing.start_ms, timing.on_loader ? " loader" : "");
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Scene edits"))
+		{
+			SceneTransactionStats stats = m_scene_edits_.get_stats();
+
+			ImGui::Text("Commits : %llu (%llu resets)", static_cast<unsigned long long>(stats.commits), static_cast<unsigned long long>(stats.resets));
+			ImGui::Text("Edits : %llu / RPR calls : %llu", static_cast<unsigned long long>(stats.edits), static_cast<unsigned long long>(stats.calls));
+			ImGui::Text("Calls saved : %llu", static_cast<unsigned long long>(stats.calls_saved));
+			ImGui::Text("Stall : %.3f ms last, %.3f ms max", stats.last_stall_ms, stats.max_stall_ms);
+
+			if (stats.commits > 0)
+			{
+				ImGui::Text("Stall : %.3f ms per commit", stats.total_stall_ms / stats.commits);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Memory"))
+		{
+			AllocationTracker& tracker = AllocationTracker::get();
+			FrameArena& arena = get_frame_arena();
+			SizeClassPool& pool = get_node_pool();
+
+			if (AllocationTracker::is_enabled())
+			{
+				const char* names[] = { "Other", "Render", "Viewer", "Node editor", "Panels" };
+				const AllocationCounters& frame = tracker.get_frame();
+
+				ImGui::Text("Last frame : %llu allocations, %llu bytes", static_cast<unsigned long long>(frame.count), static_cast<unsigned long long>(frame.bytes));
+
+				for (int i = 0; i < static_cast<int>(FramePhase::Count); ++i)
+				{
+					const AllocationCounters& phase = tracker.get_phase(static_cast<FramePhase>(i));
+					ImGui::BulletText("%s : %llu (%llu bytes)", names[i], static_cast<unsigned long long>(phase.count), static_cast<unsigned long long>(phase.bytes));
+				}
+
+				AllocationCounters background = tracker.get_background();
+				ImGui::Text("Background threads : %llu allocations", static_cast<unsigned long long>(background.count));
+				ImGui::Text("Steady frames : %llu / Violations : %llu", static_cast<unsigned long long>(tracker.get_steady_frames()), static_cast<unsigned long long>(tracker.get_violations()));
+
+				bool assert_enabled = tracker.get_assert_enabled();
+				if (ImGui::Checkbox("Assert on steady frame allocation", &assert_enabled))
+				{
+					tracker.set_assert_enabled(assert_enabled);
+				}
+			}
+			else
+			{
+				ImGui::TextUnformatted("Allocation tracking off (HRS_TRACK_ALLOCATIONS)");
+			}
+
+			ImGui::Separator();
+			ImGui::Text("Frame arena : %zu / %zu KB (peak %zu KB)", arena.get_used() / 1024, arena.get_capacity() / 1024, arena.get_high_water() / 1024);
+			ImGui::Text("Node pool : %zu nodes, %zu KB reserved", pool.get_live_count(), pool.get_reserved_bytes() / 1024);
+		}
+
+		if (ImGui::CollapsingHeader("Memory budget"))
+		{
+			MemoryLedger& ledger = MemoryLedger::get();
+			const float mb = 1.0f / (1024.0f * 1024.0f);
+
+			int budget_mb = static_cast<int>(ledger.get_budget() / (1024 * 1024));
+			ImGui::SetNextItemWidth(120);
+			if (ImGui::DragInt("Budget (MB)##ledger", &budget_mb, 4.0f, 64, 262144))
+			{
+				ledger.set_budget(static_cast<size_t>(budget_mb) * 1024 * 1024);
+			}
+
+			const size_t total = ledger.get_total();
+			ImGui::ProgressBar(static_cast<float>(total) / std::max<size_t>(ledger.get_budget(), 1), ImVec2(-1.0f, 0.0f),
+				get_frame_arena().format("%.1f / %d MB", total * mb, budget_mb));
+			ImGui::Text("Peak : %.1f MB", ledger.get_peak() * mb);
+
+			for (int i = 0; i < static_cast<int>(MemoryCategory::Count); ++i)
+			{
+				MemoryCategory category = static_cast<MemoryCategory>(i);
+				ImGui::BulletText("%s : %.2f MB", get_memory_category_name(category), ledger.get_category(category) * mb);
+			}
+
+			ImGui::Text("RPR reports : %.1f MB system / %.1f MB GPU", ledger.get_reported_system() * mb, ledger.get_reported_gpu() * mb);
+			ImGui::Text("Refused or downscaled : %llu", static_cast<unsigned long long>(ledger.get_refusals()));
+			ImGui::Text("Entries : %zu", ledger.get_entry_count());
+
+			if (ImGui::Button("Dump"))
+			{
+				if (ledger.dump("memory_ledger.txt"))
+				{
+					std::cout << "Memory ledger written to memory_ledger.txt" << std::endl;
+				}
+				else
+				{
+					std::cout << "Error: cannot write memory_ledger.txt" << std::endl;
+				}
+			}
+		}
+	}
+
+	ImGui::End();
+}
+
+void init_input_replay()
+{
+	const char* record_path = getenv("HRS_RECORD_INPUT");
+	const char* replay_path = getenv("HRS_REPLAY_INPUT");
+
+	if (replay_path && replay_path[0])
+	{
+		const char* step_ms = getenv("HRS_REPLAY_STEP_MS");
+
+		if (step_ms && step_ms[0])
+		{
+			m_input_replay_.set_step(static_cast<float>(atof(step_ms)) / 1000.0f);
+		}
+
+		if (m_input_replay_.open(replay_path))
+		{
+			std::cout << "Replaying " << m_input_replay_.get_frame_count() << " frames of input from " << replay_path << std::endl;
+		}
+	}
+	else if (record_path && record_path[0])
+	{
+		m_input_recorder_.open(record_path);
+	}
+}
+
+// Once the frame ended, its times go to the replay
+void update_input_replay()
+{
+	if (!m_input_started_)
+	{
+		m_input_started_ = m_scene_ready_ || m_startup_.has_failed();
+
+		if (m_input_started_)
+		{
+			m_input_recorder_.start();
+		}
+
+		return;
+	}
+
+	if (!m_input_replay_.is_open())
+	{
+		return;
+	}
+
+	m_input_replay_.end_frame(m_frame_timer_.get_frame(), AllocationTracker::get().get_frame().count);
+
+	if (!m_input_replay_.is_finished())
+	{
+		return;
+	}
+
+	const char* report_path = getenv("HRS_REPLAY_REPORT");
+	const char* baseline_path = getenv("HRS_REPLAY_BASELINE");
+	const char* threshold = getenv("HRS_REPLAY_THRESHOLD");
+	const std::string report = report_path && report_path[0] ? report_path : std::string(getenv("HRS_REPLAY_INPUT")) + ".json";
+
+	m_input_replay_.log();
+
+	// The input no longer matched the recording, its timings are not comparable
+	m_replay_diverged_ = m_input_replay_.get_diverged_frames() > 0;
+
+	if (!m_input_replay_.write_report(report))
+	{
+		std::cout << "Error: cannot write the replay report " << report << std::endl;
+	}
+
+	if (baseline_path && baseline_path[0])
+	{
+		m_replay_regressions_ = m_input_replay_.compare_baseline(baseline_path, threshold && threshold[0] ? static_cast<float>(atof(threshold)) : 0.1f);
+	}
+
+	m_input_started_ = false;
+	glfwSetWindowShouldClose(window, GLFW_TRUE);
+}
+
+int main()
+{
+	// Initialize the library, the renderer loads in the background from the start
+	init_input_replay();
+	radeon_init();
+
+	opengl_init();
+	imgui_init();
+	radeon_init_pre_render(m_window_width_, m_window_height_);
+	m_preview_service_.init();
+	m_startup_.record("Window", 0.0);
+
+	AllocationTracker& allocation_tracker = AllocationTracker::get();
+
+	// Main loop
+	while (!glfwWindowShouldClose(window))
+	{
+		m_frame_timer_.begin_frame();
+		get_frame_arena().reset();
+		allocation_tracker.begin_frame();
+
+		// Pre rendering
+		opengl_render();
+		imgui_init_render();
+		m_frame_timer_.mark(FramePhase::Other);
+
+		// Rendering
+		const bool is_startup_frame = update_startup();
+
+		if (m_scene_ready_)
+		{
+			AllocationPhase phase(FramePhase::Render);
+			radeon_render_engine();
+		}
+
+		radeon_display_render();
+		m_frame_timer_.mark(FramePhase::Render);
+
+		// Show the viewer with the rendered image <- dynamic window and buffers
+		// You can modificate the scene in real time
+		{
+			AllocationPhase phase(FramePhase::Viewer);
+			viewer();
+		}
+
+		m_frame_timer_.mark(FramePhase::Viewer);
+
+		// Node graph, only the part of the canvas on screen is submitted to ImNodes
+		{
+			AllocationPhase phase(FramePhase::NodeEditor);
+			node_editor();
+			update_instancers();
+			node_profile_panel();
+		}
+
+		m_frame_timer_.mark(FramePhase::NodeEditor);
+		update_memory_ledger();
+		m_frame_timer_.mark(FramePhase::Other);
+
+		{
+			AllocationPhase phase(FramePhase::Panels);
+			scene_panel();
+		}
+
+		m_frame_timer_.mark(FramePhase::Panels);
+
+		// Post rendering
+		imgui_post_render();
+		opengl_post_render();
+
+		allocation_tracker.end_frame(is_input_idle() && !m_node_editor_changed_ && !is_startup_frame);
+		m_frame_timer_.end_frame();
+		update_input_replay();
 	}
 
+	m_input_recorder_.close();
+	m_preview_service_.cleanup();
 	radeon_cleanup();
 	imgui_cleanup();
 	opengl_cleanup();
 
-	return 0;
+	// Regressed or diverged replays fail, for scripts comparing builds
+	return m_replay_regressions_ > 0 || m_replay_diverged_ ? 1 : 0;
 
 }
\ No newline at end of file
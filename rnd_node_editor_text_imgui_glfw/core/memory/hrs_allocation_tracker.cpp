@@ -0,0 +1,264 @@
+#include "hrs_allocation_tracker.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace
+{
+	thread_local bool t_is_frame_thread = false;
+
+	const char* get_phase_name(FramePhase phase)
+	{
+		const char* names[] = { "other", "render", "viewer", "node editor", "panels" };
+		return names[static_cast<int>(phase)];
+	}
+}
+
+AllocationTracker& AllocationTracker::get()
+{
+	static AllocationTracker tracker;
+	return tracker;
+}
+
+bool AllocationTracker::is_enabled()
+{
+#ifdef HRS_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void AllocationTracker::record(size_t bytes)
+{
+	AllocationTracker& tracker = get();
+
+	if (t_is_frame_thread)
+	{
+		AllocationCounters& counters = tracker.current_[static_cast<int>(tracker.phase_)];
+		counters.count++;
+		counters.bytes += bytes;
+	}
+	else
+	{
+		tracker.background_count_.fetch_add(1, std::memory_order_relaxed);
+		tracker.background_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+	}
+}
+
+void AllocationTracker::begin_frame()
+{
+	t_is_frame_thread = true;
+	phase_ = FramePhase::Other;
+
+	for (AllocationCounters& counters : current_)
+	{
+		counters = {};
+	}
+}
+
+void AllocationTracker::end_frame(bool is_steady)
+{
+	frame_ = {};
+
+	for (int i = 0; i < static_cast<int>(FramePhase::Count); ++i)
+	{
+		phases_[i] = current_[i];
+		frame_.count += current_[i].count;
+		frame_.bytes += current_[i].bytes;
+	}
+
+	idle_frames_ = is_steady ? idle_frames_ + 1 : 0;
+
+	if (!is_enabled() || idle_frames_ <= kSettleFrames)
+	{
+		return;
+	}
+
+	steady_frames_++;
+
+	// Every phase, the driver, RPR, GLFW and ImGui allocate outside operator new and the
+	// render passes run on a thread of their own
+	for (int i = 0; i < static_cast<int>(FramePhase::Count); ++i)
+	{
+		const FramePhase phase = static_cast<FramePhase>(i);
+		const AllocationCounters& counters = get_phase(phase);
+
+		if (counters.count == 0)
+		{
+			continue;
+		}
+
+		violations_++;
+		printf("Allocation in a steady frame : %llu allocations, %llu bytes in %s\n",
+			static_cast<unsigned long long>(counters.count), static_cast<unsigned long long>(counters.bytes), get_phase_name(phase));
+
+		assert(!assert_enabled_ && "steady frames must not allocate");
+	}
+}
+
+FramePhase AllocationTracker::set_phase(FramePhase phase)
+{
+	FramePhase previous = phase_;
+	phase_ = phase;
+	return previous;
+}
+
+AllocationCounters AllocationTracker::get_background() const
+{
+	return { background_count_.load(std::memory_order_relaxed), background_bytes_.load(std::memory_order_relaxed) };
+}
+
+#ifdef HRS_TRACK_ALLOCATIONS
+
+namespace
+{
+	// Over-aligned storage must go back through the matching free, never std::free on MSVC
+	void* allocate_aligned(size_t size, std::align_val_t alignment)
+	{
+		const size_t align = static_cast<size_t>(alignment);
+		size = size ? size : 1;
+
+#ifdef _MSC_VER
+		return _aligned_malloc(size, align);
+#else
+		// aligned_alloc wants the size to be a multiple of the alignment
+		return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+	}
+
+	void free_aligned(void* pointer)
+	{
+#ifdef _MSC_VER
+		_aligned_free(pointer);
+#else
+		std::free(pointer);
+#endif
+	}
+}
+
+// Replacements for the global allocation functions, nothrow and array forms forward here
+void* operator new(size_t size)
+{
+	AllocationTracker::record(size);
+
+	if (void* pointer = std::malloc(size ? size : 1))
+	{
+		return pointer;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	AllocationTracker::record(size);
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+// Aligned forms, used for types with alignas beyond the default new alignment
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	AllocationTracker::record(size);
+
+	if (void* pointer = allocate_aligned(size, alignment))
+	{
+		return pointer;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	AllocationTracker::record(size);
+	return allocate_aligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+	free_aligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+	free_aligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+	free_aligned(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+	free_aligned(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	free_aligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	free_aligned(pointer);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation accounting. Building with HRS_TRACK_ALLOCATIONS replaces the global
+// operator new/delete with counting versions, without it every counter stays at zero.
+struct AllocationCounters
+{
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+};
+
+// Main loop phases, allocations are charged to the phase running on the frame thread
+enum class FramePhase
+{
+	Other,
+	Render,
+	Viewer,
+	NodeEditor,
+	Panels,
+	Count
+};
+
+class AllocationTracker
+{
+public:
+
+	static AllocationTracker& get();
+	static bool is_enabled();
+
+	// Called by the hook, must not allocate
+	static void record(size_t bytes);
+
+	// The calling thread becomes the frame thread, other threads count as background
+	void begin_frame();
+
+	// A steady frame (unchanged graph, idle input) must not allocate in any phase, debug
+	// builds assert once enough steady frames passed for lazy UI state to settle
+	void end_frame(bool is_steady);
+
+	FramePhase set_phase(FramePhase phase);
+
+	// Last completed frame
+	const AllocationCounters& get_frame() const { return frame_; }
+	const AllocationCounters& get_phase(FramePhase phase) const { return phases_[static_cast<int>(phase)]; }
+
+	// Since startup, from threads other than the frame thread
+	AllocationCounters get_background() const;
+
+	uint64_t get_steady_frames() const { return steady_frames_; }
+	uint64_t get_violations() const { return violations_; }
+
+	void set_assert_enabled(bool enabled) { assert_enabled_ = enabled; }
+	bool get_assert_enabled() const { return assert_enabled_; }
+
+	static constexpr int kSettleFrames = 120;
+
+private:
+
+	AllocationCounters current_[static_cast<int>(FramePhase::Count)];
+	AllocationCounters phases_[static_cast<int>(FramePhase::Count)];
+	AllocationCounters frame_;
+	FramePhase phase_ = FramePhase::Other;
+
+	std::atomic<uint64_t> background_count_{ 0 };
+	std::atomic<uint64_t> background_bytes_{ 0 };
+
+	int idle_frames_ = 0;
+	uint64_t steady_frames_ = 0;
+	uint64_t violations_ = 0;
+	bool assert_enabled_ = true;
+};
+
+// Charges allocations of the enclosing scope to a phase
+class AllocationPhase
+{
+public:
+
+	explicit AllocationPhase(FramePhase phase) : previous_(AllocationTracker::get().set_phase(phase)) {}
+	~AllocationPhase() { AllocationTracker::get().set_phase(previous_); }
+
+	AllocationPhase(const AllocationPhase&) = delete;
+	AllocationPhase& operator=(const AllocationPhase&) = delete;
+
+private:
+
+	FramePhase previous_;
+};
@@ -0,0 +1,120 @@
+#include "hrs_frame_arena.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+
+FrameArena::FrameArena(size_t block_size)
+	: block_size_(block_size)
+{
+	add_block(block_size_);
+}
+
+FrameArena::~FrameArena()
+{
+	for (Block& block : blocks_)
+	{
+		::operator delete(block.data);
+	}
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+	while (true)
+	{
+		Block& block = blocks_[current_];
+		size_t aligned = (offset_ + alignment - 1) & ~(alignment - 1);
+
+		if (aligned + size <= block.size)
+		{
+			used_ += aligned + size - offset_;
+			offset_ = aligned + size;
+			return block.data + aligned;
+		}
+
+		if (current_ + 1 == blocks_.size())
+		{
+			add_block(size + alignment);
+		}
+
+		current_++;
+		offset_ = 0;
+	}
+}
+
+const char* FrameArena::format(const char* format, ...)
+{
+	Block& block = blocks_[current_];
+	size_t available = block.size - offset_;
+
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(block.data + offset_, available, format, args);
+	va_end(args);
+
+	if (length < 0)
+	{
+		return "";
+	}
+
+	// Fitted in place, claim exactly what was written
+	if (static_cast<size_t>(length) < available)
+	{
+		return static_cast<const char*>(allocate(length + 1, 1));
+	}
+
+	char* text = static_cast<char*>(allocate(length + 1, 1));
+
+	va_start(args, format);
+	vsnprintf(text, length + 1, format, args);
+	va_end(args);
+
+	return text;
+}
+
+void FrameArena::reset()
+{
+	high_water_ = std::max(high_water_, used_);
+
+	if (blocks_.size() > 1)
+	{
+		size_t total = get_capacity();
+
+		for (Block& block : blocks_)
+		{
+			::operator delete(block.data);
+		}
+
+		blocks_.clear();
+		add_block(total);
+	}
+
+	current_ = 0;
+	offset_ = 0;
+	used_ = 0;
+}
+
+size_t FrameArena::get_capacity() const
+{
+	size_t capacity = 0;
+
+	for (const Block& block : blocks_)
+	{
+		capacity += block.size;
+	}
+
+	return capacity;
+}
+
+void FrameArena::add_block(size_t min_size)
+{
+	size_t size = std::max(block_size_, min_size);
+	blocks_.push_back({ static_cast<char*>(::operator new(size)), size });
+}
+
+FrameArena& get_frame_arena()
+{
+	static FrameArena arena;
+	return arena;
+}
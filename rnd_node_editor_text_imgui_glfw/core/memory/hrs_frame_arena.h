@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that dies with the frame: temporary id lists, formatted labels.
+// reset() rewinds it, and once a frame overflowed the first block the blocks are merged so
+// the next frames fit in one and never touch the heap again.
+class FrameArena
+{
+public:
+
+	explicit FrameArena(size_t block_size = 256 * 1024);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Value-initialized, nothing is ever destroyed so only trivial types are allowed
+	template <typename T>
+	T* allocate_array(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+
+		T* data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			new (data + i) T();
+		}
+
+		return data;
+	}
+
+	// printf into the arena, valid until the next reset()
+	const char* format(const char* format, ...);
+
+	void reset();
+
+	size_t get_used() const { return used_; }
+	size_t get_capacity() const;
+	size_t get_high_water() const { return high_water_; }
+	int get_block_count() const { return static_cast<int>(blocks_.size()); }
+
+private:
+
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+
+	void add_block(size_t min_size);
+
+	std::vector<Block> blocks_;
+	size_t block_size_;
+	size_t current_ = 0;
+	size_t offset_ = 0;
+	size_t used_ = 0;
+	size_t high_water_ = 0;
+};
+
+// Main thread arena, reset at the top of every main loop iteration
+FrameArena& get_frame_arena();
@@ -0,0 +1,201 @@
+#include "hrs_memory_ledger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+const char* get_memory_category_name(MemoryCategory category)
+{
+	const char* names[] = { "RPR framebuffers", "Host framebuffers", "GL textures", "Meshes", "Images", "Instances", "Host heap" };
+	return names[static_cast<int>(category)];
+}
+
+MemoryLedger& MemoryLedger::get()
+{
+	static MemoryLedger ledger;
+	return ledger;
+}
+
+// Several editors share a workstation, HRS_MEMORY_BUDGET_MB gives each its slice
+MemoryLedger::MemoryLedger() : budget_(size_t(4096) * 1024 * 1024)
+{
+	const char* budget_mb = getenv("HRS_MEMORY_BUDGET_MB");
+
+	if (budget_mb && atoi(budget_mb) > 0)
+	{
+		budget_ = static_cast<size_t>(atoi(budget_mb)) * 1024 * 1024;
+	}
+}
+
+void MemoryLedger::record(MemoryCategory category, const void* object, size_t bytes, const char* label)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto iter = entries_.find(object);
+
+	if (iter != entries_.end())
+	{
+		Entry& entry = iter->second;
+		totals_[static_cast<int>(entry.category)] -= entry.bytes;
+		total_ -= entry.bytes;
+
+		entry.category = category;
+		entry.bytes = bytes;
+
+		// Same label most of the time, compared first so updates never allocate
+		if (entry.label != label)
+		{
+			entry.label = label;
+		}
+	}
+	else
+	{
+		entries_.emplace(object, Entry{ category, bytes, label });
+	}
+
+	totals_[static_cast<int>(category)] += bytes;
+	total_ += bytes;
+	peak_ = std::max(peak_, total_);
+}
+
+void MemoryLedger::release(const void* object)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto iter = entries_.find(object);
+
+	if (iter == entries_.end())
+	{
+		return;
+	}
+
+	totals_[static_cast<int>(iter->second.category)] -= iter->second.bytes;
+	total_ -= iter->second.bytes;
+	entries_.erase(iter);
+}
+
+size_t MemoryLedger::get_available(std::initializer_list<const void*> replaced) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	size_t total = total_;
+
+	for (const void* object : replaced)
+	{
+		auto iter = entries_.find(object);
+
+		if (iter != entries_.end())
+		{
+			total -= iter->second.bytes;
+		}
+	}
+
+	return total < budget_ ? budget_ - total : 0;
+}
+
+void MemoryLedger::count_refusal()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	refusals_++;
+}
+
+uint64_t MemoryLedger::get_refusals() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return refusals_;
+}
+
+void MemoryLedger::set_budget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	budget_ = bytes;
+}
+
+size_t MemoryLedger::get_budget() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return budget_;
+}
+
+size_t MemoryLedger::get_total() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return total_;
+}
+
+size_t MemoryLedger::get_peak() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return peak_;
+}
+
+size_t MemoryLedger::get_category(MemoryCategory category) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return totals_[static_cast<int>(category)];
+}
+
+size_t MemoryLedger::get_entry_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return entries_.size();
+}
+
+void MemoryLedger::set_reported(uint64_t system_bytes, uint64_t gpu_bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	reported_system_ = system_bytes;
+	reported_gpu_ = gpu_bytes;
+}
+
+uint64_t MemoryLedger::get_reported_system() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return reported_system_;
+}
+
+uint64_t MemoryLedger::get_reported_gpu() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return reported_gpu_;
+}
+
+bool MemoryLedger::dump(const std::string& path) const
+{
+	std::vector<std::pair<const void*, Entry>> entries;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		entries.assign(entries_.begin(), entries_.end());
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.second.bytes > b.second.bytes; });
+
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "total %.2f MB, peak %.2f MB, budget %.2f MB, RPR reports %.2f MB system / %.2f MB GPU\n\n",
+		get_total() / (1024.0 * 1024.0), get_peak() / (1024.0 * 1024.0), get_budget() / (1024.0 * 1024.0),
+		get_reported_system() / (1024.0 * 1024.0), get_reported_gpu() / (1024.0 * 1024.0));
+
+	for (int i = 0; i < static_cast<int>(MemoryCategory::Count); ++i)
+	{
+		fprintf(file, "%-18s %12.2f MB\n", get_memory_category_name(static_cast<MemoryCategory>(i)), get_category(static_cast<MemoryCategory>(i)) / (1024.0 * 1024.0));
+	}
+
+	fprintf(file, "\n");
+
+	for (const auto& [object, entry] : entries)
+	{
+		fprintf(file, "%-18s %12.3f MB  %p  %s\n", get_memory_category_name(entry.category), entry.bytes / (1024.0 * 1024.0), object, entry.label.c_str());
+	}
+
+	fclose(file);
+
+	return true;
+}
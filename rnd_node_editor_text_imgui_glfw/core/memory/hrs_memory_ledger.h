@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+enum class MemoryCategory
+{
+	RprFramebuffer,
+	HostFramebuffer,
+	GLTexture,
+	Mesh,
+	Image,
+	Instances,
+	HostHeap,
+	Count
+};
+
+const char* get_memory_category_name(MemoryCategory category);
+
+// What the application knows it holds, one entry per object (RPR handle, GL texture, buffer),
+// checked against a budget before large requests. RPR's own counters are kept next to it
+// since the ledger only sees estimates for what lives inside the renderer.
+class MemoryLedger
+{
+public:
+
+	static MemoryLedger& get();
+
+	// Adds the entry of object or updates it in place, safe from any thread
+	void record(MemoryCategory category, const void* object, size_t bytes, const char* label);
+	void release(const void* object);
+
+	// Room left under the budget once the entries of replaced objects are given back
+	size_t get_available(std::initializer_list<const void*> replaced = {}) const;
+	bool fits(size_t bytes, std::initializer_list<const void*> replaced = {}) const { return bytes <= get_available(replaced); }
+
+	// Requests turned down or downscaled because of the budget
+	void count_refusal();
+	uint64_t get_refusals() const;
+
+	void set_budget(size_t bytes);
+	size_t get_budget() const;
+
+	size_t get_total() const;
+	size_t get_peak() const;
+	size_t get_category(MemoryCategory category) const;
+	size_t get_entry_count() const;
+
+	// From rprContextGetInfo(RPR_CONTEXT_RENDER_STATISTICS), zero until first reported
+	void set_reported(uint64_t system_bytes, uint64_t gpu_bytes);
+	uint64_t get_reported_system() const;
+	uint64_t get_reported_gpu() const;
+
+	// Every entry, largest first, for diagnosing who holds what
+	bool dump(const std::string& path) const;
+
+private:
+
+	MemoryLedger();
+
+	struct Entry
+	{
+		MemoryCategory category;
+		size_t bytes;
+		std::string label;
+	};
+
+	mutable std::mutex mutex_;
+	std::unordered_map<const void*, Entry> entries_;
+	size_t totals_[static_cast<int>(MemoryCategory::Count)] = {};
+	size_t total_ = 0;
+	size_t peak_ = 0;
+	size_t budget_;
+	uint64_t refusals_ = 0;
+	uint64_t reported_system_ = 0;
+	uint64_t reported_gpu_ = 0;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Fixed size blocks carved from slabs, freed blocks go on an intrusive free list.
+// Not thread safe, graph objects are only created and destroyed on the UI thread.
+class PoolAllocator
+{
+public:
+
+	explicit PoolAllocator(size_t block_size, size_t blocks_per_slab = 256)
+		: block_size_(round_up(block_size < sizeof(FreeBlock) ? sizeof(FreeBlock) : block_size)), blocks_per_slab_(blocks_per_slab)
+	{
+	}
+
+	~PoolAllocator()
+	{
+		for (void* slab : slabs_)
+		{
+			::operator delete(slab);
+		}
+	}
+
+	PoolAllocator(const PoolAllocator&) = delete;
+	PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+	void* allocate()
+	{
+		if (!free_)
+		{
+			add_slab();
+		}
+
+		FreeBlock* block = free_;
+		free_ = block->next;
+		live_count_++;
+
+		return block;
+	}
+
+	void deallocate(void* pointer)
+	{
+		FreeBlock* block = static_cast<FreeBlock*>(pointer);
+		block->next = free_;
+		free_ = block;
+		live_count_--;
+	}
+
+	size_t get_block_size() const { return block_size_; }
+	size_t get_live_count() const { return live_count_; }
+	size_t get_reserved_bytes() const { return slabs_.size() * blocks_per_slab_ * block_size_; }
+
+private:
+
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	static size_t round_up(size_t size)
+	{
+		const size_t alignment = alignof(std::max_align_t);
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	void add_slab()
+	{
+		char* slab = static_cast<char*>(::operator new(block_size_ * blocks_per_slab_));
+		slabs_.push_back(slab);
+
+		// Thread the new blocks so they come out in address order
+		for (size_t i = blocks_per_slab_; i-- > 0;)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * block_size_);
+			block->next = free_;
+			free_ = block;
+		}
+	}
+
+	size_t block_size_;
+	size_t blocks_per_slab_;
+	std::vector<void*> slabs_;
+	FreeBlock* free_ = nullptr;
+	size_t live_count_ = 0;
+};
+
+// A few pools by power of two size, for small polymorphic objects of mixed types
+class SizeClassPool
+{
+public:
+
+	static constexpr size_t kMinSize = 16;
+	static constexpr int kClassCount = 4;
+
+	SizeClassPool()
+		: pools_{ PoolAllocator(kMinSize), PoolAllocator(kMinSize << 1), PoolAllocator(kMinSize << 2), PoolAllocator(kMinSize << 3) }
+	{
+	}
+
+	void* allocate(size_t size)
+	{
+		int size_class = get_class(size);
+		return size_class < kClassCount ? pools_[size_class].allocate() : ::operator new(size);
+	}
+
+	void deallocate(void* pointer, size_t size)
+	{
+		int size_class = get_class(size);
+
+		if (size_class < kClassCount)
+		{
+			pools_[size_class].deallocate(pointer);
+		}
+		else
+		{
+			::operator delete(pointer);
+		}
+	}
+
+	size_t get_live_count() const
+	{
+		size_t count = 0;
+
+		for (const PoolAllocator& pool : pools_)
+		{
+			count += pool.get_live_count();
+		}
+
+		return count;
+	}
+
+	size_t get_reserved_bytes() const
+	{
+		size_t bytes = 0;
+
+		for (const PoolAllocator& pool : pools_)
+		{
+			bytes += pool.get_reserved_bytes();
+		}
+
+		return bytes;
+	}
+
+private:
+
+	static int get_class(size_t size)
+	{
+		int size_class = 0;
+
+		while (size_class < kClassCount && (kMinSize << size_class) < size)
+		{
+			size_class++;
+		}
+
+		return size_class;
+	}
+
+	PoolAllocator pools_[kClassCount];
+};
@@ -1 +1,1234 @@
-﻿
\ No newline at end of file
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "graph/hrs_graph_profiler.hpp"
+#include "graph/hrs_graph_program.hpp"
+#include "graph/hrs_graph_types.hpp"
+#include "graph/hrs_output_cache.hpp"
+#include "graph/hrs_spatial_index.hpp"
+#include "graph/hrs_topo_order.hpp"
+#include "memory/hrs_pool_allocator.hpp"
+
+// Every node object lives in this pool, never destroyed so nodes held by globals can outlive it
+inline SizeClassPool& get_node_pool()
+{
+	static SizeClassPool* pool = new SizeClassPool();
+	return *pool;
+}
+
+// Nodes
+class ColorNode
+{
+public:
+
+	virtual ~ColorNode() = default;
+
+	// The virtual destructor makes delete pass the size of the concrete type
+	static void* operator new(size_t size) { return get_node_pool().allocate(size); }
+	static void operator delete(void* pointer, size_t size) { get_node_pool().deallocate(pointer, size); }
+
+	virtual ColorNodeType get_type() const = 0;
+	virtual const char* get_name() const = 0;
+	virtual int get_input_count() const { return 0; }
+	virtual Color compute(const Color* inputs) const = 0;
+
+	// Editable parameters, exposed as a flat float array for the UI
+	virtual int get_param_count() const { return 0; }
+	virtual float* get_params() { return nullptr; }
+};
+
+class ConstantColorNode : public ColorNode
+{
+public:
+
+	explicit ConstantColorNode(Color color = {}) : color_(color) {}
+
+	ColorNodeType get_type() const override { return ColorNodeType::Constant; }
+	const char* get_name() const override { return "Constant Color"; }
+	Color compute(const Color*) const override { return color_; }
+
+	int get_param_count() const override { return 3; }
+	float* get_params() override { return &color_.r; }
+
+private:
+
+	Color color_;
+};
+
+class AddColorNode : public ColorNode
+{
+public:
+
+	ColorNodeType get_type() const override { return ColorNodeType::Add; }
+	const char* get_name() const override { return "Add"; }
+	int get_input_count() const override { return 2; }
+
+	Color compute(const Color* inputs) const override
+	{
+		return { inputs[0].r + inputs[1].r, inputs[0].g + inputs[1].g, inputs[0].b + inputs[1].b };
+	}
+};
+
+class MultiplyColorNode : public ColorNode
+{
+public:
+
+	ColorNodeType get_type() const override { return ColorNodeType::Multiply; }
+	const char* get_name() const override { return "Multiply"; }
+	int get_input_count() const override { return 2; }
+
+	Color compute(const Color* inputs) const override
+	{
+		return { inputs[0].r * inputs[1].r, inputs[0].g * inputs[1].g, inputs[0].b * inputs[1].b };
+	}
+};
+
+class MixColorNode : public ColorNode
+{
+public:
+
+	explicit MixColorNode(float factor = 0.5f) : factor_(factor) {}
+
+	ColorNodeType get_type() const override { return ColorNodeType::Mix; }
+	const char* get_name() const override { return "Mix"; }
+	int get_input_count() const override { return 2; }
+
+	Color compute(const Color* inputs) const override
+	{
+		return {
+			inputs[0].r + (inputs[1].r - inputs[0].r) * factor_,
+			inputs[0].g + (inputs[1].g - inputs[0].g) * factor_,
+			inputs[0].b + (inputs[1].b - inputs[0].b) * factor_ };
+	}
+
+	int get_param_count() const override { return 1; }
+	float* get_params() override { return &factor_; }
+
+private:
+
+	float factor_;
+};
+
+class InvertColorNode : public ColorNode
+{
+public:
+
+	ColorNodeType get_type() const override { return ColorNodeType::Invert; }
+	const char* get_name() const override { return "Invert"; }
+	int get_input_count() const override { return 1; }
+
+	Color compute(const Color* inputs) const override
+	{
+		return { 1.0f - inputs[0].r, 1.0f - inputs[0].g, 1.0f - inputs[0].b };
+	}
+};
+
+// Scatters instances of the scene mesh, the input tints them and passes through unchanged.
+// The scene side lives in main.cpp, this node only carries the settings.
+class InstancerColorNode : public ColorNode
+{
+public:
+
+	enum Param
+	{
+		Count,
+		Mode,
+		Spacing,
+		Seed,
+		ScaleMin,
+		ScaleMax,
+		Jitter,
+		ParamCount
+	};
+
+	InstancerColorNode() : params_{ 100.0f, 0.0f, 2.0f, 1.0f, 0.5f, 1.0f, 0.25f } {}
+
+	ColorNodeType get_type() const override { return ColorNodeType::Instancer; }
+	const char* get_name() const override { return "Instancer"; }
+	int get_input_count() const override { return 1; }
+	Color compute(const Color* inputs) const override { return inputs[0]; }
+
+	int get_param_count() const override { return ParamCount; }
+	float* get_params() override { return params_; }
+
+private:
+
+	float params_[ParamCount];
+};
+
+inline std::unique_ptr<ColorNode> create_color_node(ColorNodeType type)
+{
+	switch (type)
+	{
+	case ColorNodeType::Constant: return std::make_unique<ConstantColorNode>();
+	case ColorNodeType::Add: return std::make_unique<AddColorNode>();
+	case ColorNodeType::Multiply: return std::make_unique<MultiplyColorNode>();
+	case ColorNodeType::Mix: return std::make_unique<MixColorNode>();
+	case ColorNodeType::Invert: return std::make_unique<InvertColorNode>();
+	case ColorNodeType::Instancer: return std::make_unique<InstancerColorNode>();
+	}
+
+	return nullptr;
+}
+
+// Graph
+using OutputCache = LruCache<Color>;
+
+// Shared by every graph of the session so identical subgraphs hit across graphs too
+inline OutputCache& get_output_cache()
+{
+	static OutputCache cache(16 * 1024 * 1024);
+	return cache;
+}
+
+struct Link
+{
+	int id = -1;
+	int start_pin = -1;
+	int end_pin = -1;
+};
+
+// Input pins of one node, a view into the graph pin array
+class PinLinks
+{
+public:
+
+	PinLinks(const int* data, int count) : data_(data), count_(count) {}
+
+	const int* begin() const { return data_; }
+	const int* end() const { return data_ + count_; }
+	int size() const { return count_; }
+	int operator[](int index) const { return data_[index]; }
+
+private:
+
+	const int* data_;
+	int count_;
+};
+
+class Graph
+{
+public:
+
+	int add_node(std::unique_ptr<ColorNode> node)
+	{
+		int id = static_cast<int>(nodes_.size());
+
+		pin_offsets_.push_back(static_cast<int>(pin_links_.size()));
+		pin_links_.resize(pin_links_.size() + node->get_input_count(), -1);
+		output_links_.emplace_back();
+		outputs_.emplace_back();
+		hashes_.emplace_back(0);
+		cone_marks_.push_back(0);
+		nodes_.push_back(std::move(node));
+		topo_.add_node(id);
+		mark_edited(id);
+
+		node_count_++;
+		order_dirty_ = true;
+		topology_revision_++;
+
+		return id;
+	}
+
+	void remove_node(int id)
+	{
+		if (!get_node(id))
+		{
+			return;
+		}
+
+		for (int link_id : get_input_links(id))
+		{
+			if (link_id != -1)
+			{
+				remove_link(link_id);
+			}
+		}
+
+		while (!output_links_[id].empty())
+		{
+			remove_link(output_links_[id].back());
+		}
+
+		nodes_[id].reset();
+		topo_.remove_node(id);
+
+		if (profiler_)
+		{
+			profiler_->remove(id);
+		}
+
+		node_count_--;
+		order_dirty_ = true;
+		topology_revision_++;
+	}
+
+	// Returns -1 when the pins are invalid, the input is taken or the link would close a cycle.
+	// The execution order is updated in place, get_last_reorder_size tells how many nodes moved.
+	int add_link(int start_pin, int end_pin)
+	{
+		if (!resolve_link_pins(start_pin, end_pin))
+		{
+			return -1;
+		}
+
+		int from = get_pin_node_id(start_pin);
+		int to = get_pin_node_id(end_pin);
+		int index = get_pin_index(end_pin);
+
+		if (get_pin_link(to, index) != -1 || !topo_.add_edge(from, to, SuccessorVisitor{ this }, PredecessorVisitor{ this }))
+		{
+			return -1;
+		}
+
+		// Removed link slots are reused before the array grows
+		int id;
+
+		if (!free_links_.empty())
+		{
+			id = free_links_.back();
+			free_links_.pop_back();
+			links_[id] = { id, start_pin, end_pin };
+		}
+		else
+		{
+			id = static_cast<int>(links_.size());
+			links_.push_back({ id, start_pin, end_pin });
+		}
+
+		get_pin_link(to, index) = id;
+		output_links_[from].push_back(id);
+		mark_edited(to);
+
+		link_count_++;
+		order_dirty_ = true;
+		topology_revision_++;
+
+		return id;
+	}
+
+	void remove_link(int id)
+	{
+		const Link* link = get_link(id);
+
+		if (!link)
+		{
+			return;
+		}
+
+		int from = get_pin_node_id(link->start_pin);
+		int to = get_pin_node_id(link->end_pin);
+
+		get_pin_link(to, get_pin_index(link->end_pin)) = -1;
+		mark_edited(to);
+
+		// Searched from the back, links are mostly removed newest first (undo, deleting what was just added)
+		auto& outs = output_links_[from];
+		outs.erase(std::next(std::find(outs.rbegin(), outs.rend(), id)).base());
+
+		links_[id].id = -1;
+		free_links_.push_back(id);
+		link_count_--;
+		order_dirty_ = true;
+		topology_revision_++;
+	}
+
+	void clear()
+	{
+		nodes_.clear();
+		links_.clear();
+		free_links_.clear();
+		pin_links_.clear();
+		pin_offsets_.clear();
+		output_links_.clear();
+		outputs_.clear();
+		hashes_.clear();
+		order_.clear();
+		topo_.clear();
+		cone_marks_.clear();
+		edited_.clear();
+		cone_.clear();
+		is_all_dirty_ = true;
+		last_evaluated_ = 0;
+
+		if (profiler_)
+		{
+			profiler_->reset();
+		}
+
+		node_count_ = 0;
+		link_count_ = 0;
+		order_dirty_ = true;
+		topology_revision_++;
+	}
+
+	ColorNode* get_node(int id) const
+	{
+		return id >= 0 && id < static_cast<int>(nodes_.size()) ? nodes_[id].get() : nullptr;
+	}
+
+	const Link* get_link(int id) const
+	{
+		return id >= 0 && id < static_cast<int>(links_.size()) && links_[id].id != -1 ? &links_[id] : nullptr;
+	}
+
+	PinLinks get_input_links(int node_id) const
+	{
+		int begin = pin_offsets_[node_id];
+		int end = node_id + 1 < static_cast<int>(pin_offsets_.size()) ? pin_offsets_[node_id + 1] : static_cast<int>(pin_links_.size());
+		return { pin_links_.data() + begin, end - begin };
+	}
+
+	const std::vector<int>& get_output_links(int node_id) const { return output_links_[node_id]; }
+
+	int get_node_count() const { return node_count_; }
+	int get_link_count() const { return link_count_; }
+	int get_node_capacity() const { return static_cast<int>(nodes_.size()); }
+	int get_link_capacity() const { return static_cast<int>(links_.size()); }
+
+	Color get_output(int node_id) const { return outputs_[node_id]; }
+
+	// Zero unless the cache is on or the graph is compiled, hashing is only paid for the cache
+	uint64_t get_output_hash(int node_id) const { return hashes_[node_id]; }
+
+	// Either switch leaves hashes of another kind behind, the next pass evaluates everything
+	void set_cache_enabled(bool enabled)
+	{
+		if (enabled != use_cache_)
+		{
+			use_cache_ = enabled;
+			invalidate();
+		}
+	}
+
+	bool get_cache_enabled() const { return use_cache_; }
+
+	// Evaluate through the compiled program instead of the node objects
+	void set_compiled(bool compiled)
+	{
+		if (compiled != use_program_)
+		{
+			use_program_ = compiled;
+			invalidate();
+		}
+	}
+
+	bool get_compiled() const { return use_program_; }
+
+	// A parameter of the node changed. It and the nodes downstream of it are recomputed by the
+	// next evaluate, the rest keep their outputs. Node and link changes mark what they touch.
+	void mark_edited(int id)
+	{
+		if (is_all_dirty_)
+		{
+			return;
+		}
+
+		// Edits piling up without a pass end in a full one
+		if (edited_.size() >= static_cast<size_t>(node_count_))
+		{
+			invalidate();
+			return;
+		}
+
+		edited_.push_back(id);
+	}
+
+	// The next evaluate recomputes every node
+	void invalidate()
+	{
+		is_all_dirty_ = true;
+		edited_.clear();
+	}
+
+	// Nodes the last evaluate recomputed or looked up, all of them for a full pass
+	int get_last_evaluated() const { return last_evaluated_; }
+	const GraphProgram& get_program() const { return program_; }
+
+	// Bumped by every node or link change, parameter edits leave it alone
+	uint64_t get_topology_revision() const { return topology_revision_; }
+
+	// Bytes held by the containers, the node objects themselves live in the node pool
+	size_t get_memory_bytes() const
+	{
+		size_t bytes = nodes_.capacity() * sizeof(nodes_[0]) + links_.capacity() * sizeof(Link) + free_links_.capacity() * sizeof(int);
+		bytes += (pin_links_.capacity() + pin_offsets_.capacity() + order_.capacity()) * sizeof(int);
+		bytes += output_links_.capacity() * sizeof(output_links_[0]) + outputs_.capacity() * sizeof(Color) + hashes_.capacity() * sizeof(uint64_t);
+		bytes += (edited_.capacity() + cone_.capacity()) * sizeof(int) + cone_marks_.capacity();
+
+		for (const std::vector<int>& outs : output_links_)
+		{
+			bytes += outs.capacity() * sizeof(int);
+		}
+
+		return bytes + topo_.get_memory_bytes();
+	}
+
+	// Kept up to date link by link, only read back here when the topology changed
+	const std::vector<int>& get_execution_order()
+	{
+		if (!order_dirty_)
+		{
+			return order_;
+		}
+
+		topo_.get_order(order_);
+
+		order_dirty_ = false;
+		return order_;
+	}
+
+	// Depth-first post-order over the input links from scratch, iterative so long chains cannot
+	// overflow the stack. The baseline the incremental order is checked and measured against.
+	void compute_full_order(std::vector<int>& order) const
+	{
+		order.clear();
+		order.reserve(node_count_);
+
+		std::vector<uint8_t> visited(nodes_.size(), 0);
+		std::vector<std::pair<int, int>> stack;
+
+		for (int root = 0; root < static_cast<int>(nodes_.size()); ++root)
+		{
+			if (!nodes_[root] || visited[root])
+			{
+				continue;
+			}
+
+			stack.push_back({ root, 0 });
+			visited[root] = 1;
+
+			while (!stack.empty())
+			{
+				auto& [id, next_input] = stack.back();
+				PinLinks inputs = get_input_links(id);
+
+				if (next_input < inputs.size())
+				{
+					int link_id = inputs[next_input++];
+
+					if (link_id != -1)
+					{
+						int source = get_pin_node_id(links_[link_id].start_pin);
+
+						if (!visited[source])
+						{
+							visited[source] = 1;
+							stack.push_back({ source, 0 });
+						}
+					}
+				}
+				else
+				{
+					order.push_back(id);
+					stack.pop_back();
+				}
+			}
+		}
+	}
+
+	// Pins as add_link takes them, without adding anything. Lets the editor reject a cycle
+	// while the link is still being dragged.
+	bool would_create_cycle(int start_pin, int end_pin)
+	{
+		if (!resolve_link_pins(start_pin, end_pin))
+		{
+			return false;
+		}
+
+		return topo_.would_create_cycle(get_pin_node_id(start_pin), get_pin_node_id(end_pin), SuccessorVisitor{ this });
+	}
+
+	// Nodes a link dragged from pin cannot end on without closing a cycle: the pin's node and
+	// the nodes reaching it for an output pin, the nodes it reaches for an input pin. One visit
+	// per drag, the pins under the mouse are then tested by their node alone.
+	void get_cycle_nodes(int pin, std::vector<uint8_t>& closes) const
+	{
+		closes.assign(nodes_.size(), 0);
+
+		const int start = get_pin_node_id(pin);
+
+		if (!get_node(start))
+		{
+			return;
+		}
+
+		std::vector<int> stack = { start };
+		closes[start] = 1;
+
+		auto visit = [&](int next)
+			{
+				if (!closes[next])
+				{
+					closes[next] = 1;
+					stack.push_back(next);
+				}
+			};
+
+		while (!stack.empty())
+		{
+			const int id = stack.back();
+			stack.pop_back();
+
+			if (is_output_pin(pin))
+			{
+				PredecessorVisitor{ this }(id, visit);
+			}
+			else
+			{
+				SuccessorVisitor{ this }(id, visit);
+			}
+		}
+	}
+
+	// Nodes the last add_link moved in the execution order, zero when it already agreed
+	int get_last_reorder_size() const { return topo_.get_last_affected(); }
+	const TopologicalOrder& get_topological_order() const { return topo_; }
+
+	// Times node executions while set, nullptr turns profiling off
+	void set_profiler(GraphProfiler* profiler) { profiler_ = profiler; }
+	GraphProfiler* get_profiler() const { return profiler_; }
+
+	// Only what mark_edited reached since the last pass, unless the graph was invalidated. The
+	// compiled program always runs whole.
+	void evaluate()
+	{
+		const int64_t start_ns = profiler_ ? GraphProfiler::now_ns() : 0;
+
+		if (use_program_)
+		{
+			evaluate_program();
+		}
+		else
+		{
+			evaluate_nodes();
+		}
+
+		if (profiler_)
+		{
+			profiler_->end_pass(GraphProfiler::now_ns() - start_ns, use_program_);
+		}
+	}
+
+protected:
+
+	void evaluate_nodes()
+	{
+		const bool is_timed = profiler_ && profiler_->begin_pass();
+
+		if (is_all_dirty_)
+		{
+			for (int id : get_execution_order())
+			{
+				evaluate_node(id, is_timed);
+			}
+
+			last_evaluated_ = node_count_;
+			is_all_dirty_ = false;
+			edited_.clear();
+			return;
+		}
+
+		// A small cone is sorted by position. Past an eighth of the graph the search stops and
+		// the order walk marks the rest itself: a node is in the cone when one of its inputs is.
+		if (collect_cone(node_count_ / 8))
+		{
+			std::sort(cone_.begin(), cone_.end(), [this](int a, int b) { return topo_.get_position(a) < topo_.get_position(b); });
+
+			for (int id : cone_)
+			{
+				evaluate_node(id, is_timed);
+				cone_marks_[id] = 0;
+			}
+
+			last_evaluated_ = static_cast<int>(cone_.size());
+		}
+		else
+		{
+			last_evaluated_ = 0;
+
+			for (int id : get_execution_order())
+			{
+				if (!cone_marks_[id] && !has_marked_input(id))
+				{
+					continue;
+				}
+
+				cone_marks_[id] = 1;
+				evaluate_node(id, is_timed);
+				last_evaluated_++;
+			}
+
+			std::fill(cone_marks_.begin(), cone_marks_.end(), 0);
+		}
+
+		edited_.clear();
+	}
+
+	// The edited nodes and everything downstream of them into cone_, marked in cone_marks_.
+	// False once more than limit nodes were found, the cone is then only partly marked.
+	bool collect_cone(int limit)
+	{
+		cone_.clear();
+
+		auto visit = [this](int id)
+			{
+				if (!cone_marks_[id])
+				{
+					cone_marks_[id] = 1;
+					cone_.push_back(id);
+				}
+			};
+
+		for (int id : edited_)
+		{
+			if (nodes_[id])
+			{
+				visit(id);
+			}
+		}
+
+		for (size_t next = 0; next < cone_.size(); ++next)
+		{
+			if (static_cast<int>(cone_.size()) > limit)
+			{
+				return false;
+			}
+
+			SuccessorVisitor{ this }(cone_[next], visit);
+		}
+
+		return true;
+	}
+
+	bool has_marked_input(int id) const
+	{
+		for (int link_id : get_input_links(id))
+		{
+			if (link_id != -1 && cone_marks_[get_pin_node_id(links_[link_id].start_pin)])
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void evaluate_node(int id, bool is_timed)
+	{
+		std::array<Color, kMaxNodeInputs> inputs;
+
+		if (use_cache_)
+		{
+			OutputCache& cache = get_output_cache();
+			hashes_[id] = compute_hash(id);
+
+			if (cache.find(hashes_[id], outputs_[id]))
+			{
+				if (profiler_)
+				{
+					profiler_->count(id, true, 0);
+				}
+
+				return;
+			}
+		}
+
+		gather_inputs(id, inputs.data());
+
+			if (is_timed)
+			{
+				const int64_t node_start_ns = GraphProfiler::now_ns();
+				outputs_[id] = nodes_[id]->compute(inputs.data());
+				profiler_->add_sample(id, GraphProfiler::now_ns() - node_start_ns, sizeof(Color));
+			}
+			else
+			{
+				outputs_[id] = nodes_[id]->compute(inputs.data());
+
+				if (profiler_)
+				{
+					profiler_->count(id, false, sizeof(Color));
+				}
+			}
+
+		if (use_cache_)
+		{
+			get_output_cache().insert(hashes_[id], outputs_[id]);
+		}
+	}
+
+	// Hashes are taken on the output value, previews only depend on the color anyway
+	void evaluate_program()
+	{
+		if (program_.is_current(*this))
+		{
+			program_.patch_constants(*this);
+		}
+		else
+		{
+			program_.compile(*this, true);
+		}
+
+		program_.run();
+
+		for (int id : get_execution_order())
+		{
+			outputs_[id] = program_.get_output(id);
+
+			if (use_cache_)
+			{
+				hashes_[id] = hash_float(hash_float(hash_float(0, outputs_[id].r), outputs_[id].g), outputs_[id].b);
+			}
+		}
+
+		last_evaluated_ = node_count_;
+		is_all_dirty_ = false;
+		edited_.clear();
+	}
+
+	// Type, parameters and input hashes, inputs must already be hashed (execution order)
+	uint64_t compute_hash(int id) const
+	{
+		ColorNode* node = nodes_[id].get();
+		uint64_t hash = hash_mix(0, static_cast<uint64_t>(node->get_type()) + 1);
+
+		const float* params = node->get_params();
+
+		for (int i = 0; i < node->get_param_count(); ++i)
+		{
+			hash = hash_float(hash, params[i]);
+		}
+
+		for (int link_id : get_input_links(id))
+		{
+			hash = hash_mix(hash, link_id != -1 ? hashes_[get_pin_node_id(links_[link_id].start_pin)] : 0);
+		}
+
+		return hash;
+	}
+
+	void gather_inputs(int id, Color* inputs) const
+	{
+		PinLinks links = get_input_links(id);
+
+		for (int i = 0; i < links.size(); ++i)
+		{
+			inputs[i] = links[i] != -1 ? outputs_[get_pin_node_id(links_[links[i]].start_pin)] : Color{};
+		}
+	}
+
+	int& get_pin_link(int node_id, int index) { return pin_links_[pin_offsets_[node_id] + index]; }
+
+	// Output first, false when the pins cannot form a link whatever the graph holds
+	bool resolve_link_pins(int& start_pin, int& end_pin) const
+	{
+		if (is_output_pin(end_pin) && !is_output_pin(start_pin))
+		{
+			std::swap(start_pin, end_pin);
+		}
+
+		if (!is_output_pin(start_pin) || is_output_pin(end_pin))
+		{
+			return false;
+		}
+
+		int from = get_pin_node_id(start_pin);
+		int to = get_pin_node_id(end_pin);
+
+		return get_node(from) && get_node(to) && get_pin_index(end_pin) < nodes_[to]->get_input_count();
+	}
+
+	// Visitors over the link endpoints for the topological order
+	struct SuccessorVisitor
+	{
+		const Graph* graph;
+
+		template <typename Visit>
+		void operator()(int id, Visit&& visit) const
+		{
+			for (int link_id : graph->output_links_[id])
+			{
+				visit(get_pin_node_id(graph->links_[link_id].end_pin));
+			}
+		}
+	};
+
+	struct PredecessorVisitor
+	{
+		const Graph* graph;
+
+		template <typename Visit>
+		void operator()(int id, Visit&& visit) const
+		{
+			for (int link_id : graph->get_input_links(id))
+			{
+				if (link_id != -1)
+				{
+					visit(get_pin_node_id(graph->links_[link_id].start_pin));
+				}
+			}
+		}
+	};
+
+	std::vector<std::unique_ptr<ColorNode>> nodes_;
+	std::vector<Link> links_;
+	std::vector<int> free_links_;
+
+	// Input pins of every node in one array, node pins start at pin_offsets_[id]
+	std::vector<int> pin_links_;
+	std::vector<int> pin_offsets_;
+	std::vector<std::vector<int>> output_links_;
+	std::vector<Color> outputs_;
+	std::vector<uint64_t> hashes_;
+	std::vector<int> order_;
+	TopologicalOrder topo_;
+
+	// Nodes marked since the last pass, and the cone they reach with its marks, kept between
+	// passes so an edit evaluates without allocating
+	std::vector<int> edited_;
+	std::vector<int> cone_;
+	std::vector<uint8_t> cone_marks_;
+	bool is_all_dirty_ = true;
+	int last_evaluated_ = 0;
+
+	GraphProgram program_;
+	GraphProfiler* profiler_ = nullptr;
+	uint64_t topology_revision_ = 0;
+
+	// Off by default: a hash and a lookup (mutex, list node, map entry) cost more than a color
+	// node does to recompute, even on a reverted edit the cache has seen. evaluate_edit_*_cached
+	// runs 1.4 to 8 times evaluate_edit_* in the graph bench.
+	bool use_cache_ = false;
+	bool use_program_ = false;
+	int node_count_ = 0;
+	int link_count_ = 0;
+	bool order_dirty_ = true;
+};
+
+// Binary graph layout: header, then every node slot in id order (type and parameters, 0xff for
+// a removed node) and every link as its two pins. Node ids survive a round trip, link ids do not.
+constexpr uint32_t kGraphFileMagic = 0x47535248; // HRSG
+constexpr uint32_t kGraphFileVersion = 1;
+constexpr uint8_t kGraphFileEmptySlot = 0xff;
+
+inline void write_graph(const Graph& graph, std::vector<uint8_t>& data)
+{
+	auto write = [&data](const void* value, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(value);
+		data.insert(data.end(), bytes, bytes + size);
+	};
+
+	const uint32_t header[4] = { kGraphFileMagic, kGraphFileVersion, static_cast<uint32_t>(graph.get_node_capacity()), static_cast<uint32_t>(graph.get_link_count()) };
+
+	data.clear();
+	data.reserve(sizeof(header) + graph.get_node_capacity() * 16 + graph.get_link_count() * 8);
+	write(header, sizeof(header));
+
+	for (int id = 0; id < graph.get_node_capacity(); ++id)
+	{
+		ColorNode* node = graph.get_node(id);
+
+		if (!node)
+		{
+			data.push_back(kGraphFileEmptySlot);
+			continue;
+		}
+
+		data.push_back(static_cast<uint8_t>(node->get_type()));
+		data.push_back(static_cast<uint8_t>(node->get_param_count()));
+		write(node->get_params(), node->get_param_count() * sizeof(float));
+	}
+
+	for (int id = 0; id < graph.get_link_capacity(); ++id)
+	{
+		if (const Link* link = graph.get_link(id))
+		{
+			const int32_t pins[2] = { link->start_pin, link->end_pin };
+			write(pins, sizeof(pins));
+		}
+	}
+}
+
+// Replaces the content of graph, false and an empty graph when the data is not a valid graph
+inline bool read_graph(Graph& graph, const uint8_t* data, size_t size)
+{
+	size_t offset = 0;
+
+	auto read = [&](void* value, size_t bytes)
+	{
+		if (offset + bytes > size)
+		{
+			return false;
+		}
+
+		memcpy(value, data + offset, bytes);
+		offset += bytes;
+		return true;
+	};
+
+	graph.clear();
+
+	uint32_t header[4];
+
+	if (!read(header, sizeof(header)) || header[0] != kGraphFileMagic || header[1] != kGraphFileVersion)
+	{
+		return false;
+	}
+
+	// Removed slots get a placeholder so later ids line up, dropped once the links are in
+	std::vector<int> placeholders;
+
+	for (uint32_t id = 0; id < header[2]; ++id)
+	{
+		uint8_t type;
+		uint8_t param_count;
+
+		if (!read(&type, 1))
+		{
+			graph.clear();
+			return false;
+		}
+
+		if (type == kGraphFileEmptySlot)
+		{
+			placeholders.push_back(graph.add_node(create_color_node(ColorNodeType::Constant)));
+			continue;
+		}
+
+		std::unique_ptr<ColorNode> node = type <= static_cast<uint8_t>(ColorNodeType::Instancer) ? create_color_node(static_cast<ColorNodeType>(type)) : nullptr;
+
+		if (!node || !read(&param_count, 1) || param_count != node->get_param_count() || !read(node->get_params(), param_count * sizeof(float)))
+		{
+			graph.clear();
+			return false;
+		}
+
+		graph.add_node(std::move(node));
+	}
+
+	for (uint32_t i = 0; i < header[3]; ++i)
+	{
+		int32_t pins[2];
+
+		if (!read(pins, sizeof(pins)) || graph.add_link(pins[0], pins[1]) == -1)
+		{
+			graph.clear();
+			return false;
+		}
+	}
+
+	for (int id : placeholders)
+	{
+		graph.remove_node(id);
+	}
+
+	return true;
+}
+
+// UI
+struct UINode
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float width = 160.0f;
+	float height = 90.0f;
+};
+
+// Owns the graph, the per-node canvas state and the spatial index kept in sync with both
+class UINodeManager
+{
+public:
+
+	int create_node(std::unique_ptr<ColorNode> node, float x, float y)
+	{
+		int id = graph_.add_node(std::move(node));
+
+		if (id >= static_cast<int>(ui_nodes_.size()))
+		{
+			ui_nodes_.resize(id + 1);
+		}
+
+		ui_nodes_[id] = UINode{ x, y };
+		index_.insert_node(id, get_bounds(id));
+		is_dirty_ = true;
+
+		return id;
+	}
+
+	void remove_node(int id)
+	{
+		if (!graph_.get_node(id))
+		{
+			return;
+		}
+
+		for (int link_id : graph_.get_input_links(id))
+		{
+			if (link_id != -1)
+			{
+				index_.remove_link(link_id);
+			}
+		}
+
+		for (int link_id : graph_.get_output_links(id))
+		{
+			index_.remove_link(link_id);
+		}
+
+		index_.remove_node(id);
+		graph_.remove_node(id);
+		is_dirty_ = true;
+	}
+
+	int create_link(int start_pin, int end_pin)
+	{
+		int id = graph_.add_link(start_pin, end_pin);
+
+		if (id != -1)
+		{
+			update_link_bounds(id, false);
+			is_dirty_ = true;
+		}
+
+		return id;
+	}
+
+	void remove_link(int id)
+	{
+		index_.remove_link(id);
+		graph_.remove_link(id);
+		is_dirty_ = true;
+	}
+
+	void move_node(int id, float x, float y)
+	{
+		UINode& ui_node = ui_nodes_[id];
+
+		if (ui_node.x == x && ui_node.y == y)
+		{
+			return;
+		}
+
+		ui_node.x = x;
+		ui_node.y = y;
+		update_node_bounds(id);
+	}
+
+	void resize_node(int id, float width, float height)
+	{
+		UINode& ui_node = ui_nodes_[id];
+
+		if (ui_node.width == width && ui_node.height == height)
+		{
+			return;
+		}
+
+		ui_node.width = width;
+		ui_node.height = height;
+		update_node_bounds(id);
+	}
+
+	void clear()
+	{
+		graph_.clear();
+		ui_nodes_.clear();
+		index_.clear();
+		is_dirty_ = true;
+	}
+
+	// Call after editing a node parameter, only the node and what depends on it are evaluated
+	void mark_edited(int id)
+	{
+		graph_.mark_edited(id);
+		is_dirty_ = true;
+	}
+
+	// Call after changing how the graph evaluates, the graph tracks the rest itself
+	void mark_dirty() { is_dirty_ = true; }
+
+	// Returns true when the graph was evaluated
+	bool evaluate_if_dirty()
+	{
+		if (!is_dirty_)
+		{
+			return false;
+		}
+
+		graph_.evaluate();
+		is_dirty_ = false;
+
+		return true;
+	}
+
+	SpatialRect get_bounds(int id) const
+	{
+		const UINode& ui_node = ui_nodes_[id];
+		return { ui_node.x, ui_node.y, ui_node.x + ui_node.width, ui_node.y + ui_node.height };
+	}
+
+	// Segment from the output pin side of the source node to the input pin side of the target
+	void get_link_segment(int link_id, float& x0, float& y0, float& x1, float& y1) const
+	{
+		const Link* link = graph_.get_link(link_id);
+		const UINode& from = ui_nodes_[get_pin_node_id(link->start_pin)];
+		const UINode& to = ui_nodes_[get_pin_node_id(link->end_pin)];
+
+		x0 = from.x + from.width;
+		y0 = from.y + from.height * 0.5f;
+		x1 = to.x;
+		y1 = to.y + to.height * 0.5f;
+	}
+
+	const UINode& get_ui_node(int id) const { return ui_nodes_[id]; }
+	Graph& get_graph() { return graph_; }
+	const SpatialGrid& get_index() const { return index_; }
+
+private:
+
+	void update_node_bounds(int id)
+	{
+		index_.update_node(id, get_bounds(id));
+
+		for (int link_id : graph_.get_input_links(id))
+		{
+			if (link_id != -1)
+			{
+				update_link_bounds(link_id, true);
+			}
+		}
+
+		for (int link_id : graph_.get_output_links(id))
+		{
+			update_link_bounds(link_id, true);
+		}
+	}
+
+	void update_link_bounds(int link_id, bool existing)
+	{
+		float x0, y0, x1, y1;
+		get_link_segment(link_id, x0, y0, x1, y1);
+
+		if (existing)
+		{
+			index_.update_link(link_id, x0, y0, x1, y1);
+		}
+		else
+		{
+			index_.insert_link(link_id, x0, y0, x1, y1);
+		}
+	}
+
+	Graph graph_;
+	std::vector<UINode> ui_nodes_;
+	SpatialGrid index_;
+	bool is_dirty_ = true;
+};
@@ -0,0 +1,403 @@
+#include "hrs_demo_scene.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "Math/mathutils.h"
+#include "../memory/hrs_memory_ledger.h"
+
+static const char* kEnvLightImage = "Resources/Textures/envLightImage.exr";
+static const char* kFloorImage = "Resources/Textures/amd.png";
+static const char* kTeapotMesh = "Resources/Meshes/teapot.obj";
+
+static ImageLoadOptions get_floor_image_options()
+{
+	ImageLoadOptions options;
+	options.gamma = 2.2f;
+	return options;
+}
+
+// Same light as CreateNatureEnvLight, with the image shared through the cache
+static rpr_status create_env_light(rpr_context context, ImageCache& image_cache, RPRGarbageCollector& gc, DemoScene& demo, float power)
+{
+	rpr_image image = image_cache.acquire(kEnvLightImage);
+
+	if (!image)
+	{
+		return RPR_ERROR_IO_ERROR;
+	}
+
+	demo.images.push_back(image);
+
+	rpr_light light = nullptr;
+	CHECK(rprContextCreateEnvironmentLight(context, &light));
+	CHECK(rprEnvironmentLightSetImage(light, image));
+	CHECK(rprEnvironmentLightSetIntensityScale(light, power));
+	CHECK(rprSceneAttachLight(demo.scene, light));
+	gc.GCAdd(light);
+
+	demo.env_light = light;
+
+	return RPR_SUCCESS;
+}
+
+// Same floor as CreateAMDFloor, with the texture shared through the cache
+static rpr_status create_floor(rpr_context context, rpr_material_system material_system, ImageCache& image_cache, RPRGarbageCollector& gc, DemoScene& demo, float scale, float scale_uv)
+{
+	rpr_image image = image_cache.acquire(kFloorImage, get_floor_image_options());
+
+	if (!image)
+	{
+		return RPR_ERROR_IO_ERROR;
+	}
+
+	demo.images.push_back(image);
+
+	const float size = 15.0f * scale;
+	const float vertices[] = { -size, 0.0f, -size, -size, 0.0f, size, size, 0.0f, size, size, 0.0f, -size };
+	const float normals[] = { 0.0f, 1.0f, 0.0f };
+	const float texcoords[] = { 0.0f, 0.0f, 0.0f, scale_uv, scale_uv, scale_uv, scale_uv, 0.0f };
+	const rpr_int indices[] = { 0, 1, 2, 3 };
+	const rpr_int normal_indices[] = { 0, 0, 0, 0 };
+	const rpr_int face_vertices[] = { 4 };
+
+	rpr_shape floor = nullptr;
+	CHECK(rprContextCreateMesh(context,
+		vertices, 4, sizeof(float) * 3,
+		normals, 1, sizeof(float) * 3,
+		texcoords, 4, sizeof(float) * 2,
+		indices, sizeof(rpr_int),
+		normal_indices, sizeof(rpr_int),
+		indices, sizeof(rpr_int),
+		face_vertices, 1, &floor));
+	CHECK(rprSceneAttachShape(demo.scene, floor));
+	gc.GCAdd(floor);
+
+	rpr_material_node texture = nullptr;
+	CHECK(rprMaterialSystemCreateNode(material_system, RPR_MATERIAL_NODE_IMAGE_TEXTURE, &texture));
+	CHECK(rprMaterialNodeSetInputImageDataByKey(texture, RPR_MATERIAL_INPUT_DATA, image));
+	gc.GCAdd(texture);
+
+	rpr_material_node material = nullptr;
+	CHECK(rprMaterialSystemCreateNode(material_system, RPR_MATERIAL_NODE_UBERV2, &material));
+	CHECK(rprMaterialNodeSetInputNByKey(material, RPR_MATERIAL_INPUT_UBER_DIFFUSE_COLOR, texture));
+	gc.GCAdd(material);
+
+	CHECK(rprShapeSetMaterial(floor, material));
+
+	demo.floor = floor;
+	demo.floor_surface.positions.assign(vertices, vertices + 12);
+	demo.floor_surface.indices = { 0, 1, 2, 0, 2, 3 };
+
+	return RPR_SUCCESS;
+}
+
+// Index of an OBJ reference, 1-based or negative from the end, -1 when out of range
+static rpr_int resolve_obj_index(long index, size_t count)
+{
+	index = index < 0 ? static_cast<long>(count) + index : index - 1;
+	return index >= 0 && index < static_cast<long>(count) ? static_cast<rpr_int>(index) : -1;
+}
+
+// v, vn, vt and f lines, v/vt/vn corners in any of their forms. Groups, materials and
+// smoothing are ignored, the teapot is a single untextured shape.
+bool load_obj_mesh(const std::string& path, ObjMesh& mesh)
+{
+	std::ifstream input(path);
+
+	if (!input)
+	{
+		std::cout << "Error: cannot open " << path << std::endl;
+		return false;
+	}
+
+	mesh = ObjMesh();
+
+	bool has_normals = true;
+	bool has_uvs = true;
+	std::string line;
+
+	while (std::getline(input, line))
+	{
+		const char* text = line.c_str();
+
+		if (line.compare(0, 2, "v ") == 0)
+		{
+			float x = 0.0f;
+			float y = 0.0f;
+			float z = 0.0f;
+			sscanf(text + 2, "%f %f %f", &x, &y, &z);
+			mesh.positions.insert(mesh.positions.end(), { x, y, z });
+		}
+		else if (line.compare(0, 3, "vn ") == 0)
+		{
+			float x = 0.0f;
+			float y = 0.0f;
+			float z = 0.0f;
+			sscanf(text + 3, "%f %f %f", &x, &y, &z);
+			mesh.normals.insert(mesh.normals.end(), { x, y, z });
+		}
+		else if (line.compare(0, 3, "vt ") == 0)
+		{
+			float u = 0.0f;
+			float v = 0.0f;
+			sscanf(text + 3, "%f %f", &u, &v);
+			mesh.uvs.insert(mesh.uvs.end(), { u, v });
+		}
+		else if (line.compare(0, 2, "f ") == 0)
+		{
+			rpr_int corners = 0;
+			const char* cursor = text + 2;
+
+			while (true)
+			{
+				char* end = nullptr;
+				long position = strtol(cursor, &end, 10);
+
+				if (end == cursor)
+				{
+					break;
+				}
+
+				long uv = 0;
+				long normal = 0;
+				cursor = end;
+
+				if (*cursor == '/')
+				{
+					uv = strtol(cursor + 1, &end, 10);
+					cursor = end;
+
+					if (*cursor == '/')
+					{
+						normal = strtol(cursor + 1, &end, 10);
+						cursor = end;
+					}
+				}
+
+				const rpr_int position_index = resolve_obj_index(position, mesh.positions.size() / 3);
+
+				if (position_index < 0)
+				{
+					std::cout << "Error: bad face in " << path << std::endl;
+					return false;
+				}
+
+				mesh.position_indices.push_back(position_index);
+				mesh.normal_indices.push_back(resolve_obj_index(normal, mesh.normals.size() / 3));
+				mesh.uv_indices.push_back(resolve_obj_index(uv, mesh.uvs.size() / 2));
+
+				has_normals &= mesh.normal_indices.back() >= 0;
+				has_uvs &= mesh.uv_indices.back() >= 0;
+				corners++;
+			}
+
+			if (corners >= 3)
+			{
+				mesh.face_sizes.push_back(corners);
+			}
+			else
+			{
+				mesh.position_indices.resize(mesh.position_indices.size() - corners);
+				mesh.normal_indices.resize(mesh.position_indices.size());
+				mesh.uv_indices.resize(mesh.position_indices.size());
+			}
+		}
+	}
+
+	if (!has_normals)
+	{
+		mesh.normals.clear();
+		mesh.normal_indices.clear();
+	}
+
+	if (!has_uvs)
+	{
+		mesh.uvs.clear();
+		mesh.uv_indices.clear();
+	}
+
+	return !mesh.face_sizes.empty();
+}
+
+static rpr_shape create_obj_shape(rpr_context context, rpr_scene scene, RPRGarbageCollector& gc, const ObjMesh& mesh)
+{
+	rpr_shape shape = nullptr;
+
+	CHECK(rprContextCreateMesh(context,
+		mesh.positions.data(), mesh.positions.size() / 3, sizeof(float) * 3,
+		mesh.normals.empty() ? nullptr : mesh.normals.data(), mesh.normals.size() / 3, sizeof(float) * 3,
+		mesh.uvs.empty() ? nullptr : mesh.uvs.data(), mesh.uvs.size() / 2, sizeof(float) * 2,
+		mesh.position_indices.data(), sizeof(rpr_int),
+		mesh.normal_indices.empty() ? nullptr : mesh.normal_indices.data(), sizeof(rpr_int),
+		mesh.uv_indices.empty() ? nullptr : mesh.uv_indices.data(), sizeof(rpr_int),
+		mesh.face_sizes.data(), mesh.face_sizes.size(), &shape));
+	CHECK(rprSceneAttachShape(scene, shape));
+	gc.GCAdd(shape);
+
+	return shape;
+}
+
+// RPR keeps its own copy of the mesh data, estimated from the counts it reports
+static void record_mesh(rpr_shape mesh, const char* label)
+{
+	size_t vertices = 0;
+	size_t normals = 0;
+	size_t uvs = 0;
+	size_t polygons = 0;
+
+	rprMeshGetInfo(mesh, RPR_MESH_VERTEX_COUNT, sizeof(vertices), &vertices, nullptr);
+	rprMeshGetInfo(mesh, RPR_MESH_NORMAL_COUNT, sizeof(normals), &normals, nullptr);
+	rprMeshGetInfo(mesh, RPR_MESH_UV_COUNT, sizeof(uvs), &uvs, nullptr);
+	rprMeshGetInfo(mesh, RPR_MESH_POLYGON_COUNT, sizeof(polygons), &polygons, nullptr);
+
+	// Three index streams of up to four corners per face
+	size_t bytes = vertices * 12 + normals * 12 + uvs * 8 + polygons * 4 * 3 * sizeof(rpr_int);
+	MemoryLedger::get().record(MemoryCategory::Mesh, mesh, bytes, label);
+}
+
+rpr_status create_demo_scene(rpr_context context, rpr_material_system material_system, ImageCache& image_cache,
+	RPRGarbageCollector& gc, const DemoSceneSettings& settings, DemoScene& demo)
+{
+	// Scene
+	rpr_scene scene = nullptr;
+	CHECK(rprContextCreateScene(context, &scene));
+	CHECK(rprContextSetScene(context, scene));
+	demo.scene = scene;
+
+	// Camera
+	rpr_camera camera = nullptr;
+	CHECK(rprContextCreateCamera(context, &camera));
+	CHECK(rprCameraLookAt(camera, settings.camera_eye[0], settings.camera_eye[1], settings.camera_eye[2], settings.camera_target[0], settings.camera_target[1], settings.camera_target[2], 0, 1, 0));
+	CHECK(rprCameraSetFocalLength(camera, settings.camera_focal_length));
+	CHECK(rprSceneSetCamera(scene, camera));
+	demo.camera = camera;
+
+	// Create env light
+	CHECK(create_env_light(context, image_cache, gc, demo, settings.env_intensity));
+
+	{
+		// Define the teapots list used in the scene
+		struct TEAPOT_DEF
+		{
+			TEAPOT_DEF(float x_, float z_, float rot_, float r_, float g_, float b_)
+			{
+				x = x_;
+				z = z_;
+				rot = rot_;
+				r = r_ / 255.0f;
+				g = g_ / 255.0f;
+				b = b_ / 255.0f;
+				shape = nullptr;
+				mat = nullptr;
+			}
+
+			float x;
+			float z;
+			float rot;
+			float r;
+			float g;
+			float b;
+			rpr_shape shape;
+			rpr_material_node mat;
+		};
+		std::vector<TEAPOT_DEF> posList;
+		posList.push_back(TEAPOT_DEF(5.0f, 2.0f, 1.6f, 122, 63, 0)); // brown
+		posList.push_back(TEAPOT_DEF(-5.0f, 3.0f, 5.6f, 122, 0, 14));
+		posList.push_back(TEAPOT_DEF(0.0f, -3.0f, 3.2f, 119, 0, 93));
+		posList.push_back(TEAPOT_DEF(1.0f, +3.0f, 1.2f, 7, 0, 119));
+		posList.push_back(TEAPOT_DEF(3.0f, +9.0f, -1.7f, 0, 59, 119));
+		posList.push_back(TEAPOT_DEF(-6.0f, +12.0f, 2.2f, 0, 119, 99));
+		posList.push_back(TEAPOT_DEF(9.0f, -6.0f, 4.8f, 0, 119, 1)); // green
+		posList.push_back(TEAPOT_DEF(9.0f, 7.0f, 2.5f, 219, 170, 0)); // yellow
+		posList.push_back(TEAPOT_DEF(-9.0f, -7.0f, 5.8f, 112, 216, 202));
+
+
+		// create teapots
+		int i = 0;
+		for (const auto iShape : posList)
+		{
+			rpr_shape teapot01 = nullptr;
+
+			if (i == 0)
+			{
+				// create from OBJ for the first teapot, parsed already when the caller could
+				teapot01 = settings.teapot_mesh ? create_obj_shape(context, scene, gc, *settings.teapot_mesh) : ImportOBJ(kTeapotMesh, scene, context);
+			}
+			else
+			{
+				// other teapots will be instances of the first one.
+				CHECK(rprContextCreateInstance(context, posList[0].shape, &teapot01));
+				CHECK(rprSceneAttachShape(scene, teapot01));
+			}
+
+			// random transforms of teapot on the floor :
+
+			RadeonProRender::matrix m;
+
+			if (i % 4 == 0)
+				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
+				* RadeonProRender::rotation_x(MY_PI);
+
+			if (i % 4 == 1)
+				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
+				* RadeonProRender::translation(RadeonProRender::float3(0, 2.65, 0))
+				* RadeonProRender::rotation_x(MY_PI + 1.9f)
+				* RadeonProRender::rotation_y(0.45);
+
+
+			if (i % 4 == 2)
+				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
+				* RadeonProRender::translation(RadeonProRender::float3(0, 2.65, 0))
+				* RadeonProRender::rotation_x(MY_PI + 1.9f)
+				* RadeonProRender::rotation_y(-0.57);
+
+
+			if (i % 4 == 3)
+				m = RadeonProRender::translation(RadeonProRender::float3(iShape.x, 0.0f, iShape.z)) * RadeonProRender::rotation_y(iShape.rot)
+				* RadeonProRender::translation(RadeonProRender::float3(0, 3.38, 0))
+				* RadeonProRender::rotation_x(+0.42f)
+				* RadeonProRender::rotation_z(-0.20f)
+				;
+
+			CHECK(rprShapeSetTransform(teapot01, RPR_TRUE, &m.m00));
+
+			posList[i].shape = teapot01;
+
+			i++;
+		}
+
+		demo.teapot = posList[0].shape;
+		record_mesh(demo.teapot, kTeapotMesh);
+
+
+
+
+	}
+
+	// create the floor
+	CHECK(create_floor(context, material_system, image_cache, gc, demo, 1.0f, 1.0f));
+	record_mesh(demo.floor, "Floor");
+
+	return RPR_SUCCESS;
+}
+
+std::vector<std::shared_future<rpr_image>> prefetch_demo_scene(ImageCache& image_cache)
+{
+	return { image_cache.request(kEnvLightImage), image_cache.request(kFloorImage, get_floor_image_options()) };
+}
+
+void release_demo_scene(ImageCache& image_cache, DemoScene& demo)
+{
+	MemoryLedger::get().release(demo.teapot);
+	MemoryLedger::get().release(demo.floor);
+
+	for (rpr_image image : demo.images)
+	{
+		image_cache.release(image);
+	}
+
+	demo.images.clear();
+}
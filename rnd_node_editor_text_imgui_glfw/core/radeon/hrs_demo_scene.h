@@ -0,0 +1,66 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "RadeonProRender_v2.h"
+#include "common.h"
+#include "hrs_image_cache.h"
+#include "hrs_instancer.h"
+
+// An OBJ as RPR takes it: one index per corner into each attribute, faces of any size.
+// Normals and texture coordinates are left empty unless every corner has one.
+struct ObjMesh
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> uvs;
+	std::vector<rpr_int> position_indices;
+	std::vector<rpr_int> normal_indices;
+	std::vector<rpr_int> uv_indices;
+	std::vector<rpr_int> face_sizes;
+};
+
+// Parses without a context, so it can run while the context is still being created
+bool load_obj_mesh(const std::string& path, ObjMesh& mesh);
+
+struct DemoSceneSettings
+{
+	float camera_eye[3] = { 4.0f, 4.0f, 15.0f };
+	float camera_target[3] = { 1.5f, 0.0f, 0.0f };
+	float camera_focal_length = 35.0f;
+	float env_intensity = 0.8f;
+
+	// Teapot parsed ahead by the caller, nullptr imports the OBJ in create_demo_scene
+	const ObjMesh* teapot_mesh = nullptr;
+};
+
+struct DemoScene
+{
+	rpr_scene scene = nullptr;
+	rpr_camera camera = nullptr;
+	rpr_light env_light = nullptr;
+
+	// First teapot, its mesh is shared by the other teapots and every scatter instance
+	rpr_shape teapot = nullptr;
+	rpr_shape floor = nullptr;
+	ScatterSurface floor_surface;
+
+	// Held from the image cache until release_demo_scene
+	std::vector<rpr_image> images;
+};
+
+// The teapot scene of the viewer: environment light, nine teapots and the AMD floor, set as
+// the context scene. Shared by the application and the render benchmark so both measure the
+// same thing.
+rpr_status create_demo_scene(rpr_context context, rpr_material_system material_system, ImageCache& image_cache,
+	RPRGarbageCollector& gc, const DemoSceneSettings& settings, DemoScene& demo);
+
+// Starts loading the scene images, the context can still be in creation. Each resolved image
+// holds a reference to release once create_demo_scene has taken its own.
+std::vector<std::shared_future<rpr_image>> prefetch_demo_scene(ImageCache& image_cache);
+
+// Gives the scene images back to the cache and the meshes to the memory ledger, objects
+// themselves go with the garbage collector
+void release_demo_scene(ImageCache& image_cache, DemoScene& demo);
@@ -0,0 +1,510 @@
+#include "hrs_image_cache.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include "common.h"
+#include "../memory/hrs_memory_ledger.h"
+
+ImageCache::ImageCache(rpr_context context, std::mutex& context_mutex, size_t budget_bytes, int worker_count)
+	: context_(context), context_mutex_(context_mutex), budget_bytes_(budget_bytes)
+{
+	for (int i = 0; i < worker_count; ++i)
+	{
+		workers_.emplace_back(&ImageCache::worker_loop, this);
+	}
+}
+
+ImageCache::~ImageCache()
+{
+	std::deque<LoadJob> jobs;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_ = false;
+		jobs.swap(jobs_);
+
+		for (const LoadJob& job : jobs)
+		{
+			entries_.erase(job.key);
+		}
+	}
+
+	wake_.notify_all();
+	context_ready_.notify_all();
+
+	// Nobody waiting on a queued load may be left with a broken promise
+	for (LoadJob& job : jobs)
+	{
+		job.promise->set_value(nullptr);
+	}
+
+	for (std::thread& worker : workers_)
+	{
+		worker.join();
+	}
+
+	if (decode_context_)
+	{
+		CHECK(rprObjectDelete(decode_context_));
+	}
+}
+
+std::string ImageCache::make_key(const std::string& path, const ImageLoadOptions& options, std::string& canonical_path)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+	canonical_path = error ? path : canonical.generic_string();
+
+	std::ostringstream key;
+	key << canonical_path << "|g" << options.gamma << "|m" << options.mipmap << "|w" << options.wrap;
+	return key.str();
+}
+
+std::shared_future<rpr_image> ImageCache::request(const std::string& path, const ImageLoadOptions& options)
+{
+	std::string canonical_path;
+	std::string key = make_key(path, options, canonical_path);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	stats_.requests++;
+
+	auto iter = entries_.find(key);
+
+	if (iter != entries_.end())
+	{
+		Entry& entry = iter->second;
+
+		if (entry.is_loaded)
+		{
+			stats_.hits++;
+		}
+		else
+		{
+			stats_.coalesced++;
+		}
+
+		if (entry.unused != unused_.end())
+		{
+			unused_.erase(entry.unused);
+			entry.unused = unused_.end();
+		}
+
+		entry.references++;
+		return entry.future;
+	}
+
+	auto promise = std::make_shared<std::promise<rpr_image>>();
+
+	Entry& entry = entries_[key];
+	entry.key = key;
+	entry.path = canonical_path;
+	entry.options = options;
+	entry.future = promise->get_future().share();
+	entry.references = 1;
+	entry.unused = unused_.end();
+
+	jobs_.push_back({ key, promise });
+	wake_.notify_one();
+
+	return entry.future;
+}
+
+void ImageCache::set_context(rpr_context context)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		context_ = context;
+	}
+
+	context_ready_.notify_all();
+}
+
+rpr_image ImageCache::acquire(const std::string& path, const ImageLoadOptions& options)
+{
+	return request(path, options).get();
+}
+
+void ImageCache::release(rpr_image image)
+{
+	if (!image)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto key = image_keys_.find(image);
+
+		if (key == image_keys_.end())
+		{
+			return;
+		}
+
+		Entry& entry = entries_[key->second];
+
+		if (--entry.references > 0)
+		{
+			return;
+		}
+
+		entry.unused = unused_.insert(unused_.end(), entry.key);
+	}
+
+	evict_over_budget();
+}
+
+void ImageCache::set_budget(size_t budget_bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		budget_bytes_ = budget_bytes;
+	}
+
+	evict_over_budget();
+}
+
+void ImageCache::clear(bool force)
+{
+	std::vector<rpr_image> images;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		if (force)
+		{
+			// Let in-flight loads land first, their images have to be deleted too
+			std::vector<std::shared_future<rpr_image>> pending;
+
+			for (const auto& [key, entry] : entries_)
+			{
+				if (!entry.is_loaded)
+				{
+					pending.push_back(entry.future);
+				}
+			}
+
+			lock.unlock();
+
+			for (const auto& future : pending)
+			{
+				future.wait();
+			}
+
+			lock.lock();
+		}
+
+		for (auto iter = entries_.begin(); iter != entries_.end();)
+		{
+			Entry& entry = iter->second;
+
+			if (!entry.is_loaded || (!force && entry.references > 0))
+			{
+				++iter;
+				continue;
+			}
+
+			if (entry.unused != unused_.end())
+			{
+				unused_.erase(entry.unused);
+			}
+
+			stats_.resident_bytes -= entry.bytes;
+			image_keys_.erase(entry.image);
+			images.push_back(entry.image);
+			iter = entries_.erase(iter);
+		}
+	}
+
+	std::lock_guard<std::mutex> context_lock(context_mutex_);
+
+	for (rpr_image image : images)
+	{
+		MemoryLedger::get().release(image);
+		rprObjectDelete(image);
+	}
+}
+
+ImageCacheStats ImageCache::get_stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	ImageCacheStats stats = stats_;
+	stats.images = static_cast<int>(entries_.size());
+	stats.referenced_bytes = 0;
+
+	for (const auto& [key, entry] : entries_)
+	{
+		if (entry.references > 0)
+		{
+			stats.referenced_bytes += entry.bytes;
+		}
+	}
+
+	return stats;
+}
+
+void ImageCache::worker_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true)
+	{
+		wake_.wait(lock, [&]() { return !running_ || !jobs_.empty(); });
+
+		if (!running_)
+		{
+			break;
+		}
+
+		LoadJob job = std::move(jobs_.front());
+		jobs_.pop_front();
+
+		lock.unlock();
+		load(job.key, job.promise);
+		lock.lock();
+	}
+}
+
+void ImageCache::load(const std::string& key, std::shared_ptr<std::promise<rpr_image>> promise)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::string path;
+	ImageLoadOptions options;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const Entry& entry = entries_[key];
+		path = entry.path;
+		options = entry.options;
+	}
+
+	// File IO and decoding stay outside the render lock, only the image creation needs it
+	std::ifstream file(path, std::ios::binary);
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	std::string extension = std::filesystem::path(path).extension().string();
+	DecodedImage decoded;
+	bool has_decoder = true;
+	bool is_decoded = !data.empty() && decode(extension, data, decoded, has_decoder);
+
+	rpr_image image = nullptr;
+	size_t bytes = 0;
+
+	rpr_context context = nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		context_ready_.wait(lock, [&]() { return context_ || !running_; });
+		context = context_;
+	}
+
+	// The encoded size stands in when the render context decodes, it is corrected once created
+	const size_t estimate = is_decoded ? decoded.pixels.size() : data.size();
+	bool is_reserved = false;
+
+	if (context && (is_decoded || (!has_decoder && !data.empty())))
+	{
+		is_reserved = make_room(estimate);
+
+		if (is_reserved)
+		{
+			// Held under the promise until the image records its own, concurrent loads see it
+			MemoryLedger::get().record(MemoryCategory::Image, promise.get(), estimate, path.c_str());
+		}
+		else
+		{
+			std::cout << "ImageCache: " << path << " does not fit the memory budget" << std::endl;
+			MemoryLedger::get().count_refusal();
+		}
+	}
+
+	if (is_reserved)
+	{
+		std::lock_guard<std::mutex> context_lock(context_mutex_);
+
+		rpr_status status = is_decoded
+			? rprContextCreateImage(context, decoded.format, &decoded.desc, decoded.pixels.data(), &image)
+			: rprContextCreateImageFromFileMemory(context, extension.c_str(), data.data(), data.size(), &image);
+
+		if (status == RPR_SUCCESS)
+		{
+			rprImageSetGamma(image, options.gamma);
+			rprImageSetMipmapEnabled(image, options.mipmap ? RPR_TRUE : RPR_FALSE);
+			rprImageSetWrap(image, options.wrap);
+
+			if (rprImageGetInfo(image, RPR_IMAGE_DATA_SIZEBYTE, sizeof(bytes), &bytes, nullptr) != RPR_SUCCESS)
+			{
+				bytes = is_decoded ? decoded.pixels.size() : data.size();
+			}
+		}
+		else
+		{
+			image = nullptr;
+		}
+	}
+
+	float elapsed_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		stats_.load_ms += elapsed_ms;
+
+		if (image)
+		{
+			Entry& entry = entries_[key];
+			entry.image = image;
+			entry.bytes = bytes;
+			entry.is_loaded = true;
+
+			image_keys_[image] = key;
+			stats_.loads++;
+
+			MemoryLedger::get().record(MemoryCategory::Image, image, bytes, path.c_str());
+			stats_.resident_bytes += bytes;
+		}
+		else
+		{
+			// Forget the key so a later request retries, waiting callers get nullptr
+			std::cout << "ImageCache: cannot load " << path << std::endl;
+			entries_.erase(key);
+			stats_.failures++;
+		}
+	}
+
+	if (is_reserved)
+	{
+		MemoryLedger::get().release(promise.get());
+	}
+
+	promise->set_value(image);
+
+	evict_over_budget();
+}
+
+bool ImageCache::decode(const std::string& extension, const std::vector<char>& data, DecodedImage& decoded, bool& has_decoder)
+{
+	std::lock_guard<std::mutex> lock(decode_mutex_);
+
+	if (!decode_context_ && !is_decoder_failed_)
+	{
+		rpr_int plugin_id = rprRegisterPlugin(RPR_PLUGIN_FILE_NAME);
+
+		if (plugin_id == -1 || rprCreateContext(RPR_API_VERSION, &plugin_id, 1, RPR_CREATION_FLAGS_ENABLE_CPU, g_contextProperties, nullptr, &decode_context_) != RPR_SUCCESS)
+		{
+			std::cout << "ImageCache: no decode context, images are decoded under the render lock" << std::endl;
+			decode_context_ = nullptr;
+			is_decoder_failed_ = true;
+		}
+		else
+		{
+			CHECK(rprContextSetActivePlugin(decode_context_, plugin_id));
+		}
+	}
+
+	has_decoder = decode_context_ != nullptr;
+
+	if (!has_decoder)
+	{
+		return false;
+	}
+
+	rpr_image image = nullptr;
+
+	if (rprContextCreateImageFromFileMemory(decode_context_, extension.c_str(), data.data(), data.size(), &image) != RPR_SUCCESS)
+	{
+		return false;
+	}
+
+	size_t size = 0;
+	bool is_read = rprImageGetInfo(image, RPR_IMAGE_FORMAT, sizeof(decoded.format), &decoded.format, nullptr) == RPR_SUCCESS
+		&& rprImageGetInfo(image, RPR_IMAGE_DESC, sizeof(decoded.desc), &decoded.desc, nullptr) == RPR_SUCCESS
+		&& rprImageGetInfo(image, RPR_IMAGE_DATA, 0, nullptr, &size) == RPR_SUCCESS;
+
+	if (is_read)
+	{
+		decoded.pixels.resize(size);
+		is_read = rprImageGetInfo(image, RPR_IMAGE_DATA, size, decoded.pixels.data(), nullptr) == RPR_SUCCESS;
+	}
+
+	CHECK(rprObjectDelete(image));
+
+	return is_read;
+}
+
+rpr_image ImageCache::evict_oldest()
+{
+	auto iter = entries_.find(unused_.front());
+	unused_.pop_front();
+
+	rpr_image image = iter->second.image;
+	stats_.resident_bytes -= iter->second.bytes;
+	stats_.evictions++;
+
+	image_keys_.erase(image);
+	entries_.erase(iter);
+
+	return image;
+}
+
+bool ImageCache::make_room(size_t bytes)
+{
+	MemoryLedger& ledger = MemoryLedger::get();
+
+	while (!ledger.fits(bytes))
+	{
+		rpr_image image = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if (unused_.empty())
+			{
+				return false;
+			}
+
+			image = evict_oldest();
+		}
+
+		std::lock_guard<std::mutex> context_lock(context_mutex_);
+		ledger.release(image);
+		rprObjectDelete(image);
+	}
+
+	return true;
+}
+
+void ImageCache::evict_over_budget()
+{
+	std::vector<rpr_image> images;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		while (stats_.resident_bytes > budget_bytes_ && !unused_.empty())
+		{
+			images.push_back(evict_oldest());
+		}
+	}
+
+	if (images.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> context_lock(context_mutex_);
+
+	for (rpr_image image : images)
+	{
+		MemoryLedger::get().release(image);
+		rprObjectDelete(image);
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "RadeonProRender_v2.h"
+
+struct ImageLoadOptions
+{
+	float gamma = 1.0f;
+	bool mipmap = true;
+	rpr_image_wrap_type wrap = RPR_IMAGE_WRAP_TYPE_REPEAT;
+};
+
+struct ImageCacheStats
+{
+	uint64_t requests = 0;
+	uint64_t hits = 0;
+	uint64_t coalesced = 0;
+	uint64_t loads = 0;
+	uint64_t failures = 0;
+	uint64_t evictions = 0;
+	size_t resident_bytes = 0;
+	size_t referenced_bytes = 0;
+	int images = 0;
+	float load_ms = 0.0f;
+};
+
+// Every RPR image of the session, keyed by canonical path and load options.
+// File reads happen on a small worker pool and concurrent requests for the same key share
+// one load. Images are reference counted, unreferenced ones stay resident until the host
+// budget is exceeded and are then evicted oldest first. Loads also have to fit the
+// MemoryLedger budget, unused images are evicted to make room and a load that still does not
+// fit resolves to nullptr.
+// Files are decoded on a CPU context of the cache's own, only the creation of the image from
+// the decoded pixels is made under context_mutex, while nothing renders. The context may come
+// later with set_context, files are read and decoded meanwhile and created once it is set.
+class ImageCache
+{
+public:
+
+	ImageCache(rpr_context context, std::mutex& context_mutex, size_t budget_bytes = 512ull * 1024 * 1024, int worker_count = 2);
+	~ImageCache();
+
+	// Loads still queued on destruction resolve to nullptr
+
+	// Starts the load if needed and takes a reference, the future resolves to nullptr on failure
+	std::shared_future<rpr_image> request(const std::string& path, const ImageLoadOptions& options = {});
+
+	// Blocking convenience over request()
+	rpr_image acquire(const std::string& path, const ImageLoadOptions& options = {});
+
+	void release(rpr_image image);
+
+	void set_context(rpr_context context);
+
+	void set_budget(size_t budget_bytes);
+	size_t get_budget() const { return budget_bytes_; }
+
+	// Deletes every unreferenced image, everything when force is set (context shutdown)
+	void clear(bool force = false);
+
+	ImageCacheStats get_stats();
+
+private:
+
+	struct Entry
+	{
+		std::string key;
+		std::string path;
+		ImageLoadOptions options;
+		std::shared_future<rpr_image> future;
+		rpr_image image = nullptr;
+		size_t bytes = 0;
+		int references = 0;
+		bool is_loaded = false;
+		std::list<std::string>::iterator unused;
+	};
+
+	struct LoadJob
+	{
+		std::string key;
+		std::shared_ptr<std::promise<rpr_image>> promise;
+	};
+
+	struct DecodedImage
+	{
+		rpr_image_format format = {};
+		rpr_image_desc desc = {};
+		std::vector<char> pixels;
+	};
+
+	static std::string make_key(const std::string& path, const ImageLoadOptions& options, std::string& canonical_path);
+
+	void worker_loop();
+	void load(const std::string& key, std::shared_ptr<std::promise<rpr_image>> promise);
+
+	// has_decoder is false when the decode context cannot be created, the caller then decodes
+	// on the render context
+	bool decode(const std::string& extension, const std::vector<char>& data, DecodedImage& decoded, bool& has_decoder);
+	void evict_over_budget();
+
+	// Least recently released unused image, taken out of the cache. mutex_ must be held
+	rpr_image evict_oldest();
+
+	// Evicts unused images until bytes fit the MemoryLedger budget, false when they never do
+	bool make_room(size_t bytes);
+
+	rpr_context context_;
+	std::mutex& context_mutex_;
+	size_t budget_bytes_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable context_ready_;
+	std::unordered_map<std::string, Entry> entries_;
+	std::unordered_map<rpr_image, std::string> image_keys_;
+	std::list<std::string> unused_;
+	std::deque<LoadJob> jobs_;
+	ImageCacheStats stats_;
+	bool running_ = true;
+
+	// Decoding context, created by the first load. RPR calls on one context are serialized
+	std::mutex decode_mutex_;
+	rpr_context decode_context_ = nullptr;
+	bool is_decoder_failed_ = false;
+
+	std::vector<std::thread> workers_;
+};
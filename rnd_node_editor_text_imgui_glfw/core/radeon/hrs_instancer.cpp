@@ -0,0 +1,581 @@
+#include "hrs_instancer.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	const float kTwoPi = 6.28318530718f;
+
+	// Per instance parameters, one array per field so four instances load as one vector
+	struct ScatterPoints
+	{
+		std::vector<float> px, py, pz;
+		std::vector<float> nx, ny, nz;
+		std::vector<float> angle, scale;
+
+		void resize(size_t count)
+		{
+			for (std::vector<float>* field : { &px, &py, &pz, &nx, &ny, &nz, &angle, &scale })
+			{
+				field->assign(count, 0.0f);
+			}
+		}
+	};
+
+	// Counter based so instance i draws the same numbers whatever the thread split or count
+	struct InstanceRandom
+	{
+		uint64_t state;
+
+		InstanceRandom(uint32_t seed, int index) : state((static_cast<uint64_t>(seed) << 32) ^ (static_cast<uint64_t>(index) * 0x9e3779b97f4a7c15ull)) {}
+
+		float next()
+		{
+			state += 0x9e3779b97f4a7c15ull;
+			uint64_t x = state;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			x ^= x >> 31;
+			return static_cast<float>(x >> 40) * (1.0f / 16777216.0f);
+		}
+	};
+
+	bool load_point_file(const std::string& path, std::vector<float>& values)
+	{
+		std::ifstream file(path);
+
+		if (!file)
+		{
+			return false;
+		}
+
+		// x y z [angle [scale]] per line, # starts a comment
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			line = line.substr(0, line.find('#'));
+			std::istringstream stream(line);
+			float point[5] = { 0.0f, 0.0f, 0.0f, -1.0f, -1.0f };
+			int read = 0;
+
+			while (read < 5 && stream >> point[read])
+			{
+				read++;
+			}
+
+			if (read >= 3)
+			{
+				values.insert(values.end(), point, point + 5);
+			}
+		}
+
+		return true;
+	}
+
+	void fill_points(const ScatterSettings& settings, const ScatterSurface& surface, const std::vector<float>& cdf,
+		const std::vector<float>& file_points, ScatterPoints& points, int begin, int end)
+	{
+		const int count = static_cast<int>(points.px.size());
+		const int side = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count)))));
+		const float half = (side - 1) * 0.5f;
+
+		for (int i = begin; i < end; ++i)
+		{
+			InstanceRandom random(settings.seed, i);
+
+			float n[3] = { 0.0f, 1.0f, 0.0f };
+			float angle = settings.random_rotation ? random.next() * kTwoPi : 0.0f;
+			float scale = settings.scale_min + (settings.scale_max - settings.scale_min) * random.next();
+
+			switch (settings.mode)
+			{
+			case ScatterMode::Grid:
+				points.px[i] = ((i % side) - half + (random.next() - 0.5f) * settings.jitter) * settings.spacing;
+				points.pz[i] = ((i / side) - half + (random.next() - 0.5f) * settings.jitter) * settings.spacing;
+				break;
+
+			case ScatterMode::Surface:
+			{
+				// Area weighted triangle, then a uniform point inside it
+				int triangle = static_cast<int>(std::upper_bound(cdf.begin(), cdf.end(), random.next() * cdf.back()) - cdf.begin());
+				triangle = std::min(triangle, static_cast<int>(cdf.size()) - 1);
+
+				const float* a = &surface.positions[surface.indices[triangle * 3 + 0] * 3];
+				const float* b = &surface.positions[surface.indices[triangle * 3 + 1] * 3];
+				const float* c = &surface.positions[surface.indices[triangle * 3 + 2] * 3];
+
+				float r1 = std::sqrt(random.next());
+				float r2 = random.next();
+				float wa = 1.0f - r1;
+				float wb = r1 * (1.0f - r2);
+				float wc = r1 * r2;
+
+				points.px[i] = a[0] * wa + b[0] * wb + c[0] * wc;
+				points.py[i] = a[1] * wa + b[1] * wb + c[1] * wc;
+				points.pz[i] = a[2] * wa + b[2] * wb + c[2] * wc;
+
+				if (settings.align_to_normal)
+				{
+					float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+					float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+					float length = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+					if (length > 0.0f)
+					{
+						n[0] = cross[0] / length;
+						n[1] = cross[1] / length;
+						n[2] = cross[2] / length;
+					}
+				}
+				break;
+			}
+
+			case ScatterMode::PointFile:
+			{
+				const float* point = &file_points[i * 5];
+				points.px[i] = point[0];
+				points.py[i] = point[1];
+				points.pz[i] = point[2];
+
+				if (point[3] >= 0.0f)
+				{
+					angle = point[3];
+				}
+
+				if (point[4] > 0.0f)
+				{
+					scale = point[4];
+				}
+				break;
+			}
+			}
+
+			points.nx[i] = n[0];
+			points.ny[i] = n[1];
+			points.nz[i] = n[2];
+			points.angle[i] = angle;
+			points.scale[i] = scale;
+		}
+	}
+
+	// T * B * Ry(angle) * S with B the orthonormal basis around the normal (Duff et al. 2017)
+	void build_matrix(const ScatterPoints& points, int i, InstanceTransform& transform)
+	{
+		float nx = points.nx[i], ny = points.ny[i], nz = points.nz[i];
+		float sign = std::copysign(1.0f, nz);
+		float a = -1.0f / (sign + nz);
+		float b = nx * ny * a;
+
+		float t[3] = { 1.0f + sign * nx * nx * a, sign * b, -sign * nx };
+		float bt[3] = { -b, -(sign + ny * ny * a), ny };
+		float n[3] = { nx, ny, nz };
+
+		float c = std::cos(points.angle[i]);
+		float s = std::sin(points.angle[i]);
+		float scale = points.scale[i];
+		float p[3] = { points.px[i], points.py[i], points.pz[i] };
+
+		for (int row = 0; row < 3; ++row)
+		{
+			transform.m[row * 4 + 0] = (t[row] * c - bt[row] * s) * scale;
+			transform.m[row * 4 + 1] = n[row] * scale;
+			transform.m[row * 4 + 2] = (t[row] * s + bt[row] * c) * scale;
+			transform.m[row * 4 + 3] = p[row];
+		}
+
+		transform.m[12] = transform.m[13] = transform.m[14] = 0.0f;
+		transform.m[15] = 1.0f;
+	}
+
+	// Polynomials on [-pi, pi] after reduction, a few 1e-6 off which is plenty for a rotation
+	void sincos_ps(__m128 x, __m128& sin_out, __m128& cos_out)
+	{
+		__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.0f / kTwoPi))));
+		x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(kTwoPi)));
+
+		__m128 x2 = _mm_mul_ps(x, x);
+
+		__m128 s = _mm_set1_ps(-7.6471637e-13f);
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.6059043e-10f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-2.5052108e-8f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(2.7557319e-6f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.9841270e-4f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(8.3333333e-3f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.6666667e-1f));
+		s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.0f));
+		sin_out = _mm_mul_ps(s, x);
+
+		__m128 c = _mm_set1_ps(4.7794773e-14f);
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.1470746e-11f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(2.0876757e-9f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-2.7557319e-7f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(2.4801587e-5f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.3888889e-3f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(4.1666667e-2f));
+		c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-0.5f));
+		cos_out = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f));
+	}
+
+	// Same math as build_matrix, four instances per iteration then transposed to rows
+	void build_matrices_sse(const ScatterPoints& points, int begin, int end, InstanceTransform* transforms)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 sign_mask = _mm_set1_ps(-0.0f);
+		const __m128 last_row = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+
+		for (int i = begin; i + 4 <= end; i += 4)
+		{
+			__m128 nx = _mm_loadu_ps(&points.nx[i]);
+			__m128 ny = _mm_loadu_ps(&points.ny[i]);
+			__m128 nz = _mm_loadu_ps(&points.nz[i]);
+
+			__m128 sign = _mm_or_ps(one, _mm_and_ps(nz, sign_mask));
+			__m128 a = _mm_div_ps(_mm_xor_ps(one, sign_mask), _mm_add_ps(sign, nz));
+			__m128 b = _mm_mul_ps(_mm_mul_ps(nx, ny), a);
+
+			__m128 t[3] = {
+				_mm_add_ps(one, _mm_mul_ps(sign, _mm_mul_ps(_mm_mul_ps(nx, nx), a))),
+				_mm_mul_ps(sign, b),
+				_mm_xor_ps(_mm_mul_ps(sign, nx), sign_mask) };
+			__m128 bt[3] = {
+				_mm_xor_ps(b, sign_mask),
+				_mm_xor_ps(_mm_add_ps(sign, _mm_mul_ps(_mm_mul_ps(ny, ny), a)), sign_mask),
+				ny };
+			__m128 n[3] = { nx, ny, nz };
+			__m128 p[3] = { _mm_loadu_ps(&points.px[i]), _mm_loadu_ps(&points.py[i]), _mm_loadu_ps(&points.pz[i]) };
+
+			__m128 s, c;
+			sincos_ps(_mm_loadu_ps(&points.angle[i]), s, c);
+			__m128 scale = _mm_loadu_ps(&points.scale[i]);
+
+			for (int row = 0; row < 3; ++row)
+			{
+				__m128 e0 = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(t[row], c), _mm_mul_ps(bt[row], s)), scale);
+				__m128 e1 = _mm_mul_ps(n[row], scale);
+				__m128 e2 = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(t[row], s), _mm_mul_ps(bt[row], c)), scale);
+				__m128 e3 = p[row];
+
+				_MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+
+				_mm_storeu_ps(transforms[i + 0].m + row * 4, e0);
+				_mm_storeu_ps(transforms[i + 1].m + row * 4, e1);
+				_mm_storeu_ps(transforms[i + 2].m + row * 4, e2);
+				_mm_storeu_ps(transforms[i + 3].m + row * 4, e3);
+			}
+
+			for (int k = 0; k < 4; ++k)
+			{
+				_mm_storeu_ps(transforms[i + k].m + 12, last_row);
+			}
+		}
+	}
+}
+
+bool generate_scatter(const ScatterSettings& settings, const ScatterSurface& surface, std::vector<InstanceTransform>& transforms, int thread_count)
+{
+	int count = std::max(0, settings.count);
+
+	std::vector<float> file_points;
+	std::vector<float> cdf;
+
+	if (settings.mode == ScatterMode::PointFile)
+	{
+		if (!load_point_file(settings.point_file, file_points))
+		{
+			transforms.clear();
+			return false;
+		}
+
+		int available = static_cast<int>(file_points.size() / 5);
+		count = count > 0 ? std::min(count, available) : available;
+	}
+	else if (settings.mode == ScatterMode::Surface)
+	{
+		float total = 0.0f;
+
+		for (size_t i = 0; i + 2 < surface.indices.size(); i += 3)
+		{
+			const float* a = &surface.positions[surface.indices[i + 0] * 3];
+			const float* b = &surface.positions[surface.indices[i + 1] * 3];
+			const float* c = &surface.positions[surface.indices[i + 2] * 3];
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float cx = e1[1] * e2[2] - e1[2] * e2[1];
+			float cy = e1[2] * e2[0] - e1[0] * e2[2];
+			float cz = e1[0] * e2[1] - e1[1] * e2[0];
+
+			total += 0.5f * std::sqrt(cx * cx + cy * cy + cz * cz);
+			cdf.push_back(total);
+		}
+
+		if (cdf.empty() || total <= 0.0f)
+		{
+			count = 0;
+		}
+	}
+
+	ScatterPoints points;
+	points.resize(count);
+	transforms.resize(count);
+
+	if (thread_count <= 0)
+	{
+		thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+
+	// Below a few thousand instances per thread the spawn costs more than it saves
+	thread_count = std::min(thread_count, std::max(1, count / 4096));
+
+	auto run_range = [&](int begin, int end)
+		{
+			fill_points(settings, surface, cdf, file_points, points, begin, end);
+
+			int simd_end = begin + (end - begin) / 4 * 4;
+			build_matrices_sse(points, begin, simd_end, transforms.data());
+
+			for (int i = simd_end; i < end; ++i)
+			{
+				build_matrix(points, i, transforms[i]);
+			}
+		};
+
+	// Ranges start on a multiple of four so every thread but the last runs full vectors
+	int per_thread = ((count + thread_count - 1) / thread_count + 3) / 4 * 4;
+	std::vector<std::thread> workers;
+
+	for (int t = 1; t < thread_count; ++t)
+	{
+		int begin = t * per_thread;
+		int end = std::min(count, begin + per_thread);
+
+		if (begin < end)
+		{
+			workers.emplace_back(run_range, begin, end);
+		}
+	}
+
+	run_range(0, std::min(count, per_thread));
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	return true;
+}
+
+Instancer::Instancer(rpr_context context, rpr_scene scene, rpr_shape prototype, std::mutex& context_mutex)
+	: context_(context), scene_(scene), prototype_(prototype), context_mutex_(context_mutex)
+{
+}
+
+Instancer::~Instancer()
+{
+	std::lock_guard<std::mutex> lock(context_mutex_);
+	delete_instances(nullptr, 0);
+}
+
+void Instancer::set_settings(const ScatterSettings& settings)
+{
+	if (settings != settings_)
+	{
+		settings_ = settings;
+		settings_valid_ = false;
+	}
+}
+
+void Instancer::set_material(rpr_material_node material)
+{
+	if (material == material_)
+	{
+		return;
+	}
+
+	material_ = material;
+
+	// Instances created so far get it on the next update through the transaction
+	applied_.clear();
+}
+
+bool Instancer::update(SceneTransaction& edits, float budget_ms, int batch_size)
+{
+	using clock = std::chrono::steady_clock;
+
+	bool is_changed = false;
+
+	if (!settings_valid_)
+	{
+		auto start = clock::now();
+		stats_.error = generate_scatter(settings_, surface_, transforms_) ? nullptr : "cannot read the point file";
+		stats_.generate_ms = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+		settings_valid_ = true;
+
+		// Transforms of the existing instances are compared against what was applied below
+		stats_.updated = 0;
+
+		for (size_t i = 0; i < std::min(applied_.size(), transforms_.size()); ++i)
+		{
+			if (std::memcmp(&applied_[i], &transforms_[i], sizeof(InstanceTransform)) != 0)
+			{
+				edits.set_transform(instances_[i], transforms_[i].m);
+				applied_[i] = transforms_[i];
+				stats_.updated++;
+			}
+		}
+
+		is_changed = stats_.updated > 0;
+	}
+
+	size_t desired = transforms_.size();
+
+	// Shrinking goes first, what follows only touches instances that have a transform
+	if (instances_.size() > desired)
+	{
+		std::unique_lock<std::mutex> lock(context_mutex_, std::try_to_lock);
+
+		if (!lock.owns_lock())
+		{
+			stats_.pending = static_cast<int>(instances_.size() - desired);
+			return is_changed;
+		}
+
+		delete_instances(&edits, desired);
+		is_changed = true;
+	}
+
+	// Material change, applied_ was dropped so every existing instance is refreshed
+	if (applied_.size() < instances_.size())
+	{
+		for (size_t i = applied_.size(); i < instances_.size(); ++i)
+		{
+			edits.set_shape_material(instances_[i], material_);
+			edits.set_transform(instances_[i], transforms_[i].m);
+		}
+
+		applied_.assign(transforms_.begin(), transforms_.begin() + instances_.size());
+		is_changed = true;
+	}
+
+	if (instances_.size() < desired)
+	{
+		if (instances_.empty())
+		{
+			rpr_bytes_before_ = get_rpr_memory();
+		}
+
+		auto start = clock::now();
+		bool is_over_budget = false;
+
+		// Batches under one lock, the budget is checked every few instances
+		while (instances_.size() < desired && !is_over_budget)
+		{
+			std::unique_lock<std::mutex> lock(context_mutex_, std::try_to_lock);
+
+			if (!lock.owns_lock())
+			{
+				break;
+			}
+
+			size_t batch_end = std::min(desired, instances_.size() + batch_size);
+
+			for (size_t i = instances_.size(); i < batch_end; ++i)
+			{
+				rpr_shape instance = nullptr;
+
+				if (rprContextCreateInstance(context_, prototype_, &instance) != RPR_SUCCESS)
+				{
+					stats_.error = "cannot create instances";
+					desired = i;
+					transforms_.resize(desired);
+					break;
+				}
+
+				rprShapeSetTransform(instance, RPR_TRUE, transforms_[i].m);
+
+				if (material_)
+				{
+					rprShapeSetMaterial(instance, material_);
+				}
+
+				rprSceneAttachShape(scene_, instance);
+
+				instances_.push_back(instance);
+				applied_.push_back(transforms_[i]);
+
+				if ((i & 63) == 63 && std::chrono::duration<float, std::milli>(clock::now() - start).count() > budget_ms)
+				{
+					is_over_budget = true;
+					break;
+				}
+			}
+
+			is_changed = true;
+			is_over_budget = is_over_budget || std::chrono::duration<float, std::milli>(clock::now() - start).count() > budget_ms;
+		}
+
+		stats_.create_ms += std::chrono::duration<float, std::milli>(clock::now() - start).count();
+
+		if (instances_.size() == desired && rpr_bytes_before_ >= 0)
+		{
+			stats_.rpr_bytes = get_rpr_memory() - rpr_bytes_before_;
+		}
+	}
+
+	stats_.instances = static_cast<int>(instances_.size());
+	stats_.pending = static_cast<int>(desired - instances_.size());
+	stats_.host_bytes = (transforms_.capacity() + applied_.capacity()) * sizeof(InstanceTransform) + instances_.capacity() * sizeof(rpr_shape);
+
+	return is_changed;
+}
+
+void Instancer::clear(SceneTransaction& edits)
+{
+	{
+		std::lock_guard<std::mutex> lock(context_mutex_);
+		delete_instances(&edits, 0);
+	}
+
+	transforms_.clear();
+	settings_valid_ = false;
+	stats_ = InstancerStats();
+}
+
+// Instances from begin on, with the context mutex held
+void Instancer::delete_instances(SceneTransaction* edits, size_t begin)
+{
+	for (size_t i = begin; i < instances_.size(); ++i)
+	{
+		if (edits)
+		{
+			edits->discard(instances_[i]);
+		}
+
+		rprSceneDetachShape(scene_, instances_[i]);
+		rprObjectDelete(instances_[i]);
+	}
+
+	instances_.resize(std::min(begin, instances_.size()));
+	applied_.resize(std::min(begin, applied_.size()));
+}
+
+long long Instancer::get_rpr_memory() const
+{
+	rpr_render_statistics statistics = {};
+
+	if (rprContextGetInfo(context_, RPR_CONTEXT_RENDER_STATISTICS, sizeof(statistics), &statistics, nullptr) != RPR_SUCCESS)
+	{
+		return -1;
+	}
+
+	return statistics.sysmem_usage;
+}
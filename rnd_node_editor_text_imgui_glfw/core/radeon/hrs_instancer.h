@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "RadeonProRender_v2.h"
+#include "hrs_scene_transaction.h"
+
+enum class ScatterMode
+{
+	Grid,
+	Surface,
+	PointFile
+};
+
+struct ScatterSettings
+{
+	ScatterMode mode = ScatterMode::Grid;
+	int count = 100;
+	float spacing = 2.0f;
+	uint32_t seed = 1;
+	float scale_min = 1.0f;
+	float scale_max = 1.0f;
+	float jitter = 0.0f;
+	bool random_rotation = true;
+	bool align_to_normal = true;
+	std::string point_file;
+
+	bool operator==(const ScatterSettings& other) const
+	{
+		return mode == other.mode && count == other.count && spacing == other.spacing && seed == other.seed &&
+			scale_min == other.scale_min && scale_max == other.scale_max && jitter == other.jitter &&
+			random_rotation == other.random_rotation && align_to_normal == other.align_to_normal && point_file == other.point_file;
+	}
+	bool operator!=(const ScatterSettings& other) const { return !(*this == other); }
+};
+
+// Triangles instances are scattered on in Surface mode, xyz positions and index triples
+struct ScatterSurface
+{
+	std::vector<float> positions;
+	std::vector<int> indices;
+};
+
+// Row major with the translation in the last column, rprShapeSetTransform with transpose
+struct InstanceTransform
+{
+	float m[16];
+};
+
+// Fills transforms from the settings, instance i only depends on the seed and i so growing
+// the count keeps the existing instances in place. Matrices are built four at a time with
+// SSE on every hardware thread. Returns false when the point file cannot be read.
+bool generate_scatter(const ScatterSettings& settings, const ScatterSurface& surface, std::vector<InstanceTransform>& transforms, int thread_count = 0);
+
+struct InstancerStats
+{
+	// Why the last update fell short, nullptr when it did not
+	const char* error = nullptr;
+	int instances = 0;
+	int pending = 0;
+	int updated = 0;
+	float generate_ms = 0.0f;
+	float create_ms = 0.0f;
+	size_t host_bytes = 0;
+	long long rpr_bytes = 0;
+};
+
+// Instances of one mesh following a scatter. Creation is spread over frames in batches under
+// the context mutex, later edits only push the transforms that changed through the scene
+// transaction. The mutex is only tried, a frame that finds it held creates nothing.
+// Instances are deleted with their queued edits discarded, the destructor skips that and
+// expects clear(edits) first whenever edits may still be queued.
+class Instancer
+{
+public:
+
+	Instancer(rpr_context context, rpr_scene scene, rpr_shape prototype, std::mutex& context_mutex);
+	~Instancer();
+
+	Instancer(const Instancer&) = delete;
+	Instancer& operator=(const Instancer&) = delete;
+
+	void set_surface(const ScatterSurface& surface) { surface_ = surface; settings_valid_ = false; }
+	void set_settings(const ScatterSettings& settings);
+	const ScatterSettings& get_settings() const { return settings_; }
+
+	// Material every instance uses, nullptr keeps the prototype material
+	void set_material(rpr_material_node material);
+
+	// Creates at most batch_size instances per call within budget_ms and queues changed
+	// transforms, returns true when the scene changed
+	bool update(SceneTransaction& edits, float budget_ms = 4.0f, int batch_size = 1024);
+
+	// Detaches and deletes every instance
+	void clear(SceneTransaction& edits);
+
+	const InstancerStats& get_stats() const { return stats_; }
+
+private:
+
+	long long get_rpr_memory() const;
+	void delete_instances(SceneTransaction* edits, size_t begin);
+
+	rpr_context context_;
+	rpr_scene scene_;
+	rpr_shape prototype_;
+	rpr_material_node material_ = nullptr;
+	std::mutex& context_mutex_;
+
+	ScatterSettings settings_;
+	ScatterSurface surface_;
+	bool settings_valid_ = false;
+
+	std::vector<InstanceTransform> transforms_;
+	std::vector<InstanceTransform> applied_;
+	std::vector<rpr_shape> instances_;
+
+	long long rpr_bytes_before_ = -1;
+	InstancerStats stats_;
+};
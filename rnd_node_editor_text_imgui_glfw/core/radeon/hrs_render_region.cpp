@@ -0,0 +1,93 @@
+#include "hrs_render_region.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+RenderRegion make_render_region(float u0, float v0, float u1, float v1, int width, int height, int min_size)
+{
+	RenderRegion region;
+	region.x0 = std::clamp(static_cast<int>(std::min(u0, u1) * width), 0, width);
+	region.y0 = std::clamp(static_cast<int>(std::min(v0, v1) * height), 0, height);
+	region.x1 = std::clamp(static_cast<int>(std::max(u0, u1) * width + 0.5f), 0, width);
+	region.y1 = std::clamp(static_cast<int>(std::max(v0, v1) * height + 0.5f), 0, height);
+
+	if (region.get_width() < min_size || region.get_height() < min_size)
+	{
+		return RenderRegion();
+	}
+
+	return region;
+}
+
+void copy_region_rows(const float* src, float* dst, int width, const RenderRegion& region)
+{
+	const size_t row_floats = static_cast<size_t>(region.get_width()) * 4;
+
+	for (int y = region.y0; y < region.y1; ++y)
+	{
+		const size_t offset = (static_cast<size_t>(y) * width + region.x0) * 4;
+		memcpy(dst + offset, src + offset, row_floats * sizeof(float));
+	}
+}
+
+void paste_region_rows(const float* src, float* dst, int width, const RenderRegion& region)
+{
+	const size_t row_floats = static_cast<size_t>(region.get_width()) * 4;
+
+	for (int y = region.y0; y < region.y1; ++y)
+	{
+		memcpy(dst + (static_cast<size_t>(y) * width + region.x0) * 4, src + (y - region.y0) * row_floats, row_floats * sizeof(float));
+	}
+}
+
+void RegionRender::begin(const RenderRegion& region, int width, int height)
+{
+	region_ = region;
+	is_active_ = !region.is_empty();
+	area_fraction_ = is_active_ ? static_cast<float>(region.get_width()) * region.get_height() / (static_cast<float>(width) * height) : 1.0f;
+	region_ms_ = 0.0f;
+
+	reset();
+}
+
+void RegionRender::end()
+{
+	is_active_ = false;
+	area_fraction_ = 1.0f;
+}
+
+void RegionRender::reset()
+{
+	samples_ = 0;
+	start_ = clock_type::now();
+	converge_ms_ = -1.0;
+}
+
+void RegionRender::add_pass(float ms, int iterations)
+{
+	if (iterations <= 0)
+	{
+		return;
+	}
+
+	ms /= iterations;
+
+	if (!is_active_)
+	{
+		full_ms_ = full_ms_ == 0.0f ? ms : full_ms_ + (ms - full_ms_) * 0.1f;
+		return;
+	}
+
+	region_ms_ = region_ms_ == 0.0f ? ms : region_ms_ + (ms - region_ms_) * 0.1f;
+	const int previous = samples_;
+	samples_ += iterations;
+
+	if (previous < budget_ && samples_ >= budget_)
+	{
+		converge_ms_ = std::chrono::duration<double, std::milli>(clock_type::now() - start_).count();
+
+		std::cout << "Region " << region_.get_width() << "x" << region_.get_height() << " (" << area_fraction_ * 100.0f << "% of the frame) reached "
+			<< budget_ << " samples in " << converge_ms_ << " ms, " << region_ms_ << " ms per sample against " << full_ms_ << " ms full frame" << std::endl;
+	}
+}
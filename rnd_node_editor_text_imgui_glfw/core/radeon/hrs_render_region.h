@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+// Framebuffer pixels, x1 and y1 excluded, rows in framebuffer order
+struct RenderRegion
+{
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = 0;
+	int y1 = 0;
+
+	int get_width() const { return x1 - x0; }
+	int get_height() const { return y1 - y0; }
+	bool is_empty() const { return x1 <= x0 || y1 <= y0; }
+};
+
+// Region from two corners in normalized image coordinates, in any order, clamped to the frame.
+// Empty when smaller than min_size pixels on a side.
+RenderRegion make_render_region(float u0, float v0, float u1, float v1, int width, int height, int min_size = 8);
+
+// Copies the rows of region from src to dst, both RGBA32F frames of the given width
+void copy_region_rows(const float* src, float* dst, int width, const RenderRegion& region);
+
+// Same with src holding the region alone, rows packed as RenderBackend::read_region gives them
+void paste_region_rows(const float* src, float* dst, int width, const RenderRegion& region);
+
+// Lookdev mode where every sample goes to a region of the frame, the rest stays as the last
+// full render left it. Keeps the sample budget of the region and the cost of a sample in
+// both modes so the speedup can be compared with the area saved.
+// The region samples add to the accumulation, they are not undone when full frame passes
+// resume: the region stays that many samples ahead of the rest until the next clear.
+class RegionRender
+{
+public:
+
+	void begin(const RenderRegion& region, int width, int height);
+	void end();
+
+	bool is_active() const { return is_active_; }
+	const RenderRegion& get_region() const { return region_; }
+
+	void set_budget(int samples) { budget_ = samples; }
+	int get_budget() const { return budget_; }
+
+	int get_samples() const { return samples_; }
+	bool is_converged() const { return is_active_ && samples_ >= budget_; }
+
+	// Backends resolve and read back the whole frame whatever the region, so only one region pass
+	// in display_interval is shown, with the first and the one reaching the budget
+	void set_display_interval(int passes) { display_interval_ = std::max(passes, 1); }
+	int get_display_interval() const { return display_interval_; }
+
+	// For the pass in flight, before add_pass counts it
+	bool is_display_due() const { return samples_ == 0 || (samples_ + 1) % display_interval_ == 0 || samples_ + 1 >= budget_; }
+
+	// Framebuffer cleared by a scene edit, the region starts over
+	void reset();
+
+	// One resolved pass of ms and iterations samples, counted for the region when active, for
+	// the full frame otherwise. Both averages are per sample.
+	void add_pass(float ms, int iterations);
+
+	float get_area_fraction() const { return area_fraction_; }
+	float get_full_ms_per_sample() const { return full_ms_; }
+	float get_region_ms_per_sample() const { return region_ms_; }
+
+	// Time from begin or reset to the budget, negative until reached
+	double get_converge_ms() const { return converge_ms_; }
+
+private:
+
+	using clock_type = std::chrono::steady_clock;
+
+	RenderRegion region_;
+	bool is_active_ = false;
+	int budget_ = 256;
+	int samples_ = 0;
+	int display_interval_ = 8;
+	float area_fraction_ = 1.0f;
+
+	// Moving averages, zero until measured
+	float full_ms_ = 0.0f;
+	float region_ms_ = 0.0f;
+
+	clock_type::time_point start_;
+	double converge_ms_ = -1.0;
+};
@@ -0,0 +1,208 @@
+#include "hrs_scene_transaction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+void SceneTransaction::set_transform(rpr_shape shape, const float matrix[16])
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::memcpy(queue(shape, EditKind::Transform, 0).values, matrix, sizeof(float) * 16);
+}
+
+void SceneTransaction::set_light_transform(rpr_light light, const float matrix[16])
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::memcpy(queue(light, EditKind::LightTransform, 0).values, matrix, sizeof(float) * 16);
+}
+
+void SceneTransaction::set_camera_look_at(rpr_camera camera, const float eye[3], const float target[3], const float up[3])
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Edit& edit = queue(camera, EditKind::CameraLookAt, 0);
+	std::copy(eye, eye + 3, edit.values);
+	std::copy(target, target + 3, edit.values + 3);
+	std::copy(up, up + 3, edit.values + 6);
+}
+
+void SceneTransaction::set_camera_focal_length(rpr_camera camera, float focal_length)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	queue(camera, EditKind::CameraFocalLength, 0).values[0] = focal_length;
+}
+
+void SceneTransaction::set_environment_intensity(rpr_light light, float intensity)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	queue(light, EditKind::EnvironmentIntensity, 0).values[0] = intensity;
+}
+
+void SceneTransaction::set_shape_material(rpr_shape shape, rpr_material_node material)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	queue(shape, EditKind::ShapeMaterial, 0).handle = material;
+}
+
+void SceneTransaction::set_material_value(rpr_material_node node, rpr_material_node_input input, float x, float y, float z, float w)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Edit& edit = queue(node, EditKind::MaterialInput, input);
+	edit.handle = nullptr;
+	edit.is_connection = false;
+	edit.values[0] = x;
+	edit.values[1] = y;
+	edit.values[2] = z;
+	edit.values[3] = w;
+}
+
+void SceneTransaction::set_material_input(rpr_material_node node, rpr_material_node_input input, rpr_material_node source)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Shares the slot of set_material_value, the last write to the input wins
+	Edit& edit = queue(node, EditKind::MaterialInput, input);
+	edit.handle = source;
+	edit.is_connection = true;
+}
+
+void SceneTransaction::request_reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	reset_requested_ = true;
+}
+
+void SceneTransaction::discard(const void* object)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto removed = std::remove_if(pending_.begin(), pending_.end(), [&](const Edit& edit)
+		{
+			return edit.key.object == object || edit.handle == object;
+		});
+
+	if (removed == pending_.end())
+	{
+		return;
+	}
+
+	pending_.erase(removed, pending_.end());
+	pending_index_.clear();
+
+	for (size_t i = 0; i < pending_.size(); ++i)
+	{
+		pending_index_[pending_[i].key] = i;
+	}
+}
+
+bool SceneTransaction::has_pending()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return reset_requested_ || !pending_.empty();
+}
+
+bool SceneTransaction::commit(rpr_framebuffer framebuffer)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	bool is_reset;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (!reset_requested_ && pending_.empty())
+		{
+			return false;
+		}
+
+		// Swap so the UI can keep queueing while the batch is applied
+		applying_.swap(pending_);
+		pending_.clear();
+		pending_index_.clear();
+		is_reset = reset_requested_;
+		reset_requested_ = false;
+	}
+
+	for (const Edit& edit : applying_)
+	{
+		rpr_status status = apply(edit);
+
+		if (status != RPR_SUCCESS)
+		{
+			std::cout << "SceneTransaction: edit failed with " << status << std::endl;
+		}
+	}
+
+	rprFrameBufferClear(framebuffer);
+
+	float stall_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	stats_.commits++;
+	stats_.calls += applying_.size() + 1;
+	stats_.resets += is_reset ? 1 : 0;
+	stats_.last_stall_ms = stall_ms;
+	stats_.max_stall_ms = std::max(stats_.max_stall_ms, stall_ms);
+	stats_.total_stall_ms += stall_ms;
+
+	applying_.clear();
+
+	return true;
+}
+
+SceneTransactionStats SceneTransaction::get_stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+SceneTransaction::Edit& SceneTransaction::queue(const void* object, EditKind kind, uint32_t parameter)
+{
+	EditKey key = { object, kind, parameter };
+
+	stats_.edits++;
+
+	auto iter = pending_index_.find(key);
+
+	if (iter != pending_index_.end())
+	{
+		stats_.calls_saved++;
+		return pending_[iter->second];
+	}
+
+	pending_index_[key] = pending_.size();
+	pending_.push_back({ key, {}, nullptr, false });
+
+	return pending_.back();
+}
+
+rpr_status SceneTransaction::apply(const Edit& edit)
+{
+	const float* v = edit.values;
+	void* object = const_cast<void*>(edit.key.object);
+
+	switch (edit.key.kind)
+	{
+	case EditKind::Transform:
+		return rprShapeSetTransform(static_cast<rpr_shape>(object), RPR_TRUE, v);
+	case EditKind::LightTransform:
+		return rprLightSetTransform(static_cast<rpr_light>(object), RPR_TRUE, v);
+	case EditKind::CameraLookAt:
+		return rprCameraLookAt(static_cast<rpr_camera>(object), v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+	case EditKind::CameraFocalLength:
+		return rprCameraSetFocalLength(static_cast<rpr_camera>(object), v[0]);
+	case EditKind::EnvironmentIntensity:
+		return rprEnvironmentLightSetIntensityScale(static_cast<rpr_light>(object), v[0]);
+	case EditKind::ShapeMaterial:
+		return rprShapeSetMaterial(static_cast<rpr_shape>(object), static_cast<rpr_material_node>(edit.handle));
+	case EditKind::MaterialInput:
+		if (!edit.is_connection)
+		{
+			return rprMaterialNodeSetInputFByKey(static_cast<rpr_material_node>(object), edit.key.parameter, v[0], v[1], v[2], v[3]);
+		}
+		return rprMaterialNodeSetInputNByKey(static_cast<rpr_material_node>(object), edit.key.parameter, static_cast<rpr_material_node>(edit.handle));
+	}
+
+	return RPR_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "RadeonProRender_v2.h"
+
+struct SceneTransactionStats
+{
+	uint64_t commits = 0;
+	uint64_t edits = 0;
+	uint64_t calls = 0;
+	uint64_t calls_saved = 0;
+	uint64_t resets = 0;
+	float last_stall_ms = 0.0f;
+	float max_stall_ms = 0.0f;
+	float total_stall_ms = 0.0f;
+};
+
+// Scene edits queued by the UI during a frame and applied by the render thread in one batch
+// between two rprContextRender calls, followed by a single framebuffer clear. A write to a
+// parameter that is already queued replaces the pending value instead of adding a call.
+class SceneTransaction
+{
+public:
+
+	// Row major, as RadeonProRender::matrix stores it
+	void set_transform(rpr_shape shape, const float matrix[16]);
+	void set_light_transform(rpr_light light, const float matrix[16]);
+	void set_camera_look_at(rpr_camera camera, const float eye[3], const float target[3], const float up[3]);
+	void set_camera_focal_length(rpr_camera camera, float focal_length);
+	void set_environment_intensity(rpr_light light, float intensity);
+	void set_shape_material(rpr_shape shape, rpr_material_node material);
+	void set_material_value(rpr_material_node node, rpr_material_node_input input, float x, float y, float z, float w);
+	void set_material_input(rpr_material_node node, rpr_material_node_input input, rpr_material_node source);
+
+	// Restart accumulation without a scene change (render settings, resize)
+	void request_reset();
+
+	// Drops every queued edit on object or connecting it, before the object is deleted. The
+	// caller holds the context mutex, so no commit is applying the batch meanwhile.
+	void discard(const void* object);
+
+	bool has_pending();
+
+	// Render thread only, with the context otherwise idle. Applies the batch and clears the
+	// framebuffer once, returns true when accumulation restarted.
+	bool commit(rpr_framebuffer framebuffer);
+
+	SceneTransactionStats get_stats();
+
+private:
+
+	enum class EditKind : uint8_t
+	{
+		Transform,
+		LightTransform,
+		CameraLookAt,
+		CameraFocalLength,
+		EnvironmentIntensity,
+		ShapeMaterial,
+		MaterialInput
+	};
+
+	struct EditKey
+	{
+		const void* object;
+		EditKind kind;
+		uint32_t parameter;
+
+		bool operator==(const EditKey& other) const
+		{
+			return object == other.object && kind == other.kind && parameter == other.parameter;
+		}
+	};
+
+	struct EditKeyHash
+	{
+		size_t operator()(const EditKey& key) const
+		{
+			size_t hash = std::hash<const void*>()(key.object);
+			return hash ^ ((static_cast<size_t>(key.kind) << 32 | key.parameter) * 0x9e3779b97f4a7c15ull);
+		}
+	};
+
+	struct Edit
+	{
+		EditKey key;
+		float values[16];
+		void* handle;
+		bool is_connection;
+	};
+
+	Edit& queue(const void* object, EditKind kind, uint32_t parameter);
+	static rpr_status apply(const Edit& edit);
+
+	std::mutex mutex_;
+	std::vector<Edit> pending_;
+	std::vector<Edit> applying_;
+	std::unordered_map<EditKey, size_t, EditKeyHash> pending_index_;
+	bool reset_requested_ = false;
+	SceneTransactionStats stats_;
+};
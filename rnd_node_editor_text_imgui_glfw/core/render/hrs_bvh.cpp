@@ -0,0 +1,465 @@
+#include "hrs_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HRS_BVH_SSE 1
+#endif
+
+namespace
+{
+	constexpr int kBinCount = 16;
+	constexpr int kLeafTriangles = 4;
+	constexpr int kMaxLeafTriangles = 16;
+	constexpr int kMaxDepth = 60;
+
+	// SAH costs count blocks of four triangles, a box test costs about as much as a block
+	constexpr float kTraversalCost = 1.0f;
+
+	float get_block_count(int triangles)
+	{
+		return static_cast<float>((triangles + kLeafTriangles - 1) / kLeafTriangles);
+	}
+
+	struct Bounds
+	{
+		float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		float max[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+		void grow(const float point_min[3], const float point_max[3])
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				min[a] = std::min(min[a], point_min[a]);
+				max[a] = std::max(max[a], point_max[a]);
+			}
+		}
+
+		float get_half_area() const
+		{
+			if (min[0] > max[0])
+			{
+				return 0.0f;
+			}
+
+			const float x = max[0] - min[0];
+			const float y = max[1] - min[1];
+			const float z = max[2] - min[2];
+			return x * y + y * z + z * x;
+		}
+	};
+}
+
+void Bvh::build(const std::vector<float>& positions, const std::vector<uint32_t>& indices)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	triangle_count_ = static_cast<int>(indices.size() / 3);
+	positions_ = positions.data();
+	indices_ = indices.data();
+
+	build_.resize(triangle_count_);
+
+	for (int i = 0; i < triangle_count_; ++i)
+	{
+		BuildTriangle& triangle = build_[i];
+		triangle.id = i;
+
+		for (int a = 0; a < 3; ++a)
+		{
+			const float p0 = positions[indices[i * 3 + 0] * 3 + a];
+			const float p1 = positions[indices[i * 3 + 1] * 3 + a];
+			const float p2 = positions[indices[i * 3 + 2] * 3 + a];
+
+			triangle.min[a] = std::min(p0, std::min(p1, p2));
+			triangle.max[a] = std::max(p0, std::max(p1, p2));
+			triangle.centroid[a] = (triangle.min[a] + triangle.max[a]) * 0.5f;
+		}
+	}
+
+	nodes_.clear();
+	blocks_.clear();
+	nodes_.reserve(std::max(1, triangle_count_ / 2));
+	blocks_.reserve(triangle_count_ / kLeafTriangles + 1);
+	nodes_.emplace_back();
+
+	if (triangle_count_ > 0)
+	{
+		build_node(0, 0, triangle_count_, 0);
+	}
+	else
+	{
+		nodes_[0] = { { 0.0f, 0.0f, 0.0f }, 0, { -1.0f, -1.0f, -1.0f }, 0 };
+	}
+
+	build_.clear();
+	build_.shrink_to_fit();
+	positions_ = nullptr;
+	indices_ = nullptr;
+
+	build_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int Bvh::build_node(int node_index, int begin, int end, int depth)
+{
+	Bounds bounds;
+	Bounds centroids;
+
+	for (int i = begin; i < end; ++i)
+	{
+		bounds.grow(build_[i].min, build_[i].max);
+		centroids.grow(build_[i].centroid, build_[i].centroid);
+	}
+
+	for (int a = 0; a < 3; ++a)
+	{
+		nodes_[node_index].min[a] = bounds.min[a];
+		nodes_[node_index].max[a] = bounds.max[a];
+	}
+
+	const int count = end - begin;
+
+	if (count <= kLeafTriangles || depth >= kMaxDepth)
+	{
+		write_leaf(nodes_[node_index], begin, end);
+		return depth;
+	}
+
+	// Binned SAH over the centroid bounds
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = std::numeric_limits<float>::max();
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = centroids.max[axis] - centroids.min[axis];
+
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		Bounds bins[kBinCount];
+		int bin_counts[kBinCount] = {};
+		const float scale = kBinCount / extent;
+
+		for (int i = begin; i < end; ++i)
+		{
+			int bin = std::min(kBinCount - 1, static_cast<int>((build_[i].centroid[axis] - centroids.min[axis]) * scale));
+			bins[bin].grow(build_[i].min, build_[i].max);
+			bin_counts[bin]++;
+		}
+
+		// Left sides accumulated forward, right sides backward
+		float left_area[kBinCount - 1];
+		int left_count[kBinCount - 1];
+		Bounds left;
+		int running = 0;
+
+		for (int b = 0; b < kBinCount - 1; ++b)
+		{
+			left.grow(bins[b].min, bins[b].max);
+			running += bin_counts[b];
+			left_area[b] = left.get_half_area();
+			left_count[b] = running;
+		}
+
+		Bounds right;
+		running = 0;
+
+		for (int b = kBinCount - 1; b > 0; --b)
+		{
+			right.grow(bins[b].min, bins[b].max);
+			running += bin_counts[b];
+
+			const float cost = left_area[b - 1] * get_block_count(left_count[b - 1]) + right.get_half_area() * get_block_count(running);
+
+			if (left_count[b - 1] > 0 && running > 0 && cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	const float leaf_cost = bounds.get_half_area() * get_block_count(count);
+	best_cost += bounds.get_half_area() * kTraversalCost;
+
+	if (best_axis == -1 || (best_cost >= leaf_cost && count <= kMaxLeafTriangles))
+	{
+		write_leaf(nodes_[node_index], begin, end);
+		return depth;
+	}
+
+	const float scale = kBinCount / (centroids.max[best_axis] - centroids.min[best_axis]);
+	const float axis_min = centroids.min[best_axis];
+
+	BuildTriangle* middle = std::partition(build_.data() + begin, build_.data() + end, [&](const BuildTriangle& triangle)
+		{
+			return std::min(kBinCount - 1, static_cast<int>((triangle.centroid[best_axis] - axis_min) * scale)) < best_split;
+		});
+
+	int split = static_cast<int>(middle - build_.data());
+
+	if (split == begin || split == end)
+	{
+		split = begin + count / 2;
+	}
+
+	const int children = static_cast<int>(nodes_.size());
+	nodes_.resize(nodes_.size() + 2);
+	nodes_[node_index].first = children;
+	nodes_[node_index].block_count = 0;
+
+	const int left_depth = build_node(children, begin, split, depth + 1);
+	const int right_depth = build_node(children + 1, split, end, depth + 1);
+
+	return std::max(left_depth, right_depth);
+}
+
+void Bvh::write_leaf(Node& node, int begin, int end)
+{
+	node.first = static_cast<int>(blocks_.size());
+	node.block_count = (end - begin + kLeafTriangles - 1) / kLeafTriangles;
+
+	for (int i = begin; i < end; i += kLeafTriangles)
+	{
+		TriangleBlock block = {};
+
+		for (int lane = 0; lane < kLeafTriangles; ++lane)
+		{
+			block.id[lane] = -1;
+
+			if (i + lane >= end)
+			{
+				continue;
+			}
+
+			const int id = build_[i + lane].id;
+			const float* p0 = positions_ + indices_[id * 3 + 0] * 3;
+			const float* p1 = positions_ + indices_[id * 3 + 1] * 3;
+			const float* p2 = positions_ + indices_[id * 3 + 2] * 3;
+
+			for (int a = 0; a < 3; ++a)
+			{
+				block.v0[a][lane] = p0[a];
+				block.e1[a][lane] = p1[a] - p0[a];
+				block.e2[a][lane] = p2[a] - p0[a];
+			}
+
+			block.id[lane] = id;
+		}
+
+		blocks_.push_back(block);
+	}
+}
+
+// Moller-Trumbore on the four lanes of a block, hit.t is the current closest distance
+void Bvh::intersect_block(const TriangleBlock& block, const float origin[3], const float direction[3], float t_min, BvhHit& hit) const
+{
+#ifdef HRS_BVH_SSE
+	const __m128 dx = _mm_set1_ps(direction[0]);
+	const __m128 dy = _mm_set1_ps(direction[1]);
+	const __m128 dz = _mm_set1_ps(direction[2]);
+
+	const __m128 e1x = _mm_load_ps(block.e1[0]);
+	const __m128 e1y = _mm_load_ps(block.e1[1]);
+	const __m128 e1z = _mm_load_ps(block.e1[2]);
+	const __m128 e2x = _mm_load_ps(block.e2[0]);
+	const __m128 e2y = _mm_load_ps(block.e2[1]);
+	const __m128 e2z = _mm_load_ps(block.e2[2]);
+
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+	const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	const __m128 tx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_load_ps(block.v0[0]));
+	const __m128 ty = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_load_ps(block.v0[1]));
+	const __m128 tz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_load_ps(block.v0[2]));
+
+	const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+	const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+	// Zero edges give a zero determinant, NaN lanes fail every comparison
+	const __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(1e-12f));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, _mm_setzero_ps()));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, _mm_setzero_ps()));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(t_min)));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+	int lanes = _mm_movemask_ps(mask);
+
+	if (lanes == 0)
+	{
+		return;
+	}
+
+	alignas(16) float t_lanes[4];
+	alignas(16) float u_lanes[4];
+	alignas(16) float v_lanes[4];
+	_mm_store_ps(t_lanes, t);
+	_mm_store_ps(u_lanes, u);
+	_mm_store_ps(v_lanes, v);
+
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		if ((lanes & (1 << lane)) && t_lanes[lane] < hit.t)
+		{
+			hit.t = t_lanes[lane];
+			hit.u = u_lanes[lane];
+			hit.v = v_lanes[lane];
+			hit.triangle = block.id[lane];
+		}
+	}
+#else
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		const float e1[3] = { block.e1[0][lane], block.e1[1][lane], block.e1[2][lane] };
+		const float e2[3] = { block.e2[0][lane], block.e2[1][lane], block.e2[2][lane] };
+
+		const float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+		const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+
+		if (std::fabs(det) <= 1e-12f)
+		{
+			continue;
+		}
+
+		const float inv_det = 1.0f / det;
+		const float s[3] = { origin[0] - block.v0[0][lane], origin[1] - block.v0[1][lane], origin[2] - block.v0[2][lane] };
+		const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+
+		const float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		const float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inv_det;
+		const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > t_min && t < hit.t)
+		{
+			hit.t = t;
+			hit.u = u;
+			hit.v = v;
+			hit.triangle = block.id[lane];
+		}
+	}
+#endif
+}
+
+bool Bvh::intersect(const float origin[3], const float direction[3], float t_min, float t_max, BvhHit& hit) const
+{
+	hit = BvhHit();
+	hit.t = t_max;
+
+	if (triangle_count_ == 0)
+	{
+		return false;
+	}
+
+	const float inv_dir[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+
+	// Entry distance of the box, infinite when missed or behind the closest hit
+	auto enter = [&](const Node& node)
+	{
+		float t0 = t_min;
+		float t1 = hit.t;
+
+		for (int a = 0; a < 3; ++a)
+		{
+			float near_t = (node.min[a] - origin[a]) * inv_dir[a];
+			float far_t = (node.max[a] - origin[a]) * inv_dir[a];
+
+			if (near_t > far_t)
+			{
+				std::swap(near_t, far_t);
+			}
+
+			// NaN from a zero direction on the slab plane keeps the current bounds
+			t0 = near_t > t0 ? near_t : t0;
+			t1 = far_t < t1 ? far_t : t1;
+		}
+
+		return t0 <= t1 ? t0 : std::numeric_limits<float>::infinity();
+	};
+
+	int stack[kMaxDepth + 4];
+	int stack_size = 0;
+	int index = 0;
+
+	if (enter(nodes_[0]) == std::numeric_limits<float>::infinity())
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		const Node& node = nodes_[index];
+
+		if (node.block_count > 0)
+		{
+			for (int b = 0; b < node.block_count; ++b)
+			{
+				intersect_block(blocks_[node.first + b], origin, direction, t_min, hit);
+			}
+		}
+		else
+		{
+			float t_left = enter(nodes_[node.first]);
+			float t_right = enter(nodes_[node.first + 1]);
+			int near_child = node.first;
+			int far_child = node.first + 1;
+
+			if (t_right < t_left)
+			{
+				std::swap(t_left, t_right);
+				std::swap(near_child, far_child);
+			}
+
+			if (t_left != std::numeric_limits<float>::infinity())
+			{
+				if (t_right != std::numeric_limits<float>::infinity())
+				{
+					stack[stack_size++] = far_child;
+				}
+
+				index = near_child;
+				continue;
+			}
+		}
+
+		// Popped boxes may now lie behind a closer hit
+		index = -1;
+
+		while (stack_size > 0)
+		{
+			int candidate = stack[--stack_size];
+
+			if (enter(nodes_[candidate]) != std::numeric_limits<float>::infinity())
+			{
+				index = candidate;
+				break;
+			}
+		}
+
+		if (index == -1)
+		{
+			break;
+		}
+	}
+
+	return hit.triangle != -1;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct BvhHit
+{
+	float t = 0.0f;
+	float u = 0.0f;
+	float v = 0.0f;
+	int triangle = -1;
+};
+
+// Bounding volume hierarchy over a triangle soup for the CPU path tracer. Built with binned
+// SAH, leaves hold their triangles four to a block in SoA layout so one SSE test covers a
+// block. Triangle ids are the index of the triangle in the build input.
+class Bvh
+{
+public:
+
+	// positions holds xyz per vertex, indices three vertices per triangle
+	void build(const std::vector<float>& positions, const std::vector<uint32_t>& indices);
+
+	// Closest hit with t in (t_min, t_max)
+	bool intersect(const float origin[3], const float direction[3], float t_min, float t_max, BvhHit& hit) const;
+
+	int get_node_count() const { return static_cast<int>(nodes_.size()); }
+	int get_triangle_count() const { return triangle_count_; }
+	size_t get_memory_bytes() const { return nodes_.capacity() * sizeof(Node) + blocks_.capacity() * sizeof(TriangleBlock); }
+
+	// Milliseconds spent in the last build
+	double get_build_ms() const { return build_ms_; }
+
+private:
+
+	// Children of an inner node are stored side by side at first and first + 1. Leaves have
+	// block_count > 0 and first is their first block.
+	struct Node
+	{
+		float min[3];
+		int first;
+		float max[3];
+		int block_count;
+	};
+
+	// Vertex and the two edges of four triangles, unused lanes have zero edges and never hit
+	struct alignas(16) TriangleBlock
+	{
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+		int id[4];
+	};
+
+	struct BuildTriangle
+	{
+		float min[3];
+		float max[3];
+		float centroid[3];
+		int id;
+	};
+
+	int build_node(int node_index, int begin, int end, int depth);
+	void write_leaf(Node& node, int begin, int end);
+	void intersect_block(const TriangleBlock& block, const float origin[3], const float direction[3], float t_min, BvhHit& hit) const;
+
+	std::vector<Node> nodes_;
+	std::vector<TriangleBlock> blocks_;
+
+	// Build inputs, released once the tree is written
+	std::vector<BuildTriangle> build_;
+	const float* positions_ = nullptr;
+	const uint32_t* indices_ = nullptr;
+
+	int triangle_count_ = 0;
+	double build_ms_ = 0.0;
+};
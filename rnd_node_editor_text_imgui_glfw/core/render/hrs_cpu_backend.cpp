@@ -0,0 +1,726 @@
+#include "hrs_cpu_backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace
+{
+	constexpr float kPi = 3.14159265358979323846f;
+	constexpr int kMaxBounces = 4;
+	constexpr float kRayEpsilon = 1e-4f;
+
+	const char* kTeapotMesh = "Resources/Meshes/teapot.obj";
+
+	// Row major with the translation in the last column, as RadeonProRender::matrix
+	struct Matrix
+	{
+		float m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+		Matrix operator*(const Matrix& other) const
+		{
+			Matrix result;
+
+			for (int r = 0; r < 4; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					float sum = 0.0f;
+
+					for (int k = 0; k < 4; ++k)
+					{
+						sum += m[r * 4 + k] * other.m[k * 4 + c];
+					}
+
+					result.m[r * 4 + c] = sum;
+				}
+			}
+
+			return result;
+		}
+	};
+
+	Matrix translation(float x, float y, float z)
+	{
+		Matrix result;
+		result.m[3] = x;
+		result.m[7] = y;
+		result.m[11] = z;
+		return result;
+	}
+
+	Matrix rotation_x(float angle)
+	{
+		Matrix result;
+		result.m[5] = result.m[10] = std::cos(angle);
+		result.m[6] = -std::sin(angle);
+		result.m[9] = std::sin(angle);
+		return result;
+	}
+
+	Matrix rotation_y(float angle)
+	{
+		Matrix result;
+		result.m[0] = result.m[10] = std::cos(angle);
+		result.m[2] = std::sin(angle);
+		result.m[8] = -std::sin(angle);
+		return result;
+	}
+
+	Matrix rotation_z(float angle)
+	{
+		Matrix result;
+		result.m[0] = result.m[5] = std::cos(angle);
+		result.m[1] = -std::sin(angle);
+		result.m[4] = std::sin(angle);
+		return result;
+	}
+
+	float dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void cross(const float a[3], const float b[3], float result[3])
+	{
+		result[0] = a[1] * b[2] - a[2] * b[1];
+		result[1] = a[2] * b[0] - a[0] * b[2];
+		result[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	void normalize(float v[3])
+	{
+		float length = std::sqrt(dot(v, v));
+
+		if (length > 0.0f)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	uint32_t hash_u32(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// PCG step, 24 bits of mantissa
+	float next_float(uint32_t& state)
+	{
+		state = state * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		word = (word >> 22u) ^ word;
+		return (word >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// v, v/vt, v/vt/vn and v//vn faces, fan triangulated. Negative indices count from the end.
+	bool load_obj(const char* path, std::vector<float>& positions, std::vector<uint32_t>& indices)
+	{
+		std::ifstream input(path);
+
+		if (!input)
+		{
+			std::cout << "Error: cannot open " << path << std::endl;
+			return false;
+		}
+
+		std::string line;
+		std::vector<uint32_t> face;
+
+		while (std::getline(input, line))
+		{
+			if (line.size() < 2 || line[1] != ' ')
+			{
+				continue;
+			}
+
+			if (line[0] == 'v')
+			{
+				float x = 0.0f;
+				float y = 0.0f;
+				float z = 0.0f;
+				sscanf(line.c_str() + 2, "%f %f %f", &x, &y, &z);
+				positions.insert(positions.end(), { x, y, z });
+			}
+			else if (line[0] == 'f')
+			{
+				std::istringstream corners(line.substr(2));
+				std::string corner;
+				const long vertex_count = static_cast<long>(positions.size() / 3);
+
+				face.clear();
+
+				while (corners >> corner)
+				{
+					long index = strtol(corner.c_str(), nullptr, 10);
+					index = index < 0 ? vertex_count + index : index - 1;
+
+					if (index < 0 || index >= vertex_count)
+					{
+						std::cout << "Error: bad face in " << path << std::endl;
+						return false;
+					}
+
+					face.push_back(static_cast<uint32_t>(index));
+				}
+
+				for (size_t i = 2; i < face.size(); ++i)
+				{
+					indices.insert(indices.end(), { face[0], face[i - 1], face[i] });
+				}
+			}
+		}
+
+		return !indices.empty();
+	}
+}
+
+CpuRenderBackend::CpuRenderBackend(int thread_count)
+{
+	if (thread_count <= 0)
+	{
+		thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	// The thread calling render works too
+	for (int i = 1; i < thread_count; ++i)
+	{
+		workers_.emplace_back(&CpuRenderBackend::worker_loop, this);
+	}
+}
+
+CpuRenderBackend::~CpuRenderBackend()
+{
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+		is_stopping_ = true;
+	}
+
+	wake_.notify_all();
+
+	for (std::thread& worker : workers_)
+	{
+		worker.join();
+	}
+}
+
+bool CpuRenderBackend::load_scene(const std::string& scene, const RenderCamera& camera, float env_intensity)
+{
+	if (!supports_scene(scene))
+	{
+		std::cout << "Error: the cpu backend has no " << scene << " scene" << std::endl;
+		return false;
+	}
+
+	positions_.clear();
+	indices_.clear();
+	normals_.clear();
+	materials_.clear();
+
+	has_scene_ = load_teapot_scene();
+
+	if (!has_scene_)
+	{
+		return false;
+	}
+
+	bvh_.build(positions_, indices_);
+
+	camera_ = camera;
+	env_intensity_ = env_intensity;
+	update_view();
+	clear();
+
+	return true;
+}
+
+// Transforms of create_demo_scene, the first teapot mesh shared by all nine
+bool CpuRenderBackend::load_teapot_scene()
+{
+	std::vector<float> teapot_positions;
+	std::vector<uint32_t> teapot_indices;
+
+	if (!load_obj(kTeapotMesh, teapot_positions, teapot_indices))
+	{
+		return false;
+	}
+
+	struct TeapotPlacement
+	{
+		float x;
+		float z;
+		float rotation;
+	};
+
+	const TeapotPlacement placements[] = {
+		{ 5.0f, 2.0f, 1.6f },
+		{ -5.0f, 3.0f, 5.6f },
+		{ 0.0f, -3.0f, 3.2f },
+		{ 1.0f, 3.0f, 1.2f },
+		{ 3.0f, 9.0f, -1.7f },
+		{ -6.0f, 12.0f, 2.2f },
+		{ 9.0f, -6.0f, 4.8f },
+		{ 9.0f, 7.0f, 2.5f },
+		{ -9.0f, -7.0f, 5.8f },
+	};
+
+	for (int i = 0; i < 9; ++i)
+	{
+		const TeapotPlacement& placement = placements[i];
+		Matrix m = translation(placement.x, 0.0f, placement.z) * rotation_y(placement.rotation);
+
+		if (i % 4 == 0)
+		{
+			m = m * rotation_x(kPi);
+		}
+		else if (i % 4 == 1)
+		{
+			m = m * translation(0.0f, 2.65f, 0.0f) * rotation_x(kPi + 1.9f) * rotation_y(0.45f);
+		}
+		else if (i % 4 == 2)
+		{
+			m = m * translation(0.0f, 2.65f, 0.0f) * rotation_x(kPi + 1.9f) * rotation_y(-0.57f);
+		}
+		else
+		{
+			m = m * translation(0.0f, 3.38f, 0.0f) * rotation_x(0.42f) * rotation_z(-0.20f);
+		}
+
+		add_mesh(teapot_positions, teapot_indices, m.m, Material::Teapot);
+	}
+
+	const float size = 15.0f;
+	const std::vector<float> floor_positions = { -size, 0.0f, -size, -size, 0.0f, size, size, 0.0f, size, size, 0.0f, -size };
+	const std::vector<uint32_t> floor_indices = { 0, 1, 2, 0, 2, 3 };
+
+	add_mesh(floor_positions, floor_indices, Matrix().m, Material::Floor);
+
+	return true;
+}
+
+void CpuRenderBackend::add_mesh(const std::vector<float>& positions, const std::vector<uint32_t>& indices, const float matrix[16], Material material)
+{
+	const uint32_t base = static_cast<uint32_t>(positions_.size() / 3);
+
+	for (size_t i = 0; i < positions.size(); i += 3)
+	{
+		for (int r = 0; r < 3; ++r)
+		{
+			positions_.push_back(matrix[r * 4] * positions[i] + matrix[r * 4 + 1] * positions[i + 1] + matrix[r * 4 + 2] * positions[i + 2] + matrix[r * 4 + 3]);
+		}
+	}
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const uint32_t a = base + indices[i];
+		const uint32_t b = base + indices[i + 1];
+		const uint32_t c = base + indices[i + 2];
+		indices_.insert(indices_.end(), { a, b, c });
+
+		// Geometric normal, the mesh normals are not loaded
+		float e1[3];
+		float e2[3];
+		float normal[3];
+
+		for (int k = 0; k < 3; ++k)
+		{
+			e1[k] = positions_[b * 3 + k] - positions_[a * 3 + k];
+			e2[k] = positions_[c * 3 + k] - positions_[a * 3 + k];
+		}
+
+		cross(e1, e2, normal);
+		normalize(normal);
+		normals_.insert(normals_.end(), normal, normal + 3);
+		materials_.push_back(material);
+	}
+}
+
+void CpuRenderBackend::set_camera(const RenderCamera& camera)
+{
+	camera_ = camera;
+	update_view();
+	clear();
+}
+
+void CpuRenderBackend::set_seed(uint32_t seed)
+{
+	seed_ = seed;
+	clear();
+}
+
+// Same framing as rprCameraLookAt with the focal length over the sensor width
+void CpuRenderBackend::update_view()
+{
+	std::copy(camera_.eye, camera_.eye + 3, view_.origin);
+
+	for (int a = 0; a < 3; ++a)
+	{
+		view_.forward[a] = camera_.target[a] - camera_.eye[a];
+	}
+
+	normalize(view_.forward);
+	cross(view_.forward, camera_.up, view_.right);
+	normalize(view_.right);
+	cross(view_.right, view_.forward, view_.up);
+
+	view_.tan_half_width = camera_.sensor_width * 0.5f / std::max(camera_.focal_length, 1e-3f);
+	view_.tan_half_height = width_ > 0 ? view_.tan_half_width * height_ / width_ : view_.tan_half_width;
+}
+
+bool CpuRenderBackend::resize(int width, int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	width_ = width;
+	height_ = height;
+
+	accumulation_.assign(static_cast<size_t>(width) * height * 4, 0.0f);
+	resolved_.assign(accumulation_.size(), 0.0f);
+	sample_count_ = 0;
+	update_view();
+
+	return true;
+}
+
+void CpuRenderBackend::clear()
+{
+	std::fill(accumulation_.begin(), accumulation_.end(), 0.0f);
+	sample_count_ = 0;
+}
+
+bool CpuRenderBackend::render(int iterations)
+{
+	if (!has_scene_ || accumulation_.empty() || iterations <= 0)
+	{
+		return false;
+	}
+
+	Pass pass;
+	pass.x1 = width_;
+	pass.y1 = height_;
+	pass.iterations = iterations;
+	run_pass(pass);
+
+	sample_count_ += iterations;
+
+	return true;
+}
+
+bool CpuRenderBackend::render_tile(int x0, int x1, int y0, int y1)
+{
+	if (!has_scene_ || accumulation_.empty())
+	{
+		return false;
+	}
+
+	Pass pass;
+	pass.x0 = std::clamp(x0, 0, width_);
+	pass.x1 = std::clamp(x1, pass.x0, width_);
+	pass.y0 = std::clamp(y0, 0, height_);
+	pass.y1 = std::clamp(y1, pass.y0, height_);
+	pass.iterations = 1;
+	run_pass(pass);
+
+	return true;
+}
+
+bool CpuRenderBackend::resolve()
+{
+	if (accumulation_.empty())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < accumulation_.size(); i += 4)
+	{
+		const float count = accumulation_[i + 3];
+		const float scale = count > 0.0f ? 1.0f / count : 0.0f;
+
+		resolved_[i + 0] = accumulation_[i + 0] * scale;
+		resolved_[i + 1] = accumulation_[i + 1] * scale;
+		resolved_[i + 2] = accumulation_[i + 2] * scale;
+		resolved_[i + 3] = count > 0.0f ? 1.0f : 0.0f;
+	}
+
+	return true;
+}
+
+bool CpuRenderBackend::read_pixels(float* pixels, size_t bytes)
+{
+	if (bytes != get_frame_bytes() || resolved_.empty())
+	{
+		return false;
+	}
+
+	memcpy(pixels, resolved_.data(), bytes);
+
+	return true;
+}
+
+bool CpuRenderBackend::read_region(float* pixels, int x0, int x1, int y0, int y1)
+{
+	if (resolved_.empty() || !is_inside(x0, x1, y0, y1))
+	{
+		return false;
+	}
+
+	cut_region(resolved_.data(), pixels, x0, x1, y0, y1);
+
+	return true;
+}
+
+bool CpuRenderBackend::read_accumulation(float* data, size_t bytes)
+{
+	if (bytes != get_frame_bytes() || accumulation_.empty())
+	{
+		return false;
+	}
+
+	memcpy(data, accumulation_.data(), bytes);
+
+	return true;
+}
+
+// Samples carry on numbered from the counts, a resumed render goes on as if never stopped
+bool CpuRenderBackend::add_accumulation(const float* data, size_t bytes, int sample_count)
+{
+	if (bytes != get_frame_bytes() || accumulation_.empty())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < accumulation_.size(); ++i)
+	{
+		accumulation_[i] += data[i];
+	}
+
+	sample_count_ += sample_count;
+
+	return true;
+}
+
+size_t CpuRenderBackend::get_memory_bytes() const
+{
+	return (positions_.capacity() + normals_.capacity() + accumulation_.capacity() + resolved_.capacity()) * sizeof(float)
+		+ indices_.capacity() * sizeof(uint32_t) + materials_.capacity() + bvh_.get_memory_bytes();
+}
+
+void CpuRenderBackend::run_pass(const Pass& pass)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+		pass_ = pass;
+		next_row_ = pass.y0;
+		active_ = static_cast<int>(workers_.size());
+		generation_++;
+	}
+
+	wake_.notify_all();
+	render_rows();
+
+	std::unique_lock<std::mutex> lock(pool_mutex_);
+	done_.wait(lock, [this]() { return active_ == 0; });
+}
+
+void CpuRenderBackend::worker_loop()
+{
+	uint64_t seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool_mutex_);
+			wake_.wait(lock, [&]() { return is_stopping_ || generation_ != seen; });
+
+			if (is_stopping_)
+			{
+				return;
+			}
+
+			seen = generation_;
+		}
+
+		render_rows();
+
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+
+		if (--active_ == 0)
+		{
+			done_.notify_one();
+		}
+	}
+}
+
+// Rows are handed out one at a time, a row of the teapot costs far more than one of sky
+void CpuRenderBackend::render_rows()
+{
+	for (int y = next_row_.fetch_add(1); y < pass_.y1; y = next_row_.fetch_add(1))
+	{
+		for (int x = pass_.x0; x < pass_.x1; ++x)
+		{
+			render_pixel(x, y, pass_.iterations);
+		}
+	}
+}
+
+void CpuRenderBackend::render_pixel(int x, int y, int iterations)
+{
+	float* pixel = &accumulation_[(static_cast<size_t>(y) * width_ + x) * 4];
+
+	// The count in alpha numbers the samples of this pixel
+	uint32_t sample = static_cast<uint32_t>(pixel[3]);
+
+	for (int i = 0; i < iterations; ++i, ++sample)
+	{
+		uint32_t rng = hash_u32(static_cast<uint32_t>(x) + hash_u32(static_cast<uint32_t>(y) + hash_u32(sample + hash_u32(seed_))));
+
+		const float sx = (2.0f * (x + next_float(rng)) / width_ - 1.0f) * view_.tan_half_width;
+		const float sy = (1.0f - 2.0f * (y + next_float(rng)) / height_) * view_.tan_half_height;
+
+		float origin[3];
+		float direction[3];
+
+		for (int a = 0; a < 3; ++a)
+		{
+			origin[a] = view_.origin[a];
+			direction[a] = view_.forward[a] + sx * view_.right[a] + sy * view_.up[a];
+		}
+
+		normalize(direction);
+
+		float radiance[3];
+		trace(origin, direction, rng, radiance);
+
+		pixel[0] += radiance[0];
+		pixel[1] += radiance[1];
+		pixel[2] += radiance[2];
+		pixel[3] += 1.0f;
+	}
+}
+
+// Cosine weighted bounces, the Lambert BRDF and the pdf cancel to the albedo
+void CpuRenderBackend::trace(float origin[3], float direction[3], uint32_t& rng, float radiance[3]) const
+{
+	float throughput[3] = { 1.0f, 1.0f, 1.0f };
+	radiance[0] = radiance[1] = radiance[2] = 0.0f;
+
+	for (int bounce = 0; bounce <= kMaxBounces; ++bounce)
+	{
+		BvhHit hit;
+
+		if (!bvh_.intersect(origin, direction, kRayEpsilon, std::numeric_limits<float>::max(), hit))
+		{
+			float sky[3];
+			sample_sky(direction, sky);
+
+			for (int c = 0; c < 3; ++c)
+			{
+				radiance[c] += throughput[c] * sky[c];
+			}
+
+			return;
+		}
+
+		float normal[3] = { normals_[hit.triangle * 3], normals_[hit.triangle * 3 + 1], normals_[hit.triangle * 3 + 2] };
+
+		if (dot(normal, direction) > 0.0f)
+		{
+			normal[0] = -normal[0];
+			normal[1] = -normal[1];
+			normal[2] = -normal[2];
+		}
+
+		for (int a = 0; a < 3; ++a)
+		{
+			origin[a] += direction[a] * hit.t + normal[a] * kRayEpsilon;
+		}
+
+		float albedo = 0.7f;
+
+		if (materials_[hit.triangle] == Material::Floor)
+		{
+			const int cell = static_cast<int>(std::floor(origin[0] / 1.5f)) + static_cast<int>(std::floor(origin[2] / 1.5f));
+			albedo = (cell & 1) ? 0.75f : 0.25f;
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			throughput[c] *= albedo;
+		}
+
+		// Russian roulette past the second bounce
+		if (bounce >= 2)
+		{
+			const float survive = std::max(throughput[0], std::max(throughput[1], throughput[2]));
+
+			if (next_float(rng) >= survive)
+			{
+				return;
+			}
+
+			for (int c = 0; c < 3; ++c)
+			{
+				throughput[c] /= survive;
+			}
+		}
+
+		// Basis around the normal (Duff et al.)
+		const float sign = std::copysign(1.0f, normal[2]);
+		const float a = -1.0f / (sign + normal[2]);
+		const float b = normal[0] * normal[1] * a;
+		const float tangent[3] = { 1.0f + sign * normal[0] * normal[0] * a, sign * b, -sign * normal[0] };
+		const float bitangent[3] = { b, sign + normal[1] * normal[1] * a, -normal[1] };
+
+		const float r = std::sqrt(next_float(rng));
+		const float phi = 2.0f * kPi * next_float(rng);
+		const float lx = r * std::cos(phi);
+		const float ly = r * std::sin(phi);
+		const float lz = std::sqrt(std::max(0.0f, 1.0f - lx * lx - ly * ly));
+
+		for (int k = 0; k < 3; ++k)
+		{
+			direction[k] = tangent[k] * lx + bitangent[k] * ly + normal[k] * lz;
+		}
+	}
+}
+
+// Horizon to zenith gradient over a dim ground, scaled like the environment light
+void CpuRenderBackend::sample_sky(const float direction[3], float radiance[3]) const
+{
+	const float horizon[3] = { 0.95f, 0.92f, 0.85f };
+	const float zenith[3] = { 0.35f, 0.55f, 0.95f };
+	const float ground[3] = { 0.3f, 0.27f, 0.24f };
+
+	if (direction[1] < 0.0f)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			radiance[c] = ground[c] * env_intensity_;
+		}
+
+		return;
+	}
+
+	const float t = std::sqrt(direction[1]);
+
+	for (int c = 0; c < 3; ++c)
+	{
+		radiance[c] = (horizon[c] + (zenith[c] - horizon[c]) * t) * env_intensity_;
+	}
+}
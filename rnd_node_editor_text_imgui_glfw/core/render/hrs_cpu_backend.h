@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hrs_bvh.h"
+#include "hrs_render_backend.h"
+
+// Reference path tracer that needs nothing but the teapot mesh: the nine teapots of the demo
+// scene on a 30 unit floor, lit by the environment only. The environment is an analytic sky
+// and the floor a procedural checker, so it converges to a look close to the RPR scene, not
+// to the same image. Lambert surfaces, up to four bounces, rows shared among worker threads.
+// Every sample is seeded from its pixel, its index and the seed, so a frame does not depend
+// on the thread count.
+class CpuRenderBackend : public RenderBackend
+{
+public:
+
+	// thread_count 0 takes every hardware thread
+	explicit CpuRenderBackend(int thread_count = 0);
+	~CpuRenderBackend() override;
+
+	CpuRenderBackend(const CpuRenderBackend&) = delete;
+	CpuRenderBackend& operator=(const CpuRenderBackend&) = delete;
+
+	const char* get_name() const override { return "cpu"; }
+
+	bool supports_scene(const std::string& scene) const override { return scene == "teapot"; }
+	bool load_scene(const std::string& scene, const RenderCamera& camera, float env_intensity) override;
+
+	void set_camera(const RenderCamera& camera) override;
+	void set_seed(uint32_t seed) override;
+
+	bool resize(int width, int height) override;
+	void clear() override;
+
+	bool render(int iterations) override;
+	bool render_tile(int x0, int x1, int y0, int y1) override;
+
+	bool resolve() override;
+	bool read_pixels(float* pixels, size_t bytes) override;
+	bool read_region(float* pixels, int x0, int x1, int y0, int y1) override;
+
+	bool read_accumulation(float* data, size_t bytes) override;
+	bool add_accumulation(const float* data, size_t bytes, int sample_count) override;
+
+	int get_sample_count() const override { return sample_count_; }
+
+	int get_thread_count() const { return static_cast<int>(workers_.size()) + 1; }
+	const Bvh& get_bvh() const { return bvh_; }
+
+	// Scene, BVH and both framebuffers
+	size_t get_memory_bytes() const;
+
+private:
+
+	enum class Material : uint8_t
+	{
+		Teapot,
+		Floor
+	};
+
+	struct Pass
+	{
+		int x0 = 0;
+		int x1 = 0;
+		int y0 = 0;
+		int y1 = 0;
+		int iterations = 0;
+	};
+
+	// Camera basis precomputed for the primary rays
+	struct View
+	{
+		float origin[3];
+		float forward[3];
+		float right[3];
+		float up[3];
+		float tan_half_width;
+		float tan_half_height;
+	};
+
+	bool load_teapot_scene();
+	void add_mesh(const std::vector<float>& positions, const std::vector<uint32_t>& indices, const float matrix[16], Material material);
+	void update_view();
+
+	// Shares the pass rows among the workers and the calling thread
+	void run_pass(const Pass& pass);
+	void worker_loop();
+	void render_rows();
+	void render_pixel(int x, int y, int iterations);
+	void trace(float origin[3], float direction[3], uint32_t& rng, float radiance[3]) const;
+	void sample_sky(const float direction[3], float radiance[3]) const;
+
+	// Scene, triangle t has its normal at 3 * t and its material at t
+	std::vector<float> positions_;
+	std::vector<uint32_t> indices_;
+	std::vector<float> normals_;
+	std::vector<Material> materials_;
+	Bvh bvh_;
+	bool has_scene_ = false;
+
+	RenderCamera camera_;
+	View view_ = {};
+	float env_intensity_ = 0.8f;
+	uint32_t seed_ = 0;
+
+	std::vector<float> accumulation_;
+	std::vector<float> resolved_;
+	int sample_count_ = 0;
+
+	// Worker pool, a pass wakes every worker through generation_ and ends when active_ is zero
+	std::vector<std::thread> workers_;
+	std::mutex pool_mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	Pass pass_;
+	uint64_t generation_ = 0;
+	int active_ = 0;
+	bool is_stopping_ = false;
+	std::atomic<int> next_row_{ 0 };
+};
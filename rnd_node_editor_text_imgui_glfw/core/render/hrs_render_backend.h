@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+struct RenderCamera
+{
+	float eye[3] = { 4.0f, 4.0f, 15.0f };
+	float target[3] = { 1.5f, 0.0f, 0.0f };
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	float focal_length = 35.0f;
+
+	// Millimetres, the RPR default. The horizontal field of view follows from it.
+	float sensor_width = 36.0f;
+};
+
+// What the viewer and the render benchmark need from a renderer. The accumulation holds the
+// radiance sum with the sample count in alpha, resolve averages it into RGBA32F rows, row 0 at
+// the top, that read_pixels copies out. A backend is driven from one thread at a time.
+class RenderBackend
+{
+public:
+
+	virtual ~RenderBackend() = default;
+
+	virtual const char* get_name() const = 0;
+
+	// teapot, instances, textures, see get_render_bench_scenes
+	virtual bool supports_scene(const std::string& scene) const = 0;
+	virtual bool load_scene(const std::string& scene, const RenderCamera& camera, float env_intensity) = 0;
+
+	// Both restart the accumulation
+	virtual void set_camera(const RenderCamera& camera) = 0;
+	virtual void set_seed(uint32_t seed) = 0;
+
+	// Reallocates the framebuffers, the accumulation starts over
+	virtual bool resize(int width, int height) = 0;
+	virtual void clear() = 0;
+
+	// Adds iterations samples to every pixel, or one sample to the pixels in [x0, x1) x [y0, y1)
+	virtual bool render(int iterations) = 0;
+	virtual bool render_tile(int x0, int x1, int y0, int y1) = 0;
+
+	virtual bool resolve() = 0;
+
+	// bytes must be get_frame_bytes()
+	virtual bool read_pixels(float* pixels, size_t bytes) = 0;
+
+	// Only [x0, x1) x [y0, y1), rows packed, for a region render that leaves the rest alone.
+	// False when the region is empty or not inside the frame.
+	virtual bool read_region(float* pixels, int x0, int x1, int y0, int y1) = 0;
+
+	// Unresolved accumulation in the same layout, for checkpoints. Includes what
+	// add_accumulation gave, a checkpoint of a resumed render holds all its samples.
+	virtual bool read_accumulation(float* data, size_t bytes) = 0;
+
+	// Resumes from a checkpoint: data is summed with the accumulation until the next clear
+	virtual bool add_accumulation(const float* data, size_t bytes, int sample_count) = 0;
+
+	// Full frame samples since the last clear
+	virtual int get_sample_count() const = 0;
+
+	int get_width() const { return width_; }
+	int get_height() const { return height_; }
+	size_t get_frame_bytes() const { return static_cast<size_t>(width_) * height_ * 4 * sizeof(float); }
+
+protected:
+
+	// Region of a full RGBA32F frame of this size, the region must lie inside the frame
+	void cut_region(const float* frame, float* pixels, int x0, int x1, int y0, int y1) const
+	{
+		const size_t row_floats = static_cast<size_t>(x1 - x0) * 4;
+
+		for (int y = y0; y < y1; ++y)
+		{
+			memcpy(pixels + (y - y0) * row_floats, frame + (static_cast<size_t>(y) * width_ + x0) * 4, row_floats * sizeof(float));
+		}
+	}
+
+	bool is_inside(int x0, int x1, int y0, int y1) const { return x0 >= 0 && y0 >= 0 && x0 < x1 && y0 < y1 && x1 <= width_ && y1 <= height_; }
+
+	int width_ = 0;
+	int height_ = 0;
+};
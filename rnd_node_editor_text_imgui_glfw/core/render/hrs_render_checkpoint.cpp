@@ -0,0 +1,346 @@
+#include "hrs_render_checkpoint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// Round to nearest even, out of range values saturate to infinity
+	uint16_t float_to_half(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000u;
+		const uint32_t magnitude = bits & 0x7fffffffu;
+
+		if (magnitude >= 0x7f800000u)
+		{
+			return static_cast<uint16_t>(sign | (magnitude > 0x7f800000u ? 0x7e00u : 0x7c00u));
+		}
+
+		if (magnitude >= 0x477ff000u)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00u);
+		}
+
+		if (magnitude < 0x38800000u)
+		{
+			// Subnormal half, shifted with the implicit bit then rounded
+			if (magnitude < 0x33000000u)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+
+			const uint32_t exponent = magnitude >> 23;
+			const uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+			const uint32_t shift = 126 - exponent;
+			uint32_t half = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+
+			if (rest > halfway || (rest == halfway && (half & 1u)))
+			{
+				half++;
+			}
+
+			return static_cast<uint16_t>(sign | half);
+		}
+
+		uint32_t half = ((magnitude - 0x38000000u) >> 13);
+		const uint32_t rest = magnitude & 0x1fffu;
+
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+		{
+			half++;
+		}
+
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	float half_to_float(uint16_t half)
+	{
+		const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+		uint32_t exponent = (half >> 10) & 0x1fu;
+		uint32_t mantissa = half & 0x3ffu;
+		uint32_t bits;
+
+		if (exponent == 0x1fu)
+		{
+			bits = sign | 0x7f800000u | (mantissa << 13);
+		}
+		else if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// Normalize the subnormal
+				exponent = 113;
+
+				while (!(mantissa & 0x400u))
+				{
+					mantissa <<= 1;
+					exponent--;
+				}
+
+				bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+			}
+		}
+		else
+		{
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+}
+
+uint64_t hash_checkpoint_bytes(const void* data, size_t size, uint64_t hash)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+std::string get_checkpoint_path(const std::string& dir, int width, int height)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "render_%dx%d.hrsc", width, height);
+	return (std::filesystem::path(dir) / name).string();
+}
+
+bool write_checkpoint(const std::string& path, const RenderCheckpoint& checkpoint, std::vector<uint8_t>& scratch)
+{
+	namespace fs = std::filesystem;
+
+	const size_t pixels = static_cast<size_t>(checkpoint.width) * checkpoint.height;
+
+	if (pixels == 0 || checkpoint.accumulation.size() != pixels * 4)
+	{
+		return false;
+	}
+
+	const float* accumulation = checkpoint.accumulation.data();
+	bool has_counts = false;
+
+	for (size_t i = 0; i < pixels && !has_counts; ++i)
+	{
+		has_counts = accumulation[i * 4 + 3] != static_cast<float>(checkpoint.sample_count);
+	}
+
+	CheckpointHeader header = {};
+	header.magic = kCheckpointMagic;
+	header.version = kCheckpointVersion;
+	header.width = static_cast<uint32_t>(checkpoint.width);
+	header.height = static_cast<uint32_t>(checkpoint.height);
+	header.scene_hash = checkpoint.scene_hash;
+	header.sample_count = static_cast<uint32_t>(checkpoint.sample_count);
+	header.has_counts = has_counts ? 1 : 0;
+
+	scratch.resize(sizeof(header) + pixels * 3 * sizeof(uint16_t) + (has_counts ? pixels * sizeof(uint32_t) : 0));
+	memcpy(scratch.data(), &header, sizeof(header));
+
+	uint8_t* colors = scratch.data() + sizeof(header);
+	uint8_t* counts = colors + pixels * 3 * sizeof(uint16_t);
+
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		const float* pixel = accumulation + i * 4;
+		const float scale = pixel[3] > 0.0f ? 1.0f / pixel[3] : 0.0f;
+		const uint16_t mean[3] = { float_to_half(pixel[0] * scale), float_to_half(pixel[1] * scale), float_to_half(pixel[2] * scale) };
+		memcpy(colors + i * sizeof(mean), mean, sizeof(mean));
+
+		if (has_counts)
+		{
+			const uint32_t count = static_cast<uint32_t>(pixel[3]);
+			memcpy(counts + i * sizeof(count), &count, sizeof(count));
+		}
+	}
+
+	std::error_code error;
+	fs::create_directories(fs::path(path).parent_path(), error);
+
+	const std::string temporary = path + ".tmp";
+
+	{
+		std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+
+		if (!output.write(reinterpret_cast<const char*>(scratch.data()), scratch.size()))
+		{
+			std::cout << "Warning: cannot write " << temporary << std::endl;
+			return false;
+		}
+	}
+
+	fs::rename(temporary, path, error);
+
+	if (error)
+	{
+		std::cout << "Warning: cannot replace " << path << ", " << error.message() << std::endl;
+		fs::remove(temporary, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool read_checkpoint(const std::string& path, RenderCheckpoint& checkpoint)
+{
+	std::ifstream input(path, std::ios::binary | std::ios::ate);
+
+	if (!input)
+	{
+		return false;
+	}
+
+	const size_t size = static_cast<size_t>(input.tellg());
+	input.seekg(0);
+
+	CheckpointHeader header = {};
+
+	if (size < sizeof(header) || !input.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return false;
+	}
+
+	const size_t pixels = static_cast<size_t>(header.width) * header.height;
+	const size_t expected = sizeof(header) + pixels * 3 * sizeof(uint16_t) + (header.has_counts ? pixels * sizeof(uint32_t) : 0);
+
+	if (header.magic != kCheckpointMagic || header.version != kCheckpointVersion || pixels == 0 || size != expected)
+	{
+		std::cout << "Warning: " << path << " is not a render checkpoint" << std::endl;
+		return false;
+	}
+
+	std::vector<uint16_t> colors(pixels * 3);
+	std::vector<uint32_t> counts(header.has_counts ? pixels : 0);
+
+	if (!input.read(reinterpret_cast<char*>(colors.data()), colors.size() * sizeof(uint16_t))
+		|| !input.read(reinterpret_cast<char*>(counts.data()), counts.size() * sizeof(uint32_t)))
+	{
+		return false;
+	}
+
+	checkpoint.width = static_cast<int>(header.width);
+	checkpoint.height = static_cast<int>(header.height);
+	checkpoint.sample_count = static_cast<int>(header.sample_count);
+	checkpoint.scene_hash = header.scene_hash;
+	checkpoint.accumulation.resize(pixels * 4);
+
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		const float count = static_cast<float>(header.has_counts ? counts[i] : header.sample_count);
+		float* pixel = &checkpoint.accumulation[i * 4];
+
+		pixel[0] = half_to_float(colors[i * 3 + 0]) * count;
+		pixel[1] = half_to_float(colors[i * 3 + 1]) * count;
+		pixel[2] = half_to_float(colors[i * 3 + 2]) * count;
+		pixel[3] = count;
+	}
+
+	return true;
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	if (!thread_.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopping_ = true;
+	}
+
+	wake_.notify_one();
+	thread_.join();
+}
+
+void CheckpointWriter::submit(const std::string& path, RenderCheckpoint& checkpoint)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (has_pending_)
+		{
+			stats_.replaced++;
+		}
+
+		pending_path_ = path;
+		std::swap(pending_, checkpoint);
+		has_pending_ = true;
+
+		if (!thread_.joinable())
+		{
+			thread_ = std::thread(&CheckpointWriter::run, this);
+		}
+	}
+
+	wake_.notify_one();
+}
+
+void CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_.wait(lock, [this]() { return !has_pending_ && !is_writing_; });
+}
+
+CheckpointStats CheckpointWriter::get_stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+// Stopping still writes the checkpoint waiting, the last one taken on close must reach the disk
+void CheckpointWriter::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true)
+	{
+		wake_.wait(lock, [this]() { return has_pending_ || is_stopping_; });
+
+		if (!has_pending_)
+		{
+			return;
+		}
+
+		std::swap(writing_, pending_);
+		const std::string path = pending_path_;
+		has_pending_ = false;
+		is_writing_ = true;
+
+		lock.unlock();
+
+		const auto start = std::chrono::steady_clock::now();
+		const bool is_written = write_checkpoint(path, writing_, scratch_);
+		const float write_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+
+		is_writing_ = false;
+		stats_.written += is_written ? 1 : 0;
+		stats_.failed += is_written ? 0 : 1;
+		stats_.last_bytes = is_written ? scratch_.size() : 0;
+		stats_.last_write_ms = write_ms;
+		stats_.max_write_ms = std::max(stats_.max_write_ms, write_ms);
+
+		idle_.notify_all();
+	}
+}
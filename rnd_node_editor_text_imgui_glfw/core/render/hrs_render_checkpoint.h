@@ -0,0 +1,108 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// File layout: a CheckpointHeader, the mean RGB of every pixel as half floats in rows, then the
+// sample count of every pixel as uint32 when has_counts is set. Without it every pixel has
+// sample_count samples, only region renders leave them uneven. The mean is stored instead of the
+// sum so half precision holds however long the render ran. Written to a temporary file and
+// renamed over the previous checkpoint, a crash mid-write leaves the last complete one.
+constexpr uint32_t kCheckpointMagic = 0x43535248; // "HRSC"
+constexpr uint32_t kCheckpointVersion = 1;
+
+struct CheckpointHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint64_t scene_hash;
+	uint32_t sample_count;
+	uint32_t has_counts;
+};
+
+// Unresolved accumulation as RenderBackend::read_accumulation gives it, RGBA32F rows with the
+// radiance sum in RGB and the pixel sample count in alpha
+struct RenderCheckpoint
+{
+	int width = 0;
+	int height = 0;
+	int sample_count = 0;
+	uint64_t scene_hash = 0;
+	std::vector<float> accumulation;
+};
+
+struct CheckpointStats
+{
+	uint64_t written = 0;
+	uint64_t failed = 0;
+
+	// Checkpoints submitted while another was still waiting, only the newest is written
+	uint64_t replaced = 0;
+
+	size_t last_bytes = 0;
+	float last_write_ms = 0.0f;
+	float max_write_ms = 0.0f;
+};
+
+// FNV-1a, chained through hash to cover several buffers
+uint64_t hash_checkpoint_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// dir/render_<width>x<height>.hrsc, one checkpoint per viewer size
+std::string get_checkpoint_path(const std::string& dir, int width, int height);
+
+// scratch holds the encoded file between calls
+bool write_checkpoint(const std::string& path, const RenderCheckpoint& checkpoint, std::vector<uint8_t>& scratch);
+bool read_checkpoint(const std::string& path, RenderCheckpoint& checkpoint);
+
+// Encodes and writes checkpoints on a thread of its own. submit swaps the checkpoint in and
+// returns at once, so the caller only pays for its accumulation readback. A checkpoint
+// submitted while the previous one is still waiting replaces it, the writer never holds more
+// than the one it writes and the one waiting, and sampling never waits on the disk.
+class CheckpointWriter
+{
+public:
+
+	CheckpointWriter() = default;
+
+	// Writes what is still waiting before returning
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	// checkpoint gets back an older buffer to fill next time, its contents are undefined
+	void submit(const std::string& path, RenderCheckpoint& checkpoint);
+
+	// Waits until nothing is waiting or being written, before reading a checkpoint back
+	void flush();
+
+	CheckpointStats get_stats();
+
+private:
+
+	void run();
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable idle_;
+
+	std::string pending_path_;
+	RenderCheckpoint pending_;
+	bool has_pending_ = false;
+	bool is_writing_ = false;
+	bool is_stopping_ = false;
+
+	// Writer thread only
+	RenderCheckpoint writing_;
+	std::vector<uint8_t> scratch_;
+
+	CheckpointStats stats_;
+};
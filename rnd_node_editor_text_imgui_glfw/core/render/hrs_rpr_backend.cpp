@@ -0,0 +1,489 @@
+#include "hrs_rpr_backend.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "Math/mathutils.h"
+#include "../radeon/hrs_scene_transaction.h"
+
+RprRenderBackend::RprRenderBackend(rpr_context context, rpr_camera camera)
+	: context_(context), camera_(camera)
+{
+}
+
+RprRenderBackend::~RprRenderBackend()
+{
+	release_framebuffers();
+
+	if (!owns_context_ || !context_)
+	{
+		return;
+	}
+
+	// Instances and images go before the objects they reference
+	instancer_ = nullptr;
+
+	if (image_cache_)
+	{
+		release_demo_scene(*image_cache_, demo_);
+		image_cache_->clear(true);
+		image_cache_ = nullptr;
+	}
+
+	gc_.GCClean();
+
+	if (material_system_)
+	{
+		CHECK(rprObjectDelete(material_system_));
+	}
+
+	rprContextClearMemory(context_);
+	CHECK(rprObjectDelete(context_));
+}
+
+bool RprRenderBackend::supports_scene(const std::string& scene) const
+{
+	return !context_ && (scene == "teapot" || scene == "instances" || scene == "textures");
+}
+
+// CPU only, the device must not decide the benchmark results
+bool RprRenderBackend::create_context()
+{
+	static rpr_int plugin_id = rprRegisterPlugin(RPR_PLUGIN_FILE_NAME);
+
+	if (plugin_id == -1)
+	{
+		std::cout << "Error: cannot register " << RPR_PLUGIN_FILE_NAME << std::endl;
+		return false;
+	}
+
+	if (rprCreateContext(RPR_API_VERSION, &plugin_id, 1, RPR_CREATION_FLAGS_ENABLE_CPU, g_contextProperties, nullptr, &context_) != RPR_SUCCESS)
+	{
+		std::cout << "Error: cannot create the RPR context" << std::endl;
+		return false;
+	}
+
+	owns_context_ = true;
+
+	CHECK(rprContextSetActivePlugin(context_, plugin_id));
+	CHECK(rprContextCreateMaterialSystem(context_, 0, &material_system_));
+
+	image_cache_ = std::make_unique<ImageCache>(context_, mutex_);
+
+	return true;
+}
+
+bool RprRenderBackend::load_scene(const std::string& scene, const RenderCamera& camera, float env_intensity)
+{
+	if (!supports_scene(scene))
+	{
+		std::cout << "Error: the rpr backend cannot load " << scene << (context_ ? " into a context it does not own" : "") << std::endl;
+		return false;
+	}
+
+	if (!create_context())
+	{
+		return false;
+	}
+
+	DemoSceneSettings settings;
+	std::copy(camera.eye, camera.eye + 3, settings.camera_eye);
+	std::copy(camera.target, camera.target + 3, settings.camera_target);
+	settings.camera_focal_length = camera.focal_length;
+	settings.env_intensity = env_intensity;
+
+	bool is_built = create_demo_scene(context_, material_system_, *image_cache_, gc_, settings, demo_) == RPR_SUCCESS;
+	camera_ = demo_.camera;
+
+	// Linear like the viewer, the display transform is not the renderer's business
+	CHECK(rprContextSetParameterByKey1f(context_, RPR_CONTEXT_DISPLAY_GAMMA, 1.0f));
+	CHECK(rprContextSetParameterByKey1u(context_, RPR_CONTEXT_RANDOM_SEED, seed_));
+
+	is_built = is_built && create_framebuffers();
+
+	if (is_built && scene == "instances")
+	{
+		is_built = add_instances();
+	}
+	else if (is_built && scene == "textures")
+	{
+		is_built = add_textures();
+	}
+
+	if (!is_built)
+	{
+		std::cout << "Error: cannot build the " << scene << " scene" << std::endl;
+	}
+
+	return is_built;
+}
+
+// 10k small teapots scattered on the floor by the Instancer, created in one go instead of
+// streamed over frames
+bool RprRenderBackend::add_instances()
+{
+	ScatterSettings settings;
+	settings.mode = ScatterMode::Surface;
+	settings.count = 10000;
+	settings.seed = 7;
+	settings.scale_min = 0.1f;
+	settings.scale_max = 0.3f;
+
+	SceneTransaction edits;
+	instancer_ = std::make_unique<Instancer>(context_, demo_.scene, demo_.teapot, mutex_);
+	instancer_->set_surface(demo_.floor_surface);
+	instancer_->set_settings(settings);
+
+	do
+	{
+		instancer_->update(edits, 1e9f, settings.count);
+	} while (instancer_->get_stats().pending > 0);
+
+	edits.commit(framebuffer_);
+
+	return instancer_->get_stats().instances == settings.count;
+}
+
+// 64 teapots on an 8x8 grid, each with its own 1024x1024 texture. The images are generated
+// so the scene does not depend on files outside the repository.
+bool RprRenderBackend::add_textures()
+{
+	const int side = 8;
+	const int size = 1024;
+
+	std::vector<uint8_t> pixels(size * size * 4);
+
+	for (int t = 0; t < side * side; ++t)
+	{
+		// Checker with a per texture cell size and tint, cheap and deterministic
+		int cell = 8 + (t % 7) * 8;
+		uint8_t tint[3] = { static_cast<uint8_t>(64 + (t * 37) % 192), static_cast<uint8_t>(64 + (t * 71) % 192), static_cast<uint8_t>(64 + (t * 113) % 192) };
+
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				bool is_odd = ((x / cell) + (y / cell)) & 1;
+				uint8_t* pixel = &pixels[(y * size + x) * 4];
+				pixel[0] = is_odd ? tint[0] : 255 - tint[0];
+				pixel[1] = is_odd ? tint[1] : 255 - tint[1];
+				pixel[2] = is_odd ? tint[2] : 255 - tint[2];
+				pixel[3] = 255;
+			}
+		}
+
+		rpr_image_format format = { 4, RPR_COMPONENT_TYPE_UINT8 };
+		rpr_image_desc desc = {};
+		desc.image_width = size;
+		desc.image_height = size;
+
+		rpr_image image = nullptr;
+		CHECK(rprContextCreateImage(context_, format, &desc, pixels.data(), &image));
+		gc_.GCAdd(image);
+
+		rpr_material_node texture = nullptr;
+		CHECK(rprMaterialSystemCreateNode(material_system_, RPR_MATERIAL_NODE_IMAGE_TEXTURE, &texture));
+		CHECK(rprMaterialNodeSetInputImageDataByKey(texture, RPR_MATERIAL_INPUT_DATA, image));
+		gc_.GCAdd(texture);
+
+		rpr_material_node material = nullptr;
+		CHECK(rprMaterialSystemCreateNode(material_system_, RPR_MATERIAL_NODE_UBERV2, &material));
+		CHECK(rprMaterialNodeSetInputNByKey(material, RPR_MATERIAL_INPUT_UBER_DIFFUSE_COLOR, texture));
+		gc_.GCAdd(material);
+
+		rpr_shape teapot = nullptr;
+		CHECK(rprContextCreateInstance(context_, demo_.teapot, &teapot));
+		CHECK(rprSceneAttachShape(demo_.scene, teapot));
+		gc_.GCAdd(teapot);
+
+		float x = ((t % side) - (side - 1) * 0.5f) * 3.0f;
+		float z = ((t / side) - (side - 1) * 0.5f) * 3.0f;
+		RadeonProRender::matrix m = RadeonProRender::translation(RadeonProRender::float3(x, 0.0f, z)) * RadeonProRender::rotation_y(t * 0.7f)
+			* RadeonProRender::scale(RadeonProRender::float3(0.3f, 0.3f, 0.3f)) * RadeonProRender::rotation_x(MY_PI);
+
+		CHECK(rprShapeSetTransform(teapot, RPR_TRUE, &m.m00));
+		CHECK(rprShapeSetMaterial(teapot, material));
+	}
+
+	return true;
+}
+
+void RprRenderBackend::set_camera(const RenderCamera& camera)
+{
+	if (camera_)
+	{
+		CHECK(rprCameraLookAt(camera_, camera.eye[0], camera.eye[1], camera.eye[2], camera.target[0], camera.target[1], camera.target[2], camera.up[0], camera.up[1], camera.up[2]));
+		CHECK(rprCameraSetFocalLength(camera_, camera.focal_length));
+	}
+
+	clear();
+}
+
+void RprRenderBackend::set_seed(uint32_t seed)
+{
+	seed_ = seed;
+
+	if (context_)
+	{
+		CHECK(rprContextSetParameterByKey1u(context_, RPR_CONTEXT_RANDOM_SEED, seed_));
+	}
+
+	clear();
+}
+
+bool RprRenderBackend::resize(int width, int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	width_ = width;
+	height_ = height;
+	sample_count_ = 0;
+
+	return !context_ || create_framebuffers();
+}
+
+bool RprRenderBackend::create_framebuffers()
+{
+	release_framebuffers();
+	notify_cleared();
+
+	if (width_ <= 0 || height_ <= 0)
+	{
+		return true;
+	}
+
+	rpr_framebuffer_desc desc = { static_cast<unsigned int>(width_), static_cast<unsigned int>(height_) };
+	rpr_framebuffer_format format = { 4, RPR_COMPONENT_TYPE_FLOAT32 };
+
+	if (rprContextCreateFrameBuffer(context_, format, &desc, &framebuffer_) != RPR_SUCCESS
+		|| rprContextCreateFrameBuffer(context_, format, &desc, &resolved_) != RPR_SUCCESS)
+	{
+		std::cout << "Error: cannot create " << width_ << "x" << height_ << " framebuffers" << std::endl;
+		release_framebuffers();
+		return false;
+	}
+
+	CHECK(rprContextSetAOV(context_, RPR_AOV_COLOR, framebuffer_));
+
+	return true;
+}
+
+void RprRenderBackend::release_framebuffers()
+{
+	if (framebuffer_)
+	{
+		CHECK(rprObjectDelete(framebuffer_)); framebuffer_ = nullptr;
+	}
+
+	if (resolved_)
+	{
+		CHECK(rprObjectDelete(resolved_)); resolved_ = nullptr;
+	}
+}
+
+void RprRenderBackend::clear()
+{
+	if (framebuffer_)
+	{
+		CHECK(rprFrameBufferClear(framebuffer_));
+	}
+
+	notify_cleared();
+}
+
+void RprRenderBackend::notify_cleared()
+{
+	sample_count_ = 0;
+	resumed_.clear();
+	resumed_.shrink_to_fit();
+	host_resolved_.clear();
+	host_resolved_.shrink_to_fit();
+}
+
+bool RprRenderBackend::render(int iterations)
+{
+	if (!framebuffer_ || iterations <= 0)
+	{
+		return false;
+	}
+
+	// Only set when it changes, the parameter is read at the start of every render
+	if (iterations != iterations_)
+	{
+		CHECK(rprContextSetParameterByKey1u(context_, RPR_CONTEXT_ITERATIONS, iterations));
+		iterations_ = iterations;
+	}
+
+	rpr_status status = rprContextRender(context_);
+
+	if (status != RPR_SUCCESS)
+	{
+		std::cout << "RPR Error: " << status << std::endl;
+		return false;
+	}
+
+	sample_count_ += iterations;
+
+	// A full pass means the region render ended, its readback copy goes
+	if (!region_readback_.empty())
+	{
+		region_readback_.clear();
+		region_readback_.shrink_to_fit();
+	}
+
+	return true;
+}
+
+bool RprRenderBackend::render_tile(int x0, int x1, int y0, int y1)
+{
+	if (!framebuffer_)
+	{
+		return false;
+	}
+
+	// The iteration count applies to tiles too, a tile pass is one sample whatever the batch
+	if (iterations_ != 1)
+	{
+		CHECK(rprContextSetParameterByKey1u(context_, RPR_CONTEXT_ITERATIONS, 1));
+		iterations_ = 1;
+	}
+
+	rpr_status status = rprContextRenderTile(context_, x0, x1, y0, y1);
+
+	if (status != RPR_SUCCESS)
+	{
+		std::cout << "RPR Error: " << status << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool RprRenderBackend::resolve()
+{
+	if (!framebuffer_)
+	{
+		return false;
+	}
+
+	// RPR keeps the sample count in alpha of the unresolved color AOV, its resolve divides by it
+	if (!resumed_.empty())
+	{
+		if (!read_accumulation(host_resolved_.data(), get_frame_bytes()))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < host_resolved_.size(); i += 4)
+		{
+			const float count = host_resolved_[i + 3];
+			const float scale = count > 0.0f ? 1.0f / count : 0.0f;
+
+			host_resolved_[i + 0] *= scale;
+			host_resolved_[i + 1] *= scale;
+			host_resolved_[i + 2] *= scale;
+			host_resolved_[i + 3] = count > 0.0f ? 1.0f : 0.0f;
+		}
+
+		return true;
+	}
+
+	rpr_status status = rprContextResolveFrameBuffer(context_, framebuffer_, resolved_, false);
+
+	if (status != RPR_SUCCESS)
+	{
+		std::cout << "RPR Error: " << status << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool RprRenderBackend::read_pixels(float* pixels, size_t bytes)
+{
+	if (!resolved_ || bytes != get_frame_bytes())
+	{
+		return false;
+	}
+
+	if (!resumed_.empty())
+	{
+		memcpy(pixels, host_resolved_.data(), bytes);
+		return true;
+	}
+
+	return rprFrameBufferGetInfo(resolved_, RPR_FRAMEBUFFER_DATA, bytes, pixels, nullptr) == RPR_SUCCESS;
+}
+
+bool RprRenderBackend::read_region(float* pixels, int x0, int x1, int y0, int y1)
+{
+	if (!resolved_ || !is_inside(x0, x1, y0, y1))
+	{
+		return false;
+	}
+
+	if (!resumed_.empty())
+	{
+		cut_region(host_resolved_.data(), pixels, x0, x1, y0, y1);
+		return true;
+	}
+
+	region_readback_.resize(get_frame_bytes() / sizeof(float));
+
+	if (rprFrameBufferGetInfo(resolved_, RPR_FRAMEBUFFER_DATA, get_frame_bytes(), region_readback_.data(), nullptr) != RPR_SUCCESS)
+	{
+		return false;
+	}
+
+	cut_region(region_readback_.data(), pixels, x0, x1, y0, y1);
+
+	return true;
+}
+
+bool RprRenderBackend::read_accumulation(float* data, size_t bytes)
+{
+	if (!framebuffer_ || bytes != get_frame_bytes())
+	{
+		return false;
+	}
+
+	if (rprFrameBufferGetInfo(framebuffer_, RPR_FRAMEBUFFER_DATA, bytes, data, nullptr) != RPR_SUCCESS)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < resumed_.size(); ++i)
+	{
+		data[i] += resumed_[i];
+	}
+
+	return true;
+}
+
+bool RprRenderBackend::add_accumulation(const float* data, size_t bytes, int sample_count)
+{
+	if (!framebuffer_ || bytes != get_frame_bytes())
+	{
+		return false;
+	}
+
+	if (resumed_.empty())
+	{
+		resumed_.assign(data, data + bytes / sizeof(float));
+		host_resolved_.resize(resumed_.size());
+	}
+	else
+	{
+		for (size_t i = 0; i < resumed_.size(); ++i)
+		{
+			resumed_[i] += data[i];
+		}
+	}
+
+	sample_count_ += sample_count;
+
+	return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include "RadeonProRender_v2.h"
+#include "common.h"
+#include "hrs_render_backend.h"
+#include "../radeon/hrs_demo_scene.h"
+#include "../radeon/hrs_image_cache.h"
+#include "../radeon/hrs_instancer.h"
+
+// RPR behind the backend interface. Built without a context it creates a CPU only one in
+// load_scene and builds the bench scenes itself, so a GPU or driver change does not show up
+// in the benchmark. Built on a context it renders the scene already set there, the viewer
+// builds that scene at startup. The framebuffers belong to the backend either way.
+class RprRenderBackend : public RenderBackend
+{
+public:
+
+	RprRenderBackend() = default;
+
+	// camera is the scene camera set_camera moves, nullptr leaves it to the caller
+	RprRenderBackend(rpr_context context, rpr_camera camera);
+
+	~RprRenderBackend() override;
+
+	RprRenderBackend(const RprRenderBackend&) = delete;
+	RprRenderBackend& operator=(const RprRenderBackend&) = delete;
+
+	const char* get_name() const override { return "rpr"; }
+
+	bool supports_scene(const std::string& scene) const override;
+	bool load_scene(const std::string& scene, const RenderCamera& camera, float env_intensity) override;
+
+	void set_camera(const RenderCamera& camera) override;
+	void set_seed(uint32_t seed) override;
+
+	// Before load_scene only the size is kept, the framebuffers come with the context
+	bool resize(int width, int height) override;
+	void clear() override;
+
+	bool render(int iterations) override;
+	bool render_tile(int x0, int x1, int y0, int y1) override;
+
+	bool resolve() override;
+	bool read_pixels(float* pixels, size_t bytes) override;
+
+	// RPR reads a framebuffer whole, the region is cut from a host copy of the resolved frame
+	bool read_region(float* pixels, int x0, int x1, int y0, int y1) override;
+
+	// RPR takes no pixels in, a resumed accumulation stays on the host and is summed with the
+	// framebuffer at every resolve until the next clear
+	bool read_accumulation(float* data, size_t bytes) override;
+	bool add_accumulation(const float* data, size_t bytes, int sample_count) override;
+
+	// A scene transaction commit clears the framebuffer around the backend, this forgets the
+	// resumed accumulation and restarts the sample count with it
+	void notify_cleared();
+
+	int get_sample_count() const override { return sample_count_; }
+
+	// For the scene transaction, its commit clears the accumulation
+	rpr_framebuffer get_framebuffer() const { return framebuffer_; }
+	rpr_framebuffer get_resolved_framebuffer() const { return resolved_; }
+
+private:
+
+	bool create_context();
+	bool create_framebuffers();
+	void release_framebuffers();
+	bool add_instances();
+	bool add_textures();
+
+	rpr_context context_ = nullptr;
+	rpr_camera camera_ = nullptr;
+	bool owns_context_ = false;
+
+	rpr_framebuffer framebuffer_ = nullptr;
+	rpr_framebuffer resolved_ = nullptr;
+
+	// Owned context only, torn down in reverse order by the destructor
+	rpr_material_system material_system_ = nullptr;
+	std::mutex mutex_;
+	RPRGarbageCollector gc_;
+	std::unique_ptr<ImageCache> image_cache_;
+	DemoScene demo_;
+	std::unique_ptr<Instancer> instancer_;
+
+	// Resumed accumulation and the host resolve it needs, empty when not resumed
+	std::vector<float> resumed_;
+	std::vector<float> host_resolved_;
+
+	// Resolved frame read_region cuts from, freed by the next full pass
+	std::vector<float> region_readback_;
+
+	uint32_t seed_ = 0;
+	int iterations_ = 0;
+	int sample_count_ = 0;
+};
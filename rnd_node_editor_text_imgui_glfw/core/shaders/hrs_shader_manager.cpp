@@ -109,4 +109,29 @@ GLuint ShaderManager::get_program(std::string const& prog_name)
 		programs_[prog_name] = program;
 		return program;
 	}
+}
+
+GLint ShaderManager::get_uniform_location(GLuint program, const char* name)
+{
+	auto key = std::make_pair(program, std::string(name));
+	auto iter = uniforms_.find(key);
+
+	if (iter != uniforms_.end())
+	{
+		return iter->second;
+	}
+
+	GLint location = glGetUniformLocation(program, name);
+	uniforms_[key] = location;
+	return location;
+}
+
+void ShaderManager::set_uniform(GLuint program, const char* name, float value)
+{
+	glUniform1f(get_uniform_location(program, name), value);
+}
+
+void ShaderManager::set_uniform(GLuint program, const char* name, int value)
+{
+	glUniform1i(get_uniform_location(program, name), value);
 }
\ No newline at end of file
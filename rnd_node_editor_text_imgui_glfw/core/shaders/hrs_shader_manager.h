@@ -5,6 +5,7 @@
 
 #include <string>
 #include <map>
+#include <utility>
 
 class ShaderManager
 {
@@ -22,13 +23,20 @@ public:
 
 	GLuint get_program(std::string const& prog_name);
 
+	// On the program in use, locations are looked up once per program and name
+	void set_uniform(GLuint program, const char* name, float value);
+	void set_uniform(GLuint program, const char* name, int value);
+
 private:
 
+	GLint get_uniform_location(GLuint program, const char* name);
+
 	GLuint compile_program(std::string const& prog_name);
 
 	ShaderManager(ShaderManager const&);
 	ShaderManager& operator=(ShaderManager const&);
 
 	std::map<std::string, GLuint> programs_;
+	std::map<std::pair<GLuint, std::string>, GLint> uniforms_;
 };
 
@@ -1,8 +1,69 @@
 uniform sampler2D g_Texture;
 
+// Display transform, the texture holds linear radiance
+uniform float u_exposure;	// stops
+uniform int u_curve;		// 0 clamp, 1 ACES filmic
+uniform int u_output;		// 0 sRGB, 1 power gamma
+uniform float u_gamma;
+uniform int u_view;			// 0 image, 1 false color, 2 clipping
+
 varying vec2 Texcoord;
 
+// Narkowicz fit of the ACES reference rendering transform
+vec3 aces_filmic(vec3 x)
+{
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 linear_to_srgb(vec3 c)
+{
+	vec3 low = c * 12.92;
+	vec3 high = 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055;
+	return mix(low, high, step(vec3(0.0031308), c));
+}
+
+// Stops around middle grey, blue under, green at 0.18, red over
+vec3 false_color(float luminance)
+{
+	float stops = clamp(log2(max(luminance, 1e-6) / 0.18), -6.0, 6.0) / 6.0;
+
+	if (stops < 0.0)
+	{
+		return mix(vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0), -stops);
+	}
+
+	return mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), stops);
+}
+
 void main()
 {
-	gl_FragColor = texture2D(g_Texture, vec2(Texcoord.x, 1.0 - Texcoord.y));
+	// Rendered into the display texture, rows already in the order ImGui shows them
+	vec3 color = max(texture2D(g_Texture, Texcoord).rgb, vec3(0.0)) * exp2(u_exposure);
+	float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+
+	if (u_view == 1)
+	{
+		gl_FragColor = vec4(false_color(luminance), 1.0);
+		return;
+	}
+
+	if (u_view == 2)
+	{
+		if (max(color.r, max(color.g, color.b)) > 1.0)
+		{
+			gl_FragColor = vec4(1.0, 0.0, 1.0, 1.0);
+			return;
+		}
+
+		if (luminance < 1.0 / 1024.0)
+		{
+			gl_FragColor = vec4(0.0, 0.3, 1.0, 1.0);
+			return;
+		}
+	}
+
+	vec3 mapped = u_curve == 1 ? aces_filmic(color) : clamp(color, 0.0, 1.0);
+	vec3 display = u_output == 0 ? linear_to_srgb(mapped) : pow(mapped, vec3(1.0 / u_gamma));
+
+	gl_FragColor = vec4(display, 1.0);
 }
\ No newline at end of file